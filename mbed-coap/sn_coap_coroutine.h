@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file sn_coap_coroutine.h
+ *
+ * \brief CoAP C-library C++20 coroutine interface header file
+ *
+ * Lets a C++20 coroutine wait for the response of a request:
+ *
+ *     sn_coap::task read_value(sn_coap::client &client, sn_nsdl_addr_s peer)
+ *     {
+ *         sn_coap::response rsp = co_await client.get(peer, "/3/0/1");
+ *         if (rsp) {
+ *             ...
+ *         }
+ *     }
+ *
+ *     sn_coap::executor executor;
+ *     sn_coap::client client(handle, executor, udp);
+ *     read_value(client, peer);
+ *     while (sn_coap_udp_run(udp, -1) == 0) {
+ *         executor.run();
+ *     }
+ *
+ * Requests are sent with sn_coap_protocol_send_request(), so the library keeps
+ * waiting coroutines in its table of pending exchanges, keyed by the generated
+ * token. Coroutine is completed by sn_coap_protocol_parse() when the response or
+ * Reset is received, and by sn_coap_protocol_exec() when the request was not
+ * acknowledged after all re-sendings or there was no response in
+ * SN_COAP_CLIENT_EXCHANGE_TIMEOUT. The library must be compiled with
+ * SN_COAP_CLIENT_MAX_EXCHANGES.
+ *
+ * Completed coroutines are not resumed inside the library. They are queued to the
+ * executor of the client, and resumed by executor.run(), which the thread calling
+ * sn_coap_protocol_parse() and sn_coap_protocol_exec() for the handle calls after
+ * they return. So a resumed coroutine can send new requests, or destroy the handle,
+ * without the library being in the middle of a call. Coroutines waiting when the
+ * handle is destroyed are never resumed.
+ *
+ * The interface is available only when compiled as C++20.
+ */
+
+#ifndef SN_COAP_COROUTINE_H_
+#define SN_COAP_COROUTINE_H_
+
+#if defined(__cplusplus) && __cplusplus >= 202002L && defined(__has_include)
+#if __has_include(<coroutine>)
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <utility>
+#include <vector>
+#include "sn_coap_header.h"
+#include "sn_coap_protocol.h"
+
+namespace sn_coap {
+
+/**
+ * \brief Coroutine type for request flows. Coroutine starts running when it is called, and
+ *        its frame is released when it returns.
+ */
+struct task {
+    struct promise_type {
+        task get_return_object() noexcept
+        {
+            return task();
+        }
+        std::suspend_never initial_suspend() noexcept
+        {
+            return std::suspend_never();
+        }
+        std::suspend_never final_suspend() noexcept
+        {
+            return std::suspend_never();
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+/**
+ * \brief Result of awaited request. Response is copied from the parsed message, so it stays
+ *        valid after the message has been released.
+ */
+struct response {
+    enum result_e {
+        RESPONSE,           /**< Response received */
+        RESET,              /**< Reset received to request */
+        TIMEOUT,            /**< No response in SN_COAP_CLIENT_EXCHANGE_TIMEOUT */
+        SENDING_FAILED,     /**< Confirmable request was not acknowledged after all re-sendings */
+        NOT_SENT            /**< Request was not sent, too many pending requests or out of memory */
+    };
+
+    result_e                    result = NOT_SENT;
+    sn_coap_msg_type_e          msg_type = COAP_MSG_TYPE_RESET;
+    sn_coap_msg_code_e          msg_code = COAP_MSG_CODE_EMPTY;
+    sn_coap_content_format_e    content_format = COAP_CT_NONE;
+    std::vector<uint8_t>        payload;
+
+    /** \brief True if response was received */
+    explicit operator bool() const
+    {
+        return result == RESPONSE;
+    }
+};
+
+/**
+ * \brief Queue of coroutines whose requests have completed, owned by the thread using the handle
+ */
+class executor {
+public:
+    /** \brief Queues coroutine to be resumed by run() */
+    void post(std::coroutine_handle<> coroutine)
+    {
+        _ready.push_back(coroutine);
+    }
+
+    /**
+     * \brief Resumes queued coroutines, also ones queued while running. Must not be called
+     *        from the callbacks of the handle.
+     *
+     * \return Count of resumed coroutines
+     */
+    size_t run()
+    {
+        size_t count = 0;
+
+        while (!_ready.empty()) {
+            std::coroutine_handle<> coroutine = _ready.front();
+            _ready.pop_front();
+            coroutine.resume();
+            count++;
+        }
+        return count;
+    }
+
+    /** \brief True if no coroutine is waiting to be resumed */
+    bool empty() const
+    {
+        return _ready.empty();
+    }
+
+private:
+    std::deque<std::coroutine_handle<> > _ready;
+};
+
+/**
+ * \brief Awaitable request, returned by client. Request is sent when awaited.
+ */
+class request_awaiter {
+public:
+    request_awaiter(struct coap_s *handle, executor &exec, void *param, const sn_nsdl_addr_s &dst, sn_coap_msg_code_e msg_code,
+                    const char *uri_path, const uint8_t *payload, uint16_t payload_len) :
+        _handle(handle), _executor(exec), _param(param), _dst(dst), _msg_code(msg_code), _uri_path(uri_path),
+        _payload(payload), _payload_len(payload_len)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        sn_coap_hdr_s request;
+
+        std::memset(&request, 0, sizeof(request));
+        request.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+        request.msg_code = _msg_code;
+        request.content_format = COAP_CT_NONE;
+        if (_uri_path) {
+            /* Leading slash is not part of the first Uri-Path option */
+            if (_uri_path[0] == '/') {
+                _uri_path++;
+            }
+            request.uri_path_ptr = (uint8_t *)_uri_path;
+            request.uri_path_len = (uint16_t)std::strlen(_uri_path);
+        }
+        request.payload_ptr = (uint8_t *)_payload;
+        request.payload_len = _payload_len;
+
+        _awaiting = awaiting;
+
+        /* Response can not arrive before this returns, request is only built and sent here */
+        if (sn_coap_protocol_send_request(_handle, &_dst, &request, &request_awaiter::response_cb, this, _param) != 0) {
+            _response.result = response::NOT_SENT;
+            return false;
+        }
+        return true;
+    }
+
+    response await_resume() noexcept
+    {
+        return std::move(_response);
+    }
+
+private:
+    static void response_cb(struct coap_s *handle, const sn_coap_hdr_s *msg_ptr, void *ctx)
+    {
+        request_awaiter *awaiter = static_cast<request_awaiter *>(ctx);
+        response &rsp = awaiter->_response;
+
+        (void) handle;
+
+        if (msg_ptr == NULL) {
+            rsp.result = response::TIMEOUT;
+        } else if (msg_ptr->coap_status == COAP_STATUS_BUILDER_MESSAGE_SENDING_FAILED) {
+            rsp.result = response::SENDING_FAILED;
+        } else if (msg_ptr->msg_type == COAP_MSG_TYPE_RESET) {
+            rsp.result = response::RESET;
+            rsp.msg_type = msg_ptr->msg_type;
+        } else {
+            rsp.result = response::RESPONSE;
+            rsp.msg_type = msg_ptr->msg_type;
+            rsp.msg_code = msg_ptr->msg_code;
+            rsp.content_format = msg_ptr->content_format;
+            if (msg_ptr->payload_ptr && msg_ptr->payload_len) {
+                rsp.payload.assign(msg_ptr->payload_ptr, msg_ptr->payload_ptr + msg_ptr->payload_len);
+            }
+        }
+
+        /* Coroutine is resumed by executor after the library call has returned */
+        awaiter->_executor.post(awaiter->_awaiting);
+    }
+
+    struct coap_s           *_handle;
+    executor                &_executor;
+    void                    *_param;
+    sn_nsdl_addr_s          _dst;
+    sn_coap_msg_code_e      _msg_code;
+    const char              *_uri_path;
+    const uint8_t           *_payload;
+    uint16_t                _payload_len;
+    std::coroutine_handle<> _awaiting;
+    response                _response;
+};
+
+/**
+ * \brief Sends Confirmable requests with a CoAP library handle. Destination address, Uri-Path
+ *        and payload are needed only until the request is awaited.
+ */
+class client {
+public:
+    /**
+     * \param *handle CoAP library handle
+     * \param exec Executor resuming coroutines whose requests have completed
+     * \param *param Parameter given to TX callback with the requests
+     */
+    client(struct coap_s *handle, executor &exec, void *param = NULL) : _handle(handle), _executor(exec), _param(param) {}
+
+    request_awaiter request(const sn_nsdl_addr_s &dst, sn_coap_msg_code_e msg_code, const char *uri_path,
+                            const uint8_t *payload = NULL, uint16_t payload_len = 0) const
+    {
+        return request_awaiter(_handle, _executor, _param, dst, msg_code, uri_path, payload, payload_len);
+    }
+
+    request_awaiter get(const sn_nsdl_addr_s &dst, const char *uri_path) const
+    {
+        return request(dst, COAP_MSG_CODE_REQUEST_GET, uri_path);
+    }
+
+    request_awaiter post(const sn_nsdl_addr_s &dst, const char *uri_path, const uint8_t *payload, uint16_t payload_len) const
+    {
+        return request(dst, COAP_MSG_CODE_REQUEST_POST, uri_path, payload, payload_len);
+    }
+
+    request_awaiter put(const sn_nsdl_addr_s &dst, const char *uri_path, const uint8_t *payload, uint16_t payload_len) const
+    {
+        return request(dst, COAP_MSG_CODE_REQUEST_PUT, uri_path, payload, payload_len);
+    }
+
+    request_awaiter del(const sn_nsdl_addr_s &dst, const char *uri_path) const
+    {
+        return request(dst, COAP_MSG_CODE_REQUEST_DELETE, uri_path);
+    }
+
+    struct coap_s *handle() const
+    {
+        return _handle;
+    }
+
+private:
+    struct coap_s   *_handle;
+    executor        &_executor;
+    void            *_param;
+};
+
+} // namespace sn_coap
+
+#endif /* __has_include(<coroutine>) */
+#endif /* C++20 */
+
+#endif /* SN_COAP_COROUTINE_H_ */
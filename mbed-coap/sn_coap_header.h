@@ -103,13 +103,16 @@ typedef enum sn_coap_option_numbers_ {
     COAP_OPTION_MAX_AGE         = 14,
     COAP_OPTION_URI_QUERY       = 15,
     COAP_OPTION_ACCEPT          = 17,
+    COAP_OPTION_Q_BLOCK1        = 19,
     COAP_OPTION_LOCATION_QUERY  = 20,
     COAP_OPTION_BLOCK2          = 23,
     COAP_OPTION_BLOCK1          = 27,
     COAP_OPTION_SIZE2           = 28,
+    COAP_OPTION_Q_BLOCK2        = 31,
     COAP_OPTION_PROXY_URI       = 35,
     COAP_OPTION_PROXY_SCHEME    = 39,
-    COAP_OPTION_SIZE1           = 60
+    COAP_OPTION_SIZE1           = 60,
+    COAP_OPTION_REQUEST_TAG     = 292
 //  128 =   (Reserved)
 //  132 =   (Reserved)
 //  136 =   (Reserved)
@@ -126,6 +129,7 @@ typedef enum sn_coap_content_format_ {
     COAP_CT_OCTET_STREAM        = 42,
     COAP_CT_EXI                 = 47,
     COAP_CT_JSON                = 50,
+    COAP_CT_MISSING_BLOCKS      = 272,  /**< application/missing-blocks+cbor-seq (RFC 9177) */
     COAP_CT__MAX                = 0xffff
 } sn_coap_content_format_e;
 
@@ -174,6 +178,10 @@ typedef struct sn_coap_options_list_ {
     uint8_t         etag_len;           /**< 1-8 bytes. Repeatable */
     unsigned int    use_size1:1;
     unsigned int    use_size2:1;
+    unsigned int    use_request_tag:1;  /**< Set if Request-Tag is used, tag can be empty */
+    unsigned int    use_q_block1:1;     /**< Set if block1 is carried in Q-Block1 option (RFC 9177) */
+    unsigned int    use_q_block2:1;     /**< Set if block2 is carried in Q-Block2 option (RFC 9177) */
+    uint8_t         request_tag_len;    /**< 0-8 bytes. */
 
     uint16_t    proxy_uri_len;      /**< 1-1034 bytes. */
     uint16_t    uri_host_len;       /**< 1-255 bytes. */
@@ -197,6 +205,7 @@ typedef struct sn_coap_options_list_ {
     uint8_t    *location_path_ptr;  /**< Must be set to NULL if not used */
     uint8_t    *location_query_ptr; /**< Must be set to NULL if not used */
     uint8_t    *uri_query_ptr;      /**< Must be set to NULL if not used */
+    uint8_t     request_tag[8];     /**< Request-Tag, separates concurrent blockwise requests (RFC 9175) */
 } sn_coap_options_list_s;
 
 /* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!! */
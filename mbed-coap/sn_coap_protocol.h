@@ -53,6 +53,52 @@ extern struct coap_s *sn_coap_protocol_init(void *(*used_malloc_func_ptr)(uint16
         uint8_t (*used_tx_callback_ptr)(uint8_t *, uint16_t, sn_nsdl_addr_s *, void *),
         int8_t (*used_rx_callback_ptr)(sn_coap_hdr_s *, sn_nsdl_addr_s *, void *));
 
+/**
+ * \brief Metadata of a confirmable message whose re-sendings have run out.
+ *
+ * Collected when the message is stored to the re-sending queue, so the failure
+ * can be reported without parsing the stored packet again. All pointers are owned
+ * by the library and are valid only during the failure callback.
+ */
+typedef struct sn_coap_send_failure_ {
+    uint16_t            msg_id;         /**< Message ID of the failed message */
+    sn_coap_msg_code_e  msg_code;       /**< Message code of the failed message */
+    uint8_t             token_len;      /**< Token length, 0 if message had no token */
+    const uint8_t       *token_ptr;     /**< Token of the failed message */
+    uint8_t             uri_path_len;   /**< Uri-Path length, 0 if not stored */
+    const uint8_t       *uri_path_ptr;  /**< Uri-Path of the failed message */
+    sn_nsdl_addr_s      *dst_addr_ptr;  /**< Destination address of the failed message */
+    void                *param;         /**< Parameter given to sn_coap_protocol_build() */
+} sn_coap_send_failure_s;
+
+/**
+ * \brief Packet given to batch TX callback.
+ *
+ * Packet and address are copies owned by the library and are valid only during
+ * the batch TX callback.
+ */
+typedef struct sn_coap_tx_entry_ {
+    uint8_t             *packet_ptr;    /**< Packet data to send */
+    uint16_t            packet_len;     /**< Length of packet data */
+    sn_nsdl_addr_s      *dst_addr_ptr;  /**< Destination address of the packet */
+    void                *param;         /**< Parameter which would have been given to TX callback */
+} sn_coap_tx_entry_s;
+
+/**
+ * \brief Block of a blockwise transfer delivered to block sink.
+ *
+ * All pointers are owned by the library and are valid only during the block sink callback.
+ */
+typedef struct sn_coap_block_ {
+    sn_coap_hdr_s       *coap_msg_ptr;  /**< Received message carrying the block */
+    sn_nsdl_addr_s      *src_addr_ptr;  /**< Source address of the block */
+    uint32_t            offset;         /**< Offset of the block in whole payload */
+    uint32_t            total_size;     /**< Size of whole payload told by the sender in Size1 or Size2, 0 if unknown */
+    const uint8_t       *payload_ptr;   /**< Payload of the block */
+    uint16_t            payload_len;    /**< Payload length of the block */
+    uint8_t             last;           /**< 1 for the last block of the transfer, 0 otherwise */
+} sn_coap_block_s;
+
 /**
  * \fn int8_t sn_coap_protocol_destroy(void)
  *
@@ -143,6 +189,19 @@ extern int8_t sn_coap_protocol_exec(struct coap_s *handle, uint32_t current_time
  */
 extern int8_t sn_coap_protocol_set_block_size(struct coap_s *handle, uint16_t block_size);
 
+/**
+ * \fn int8_t sn_coap_protocol_set_path_mtu(struct coap_s *handle, uint16_t path_mtu)
+ *
+ * \brief If block transfer is enabled, this function sets path MTU used to select the block size.
+ *        Sent blocks are limited to the largest valid block size that fits in path MTU together
+ *        with IP, UDP and CoAP headers, and to the size set with sn_coap_protocol_set_block_size().
+ *
+ * \param uint16_t path_mtu path MTU in bytes, 0 if not known
+ * \return  0 = success
+ *          -1 = failure
+ */
+extern int8_t sn_coap_protocol_set_path_mtu(struct coap_s *handle, uint16_t path_mtu);
+
 /**
  * \fn int8_t sn_coap_protocol_set_duplicate_buffer_size(uint8_t message_count)
  *
@@ -154,6 +213,49 @@ extern int8_t sn_coap_protocol_set_block_size(struct coap_s *handle, uint16_t bl
  */
 extern int8_t sn_coap_protocol_set_duplicate_buffer_size(struct coap_s *handle, uint8_t message_count);
 
+/**
+ * \fn int8_t sn_coap_protocol_set_duplicate_buffer_size_2(struct coap_s *handle, uint32_t message_count)
+ *
+ * \brief Same as sn_coap_protocol_set_duplicate_buffer_size(), but with 32-bit limit.
+ *        Limit is checked against SN_COAP_MAX_ALLOWED_DUPLICATION_MESSAGE_COUNT.
+ *
+ * \param uint32_t message_count max number of messages saved for duplicate control
+ * \return  0 = success
+ *          -1 = failure
+ */
+extern int8_t sn_coap_protocol_set_duplicate_buffer_size_2(struct coap_s *handle, uint32_t message_count);
+
+/**
+ * \fn int8_t sn_coap_protocol_set_duplicate_response_cache_size(struct coap_s *handle, uint32_t size_bytes)
+ *
+ * \brief If dublicate message detection is enabled, this function changes the memory budget
+ *        for Acknowledgements replayed to duplicate Confirmable requests. Acknowledgements
+ *        built with sn_coap_protocol_build() are stored with the duplicate detection info of
+ *        the request and sent again when the request is received again, until the detection
+ *        info expires. Oldest Acknowledgements are dropped when budget is exceeded.
+ *        Application does not need to respond to messages with COAP_STATUS_PARSER_DUPLICATED_MSG status.
+ *
+ * \param uint32_t size_bytes max total size of stored Acknowledgements, 0 disables replaying
+ * \return  0 = success
+ *          -1 = failure
+ */
+extern int8_t sn_coap_protocol_set_duplicate_response_cache_size(struct coap_s *handle, uint32_t size_bytes);
+
+/**
+ * \fn int8_t sn_coap_protocol_set_peer_table_size(struct coap_s *handle, uint32_t max_peers, uint32_t idle_timeout)
+ *
+ * \brief If server profile is enabled, this function changes limits of the peer table. Peer table
+ *        stores each peer address once for duplicate detection, re-sending and blockwise data.
+ *        When table is full, least recently used peer without stored messages is replaced.
+ *        Messages from peers which do not fit to the table are not stored.
+ *
+ * \param uint32_t max_peers max number of peers in table, can not be less than peers already stored
+ * \param uint32_t idle_timeout time in seconds after peer without stored messages is removed, 0 = never
+ * \return  0 = success
+ *          -1 = failure
+ */
+extern int8_t sn_coap_protocol_set_peer_table_size(struct coap_s *handle, uint32_t max_peers, uint32_t idle_timeout);
+
 /**
  * \fn int8_t sn_coap_protocol_set_retransmission_parameters(uint8_t resending_count, uint8_t resending_intervall)
  *
@@ -166,6 +268,19 @@ extern int8_t sn_coap_protocol_set_duplicate_buffer_size(struct coap_s *handle,
 extern int8_t sn_coap_protocol_set_retransmission_parameters(struct coap_s *handle,
         uint8_t resending_count, uint8_t resending_interval);
 
+/**
+ * \fn int8_t sn_coap_protocol_set_retransmission_parameters_2(struct coap_s *handle, uint8_t resending_count, uint16_t resending_interval)
+ *
+ * \brief Same as sn_coap_protocol_set_retransmission_parameters(), but with 16-bit interval.
+ *        Interval is checked against SN_COAP_MAX_ALLOWED_RESPONSE_TIMEOUT.
+ *
+ * \param uint8_t resending_count max number of resendings for message
+ * \param uint16_t resending_interval message resending interval in seconds
+ * \return  0 = success, -1 = failure
+ */
+extern int8_t sn_coap_protocol_set_retransmission_parameters_2(struct coap_s *handle,
+        uint8_t resending_count, uint16_t resending_interval);
+
 /**
  * \fn int8_t sn_coap_protocol_set_retransmission_buffer(uint8_t buffer_size_messages, uint16_t buffer_size_bytes)
  *
@@ -179,6 +294,33 @@ extern int8_t sn_coap_protocol_set_retransmission_parameters(struct coap_s *hand
 extern int8_t sn_coap_protocol_set_retransmission_buffer(struct coap_s *handle,
         uint8_t buffer_size_messages, uint16_t buffer_size_bytes);
 
+/**
+ * \fn int8_t sn_coap_protocol_set_retransmission_buffer_2(struct coap_s *handle, uint32_t buffer_size_messages, uint32_t buffer_size_bytes)
+ *
+ * \brief Same as sn_coap_protocol_set_retransmission_buffer(), but with 32-bit limits.
+ *        Limits are checked against SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_MSGS and
+ *        SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES, which are not capped in server profile.
+ *
+ * \param uint32_t buffer_size_messages queue size - maximum number of messages to be saved to queue
+ * \param uint32_t buffer_size_bytes queue size - maximum size of messages saved to queue
+ * \return  0 = success, -1 = failure
+ */
+extern int8_t sn_coap_protocol_set_retransmission_buffer_2(struct coap_s *handle,
+        uint32_t buffer_size_messages, uint32_t buffer_size_bytes);
+
+/**
+ * \fn int8_t sn_coap_protocol_get_retransmission_buffer_usage(struct coap_s *handle, uint32_t *msg_count, uint32_t *byte_count)
+ *
+ * \brief If re-transmissions are enabled, this function returns current occupancy of the retransmission queue.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param *msg_count number of messages in the queue is written here, can be NULL
+ * \param *byte_count total packet size of messages in the queue is written here, can be NULL
+ * \return  0 = success, -1 = failure
+ */
+extern int8_t sn_coap_protocol_get_retransmission_buffer_usage(struct coap_s *handle,
+        uint32_t *msg_count, uint32_t *byte_count);
+
 /**
  * \fn void sn_coap_protocol_clear_retransmission_buffer(struct coap_s *handle)
  *
@@ -188,6 +330,94 @@ extern int8_t sn_coap_protocol_set_retransmission_buffer(struct coap_s *handle,
  */
 extern void sn_coap_protocol_clear_retransmission_buffer(struct coap_s *handle);
 
+/**
+ * \fn int8_t sn_coap_protocol_set_send_failure_callback(struct coap_s *handle, void (*send_failure_cb)(struct coap_s *, const sn_coap_send_failure_s *, uint8_t))
+ *
+ * \brief If re-transmissions are enabled, sets callback that is called when re-sendings of messages have run out.
+ *        Failed messages are reported in batches of at most SN_COAP_SEND_FAILURE_BATCH_SIZE entries per call
+ *        from sn_coap_protocol_exec(). When set, RX callback is no longer called with
+ *        COAP_STATUS_BUILDER_MESSAGE_SENDING_FAILED. Set to NULL to restore that behaviour.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param send_failure_cb Callback function, or NULL
+ * \return  0 = success, -1 = failure
+ */
+extern int8_t sn_coap_protocol_set_send_failure_callback(struct coap_s *handle,
+        void (*send_failure_cb)(struct coap_s *, const sn_coap_send_failure_s *, uint8_t));
+
+/**
+ * \fn int8_t sn_coap_protocol_set_tx_batch_callback(struct coap_s *handle, void (*tx_batch_cb)(struct coap_s *, const sn_coap_tx_entry_s *, uint8_t))
+ *
+ * \brief Sets callback that sends packets generated by the library in batches. Re-sendings, acknowledgements,
+ *        resets, blocks and notifications sent during one sn_coap_protocol_parse(), sn_coap_protocol_ingress_process(),
+ *        sn_coap_protocol_egress_process() or sn_coap_protocol_exec() call are collected and given to the callback at most SN_COAP_TX_BATCH_SIZE
+ *        packets per call before the function returns, e.g. to be sent with one system call. Packets sent outside
+ *        these calls, and packets which could not be collected, are given to TX callback as before. Set to NULL to
+ *        send all packets with TX callback.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param tx_batch_cb Callback function, or NULL
+ * \return  0 = success, -1 = invalid handle, -2 = out of memory
+ */
+extern int8_t sn_coap_protocol_set_tx_batch_callback(struct coap_s *handle,
+        void (*tx_batch_cb)(struct coap_s *, const sn_coap_tx_entry_s *, uint8_t));
+
+/**
+ * \fn int8_t sn_coap_protocol_set_block_sink_callback(struct coap_s *handle, int8_t (*block_sink_cb)(struct coap_s *, const sn_coap_block_s *, void *))
+ *
+ * \brief Sets callback that receives payload of incoming Block1 requests and Block2 responses one block at
+ *        a time, in order, instead of the library gathering the whole payload. A block is acknowledged only
+ *        after the callback has accepted it, so memory use does not depend on the size of the transfer.
+ *        Out of order Block1 requests are responded with 4.08 and rejected ones with 5.00. Rejected Block2
+ *        transfer is stopped and the response is returned with COAP_STATUS_PARSER_BLOCKWISE_MSG_REJECTED.
+ *        When the last block has been accepted, the message is returned with COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED
+ *        and no payload. Set to NULL to gather whole payload again.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param block_sink_cb Callback function returning 0 if block was accepted, or NULL. Last parameter is the
+ *        parameter given to sn_coap_protocol_parse().
+ * \return  0 = success, -1 = failure
+ */
+extern int8_t sn_coap_protocol_set_block_sink_callback(struct coap_s *handle,
+        int8_t (*block_sink_cb)(struct coap_s *, const sn_coap_block_s *, void *));
+
+/**
+ * \fn int8_t sn_coap_protocol_set_payload_provider(struct coap_s *handle, const uint8_t *(*payload_provider_cb)(struct coap_s *, const uint8_t *, uint32_t, uint16_t))
+ *
+ * \brief Sets callback that provides payload of outgoing Block1 requests and Block2 responses one block at a time.
+ *        When set, sn_coap_protocol_build() does not copy payload that is larger than the block size. Instead
+ *        payload_ptr of the built message is passed to the callback as such, together with offset and length
+ *        of each block including the first one, and is not accessed by the library. Callback returns pointer to
+ *        the block data, which needs to stay valid until the next call. For payload that stays in memory until the
+ *        transfer has ended, such as a memory mapped file, callback can return payload_ptr + offset. Callback
+ *        returning NULL ends the transfer. Set to NULL to copy payload again.
+ *        Payload can be longer than 64 KB: set payload_len to UINT16_MAX and Size1 of a request or Size2 of a
+ *        response to the total length, which is then used for sending the blocks.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param payload_provider_cb Callback function, or NULL
+ * \return  0 = success, -1 = failure
+ */
+extern int8_t sn_coap_protocol_set_payload_provider(struct coap_s *handle,
+        const uint8_t *(*payload_provider_cb)(struct coap_s *, const uint8_t *, uint32_t, uint16_t));
+
+/**
+ * \fn int8_t sn_coap_protocol_set_stateless_block2(struct coap_s *handle, bool enable)
+ *
+ * \brief Sets stateless Block2 mode. In stateless mode a response larger than the block size is not stored
+ *        for sending the rest of the blocks. Instead requests of later blocks are returned to the user like
+ *        any request, and the user builds the response from the whole representation again, with Block2
+ *        option of the request copied to the response. sn_coap_protocol_build() then sends only the asked
+ *        block, read from payload_ptr or from payload provider, so memory use does not depend on the count
+ *        of clients. Representation should not change between blocks, or the response should carry an ETag
+ *        which lets clients notice the change.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param enable true to enable stateless mode, false to store responses again
+ * \return  0 = success, -1 = failure
+ */
+extern int8_t sn_coap_protocol_set_stateless_block2(struct coap_s *handle, bool enable);
+
 /**
  * \fn sn_coap_protocol_block_remove
  *
@@ -212,6 +442,222 @@ extern void sn_coap_protocol_block_remove(struct coap_s *handle, sn_nsdl_addr_s
  */
 extern int8_t sn_coap_protocol_delete_retransmission(struct coap_s *handle, uint16_t msg_id);
 
+/**
+ * \fn int32_t sn_coap_protocol_observe_register(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *request_ptr)
+ *
+ * \brief Registers sender of a GET request with Observe option 0 as observer of the resource in Uri-Path of the
+ *        request. Observer is identified by its address and the token of the request, registering it again
+ *        keeps one registration. Requires SN_COAP_OBSERVE_MAX_OBSERVERS.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param *src_addr_ptr Address of the observer
+ * \param *request_ptr Received GET request
+ * \return Observe value for the response to the request, -1 if request is not a registration, registry is full
+ *         or out of memory
+ */
+extern int32_t sn_coap_protocol_observe_register(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *request_ptr);
+
+/**
+ * \fn int8_t sn_coap_protocol_observe_deregister(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const uint8_t *token_ptr, uint8_t token_len)
+ *
+ * \brief Removes observer from observer registry, for example when GET request with Observe option 1 is received
+ *        or a confirmable notification could not be sent.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param *addr_ptr Address of the observer
+ * \param *token_ptr Token of the observation
+ * \param token_len Length of the token
+ * \return 0 = success, -1 = invalid parameter, -2 = observer not found
+ */
+extern int8_t sn_coap_protocol_observe_deregister(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const uint8_t *token_ptr, uint8_t token_len);
+
+/**
+ * \fn int32_t sn_coap_protocol_observe_notify(struct coap_s *handle, const sn_coap_hdr_s *notification_ptr, void *param)
+ *
+ * \brief Sends notification to all observers of the resource in Uri-Path of the notification. Notification
+ *        is encoded once with the next Observe value of the resource, and only token and Message ID are
+ *        written for each observer before it is given to TX callback. Confirmable notifications are stored
+ *        for re-sending. Uri-Path, token and Message ID of the notification are not sent, and payload must
+ *        fit in one block.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param *notification_ptr Notification to send, type must be Confirmable or Non-confirmable
+ * \param *param Parameter given to TX callback
+ * \return Count of observers notified, -1 = invalid parameter, -2 = out of memory or failure in building
+ */
+extern int32_t sn_coap_protocol_observe_notify(struct coap_s *handle, const sn_coap_hdr_s *notification_ptr, void *param);
+
+/**
+ * \fn int8_t sn_coap_protocol_observe_set_rate(struct coap_s *handle, const uint8_t *uri_path_ptr, uint16_t uri_path_len, uint32_t pmin, uint32_t pmax)
+ *
+ * \brief Sets minimum and maximum time between notifications of an observed resource. Values given to
+ *        sn_coap_protocol_observe_changed() are then sent from sn_coap_protocol_exec() at most once per
+ *        pmin, so that only the latest value is sent, and the latest value is sent again if no notification
+ *        has been sent for pmax. Settings are removed with the last observer of the resource.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param *uri_path_ptr Uri-Path of the observed resource
+ * \param uri_path_len Length of Uri-Path
+ * \param pmin Minimum time in seconds between notifications, 0 sends changed values right away
+ * \param pmax Maximum time in seconds between notifications, 0 if none
+ * \return  0 = success, -1 = invalid parameter, -2 = resource has no observers
+ */
+extern int8_t sn_coap_protocol_observe_set_rate(struct coap_s *handle, const uint8_t *uri_path_ptr, uint16_t uri_path_len, uint32_t pmin, uint32_t pmax);
+
+/**
+ * \fn int8_t sn_coap_protocol_observe_changed(struct coap_s *handle, const sn_coap_hdr_s *notification_ptr, void *param)
+ *
+ * \brief Gives new value of the resource in Uri-Path of the notification. Value is sent to all observers right
+ *        away if pmin has passed since the last notification. Otherwise it replaces any value waiting to be sent,
+ *        and is sent from sn_coap_protocol_exec() when pmin has passed. Message code, Content-Format, Max-Age and
+ *        payload of the notification are stored; type of the notification is chosen by the library, see
+ *        SN_COAP_OBSERVE_CON_INTERVAL.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param *notification_ptr Notification with the new value, payload must fit in one block
+ * \param *param Parameter given to TX callback
+ * \return  0 = success or resource has no observers, -1 = invalid parameter, -2 = out of memory or failure in building
+ */
+extern int8_t sn_coap_protocol_observe_changed(struct coap_s *handle, const sn_coap_hdr_s *notification_ptr, void *param);
+
+/**
+ * \fn int8_t sn_coap_protocol_send_request(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, sn_coap_hdr_s *request_ptr, void (*response_cb)(struct coap_s *, const sn_coap_hdr_s *, void *), void *ctx, void *param)
+ *
+ * \brief Builds request with a unique token generated by the library and gives it to TX callback. Response,
+ *        or Reset to the request, is found by token and given to response callback when it is parsed with
+ *        sn_coap_protocol_parse(), which still returns the message to be released by caller. Blockwise
+ *        responses are given to response callback when all blocks have been received. If there is no
+ *        response in SN_COAP_CLIENT_EXCHANGE_TIMEOUT, response callback is called from sn_coap_protocol_exec()
+ *        with NULL response. If Confirmable request is not acknowledged after all re-sendings, response
+ *        callback is called from sn_coap_protocol_exec() with an empty message whose coap_status is
+ *        COAP_STATUS_BUILDER_MESSAGE_SENDING_FAILED. Any number of requests can be pending to same destination.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param *dst_addr_ptr Destination address of the request
+ * \param *request_ptr Confirmable or Non-confirmable request, token is replaced with the generated one
+ * \param response_cb Callback called once with response, failure message or NULL if request timed out.
+ *        Callback must not release the message.
+ * \param *ctx Parameter given to response callback
+ * \param *param Parameter given to TX callback
+ * \return  0 = success, -1 = invalid parameter or too many pending requests, -2 = out of memory or failure in building
+ */
+extern int8_t sn_coap_protocol_send_request(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, sn_coap_hdr_s *request_ptr,
+        void (*response_cb)(struct coap_s *, const sn_coap_hdr_s *, void *), void *ctx, void *param);
+
+/**
+ * \fn int8_t sn_coap_protocol_set_ingress_queue_size(struct coap_s *handle, uint16_t queue_size)
+ *
+ * \brief If ingress queue is enabled, sets size of the queue where other threads submit received messages.
+ *        Must be called by the thread owning the handle while no other thread is submitting messages.
+ *        Messages still in the queue are released.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param queue_size Count of messages in queue, power of two up to SN_COAP_INGRESS_QUEUE_MAX_SIZE, 0 frees the queue
+ * \return  0 = success, -1 = invalid size, out of memory or ingress queue not enabled
+ */
+extern int8_t sn_coap_protocol_set_ingress_queue_size(struct coap_s *handle, uint16_t queue_size);
+
+/**
+ * \fn int8_t sn_coap_protocol_ingress_submit(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t packet_data_len, uint8_t *packet_data_ptr, void *param)
+ *
+ * \brief Parses received message and adds it to ingress queue. Can be called from any thread at the same time
+ *        with other calls to this function and with the thread owning the handle. Packet data and source address
+ *        are not needed after the call, payload is copied to the same allocation as the parsed header, and is
+ *        released with the message.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param *src_addr_ptr Source address of received message
+ * \param packet_data_len Length of packet data
+ * \param *packet_data_ptr Received packet data
+ * \param *param Parameter returned from sn_coap_protocol_ingress_process()
+ * \return  0 = success, -1 = invalid parameter or queue full, -2 = out of memory in parser or for payload copy
+ */
+extern int8_t sn_coap_protocol_ingress_submit(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t packet_data_len, uint8_t *packet_data_ptr, void *param);
+
+/**
+ * \fn sn_coap_hdr_s *sn_coap_protocol_ingress_process(struct coap_s *handle, sn_nsdl_addr_s **src_addr_ptr, void **param)
+ *
+ * \brief Takes messages from ingress queue in the thread owning the handle and handles them as
+ *        sn_coap_protocol_parse() does, until a message for user is found or queue is empty.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param **src_addr_ptr Source address of returned message is written here, valid until next call
+ * \param **param Parameter given to sn_coap_protocol_ingress_submit() is written here
+ * \return Message as returned by sn_coap_protocol_parse(), NULL if queue is empty
+ */
+extern sn_coap_hdr_s *sn_coap_protocol_ingress_process(struct coap_s *handle, sn_nsdl_addr_s **src_addr_ptr, void **param);
+
+/**
+ * \fn int8_t sn_coap_protocol_set_egress_queue_size(struct coap_s *handle, uint16_t queue_size)
+ *
+ * \brief If egress queue is enabled, sets size of the queue where other threads submit outgoing messages.
+ *        Must be called by the thread owning the handle while no other thread is submitting messages.
+ *        Messages still in the queue are released without sending.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param queue_size Count of messages in queue, power of two up to SN_COAP_EGRESS_QUEUE_MAX_SIZE, 0 frees the queue
+ * \return  0 = success, -1 = invalid size, out of memory or egress queue not enabled
+ */
+extern int8_t sn_coap_protocol_set_egress_queue_size(struct coap_s *handle, uint16_t queue_size);
+
+/**
+ * \fn int8_t sn_coap_protocol_egress_submit(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, sn_coap_hdr_s *src_coap_msg_ptr, void *param)
+ *
+ * \brief Builds message and adds it to egress queue. Can be called from any thread at the same time
+ *        with other calls to this function and with the thread owning the handle. Message and destination
+ *        address are not needed after the call, and message is not modified. If Message ID of Confirmable
+ *        or Non-confirmable message is 0, it is assigned when the message is sent.
+ *
+ *        Payload must fit in one block, blockwise messages are built with sn_coap_protocol_build() by the
+ *        thread owning the handle. Smaller block sizes asked by the peer in server profile are not applied.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param *dst_addr_ptr Destination address of the message
+ * \param *src_coap_msg_ptr Message to be sent
+ * \param *param Parameter given to TX callback when message is sent
+ * \return  0 = success, -1 = invalid parameter, payload does not fit in one block or queue full,
+ *          -2 = out of memory or failure in building
+ */
+extern int8_t sn_coap_protocol_egress_submit(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, sn_coap_hdr_s *src_coap_msg_ptr, void *param);
+
+/**
+ * \fn uint16_t sn_coap_protocol_egress_process(struct coap_s *handle)
+ *
+ * \brief Takes messages from egress queue in the thread owning the handle and sends them with TX callback.
+ *        Message IDs are assigned, and messages are stored for re-sending and duplicate detection as
+ *        sn_coap_protocol_build() does. At most the size of the queue is taken in one call, so that
+ *        producers can not keep the owner thread here.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \return Count of sent messages
+ */
+extern uint16_t sn_coap_protocol_egress_process(struct coap_s *handle);
+
+/**
+ * \brief Counts of protocol state kept by a handle. Counts of features which are not compiled in are 0.
+ */
+typedef struct sn_coap_stats_ {
+    uint32_t    resent_msgs;            /**< Messages waiting for acknowledgement and re-sending */
+    uint32_t    resent_bytes;           /**< Total packet size of messages waiting for re-sending */
+    uint32_t    duplication_msgs;       /**< Messages stored for duplicate detection */
+    uint32_t    blockwise_sent_msgs;    /**< Blockwise messages being sent */
+    uint32_t    blockwise_received_payloads; /**< Blockwise payloads being received */
+    uint32_t    observers;              /**< Observers in observer registry */
+    uint32_t    exchanges;              /**< Pending requests sent with sn_coap_protocol_send_request() */
+    uint32_t    peers;                  /**< Peers in peer table */
+} sn_coap_stats_s;
+
+/**
+ * \fn int8_t sn_coap_protocol_get_stats(struct coap_s *handle, sn_coap_stats_s *stats_ptr)
+ *
+ * \brief Reads counts of protocol state kept by the handle. Must be called by the thread owning the handle.
+ *
+ * \param *handle Pointer to CoAP library handle
+ * \param *stats_ptr Counts are written here
+ * \return  0 = success, -1 = invalid parameter
+ */
+extern int8_t sn_coap_protocol_get_stats(struct coap_s *handle, sn_coap_stats_s *stats_ptr);
+
 #endif /* SN_COAP_PROTOCOL_H_ */
 
 #ifdef __cplusplus
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file sn_coap_shard.h
+ *
+ * \brief CoAP C-library sharding interface header file
+ *
+ * Sharding splits a server to N CoAP library handles, for example one per core.
+ * Every peer belongs to one shard, selected by hash of the peer address, so
+ * duplicate detection, re-sending and blockwise state of a peer is kept by one
+ * handle only. Each handle is used by one thread: received messages of a peer
+ * are parsed, messages to the peer are built and sn_coap_protocol_exec() is
+ * called with the handle of the shard, without locking. Packets of a peer must
+ * therefore reach the thread owning its shard: UDP transports bound to the same
+ * port can be steered with sn_coap_udp_steer_shards(), otherwise receiving thread
+ * hands messages to the owning thread with sn_coap_protocol_ingress_submit().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SN_COAP_SHARD_H_
+#define SN_COAP_SHARD_H_
+
+#include "sn_coap_header.h"
+#include "sn_coap_protocol.h"
+
+typedef struct sn_coap_shards_ sn_coap_shards_s;
+
+/**
+ * \fn sn_coap_shards_s *sn_coap_shards_init(uint16_t shard_count, void *(*used_malloc_func_ptr)(uint16_t), void (*used_free_func_ptr)(void *), uint8_t (*used_tx_callback_ptr)(uint8_t *, uint16_t, sn_nsdl_addr_s *, void *), int8_t (*used_rx_callback_ptr)(sn_coap_hdr_s *, sn_nsdl_addr_s *, void *))
+ *
+ * \brief Creates shard_count CoAP library handles with sn_coap_protocol_init(). Each handle
+ *        has its own Message IDs and protocol state. If used from several threads, memory
+ *        allocation functions must be thread safe.
+ *
+ * \return Pointer to shards, NULL if shard_count is 0 or out of memory
+ */
+extern sn_coap_shards_s *sn_coap_shards_init(uint16_t shard_count, void *(*used_malloc_func_ptr)(uint16_t), void (*used_free_func_ptr)(void *),
+        uint8_t (*used_tx_callback_ptr)(uint8_t *, uint16_t, sn_nsdl_addr_s *, void *),
+        int8_t (*used_rx_callback_ptr)(sn_coap_hdr_s *, sn_nsdl_addr_s *, void *));
+
+/**
+ * \fn void sn_coap_shards_destroy(sn_coap_shards_s *shards)
+ *
+ * \brief Destroys all handles with sn_coap_protocol_destroy() and releases shards
+ */
+extern void sn_coap_shards_destroy(sn_coap_shards_s *shards);
+
+/**
+ * \fn uint16_t sn_coap_shards_count(const sn_coap_shards_s *shards)
+ *
+ * \return Count of shards
+ */
+extern uint16_t sn_coap_shards_count(const sn_coap_shards_s *shards);
+
+/**
+ * \fn struct coap_s *sn_coap_shards_get(const sn_coap_shards_s *shards, uint16_t index)
+ *
+ * \return Handle of shard, NULL if index is not below count of shards
+ */
+extern struct coap_s *sn_coap_shards_get(const sn_coap_shards_s *shards, uint16_t index);
+
+/**
+ * \fn uint16_t sn_coap_shards_index(const sn_coap_shards_s *shards, const sn_nsdl_addr_s *addr_ptr)
+ *
+ * \brief Selects shard of a peer from hash of address type, address and port
+ *
+ * \return Index of the shard owning the peer
+ */
+extern uint16_t sn_coap_shards_index(const sn_coap_shards_s *shards, const sn_nsdl_addr_s *addr_ptr);
+
+/**
+ * \fn struct coap_s *sn_coap_shards_route(const sn_coap_shards_s *shards, const sn_nsdl_addr_s *addr_ptr)
+ *
+ * \brief Returns handle used for all messages from and to the peer
+ */
+extern struct coap_s *sn_coap_shards_route(const sn_coap_shards_s *shards, const sn_nsdl_addr_s *addr_ptr);
+
+/**
+ * \fn int8_t sn_coap_shards_get_stats(const sn_coap_shards_s *shards, sn_coap_stats_s *stats_ptr)
+ *
+ * \brief Sums counts of protocol state of all shards, see sn_coap_protocol_get_stats(). Threads
+ *        owning the handles must not use them during the call.
+ *
+ * \return  0 = success, -1 = invalid parameter
+ */
+extern int8_t sn_coap_shards_get_stats(const sn_coap_shards_s *shards, sn_coap_stats_s *stats_ptr);
+
+#endif /* SN_COAP_SHARD_H_ */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file sn_coap_udp.h
+ *
+ * \brief CoAP C-library reference UDP transport for Linux
+ *
+ * Transport binds a UDP socket to a CoAP library handle and runs an epoll loop
+ * for it. Received packets are read with recvmmsg() in batches and given to
+ * sn_coap_protocol_parse(), packets sent by the library are collected to a batch
+ * and sent with sendmmsg(), and sn_coap_protocol_exec() is called once a second
+ * from a timerfd. The transport is available only when compiled for Linux.
+ *
+ * Library handle must be created with sn_coap_udp_tx() as TX callback. Transport
+ * gives itself as the param of sn_coap_protocol_parse(), so responses sent by the
+ * library reach it. Messages built by user must also be given the transport as
+ * param of sn_coap_protocol_build(): re-sendings from sn_coap_protocol_exec() use
+ * the param stored with each message, and reach sn_coap_udp_tx() only if it is the
+ * transport. Packets built with sn_coap_protocol_build() are sent by calling
+ * sn_coap_udp_tx().
+ *
+ * A transport and its handle are used by one thread. Several transports created
+ * with reuse_port can be bound to the same port, one per thread. By default kernel
+ * spreads peers to the sockets with its own hash, which does not match the shard
+ * selected by sn_coap_shards_index(). To use them with handles of sn_coap_shards_s,
+ * create the transport of each shard in order of shard index and call
+ * sn_coap_udp_steer_shards(), so packets from a peer reach the handle which also
+ * sends to the peer.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SN_COAP_UDP_H_
+#define SN_COAP_UDP_H_
+
+#include "sn_coap_header.h"
+#include "sn_coap_protocol.h"
+
+typedef struct sn_coap_udp_ sn_coap_udp_s;
+
+/**
+ * \fn sn_coap_udp_s *sn_coap_udp_init(struct coap_s *handle, uint16_t port, bool reuse_port, void (*msg_cb)(sn_coap_udp_s *, sn_coap_hdr_s *, sn_nsdl_addr_s *, void *), void *ctx)
+ *
+ * \brief Opens a dual-stack UDP socket bound to port, and epoll and timer descriptors for it.
+ *        Memory is allocated with the allocation functions of the handle.
+ *
+ * \param *handle Pointer to CoAP library handle, created with sn_coap_udp_tx() as TX callback
+ * \param port UDP port to bind to, 0 binds to an ephemeral port
+ * \param reuse_port true to allow several sockets bound to same port with SO_REUSEPORT
+ * \param msg_cb Called with each message returned by sn_coap_protocol_parse(). Callback must
+ *        release the message with sn_coap_parser_release_allocated_coap_msg_mem(). Payload of
+ *        the message points to receive buffer, valid until callback returns.
+ * \param *ctx Parameter given to message callback
+ *
+ * \return Pointer to transport, NULL if failed to open socket or out of memory
+ */
+extern sn_coap_udp_s *sn_coap_udp_init(struct coap_s *handle, uint16_t port, bool reuse_port,
+                                       void (*msg_cb)(sn_coap_udp_s *, sn_coap_hdr_s *, sn_nsdl_addr_s *, void *), void *ctx);
+
+/**
+ * \fn void sn_coap_udp_destroy(sn_coap_udp_s *udp)
+ *
+ * \brief Sends pending packets, closes descriptors and releases transport. Library handle is not destroyed.
+ */
+extern void sn_coap_udp_destroy(sn_coap_udp_s *udp);
+
+/**
+ * \fn int sn_coap_udp_get_fd(const sn_coap_udp_s *udp)
+ *
+ * \brief Returns epoll descriptor of transport. Descriptor is readable when sn_coap_udp_run()
+ *        has work to do, so it can be added to epoll set of the application.
+ */
+extern int sn_coap_udp_get_fd(const sn_coap_udp_s *udp);
+
+/**
+ * \fn uint16_t sn_coap_udp_get_port(const sn_coap_udp_s *udp)
+ *
+ * \return Local UDP port of socket, 0 on failure
+ */
+extern uint16_t sn_coap_udp_get_port(const sn_coap_udp_s *udp);
+
+/**
+ * \fn void *sn_coap_udp_get_context(const sn_coap_udp_s *udp)
+ *
+ * \brief Returns ctx given to sn_coap_udp_init(), e.g. for RX callback of the handle
+ */
+extern void *sn_coap_udp_get_context(const sn_coap_udp_s *udp);
+
+/**
+ * \fn int8_t sn_coap_udp_steer_shards(sn_coap_udp_s *udp, uint16_t shard_count)
+ *
+ * \brief Steers packets received on the port to the socket of the shard owning the sender.
+ *        Attaches a classic BPF program to the SO_REUSEPORT group of the socket, which
+ *        calculates the same hash of source address and port as sn_coap_shards_index().
+ *
+ *        Program selects the socket by its index in the group, which is the order the
+ *        sockets were bound. Transports of shards 0 to shard_count - 1 must be created
+ *        with reuse_port in that order, and none of them may be destroyed while others
+ *        receive, as kernel then moves the last socket to the freed index. Source port is
+ *        read after fixed IPv6 header, so IPv6 packets with extension headers may reach
+ *        another shard.
+ *
+ * \param *udp Any transport of the group, created with reuse_port
+ * \param shard_count Count of shards, see sn_coap_shards_count()
+ *
+ * \return  0 = success, -1 = invalid parameter or kernel refused the program
+ */
+extern int8_t sn_coap_udp_steer_shards(sn_coap_udp_s *udp, uint16_t shard_count);
+
+/**
+ * \fn int8_t sn_coap_udp_run(sn_coap_udp_s *udp, int timeout_ms)
+ *
+ * \brief Waits for received packets or timer, at most timeout_ms milliseconds. All received
+ *        packets are parsed, sn_coap_protocol_exec() is called if timer has expired and pending
+ *        packets are sent before returning.
+ *
+ * \param timeout_ms Maximum time to wait, 0 returns at once, -1 waits until something happens
+ *
+ * \return  0 = success, -1 = failure in epoll or socket
+ */
+extern int8_t sn_coap_udp_run(sn_coap_udp_s *udp, int timeout_ms);
+
+/**
+ * \fn int8_t sn_coap_udp_flush(sn_coap_udp_s *udp)
+ *
+ * \brief Sends pending packets with sendmmsg(). Called by sn_coap_udp_run(), application
+ *        needs to call it after building messages outside of the callbacks.
+ *
+ * \return  0 = success, -1 = some packets could not be sent
+ */
+extern int8_t sn_coap_udp_flush(sn_coap_udp_s *udp);
+
+/**
+ * \fn uint8_t sn_coap_udp_tx(uint8_t *packet_ptr, uint16_t packet_len, sn_nsdl_addr_s *dst_addr_ptr, void *param)
+ *
+ * \brief TX callback of the transport, param must be the transport. Packet is copied to the
+ *        pending batch, which is sent when it is full or by sn_coap_udp_flush().
+ *
+ * \return 1 if packet was added to batch, 0 on failure
+ */
+extern uint8_t sn_coap_udp_tx(uint8_t *packet_ptr, uint16_t packet_len, sn_nsdl_addr_s *dst_addr_ptr, void *param);
+
+#endif /* SN_COAP_UDP_H_ */
+
+#ifdef __cplusplus
+}
+#endif
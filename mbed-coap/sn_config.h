@@ -34,6 +34,17 @@
  */
 #undef SN_COAP_DUPLICATION_MAX_MSGS_COUNT   /* 1 */
 
+/**
+ * \def SN_COAP_DUPLICATION_RESPONSE_CACHE_SIZE
+ * \brief For Message duplication detection
+ * Init value for the maximum total size in bytes of Acknowledgements
+ * stored for duplicate detected Confirmable requests. Stored Acknowledgement
+ * is sent again when request is received again.
+ * Setting of this value to 0 will disable response replaying.
+ * Default is set to 0.
+ */
+#undef SN_COAP_DUPLICATION_RESPONSE_CACHE_SIZE   /* 0 */
+
 /**
  * \def SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
  *
@@ -71,6 +82,197 @@
  */
 #undef SN_COAP_RESENDING_QUEUE_SIZE_BYTES   /* 0  */ // Default re-sending queue size - defines size of the re-sending buffer. Setting this to 0 disables feature
 
+/**
+ * \def SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES
+ *
+ * \brief Sets the maximum size of the re-sending buffer
+ * application can set with sn_coap_protocol_set_retransmission_buffer().
+ * Default is 512, or UINT32_MAX when SN_COAP_SERVER_PROFILE is enabled.
+ */
+#undef SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES /* 512 */
+
+/**
+ * \def SN_COAP_SERVER_PROFILE
+ *
+ * \brief Enables server profile, intended for
+ * servers talking to large number of devices.
+ * Runtime limits set with the sn_coap_protocol_set_*_2()
+ * functions are not capped by the SN_COAP_MAX_ALLOWED_*
+ * values, stored re-sending messages are indexed
+ * by Message ID and duplicate detection uses a
+ * preallocated hash cache instead of a Linked list.
+ * The cache is allocated in chunks of 4096 entries, so
+ * its size set with sn_coap_protocol_set_duplicate_buffer_size_2()
+ * is limited to 8388608 (0x800000) messages, and
+ * SN_COAP_MAX_ALLOWED_DUPLICATION_MESSAGE_COUNT can not be
+ * configured above that.
+ * Peer addresses of stored messages are interned
+ * to a shared peer table. Blockwise transfers are
+ * indexed by peer and token.
+ * By default, this feature is disabled.
+ */
+#undef SN_COAP_SERVER_PROFILE    /* 0 */
+
+/**
+ * \def SN_COAP_PEER_TABLE_MAX_PEERS
+ *
+ * \brief Sets the maximum count of peers in the peer table of
+ * server profile. When table is full, least recently used peer
+ * not referenced by any stored message is replaced.
+ * Application can change this with sn_coap_protocol_set_peer_table_size().
+ * Default is 4096.
+ */
+#undef SN_COAP_PEER_TABLE_MAX_PEERS    /* 4096 */
+
+/**
+ * \def SN_COAP_PEER_IDLE_TIMEOUT
+ *
+ * \brief Sets the time in seconds after peer not referenced by
+ * any stored message is removed from the peer table of server profile.
+ * Setting of this value to 0 keeps peers until table is full.
+ * Default is 300.
+ */
+#undef SN_COAP_PEER_IDLE_TIMEOUT    /* 300 */
+
+/**
+ * \def SN_COAP_BLOCKWISE_REASSEMBLY
+ *
+ * \brief For Message blockwising
+ * Writes received blocks directly to one payload buffer per transfer.
+ * Buffer is allocated once from Size1/Size2 option when sender includes it,
+ * otherwise it is grown geometrically. Whole payload is returned without
+ * copying, so peak memory use is about the size of the payload instead of
+ * twice of it.
+ * By default, this feature is disabled.
+ */
+#undef SN_COAP_BLOCKWISE_REASSEMBLY    /* 0 */
+
+/**
+ * \def SN_COAP_Q_BLOCK_MAX_PAYLOADS
+ *
+ * \brief For Message blockwising
+ * Enables Q-Block1 transfers (RFC 9177) and sets MAX_PAYLOADS, the count of
+ * blocks sent in one set without waiting for a response. Request is sent with
+ * Q-Block1 when User sets use_q_block1 in its options. Receiver acknowledges
+ * each complete set with 2.31 and lists missing blocks in 4.08, so only lost
+ * blocks are sent again. Receiving needs SN_COAP_BLOCKWISE_REASSEMBLY.
+ * Value must be the same in both ends, RFC 9177 suggests 10.
+ * By default, this feature is disabled.
+ */
+#undef SN_COAP_Q_BLOCK_MAX_PAYLOADS    /* 0 */
+
+/**
+ * \def SN_COAP_BLOCKWISE_PATH_MTU
+ *
+ * \brief For Message blockwising
+ * Path MTU in bytes used to select the block size of sent blockwise messages.
+ * Largest block size that fits in path MTU together with IP, UDP and CoAP
+ * headers is used, up to SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE. With
+ * SN_COAP_SERVER_PROFILE, block size also follows smaller block sizes asked
+ * by each peer. Can be changed with sn_coap_protocol_set_path_mtu().
+ * By default, path MTU is not known (0).
+ */
+#undef SN_COAP_BLOCKWISE_PATH_MTU    /* 0 */
+
+/**
+ * \def SN_COAP_BLOCK_SIZE_TUNING
+ *
+ * \brief For Message blockwising
+ * Tunes block size of sent blockwise messages per peer from loss of messages
+ * to the peer. Needs SN_COAP_SERVER_PROFILE. Loss ratio is measured over
+ * SN_COAP_BLOCK_SIZE_TUNING_WINDOW transmissions. Block size is halved when
+ * three quarters or more of them were lost, and the smaller size is kept
+ * only if it lowers the loss enough to save time, so random loss that does
+ * not depend on packet size does not make blocks smaller. Block size is
+ * doubled again after SN_COAP_BLOCK_SIZE_INCREASE_INTERVAL blocks have been
+ * acknowledged without retransmissions. Block size stays between 16 bytes
+ * and the size selected from SN_COAP_BLOCKWISE_PATH_MTU.
+ * By default, this feature is disabled.
+ */
+#undef SN_COAP_BLOCK_SIZE_TUNING    /* 0 */
+
+/**
+ * \def SN_COAP_OBSERVE_MAX_OBSERVERS
+ *
+ * \brief Enables observer registry and sets the maximum count of
+ * observers in it. Application registers observers of its resources
+ * with sn_coap_protocol_observe_register(), and sends a notification
+ * to all observers of a resource with sn_coap_protocol_observe_notify().
+ * Notification is encoded once and only token and Message ID are
+ * written for each observer. Reset to a notification cancels the
+ * observation.
+ * By default, this feature is disabled.
+ */
+#undef SN_COAP_OBSERVE_MAX_OBSERVERS    /* 0 */
+
+/**
+ * \def SN_COAP_OBSERVE_CON_INTERVAL
+ *
+ * \brief Notifications sent from sn_coap_protocol_exec() for resources
+ * with pmin/pmax set are Non-confirmable, except that every
+ * SN_COAP_OBSERVE_CON_INTERVAL'th one, and notifications forced by pmax,
+ * are Confirmable so that observers which have gone away are detected.
+ * Confirmable notification is sent as Non-confirmable if it would not
+ * fit in the re-sending queue.
+ * By default, every 10th scheduled notification is Confirmable.
+ */
+#undef SN_COAP_OBSERVE_CON_INTERVAL    /* 10 */
+
+/**
+ * \def SN_COAP_CLIENT_MAX_EXCHANGES
+ *
+ * \brief Enables client exchanges and sets the maximum count of pending
+ * requests. Requests sent with sn_coap_protocol_send_request() get a
+ * unique token generated by the library, and the response is given to
+ * the callback of the request, found by token. Requests without response
+ * are completed after SN_COAP_CLIENT_EXCHANGE_TIMEOUT.
+ * By default, this feature is disabled.
+ */
+#undef SN_COAP_CLIENT_MAX_EXCHANGES    /* 0 */
+
+/**
+ * \def SN_COAP_CLIENT_EXCHANGE_TIMEOUT
+ *
+ * \brief Time in seconds after which a request sent with
+ * sn_coap_protocol_send_request() is completed without response.
+ * By default, MAX_TRANSMIT_WAIT of RFC 7252 (93 seconds).
+ */
+#undef SN_COAP_CLIENT_EXCHANGE_TIMEOUT    /* 93 */
+
+/**
+ * \def SN_COAP_INGRESS_QUEUE_MAX_SIZE
+ *
+ * \brief Enables ingress queue and sets its maximum size. Ingress queue
+ * is a lock-free ring where any thread can submit received datagrams with
+ * sn_coap_protocol_ingress_submit(). Datagrams are parsed on the
+ * submitting thread, payload is copied so that the datagram buffer can be
+ * reused at once, and the thread owning the handle takes them with
+ * sn_coap_protocol_ingress_process(), which does the rest of the protocol
+ * handling of sn_coap_protocol_parse(). Memory allocation functions given
+ * to sn_coap_protocol_init() must be thread safe. Queue is taken into use
+ * with sn_coap_protocol_set_ingress_queue_size(). Needs compiler with
+ * GCC compatible __atomic builtins.
+ * By default, this feature is disabled.
+ */
+#undef SN_COAP_INGRESS_QUEUE_MAX_SIZE    /* 0 */
+
+/**
+ * \def SN_COAP_EGRESS_QUEUE_MAX_SIZE
+ *
+ * \brief Enables egress queue and sets its maximum size. Egress queue
+ * is a lock-free ring where any thread can submit outgoing messages with
+ * sn_coap_protocol_egress_submit(). Messages are built on the submitting
+ * thread, and the thread owning the handle sends them with
+ * sn_coap_protocol_egress_process(), which assigns Message IDs and stores
+ * messages for re-sending like sn_coap_protocol_build(). Blockwise messages
+ * can not be submitted. Memory allocation functions given to
+ * sn_coap_protocol_init() must be thread safe. Queue is taken into use
+ * with sn_coap_protocol_set_egress_queue_size(). Needs compiler with
+ * GCC compatible __atomic builtins.
+ * By default, this feature is disabled.
+ */
+#undef SN_COAP_EGRESS_QUEUE_MAX_SIZE    /* 0 */
+
 /**
  * \def SN_COAP_MAX_INCOMING_MESSAGE_SIZE
  *
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file sn_coap_peer_table_internal.h
+ *
+ * \brief Header file for CoAP Peer table part
+ *
+ * Peer table interns peer addresses (address type, address and port) and
+ * hands out compact peer IDs, so stored protocol state does not need its
+ * own copy of the address. Peers are stored in fixed size chunks, so IDs and
+ * address pointers stay valid as long as the peer is in the table.
+ */
+
+#ifndef SN_COAP_PEER_TABLE_INTERNAL_H_
+#define SN_COAP_PEER_TABLE_INTERNAL_H_
+
+#include "ns_types.h"
+#include "mbed-coap/sn_coap_header.h"
+#include "mbed-coap/sn_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* * * * * * * * * * * */
+/* * * * DEFINES * * * */
+/* * * * * * * * * * * */
+
+/* Init value for the maximum count of peers in peer table */
+#ifdef YOTTA_CFG_COAP_PEER_TABLE_MAX_PEERS
+#define SN_COAP_PEER_TABLE_MAX_PEERS YOTTA_CFG_COAP_PEER_TABLE_MAX_PEERS
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_PEER_TABLE_MAX_PEERS
+#define SN_COAP_PEER_TABLE_MAX_PEERS MBED_CONF_MBED_CLIENT_SN_COAP_PEER_TABLE_MAX_PEERS
+#endif
+
+#ifndef SN_COAP_PEER_TABLE_MAX_PEERS
+#define SN_COAP_PEER_TABLE_MAX_PEERS                4096
+#endif
+
+/* Init value for time in seconds after unused peer is removed from peer table, 0 keeps unused peers until table is full */
+#ifdef YOTTA_CFG_COAP_PEER_IDLE_TIMEOUT
+#define SN_COAP_PEER_IDLE_TIMEOUT YOTTA_CFG_COAP_PEER_IDLE_TIMEOUT
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_PEER_IDLE_TIMEOUT
+#define SN_COAP_PEER_IDLE_TIMEOUT MBED_CONF_MBED_CLIENT_SN_COAP_PEER_IDLE_TIMEOUT
+#endif
+
+#ifndef SN_COAP_PEER_IDLE_TIMEOUT
+#define SN_COAP_PEER_IDLE_TIMEOUT                   300
+#endif
+
+/* Maximum address length stored to peer table, peers with longer addresses are not interned */
+#ifndef SN_COAP_PEER_MAX_ADDR_LEN
+#define SN_COAP_PEER_MAX_ADDR_LEN                   16
+#endif
+
+#define SN_COAP_PEER_CHUNK_SIZE                     512     /* Peers per allocated chunk, power of two */
+#define SN_COAP_PEER_BUCKET_CHUNK_SIZE              8192    /* Hash buckets per allocated chunk, power of two */
+
+/* * * * * * * * * * * * * * */
+/* * * * ENUMS & STRUCTS * * * */
+/* * * * * * * * * * * * * * */
+
+/* Interned peer */
+typedef struct sn_coap_peer_ {
+    sn_nsdl_addr_s      addr;           /* Peer address, addr_ptr points to addr_data */
+    uint8_t             addr_data[SN_COAP_PEER_MAX_ADDR_LEN];
+
+    uint32_t            last_used;      /* Tells when peer was last interned or released */
+    uint32_t            ref_count;      /* Count of stored states using peer, unreferenced peers are in LRU list */
+
+    uint32_t            hash_next;      /* ID of next peer in same hash bucket or in free list, 0 if none */
+    uint32_t            lru_prev;       /* ID of previous (less recently used) peer in LRU list, 0 if none */
+    uint32_t            lru_next;       /* ID of next (more recently used) peer in LRU list, 0 if none */
+
+    uint16_t            block_size;     /* Block size used for blockwise messages to peer, 0 if not tuned yet */
+    uint16_t            block_size_max; /* Block size last asked by peer instead of a larger one, 0 if none */
+    uint8_t             block_ack_count; /* Blocks acknowledged without retransmissions since last retransmission or block size change */
+    uint8_t             block_tx_count; /* Transmissions to peer in current loss window */
+    uint8_t             block_loss_count; /* Retransmissions to peer in current loss window */
+    uint8_t             block_loss_larger; /* Loss count of the window before block size was halved, 0xff if not halved */
+} sn_coap_peer_s;
+
+/* Peer table, ID of a peer is its index + 1 */
+typedef struct sn_coap_peer_table_ {
+    void *(*sn_coap_peer_table_malloc)(uint16_t);
+    void (*sn_coap_peer_table_free)(void *);
+
+    sn_coap_peer_s      **chunks;       /* Peers in chunks of SN_COAP_PEER_CHUNK_SIZE, allocated when first needed */
+    uint32_t            **buckets;      /* Hash index of peer IDs in chunks of SN_COAP_PEER_BUCKET_CHUNK_SIZE */
+    uint32_t            bucket_count;
+
+    uint32_t            max_peers;
+    uint32_t            idle_timeout;
+    uint32_t            slot_count;     /* Count of peer slots taken into use */
+    uint32_t            peer_count;     /* Count of interned peers */
+    uint32_t            free_list;      /* ID of first released slot, 0 if none */
+
+    uint32_t            lru_head;       /* ID of least recently used unreferenced peer, 0 if none */
+    uint32_t            lru_tail;       /* ID of most recently used unreferenced peer, 0 if none */
+} sn_coap_peer_table_s;
+
+/* * * * * * * * * * * * * * * * * * * * */
+/* * * * FUNCTION PROTOTYPES * * * */
+/* * * * * * * * * * * * * * * * * * * * */
+
+/**
+ * \fn void sn_coap_peer_table_init(sn_coap_peer_table_s *table, void *(*used_malloc_func_ptr)(uint16_t), void (*used_free_func_ptr)(void *), uint32_t max_peers, uint32_t idle_timeout)
+ *
+ * \brief Initializes empty peer table. Memory is allocated when first peer is interned.
+ *
+ * \param max_peers is maximum count of peers in table
+ * \param idle_timeout is time in seconds after unreferenced peer is removed, 0 disables timeout
+ */
+extern void sn_coap_peer_table_init(sn_coap_peer_table_s *table, void *(*used_malloc_func_ptr)(uint16_t),
+                                    void (*used_free_func_ptr)(void *), uint32_t max_peers, uint32_t idle_timeout);
+
+/**
+ * \fn int8_t sn_coap_peer_table_set_size(sn_coap_peer_table_s *table, uint32_t max_peers, uint32_t idle_timeout)
+ *
+ * \brief Changes limits of peer table. Existing peers and their IDs are kept.
+ *
+ * \return 0 on success, -1 if table has used more slots than max_peers, max_peers
+ *         is too big or out of memory
+ */
+extern int8_t sn_coap_peer_table_set_size(sn_coap_peer_table_s *table, uint32_t max_peers, uint32_t idle_timeout);
+
+/**
+ * \fn void sn_coap_peer_table_destroy(sn_coap_peer_table_s *table)
+ *
+ * \brief Releases all memory of peer table. All peer IDs become invalid.
+ */
+extern void sn_coap_peer_table_destroy(sn_coap_peer_table_s *table);
+
+/**
+ * \fn uint32_t sn_coap_peer_table_find(sn_coap_peer_table_s *table, const sn_nsdl_addr_s *addr_ptr)
+ *
+ * \brief Finds ID of interned peer
+ *
+ * \return Peer ID, 0 if peer is not in table
+ */
+extern uint32_t sn_coap_peer_table_find(const sn_coap_peer_table_s *table, const sn_nsdl_addr_s *addr_ptr);
+
+/**
+ * \fn uint32_t sn_coap_peer_table_intern(sn_coap_peer_table_s *table, const sn_nsdl_addr_s *addr_ptr, uint32_t current_time)
+ *
+ * \brief Finds ID of peer, adding the peer to table if needed. If table is full,
+ *        least recently used unreferenced peer is replaced. Returned peer is not
+ *        referenced, so sn_coap_peer_table_ref() must be called before ID is stored.
+ *
+ * \return Peer ID, 0 if address is too long, table is full of referenced peers or out of memory
+ */
+extern uint32_t sn_coap_peer_table_intern(sn_coap_peer_table_s *table, const sn_nsdl_addr_s *addr_ptr, uint32_t current_time);
+
+/**
+ * \fn sn_nsdl_addr_s *sn_coap_peer_table_get_addr(const sn_coap_peer_table_s *table, uint32_t peer_id)
+ *
+ * \brief Returns address of interned peer, valid until peer is removed from table
+ */
+extern sn_nsdl_addr_s *sn_coap_peer_table_get_addr(const sn_coap_peer_table_s *table, uint32_t peer_id);
+
+/**
+ * \fn sn_coap_peer_s *sn_coap_peer_table_get_peer(const sn_coap_peer_table_s *table, uint32_t peer_id)
+ *
+ * \brief Returns interned peer for reading and updating state kept per peer,
+ *        valid until peer is removed from table
+ */
+extern sn_coap_peer_s *sn_coap_peer_table_get_peer(const sn_coap_peer_table_s *table, uint32_t peer_id);
+
+/**
+ * \fn void sn_coap_peer_table_ref(sn_coap_peer_table_s *table, uint32_t peer_id)
+ *
+ * \brief Adds reference to peer, referenced peers are not removed from table
+ */
+extern void sn_coap_peer_table_ref(sn_coap_peer_table_s *table, uint32_t peer_id);
+
+/**
+ * \fn void sn_coap_peer_table_unref(sn_coap_peer_table_s *table, uint32_t peer_id, uint32_t current_time)
+ *
+ * \brief Removes reference from peer. Unreferenced peer stays in table until it has been
+ *        idle for idle timeout or it is replaced by a new peer.
+ */
+extern void sn_coap_peer_table_unref(sn_coap_peer_table_s *table, uint32_t peer_id, uint32_t current_time);
+
+/**
+ * \fn void sn_coap_peer_table_remove_idle(sn_coap_peer_table_s *table, uint32_t current_time)
+ *
+ * \brief Removes unreferenced peers which have been idle longer than idle timeout
+ */
+extern void sn_coap_peer_table_remove_idle(sn_coap_peer_table_s *table, uint32_t current_time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SN_COAP_PEER_TABLE_INTERNAL_H_ */
@@ -27,17 +27,36 @@
 #include "ns_list.h"
 #include "sn_coap_header_internal.h"
 #include "mbed-coap/sn_config.h"
+#include "sn_coap_peer_table_internal.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 struct sn_coap_hdr_;
+struct sn_coap_send_failure_;
+struct sn_coap_block_;
+struct sn_coap_tx_entry_;
+struct coap_tx_batch_;
 
 /* * * * * * * * * * * */
 /* * * * DEFINES * * * */
 /* * * * * * * * * * * */
 
+/* * Server profile * */
+
+/* Server profile lifts compile-time caps of runtime limits and uses indexed lookups for stored messages */
+
+#ifdef YOTTA_CFG_COAP_SERVER_PROFILE
+#define SN_COAP_SERVER_PROFILE YOTTA_CFG_COAP_SERVER_PROFILE
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_SERVER_PROFILE
+#define SN_COAP_SERVER_PROFILE MBED_CONF_MBED_CLIENT_SN_COAP_SERVER_PROFILE
+#endif
+
+#ifndef SN_COAP_SERVER_PROFILE
+#define SN_COAP_SERVER_PROFILE                          0   /**< Disabled by default */
+#endif
+
 /* * For Message resending * */
 #define ENABLE_RESENDINGS                               1   /**< Enable / Disable resending from library in building */
 
@@ -66,13 +85,70 @@ struct sn_coap_hdr_;
 #define DEFAULT_RESPONSE_TIMEOUT                        10  /**< Default re-sending timeout as seconds */
 
 /* These parameters sets maximum values application can set with API */
+#ifndef SN_COAP_MAX_ALLOWED_RESENDING_COUNT
 #define SN_COAP_MAX_ALLOWED_RESENDING_COUNT             6   /**< Maximum allowed count of re-sending */
+#endif
+
+#ifdef YOTTA_CFG_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES
+#define SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES YOTTA_CFG_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES
+#define SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES MBED_CONF_MBED_CLIENT_SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES
+#endif
+
+/* Bucket arrays are allocated with one call to the 16-bit allocator */
+#if UINTPTR_MAX > 0xFFFFFFFFu
+#define SN_COAP_MAX_HASH_SIZE                           4096
+#else
+#define SN_COAP_MAX_HASH_SIZE                           8192
+#endif
+
+#if SN_COAP_SERVER_PROFILE
+#ifndef SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_MSGS
+#define SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_MSGS    UINT32_MAX
+#endif
+#ifndef SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES
+#define SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES   UINT32_MAX
+#endif
+#ifndef SN_COAP_MAX_ALLOWED_RESPONSE_TIMEOUT
+#define SN_COAP_MAX_ALLOWED_RESPONSE_TIMEOUT            UINT16_MAX
+#endif
+#ifndef SN_COAP_RESENDING_HASH_SIZE
+#define SN_COAP_RESENDING_HASH_SIZE                     1024 /**< Number of buckets in re-sending message index, must be 2^x */
+#endif
+#ifndef SN_COAP_BLOCKWISE_HASH_SIZE
+#define SN_COAP_BLOCKWISE_HASH_SIZE                     1024 /**< Number of buckets in blockwise session indexes, must be 2^x */
+#endif
+#if SN_COAP_RESENDING_HASH_SIZE > SN_COAP_MAX_HASH_SIZE || (SN_COAP_RESENDING_HASH_SIZE & (SN_COAP_RESENDING_HASH_SIZE - 1))
+#error "SN_COAP_RESENDING_HASH_SIZE must be power of two and fit to one allocation of 64 KiB"
+#endif
+#if SN_COAP_BLOCKWISE_HASH_SIZE > SN_COAP_MAX_HASH_SIZE || (SN_COAP_BLOCKWISE_HASH_SIZE & (SN_COAP_BLOCKWISE_HASH_SIZE - 1))
+#error "SN_COAP_BLOCKWISE_HASH_SIZE must be power of two and fit to one allocation of 64 KiB"
+#endif
+#endif
+
+#ifndef SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_MSGS
 #define SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_MSGS    6   /**< Maximum allowed number of saved re-sending messages */
+#endif
+#ifndef SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES
 #define SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES   512 /**< Maximum allowed size of re-sending buffer */
+#endif
+#ifndef SN_COAP_MAX_ALLOWED_RESPONSE_TIMEOUT
 #define SN_COAP_MAX_ALLOWED_RESPONSE_TIMEOUT            40  /**< Maximum allowed re-sending timeout */
+#endif
 
 #define RESPONSE_RANDOM_FACTOR                          1   /**< Resending random factor, value is specified in IETF CoAP specification */
 
+#ifndef SN_COAP_SEND_FAILURE_BATCH_SIZE
+#define SN_COAP_SEND_FAILURE_BATCH_SIZE                 8   /**< Maximum number of failed messages reported with one send failure callback */
+#endif
+
+#ifndef SN_COAP_TX_BATCH_SIZE
+#define SN_COAP_TX_BATCH_SIZE                           16  /**< Maximum number of packets given to batch TX callback with one call */
+#endif
+#ifndef SN_COAP_TX_BATCH_MAX_ADDR_LEN
+#define SN_COAP_TX_BATCH_MAX_ADDR_LEN                   16  /**< Maximum destination address length of batched packets, longer are sent with TX callback */
+#endif
+
 /* * For Message duplication detecting * */
 
 /* Init value for the maximum count of messages to be stored for duplication detection          */
@@ -92,7 +168,31 @@ struct sn_coap_hdr_;
 
 
 /* Maximum allowed number of saved messages for duplicate searching */
+#ifndef SN_COAP_MAX_ALLOWED_DUPLICATION_MESSAGE_COUNT
+#if SN_COAP_SERVER_PROFILE
+#define SN_COAP_MAX_ALLOWED_DUPLICATION_MESSAGE_COUNT   0x800000 /* Limited by count of cache chunks in one allocation */
+#else
 #define SN_COAP_MAX_ALLOWED_DUPLICATION_MESSAGE_COUNT   6
+#endif
+#endif
+
+#define SN_COAP_DUPLICATION_CHUNK_SIZE                  4096 /* Cache entries and hash slots per allocated chunk, power of two */
+
+#if SN_COAP_SERVER_PROFILE && SN_COAP_MAX_ALLOWED_DUPLICATION_MESSAGE_COUNT > 0x800000
+#error "SN_COAP_MAX_ALLOWED_DUPLICATION_MESSAGE_COUNT can be at most 0x800000, hash slot chunk pointers must fit to one allocation of 64 KiB"
+#endif
+
+/* Init value for the maximum total size in bytes of Acknowledgements stored for replaying them to duplicate requests */
+/* Setting of this value to 0 will disable response replaying                                                        */
+#ifdef YOTTA_CFG_COAP_DUPLICATION_RESPONSE_CACHE_SIZE
+#define SN_COAP_DUPLICATION_RESPONSE_CACHE_SIZE YOTTA_CFG_COAP_DUPLICATION_RESPONSE_CACHE_SIZE
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_DUPLICATION_RESPONSE_CACHE_SIZE
+#define SN_COAP_DUPLICATION_RESPONSE_CACHE_SIZE MBED_CONF_MBED_CLIENT_SN_COAP_DUPLICATION_RESPONSE_CACHE_SIZE
+#endif
+
+#ifndef SN_COAP_DUPLICATION_RESPONSE_CACHE_SIZE
+#define SN_COAP_DUPLICATION_RESPONSE_CACHE_SIZE     0
+#endif
 
 /* Maximum time in seconds of messages to be stored for duplication detection */
 #define SN_COAP_DUPLICATION_MAX_TIME_MSGS_STORED    60 /* RESPONSE_TIMEOUT * RESPONSE_RANDOM_FACTOR * (2 ^ MAX_RETRANSMIT - 1) + the expected maximum round trip time */
@@ -114,6 +214,70 @@ struct sn_coap_hdr_;
 #endif
 
 
+/* Received blockwise payload is written to one buffer per transfer at the offset of each block. Buffer is      */
+/* allocated from Size1/Size2 option when present, otherwise it grows geometrically. Whole payload is returned */
+/* to User without copying. When 0, each block is stored separately and gathered when last block is received. */
+#ifdef YOTTA_CFG_COAP_BLOCKWISE_REASSEMBLY
+#define SN_COAP_BLOCKWISE_REASSEMBLY YOTTA_CFG_COAP_BLOCKWISE_REASSEMBLY
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_BLOCKWISE_REASSEMBLY
+#define SN_COAP_BLOCKWISE_REASSEMBLY MBED_CONF_MBED_CLIENT_SN_COAP_BLOCKWISE_REASSEMBLY
+#endif
+
+#ifndef SN_COAP_BLOCKWISE_REASSEMBLY
+#define SN_COAP_BLOCKWISE_REASSEMBLY                0
+#endif
+
+/* Count of blocks in one set of Q-Block1 transfer (MAX_PAYLOADS of RFC 9177). Blocks of a set are sent without */
+/* waiting for responses, and receiver acknowledges each set or asks for its missing blocks. Receiving needs      */
+/* SN_COAP_BLOCKWISE_REASSEMBLY, as blocks can arrive out of order. When 0, Q-Block1 transfers are not supported. */
+#ifdef YOTTA_CFG_COAP_Q_BLOCK_MAX_PAYLOADS
+#define SN_COAP_Q_BLOCK_MAX_PAYLOADS YOTTA_CFG_COAP_Q_BLOCK_MAX_PAYLOADS
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_Q_BLOCK_MAX_PAYLOADS
+#define SN_COAP_Q_BLOCK_MAX_PAYLOADS MBED_CONF_MBED_CLIENT_SN_COAP_Q_BLOCK_MAX_PAYLOADS
+#endif
+
+#ifndef SN_COAP_Q_BLOCK_MAX_PAYLOADS
+#define SN_COAP_Q_BLOCK_MAX_PAYLOADS                0
+#endif
+
+/* Init value for path MTU in bytes. Blocks of sent blockwise messages are limited so that block, CoAP header and */
+/* IP/UDP headers fit in path MTU. When 0, block size is limited only by SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE.      */
+#ifdef YOTTA_CFG_COAP_BLOCKWISE_PATH_MTU
+#define SN_COAP_BLOCKWISE_PATH_MTU YOTTA_CFG_COAP_BLOCKWISE_PATH_MTU
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_BLOCKWISE_PATH_MTU
+#define SN_COAP_BLOCKWISE_PATH_MTU MBED_CONF_MBED_CLIENT_SN_COAP_BLOCKWISE_PATH_MTU
+#endif
+
+#ifndef SN_COAP_BLOCKWISE_PATH_MTU
+#define SN_COAP_BLOCKWISE_PATH_MTU                  0
+#endif
+
+#ifndef SN_COAP_BLOCKWISE_MTU_OVERHEAD
+#define SN_COAP_BLOCKWISE_MTU_OVERHEAD              128 /**< Bytes of path MTU reserved for IPv6, UDP and CoAP headers of a block */
+#endif
+
+/* Tunes block size of blockwise messages per peer from loss of messages to the peer. Needs SN_COAP_SERVER_PROFILE. */
+/* When 0, block size follows only path MTU and smaller block sizes asked by the peer.                              */
+#ifdef YOTTA_CFG_COAP_BLOCK_SIZE_TUNING
+#define SN_COAP_BLOCK_SIZE_TUNING YOTTA_CFG_COAP_BLOCK_SIZE_TUNING
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_BLOCK_SIZE_TUNING
+#define SN_COAP_BLOCK_SIZE_TUNING MBED_CONF_MBED_CLIENT_SN_COAP_BLOCK_SIZE_TUNING
+#endif
+
+#ifndef SN_COAP_BLOCK_SIZE_TUNING
+#define SN_COAP_BLOCK_SIZE_TUNING                   0
+#endif
+
+#ifndef SN_COAP_BLOCK_SIZE_TUNING_WINDOW
+#define SN_COAP_BLOCK_SIZE_TUNING_WINDOW            16 /**< Count of transmissions to a peer over which its loss ratio is measured, up to 254 */
+#endif
+
+#define SN_COAP_BLOCK_LOSS_NOT_HALVED               0xff /**< Loss count of a peer whose block size was not halved in the previous window */
+
+#ifndef SN_COAP_BLOCK_SIZE_INCREASE_INTERVAL
+#define SN_COAP_BLOCK_SIZE_INCREASE_INTERVAL        16 /**< Count of blocks acknowledged by peer without retransmissions before its block size is doubled */
+#endif
+
 #ifndef SN_COAP_BLOCKWISE_MAX_TIME_DATA_STORED
 #define SN_COAP_BLOCKWISE_MAX_TIME_DATA_STORED      10 /**< Maximum time in seconds of data (messages and payload) to be stored for blockwising */
 #endif
@@ -128,10 +292,101 @@ struct sn_coap_hdr_;
 #define SN_COAP_MAX_INCOMING_BLOCK_MESSAGE_SIZE UINT16_MAX
 #endif
 
+/* Maximum count of observers in observer registry. Notification to observers of a resource is encoded once and */
+/* only token and Message ID are written for each observer. When 0, observer registry is not used.            */
+#ifdef YOTTA_CFG_COAP_OBSERVE_MAX_OBSERVERS
+#define SN_COAP_OBSERVE_MAX_OBSERVERS YOTTA_CFG_COAP_OBSERVE_MAX_OBSERVERS
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_OBSERVE_MAX_OBSERVERS
+#define SN_COAP_OBSERVE_MAX_OBSERVERS MBED_CONF_MBED_CLIENT_SN_COAP_OBSERVE_MAX_OBSERVERS
+#endif
+
+#ifndef SN_COAP_OBSERVE_MAX_OBSERVERS
+#define SN_COAP_OBSERVE_MAX_OBSERVERS               0
+#endif
+
+/* Count of scheduled notifications after which next one is sent Confirmable, so observers that have gone away are detected */
+#ifdef YOTTA_CFG_COAP_OBSERVE_CON_INTERVAL
+#define SN_COAP_OBSERVE_CON_INTERVAL YOTTA_CFG_COAP_OBSERVE_CON_INTERVAL
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_OBSERVE_CON_INTERVAL
+#define SN_COAP_OBSERVE_CON_INTERVAL MBED_CONF_MBED_CLIENT_SN_COAP_OBSERVE_CON_INTERVAL
+#endif
+
+#ifndef SN_COAP_OBSERVE_CON_INTERVAL
+#define SN_COAP_OBSERVE_CON_INTERVAL                10
+#endif
+
+/* Maximum count of pending requests sent with sn_coap_protocol_send_request(), 0 disables client exchanges */
+#ifdef YOTTA_CFG_COAP_CLIENT_MAX_EXCHANGES
+#define SN_COAP_CLIENT_MAX_EXCHANGES YOTTA_CFG_COAP_CLIENT_MAX_EXCHANGES
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_CLIENT_MAX_EXCHANGES
+#define SN_COAP_CLIENT_MAX_EXCHANGES MBED_CONF_MBED_CLIENT_SN_COAP_CLIENT_MAX_EXCHANGES
+#endif
+
+#ifndef SN_COAP_CLIENT_MAX_EXCHANGES
+#define SN_COAP_CLIENT_MAX_EXCHANGES                0
+#endif
+
+/* Time in seconds after pending request is completed without response, MAX_TRANSMIT_WAIT of RFC 7252 by default */
+#ifdef YOTTA_CFG_COAP_CLIENT_EXCHANGE_TIMEOUT
+#define SN_COAP_CLIENT_EXCHANGE_TIMEOUT YOTTA_CFG_COAP_CLIENT_EXCHANGE_TIMEOUT
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_CLIENT_EXCHANGE_TIMEOUT
+#define SN_COAP_CLIENT_EXCHANGE_TIMEOUT MBED_CONF_MBED_CLIENT_SN_COAP_CLIENT_EXCHANGE_TIMEOUT
+#endif
+
+#ifndef SN_COAP_CLIENT_EXCHANGE_TIMEOUT
+#define SN_COAP_CLIENT_EXCHANGE_TIMEOUT             93
+#endif
+
+#ifndef SN_COAP_CLIENT_EXCHANGE_HASH_SIZE
+#define SN_COAP_CLIENT_EXCHANGE_HASH_SIZE           256 /**< Number of buckets in pending exchange index, must be 2^x */
+#endif
+#if SN_COAP_CLIENT_EXCHANGE_HASH_SIZE > SN_COAP_MAX_HASH_SIZE || (SN_COAP_CLIENT_EXCHANGE_HASH_SIZE & (SN_COAP_CLIENT_EXCHANGE_HASH_SIZE - 1))
+#error "SN_COAP_CLIENT_EXCHANGE_HASH_SIZE must be power of two and fit to one allocation of 64 KiB"
+#endif
+
+#define SN_COAP_CLIENT_TOKEN_LEN                    4   /**< Length of tokens generated for client exchanges */
+
+/* Maximum size of ingress queue where other threads submit received messages, 0 disables ingress queue */
+#ifdef YOTTA_CFG_COAP_INGRESS_QUEUE_MAX_SIZE
+#define SN_COAP_INGRESS_QUEUE_MAX_SIZE YOTTA_CFG_COAP_INGRESS_QUEUE_MAX_SIZE
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_INGRESS_QUEUE_MAX_SIZE
+#define SN_COAP_INGRESS_QUEUE_MAX_SIZE MBED_CONF_MBED_CLIENT_SN_COAP_INGRESS_QUEUE_MAX_SIZE
+#endif
+
+#ifndef SN_COAP_INGRESS_QUEUE_MAX_SIZE
+#define SN_COAP_INGRESS_QUEUE_MAX_SIZE              0
+#endif
+
+#ifndef SN_COAP_INGRESS_MAX_ADDR_LEN
+#define SN_COAP_INGRESS_MAX_ADDR_LEN                16  /**< Maximum source address length of messages in ingress queue */
+#endif
+
+/* Maximum size of egress queue where other threads submit outgoing messages, 0 disables egress queue */
+#ifdef YOTTA_CFG_COAP_EGRESS_QUEUE_MAX_SIZE
+#define SN_COAP_EGRESS_QUEUE_MAX_SIZE YOTTA_CFG_COAP_EGRESS_QUEUE_MAX_SIZE
+#elif defined MBED_CONF_MBED_CLIENT_SN_COAP_EGRESS_QUEUE_MAX_SIZE
+#define SN_COAP_EGRESS_QUEUE_MAX_SIZE MBED_CONF_MBED_CLIENT_SN_COAP_EGRESS_QUEUE_MAX_SIZE
+#endif
+
+#ifndef SN_COAP_EGRESS_QUEUE_MAX_SIZE
+#define SN_COAP_EGRESS_QUEUE_MAX_SIZE               0
+#endif
+
+#ifndef SN_COAP_EGRESS_MAX_ADDR_LEN
+#define SN_COAP_EGRESS_MAX_ADDR_LEN                 16  /**< Maximum destination address length of messages in egress queue */
+#endif
+
+/* Results of delivering received block to block sink */
+#define SN_COAP_BLOCK_SINK_ACCEPTED                 0   /**< Block was accepted by block sink */
+#define SN_COAP_BLOCK_SINK_DUPLICATE                1   /**< Block has already been accepted */
+#define SN_COAP_BLOCK_SINK_OUT_OF_ORDER             (-1) /**< Block is not the next expected block */
+#define SN_COAP_BLOCK_SINK_REJECTED                 (-2) /**< Block was rejected by block sink or out of memory */
+
 /* * For Option handling * */
 #define COAP_OPTION_MAX_AGE_DEFAULT                 60 /**< Default value of Max-Age if option not present */
 #define COAP_OPTION_URI_PORT_NONE                   (-1) /**< Internal value to represent no Uri-Port option */
 #define COAP_OPTION_BLOCK_NONE                      (-1) /**< Internal value to represent no Block1/2 option */
+#define COAP_REQUEST_TAG_NONE                       0xFF /**< Internal value to represent no Request-Tag option */
 
 
 #if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
@@ -143,8 +398,18 @@ typedef struct coap_send_msg_ {
     uint8_t             resending_counter;  /* Tells how many times message is still tried to resend */
     uint32_t            resending_time;     /* Tells next resending time */
 
+    uint16_t            msg_id;             /* Message ID of stored message */
+    uint8_t             msg_code;           /* Message code of stored message */
+    uint8_t             token_len;          /* Token length of stored message */
+    uint8_t             token[8];           /* Token of stored message */
+
     sn_nsdl_transmit_s *send_msg_ptr;
 
+#if SN_COAP_SERVER_PROFILE
+    struct coap_send_msg_ *hash_next;       /* Next message in same re-sending index bucket */
+    uint32_t            peer_id;            /* Destination in peer table, dst_addr_ptr points to its address */
+#endif
+
     struct coap_s       *coap;              /* CoAP library handle */
     void                *param;             /* Extra parameter that will be passed to TX/RX callback functions */
 
@@ -153,6 +418,12 @@ typedef struct coap_send_msg_ {
 
 typedef NS_LIST_HEAD(coap_send_msg_s, link) coap_send_msg_list_t;
 
+/* Acknowledgement sent to duplicate detected request, packet is allocated right after this structure */
+typedef struct coap_duplication_response_ {
+    uint16_t            packet_len;
+    uint8_t             *packet_ptr;
+} coap_duplication_response_s;
+
 /* Structure which is stored to Linked list for message duplication detection purposes */
 typedef struct coap_duplication_info_ {
     uint32_t            timestamp; /* Tells when duplication information is stored to Linked list */
@@ -163,6 +434,8 @@ typedef struct coap_duplication_info_ {
 
     uint16_t            msg_id;
 
+    coap_duplication_response_s *response_ptr; /* Acknowledgement replayed to duplicates, or NULL */
+
     struct coap_s       *coap;  /* CoAP library handle */
 
     ns_list_link_t     link;
@@ -170,12 +443,36 @@ typedef struct coap_duplication_info_ {
 
 typedef NS_LIST_HEAD(coap_duplication_info_s, link) coap_duplication_info_list_t;
 
-/* Structure which is stored to Linked list for blockwise messages sending purposes */
+/* Structure which is stored to duplication detection cache of server profile */
+typedef struct coap_duplication_entry_ {
+    uint32_t            timestamp; /* Tells when duplication information is stored to cache */
+    uint32_t            peer_id;   /* Source in peer table */
+    uint16_t            msg_id;
+} coap_duplication_entry_s;
+
+/* Structure which is stored to Linked list for blockwise messages sending purposes. A request that */
+/* may get a Block2 response is stored without coap_msg_ptr, only with its Message ID, code and token. */
 typedef struct coap_blockwise_msg_ {
     uint32_t            timestamp;  /* Tells when Blockwise message is stored to Linked list */
 
     sn_coap_hdr_s       *coap_msg_ptr;
     struct coap_s       *coap;      /* CoAP library handle */
+    uint32_t            payload_len;    /* Total length of sent payload, can be over 64 KB with payload provider */
+#if SN_COAP_SERVER_PROFILE
+    struct coap_blockwise_msg_ *hash_next;  /* Next message in same blockwise session index bucket */
+    uint32_t            peer_id;        /* Peer in peer table */
+#endif
+    uint16_t            msg_id;         /* Message ID of stored request, when coap_msg_ptr is not stored */
+    uint8_t             msg_code;       /* Code of stored request, when coap_msg_ptr is not stored */
+    uint8_t             token_len;      /* Token of the session, in server profile blocks are matched with peer and token */
+    uint8_t             token[8];
+    uint8_t             *uri_ptr;       /* Uri-Path followed by Uri-Query of stored request, when coap_msg_ptr is not stored */
+    uint16_t            uri_path_len;
+    uint16_t            uri_query_len;
+
+    /* Set if blocks are read from payload provider, payload is not copied to coap_msg_ptr then */
+    const uint8_t *(*payload_provider)(struct coap_s *, const uint8_t *, uint32_t, uint16_t);
+    const uint8_t       *payload_ref;   /* Payload pointer given to sn_coap_protocol_build(), passed to payload provider */
 
     ns_list_link_t     link;
 } coap_blockwise_msg_s;
@@ -189,9 +486,29 @@ typedef struct coap_blockwise_payload_ {
     uint8_t             addr_len;
     uint8_t             *addr_ptr;
     uint16_t            port;
+    uint8_t             request_tag_len;    /* Request-Tag of the session, COAP_REQUEST_TAG_NONE if requests have none */
+    uint8_t             request_tag[8];
+#if SN_COAP_SERVER_PROFILE
+    struct coap_blockwise_payload_ *hash_next; /* Next payload in same blockwise session index bucket */
+    uint32_t            peer_id;   /* Source in peer table, address is not copied */
+    uint8_t             token_len; /* Token of the session, used as key when requests have no Request-Tag */
+    uint8_t             token[8];
+#endif
 
     uint16_t            payload_len;
     uint8_t             *payload_ptr;
+#if SN_COAP_BLOCKWISE_REASSEMBLY
+    uint16_t            payload_size;   /* Allocated size of payload_ptr */
+    uint32_t            payload_offset; /* Offset of payload_ptr in whole payload */
+#if SN_COAP_Q_BLOCK_MAX_PAYLOADS
+    uint8_t             *q_block_map;   /* Bitmap of received Q-Block1 blocks, NULL for Block1 transfers */
+    uint16_t            q_block_map_size;
+    uint32_t            q_block_count;  /* Count of blocks in transfer, 0 until last block is received */
+    uint32_t            q_block_set_end; /* Blocks before this were asked again with 4.08, 0 if none */
+    uint32_t            q_block_last_missing; /* Last block asked in 4.08, its arrival triggers next 4.08 if some are still missing */
+#endif
+#endif
+    uint32_t            sink_offset;    /* Offset of next block expected by block sink, if payload is streamed */
     struct coap_s       *coap;  /* CoAP library handle */
 
     ns_list_link_t     link;
@@ -199,35 +516,179 @@ typedef struct coap_blockwise_payload_ {
 
 typedef NS_LIST_HEAD(coap_blockwise_payload_s, link) coap_blockwise_payload_list_t;
 
+/* Observer of a resource in observer registry */
+typedef struct coap_observer_ {
+#if SN_COAP_SERVER_PROFILE
+    uint32_t            peer_id;        /* Observer in peer table */
+#else
+    sn_nsdl_addr_s      addr;           /* Address of observer, addr_ptr points to memory allocated right after this structure */
+#endif
+    uint16_t            msg_id;         /* Message ID of last notification, Reset to it cancels the observation */
+    uint8_t             token_len;      /* Token of the observation, written to each notification */
+    uint8_t             token[8];
+
+    ns_list_link_t      link;
+} coap_observer_s;
+
+typedef NS_LIST_HEAD(coap_observer_s, link) coap_observer_list_t;
+
+/* Observed resource in observer registry, Uri-Path is allocated right after this structure */
+typedef struct coap_observe_resource_ {
+    uint8_t             *uri_path_ptr;
+    uint16_t            uri_path_len;
+    uint32_t            observe_seq;    /* Observe value of the last notification */
+    coap_observer_list_t observers;
+
+    uint32_t            pmin;           /* Minimum time in seconds between notifications, 0 if not rate controlled */
+    uint32_t            pmax;           /* Maximum time in seconds between notifications, 0 if none */
+    uint32_t            notify_time;    /* System time of the last notification */
+    uint8_t             *value_ptr;     /* Payload of the latest value given to sn_coap_protocol_observe_changed() */
+    uint16_t            value_len;
+    uint8_t             value_code;     /* Message code of the latest value, COAP_MSG_CODE_EMPTY if none */
+    uint8_t             non_count;      /* Non-confirmable notifications since the last Confirmable one */
+    bool                value_pending;  /* Latest value has not been sent yet */
+    sn_coap_content_format_e content_format;
+    uint32_t            max_age;
+    void                *param;         /* Parameter given to TX callback with scheduled notifications */
+
+    ns_list_link_t      link;
+} coap_observe_resource_s;
+
+typedef NS_LIST_HEAD(coap_observe_resource_s, link) coap_observe_resource_list_t;
+
+/* Pending request sent with sn_coap_protocol_send_request() */
+typedef struct coap_exchange_ {
+#if SN_COAP_SERVER_PROFILE
+    uint32_t            peer_id;        /* Destination of the request in peer table */
+#else
+    sn_nsdl_addr_s      addr;           /* Destination of the request, addr_ptr points to memory allocated right after this structure */
+#endif
+    uint32_t            token;          /* Token generated for the request */
+    uint32_t            timeout;        /* System time when exchange is completed without response */
+    uint16_t            msg_id;         /* Message ID of the request, Reset to it completes the exchange */
+
+    void (*response_cb)(struct coap_s *, const sn_coap_hdr_s *, void *);
+    void                *ctx;
+
+    struct coap_exchange_ *hash_next;   /* Next exchange in same token index bucket */
+    ns_list_link_t      link;
+} coap_exchange_s;
+
+typedef NS_LIST_HEAD(coap_exchange_s, link) coap_exchange_list_t;
+
+/* Slot of ingress queue. Slot is free for producer when sequence equals its position,
+ * and holds a message for owner thread when sequence is position + 1. */
+typedef struct coap_ingress_slot_ {
+    uint32_t            sequence;
+    sn_coap_hdr_s       *coap_msg_ptr;  /* Message parsed by producer */
+    coap_version_e      coap_version;
+    void                *param;
+    sn_nsdl_addr_s      addr;           /* Source address, addr_ptr points to addr_data when message is taken */
+    uint8_t             addr_data[SN_COAP_INGRESS_MAX_ADDR_LEN];
+} coap_ingress_slot_s;
+
+/* Slot of egress queue, used like slot of ingress queue */
+typedef struct coap_egress_slot_ {
+    uint32_t            sequence;
+    uint8_t             *packet_ptr;    /* Packet built by producer, followed by Uri-Path and Uri-Query of the message */
+    uint16_t            packet_len;
+    uint16_t            uri_path_len;
+    uint16_t            uri_query_len;
+    bool                msg_id_assign;  /* Message ID is assigned by owner thread */
+    void                *param;
+    sn_nsdl_addr_s      addr;           /* Destination address, addr_ptr points to addr_data when message is taken */
+    uint8_t             addr_data[SN_COAP_EGRESS_MAX_ADDR_LEN];
+} coap_egress_slot_s;
+
 struct coap_s {
     void *(*sn_coap_protocol_malloc)(uint16_t);
     void (*sn_coap_protocol_free)(void *);
 
     uint8_t (*sn_coap_tx_callback)(uint8_t *, uint16_t, sn_nsdl_addr_s *, void *);
     int8_t (*sn_coap_rx_callback)(sn_coap_hdr_s *, sn_nsdl_addr_s *, void *);
+    void (*sn_coap_tx_batch_callback)(struct coap_s *, const struct sn_coap_tx_entry_ *, uint8_t); /* Called with packets collected during parse and exec */
+    struct coap_tx_batch_ *tx_batch;    /* Packets collected for batch TX callback, allocated when callback is set */
 
     #if ENABLE_RESENDINGS /* If Message resending is not used at all, this part of code will not be compiled */
         coap_send_msg_list_t linked_list_resent_msgs; /* Active resending messages are stored to this Linked list */
-        uint16_t count_resent_msgs;
+        uint32_t count_resent_msgs;
+        uint32_t count_resent_bytes; /* Total packet size of active resending messages */
+        #if SN_COAP_SERVER_PROFILE
+            struct coap_send_msg_ **resent_msgs_hash; /* Active resending messages indexed by Message ID */
+        #endif
+        void (*sn_coap_send_failure_callback)(struct coap_s *, const struct sn_coap_send_failure_ *, uint8_t); /* Called with failed messages when re-sendings have run out */
     #endif
 
     #if SN_COAP_DUPLICATION_MAX_MSGS_COUNT /* If Message duplication detection is not used at all, this part of code will not be compiled */
+    #if SN_COAP_SERVER_PROFILE
+        void                          **duplication_ring;   /* Chunks of coap_duplication_entry_s, messages for duplicated messages detection in arrival order */
+        void                          **duplication_slots;  /* Chunks of uint32_t, hash index to duplication_ring, position + 1 or 0 if free */
+        uint32_t                      duplication_slot_mask;
+        uint32_t                      duplication_ring_head; /* Position of oldest stored message */
+        void                          **duplication_responses; /* Chunks of Acknowledgement pointers by ring position, allocated when replaying is enabled */
+    #else
         coap_duplication_info_list_t  linked_list_duplication_msgs; /* Messages for duplicated messages detection is stored to this Linked list */
-        uint16_t                      count_duplication_msgs;
+    #endif
+        uint32_t                      count_duplication_msgs;
+        uint32_t                      count_duplication_response_bytes;
     #endif
 
     #if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwise is not used at all, this part of code will not be compiled */
         coap_blockwise_msg_list_t     linked_list_blockwise_sent_msgs; /* Blockwise message to to be sent is stored to this Linked list */
         coap_blockwise_payload_list_t linked_list_blockwise_received_payloads; /* Blockwise payload to to be received is stored to this Linked list */
+        int8_t (*sn_coap_block_sink_callback)(struct coap_s *, const struct sn_coap_block_ *, void *); /* Called with each received block instead of storing payload */
+        const uint8_t *(*sn_coap_payload_provider_callback)(struct coap_s *, const uint8_t *, uint32_t, uint16_t); /* Provides blocks of sent payload instead of copying it */
+        bool                          sn_coap_block2_stateless; /* Block2 responses are not stored, user builds each block */
+        #if SN_COAP_SERVER_PROFILE
+            coap_blockwise_msg_s      **blockwise_sent_hash; /* Sent blockwise messages indexed by peer and token */
+            coap_blockwise_payload_s  **blockwise_received_hash; /* Received blockwise payloads indexed by peer and Request-Tag or token */
+        #endif
+    #endif
+
+    #if SN_COAP_SERVER_PROFILE
+        sn_coap_peer_table_s          peer_table; /* Peers referenced by stored messages */
+    #endif
+
+    #if SN_COAP_OBSERVE_MAX_OBSERVERS /* If observer registry is not used at all, this part of code will not be compiled */
+        coap_observe_resource_list_t  linked_list_observe_resources; /* Observed resources and their observers */
+        uint32_t                      count_observers;
+    #endif
+
+    #if SN_COAP_CLIENT_MAX_EXCHANGES /* If client exchanges are not used at all, this part of code will not be compiled */
+        coap_exchange_list_t          linked_list_exchanges; /* Pending exchanges in sending order */
+        coap_exchange_s               **exchanges_hash;     /* Pending exchanges indexed by token, allocated when first needed */
+        uint32_t                      count_exchanges;
+        uint32_t                      exchange_token;       /* Token of the next request */
+    #endif
+
+    #if SN_COAP_INGRESS_QUEUE_MAX_SIZE /* If ingress queue is not used at all, this part of code will not be compiled */
+        coap_ingress_slot_s           *ingress_queue;       /* Ring of received messages, written by any thread */
+        uint32_t                      ingress_queue_mask;   /* Size of ring - 1 */
+        uint32_t                      ingress_head;         /* Position of next slot to write, updated atomically by producers */
+        uint32_t                      ingress_tail;         /* Position of next slot to read, used only by owner thread */
+        sn_nsdl_addr_s                ingress_addr;         /* Source address of the message last taken from ring */
+        uint8_t                       ingress_addr_data[SN_COAP_INGRESS_MAX_ADDR_LEN];
+    #endif
+
+    #if SN_COAP_EGRESS_QUEUE_MAX_SIZE /* If egress queue is not used at all, this part of code will not be compiled */
+        coap_egress_slot_s            *egress_queue;        /* Ring of built messages, written by any thread */
+        uint32_t                      egress_queue_mask;    /* Size of ring - 1 */
+        uint32_t                      egress_head;          /* Position of next slot to write, updated atomically by producers */
+        uint32_t                      egress_tail;          /* Position of next slot to read, used only by owner thread */
+        sn_nsdl_addr_s                egress_addr;          /* Destination address of the message last taken from ring */
+        uint8_t                       egress_addr_data[SN_COAP_EGRESS_MAX_ADDR_LEN];
     #endif
 
     uint32_t system_time;    /* System time seconds */
+    uint16_t message_id;     /* Message ID of the next sent message, never 0 */
+    uint32_t sn_coap_resending_queue_msgs;
+    uint32_t sn_coap_resending_queue_bytes;
+    uint32_t sn_coap_duplication_buffer_size;
+    uint32_t sn_coap_duplication_response_cache_size;
     uint16_t sn_coap_block_data_size;
-    uint8_t sn_coap_resending_queue_msgs;
-    uint8_t sn_coap_resending_queue_bytes;
+    uint16_t sn_coap_path_mtu;
+    uint16_t sn_coap_resending_intervall;
     uint8_t sn_coap_resending_count;
-    uint8_t sn_coap_resending_intervall;
-    uint8_t sn_coap_duplication_buffer_size;
 };
 
 #ifdef __cplusplus
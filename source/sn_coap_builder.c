@@ -326,6 +326,13 @@ uint16_t sn_coap_builder_calc_needed_packet_data_size_2(sn_coap_hdr_s *src_coap_
             if (src_coap_msg_ptr->options_list_ptr->use_size2) {
                 returned_byte_count += sn_coap_builder_options_build_add_uint_option(NULL, src_coap_msg_ptr->options_list_ptr->size2, COAP_OPTION_SIZE2, &tempInt);
             }
+            /* REQUEST TAG - Length of this option is 0-8 bytes */
+            if (src_coap_msg_ptr->options_list_ptr->use_request_tag) {
+                if (src_coap_msg_ptr->options_list_ptr->request_tag_len > 8) {
+                    return 0;
+                }
+                returned_byte_count += 1 + src_coap_msg_ptr->options_list_ptr->request_tag_len;
+            }
         }
 #if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
         if ((src_coap_msg_ptr->payload_len > blockwise_payload_size) && (blockwise_payload_size > 0)) {
@@ -371,7 +378,8 @@ static uint8_t sn_coap_builder_options_calculate_jump_need(sn_coap_hdr_s *src_co
                 !src_coap_msg_ptr->options_list_ptr->proxy_uri_ptr      &&
                 src_coap_msg_ptr->options_list_ptr->max_age == COAP_OPTION_MAX_AGE_DEFAULT &&
                 !src_coap_msg_ptr->options_list_ptr->use_size1          &&
-                !src_coap_msg_ptr->options_list_ptr->use_size2) {
+                !src_coap_msg_ptr->options_list_ptr->use_size2          &&
+                !src_coap_msg_ptr->options_list_ptr->use_request_tag) {
             return 0;
         }
 
@@ -420,19 +428,28 @@ static uint8_t sn_coap_builder_options_calculate_jump_need(sn_coap_hdr_s *src_co
             }
             previous_option_number = (COAP_OPTION_ACCEPT);
         }
+        if (src_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE &&
+                src_coap_msg_ptr->options_list_ptr->use_q_block1) {
+            if ((COAP_OPTION_Q_BLOCK1 - previous_option_number) > 12) {
+                needed_space += 1;
+            }
+            previous_option_number = (COAP_OPTION_Q_BLOCK1);
+        }
         if (src_coap_msg_ptr->options_list_ptr->location_query_ptr != NULL) {
             if ((COAP_OPTION_LOCATION_QUERY - previous_option_number) > 12) {
                 needed_space += 1;
             }
             previous_option_number = (COAP_OPTION_LOCATION_QUERY);
         }
-        if (src_coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE) {
+        if (src_coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE &&
+                !src_coap_msg_ptr->options_list_ptr->use_q_block2) {
             if ((COAP_OPTION_BLOCK2 - previous_option_number) > 12 ){
                 needed_space += 1;
             }
             previous_option_number = (COAP_OPTION_BLOCK2);
         }
-        if (src_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE) {
+        if (src_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE &&
+                !src_coap_msg_ptr->options_list_ptr->use_q_block1) {
             if ((COAP_OPTION_BLOCK1 - previous_option_number) > 12 ){
                 needed_space += 1;
             }
@@ -444,6 +461,13 @@ static uint8_t sn_coap_builder_options_calculate_jump_need(sn_coap_hdr_s *src_co
             }
             previous_option_number = (COAP_OPTION_SIZE2);
         }
+        if (src_coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE &&
+                src_coap_msg_ptr->options_list_ptr->use_q_block2) {
+            if ((COAP_OPTION_Q_BLOCK2 - previous_option_number) > 12) {
+                needed_space += 1;
+            }
+            previous_option_number = (COAP_OPTION_Q_BLOCK2);
+        }
         if (src_coap_msg_ptr->options_list_ptr->proxy_uri_ptr != NULL) {
             if ((COAP_OPTION_PROXY_URI - previous_option_number) > 12) {
                 needed_space += 1;
@@ -459,6 +483,13 @@ static uint8_t sn_coap_builder_options_calculate_jump_need(sn_coap_hdr_s *src_co
             }
             previous_option_number = (COAP_OPTION_SIZE1);
         }
+        if (src_coap_msg_ptr->options_list_ptr->use_request_tag) {
+            /* Delta is always extended, with two bytes if previous option is below 24 */
+            needed_space += 1;
+            if ((COAP_OPTION_REQUEST_TAG - previous_option_number) >= 269) {
+                needed_space += 1;
+            }
+        }
     }
 
     else {
@@ -607,18 +638,27 @@ static int8_t sn_coap_builder_options_build(uint8_t **dst_packet_data_pptr, sn_c
     }
 
     if (src_coap_msg_ptr->options_list_ptr != NULL) {
+        /* * * * Build Q-Block1 option * * * * */
+        if (src_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE &&
+                src_coap_msg_ptr->options_list_ptr->use_q_block1) {
+            sn_coap_builder_options_build_add_uint_option(dst_packet_data_pptr, src_coap_msg_ptr->options_list_ptr->block1,
+                         COAP_OPTION_Q_BLOCK1, &previous_option_number);
+        }
+
         /* * * * Build Location-Query option * * * */
         sn_coap_builder_options_build_add_multiple_option(dst_packet_data_pptr, &src_coap_msg_ptr->options_list_ptr->location_query_ptr,
                      &src_coap_msg_ptr->options_list_ptr->location_query_len, COAP_OPTION_LOCATION_QUERY, &previous_option_number);
 
         /* * * * Build Block2 option * * * * */
-        if (src_coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE) {
+        if (src_coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE &&
+                !src_coap_msg_ptr->options_list_ptr->use_q_block2) {
             sn_coap_builder_options_build_add_uint_option(dst_packet_data_pptr, src_coap_msg_ptr->options_list_ptr->block2,
                          COAP_OPTION_BLOCK2, &previous_option_number);
         }
 
         /* * * * Build Block1 option * * * * */
-        if (src_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE) {
+        if (src_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE &&
+                !src_coap_msg_ptr->options_list_ptr->use_q_block1) {
             sn_coap_builder_options_build_add_uint_option(dst_packet_data_pptr, src_coap_msg_ptr->options_list_ptr->block1,
                          COAP_OPTION_BLOCK1, &previous_option_number);
         }
@@ -629,6 +669,13 @@ static int8_t sn_coap_builder_options_build(uint8_t **dst_packet_data_pptr, sn_c
                          COAP_OPTION_SIZE2, &previous_option_number);
         }
 
+        /* * * * Build Q-Block2 option * * * * */
+        if (src_coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE &&
+                src_coap_msg_ptr->options_list_ptr->use_q_block2) {
+            sn_coap_builder_options_build_add_uint_option(dst_packet_data_pptr, src_coap_msg_ptr->options_list_ptr->block2,
+                         COAP_OPTION_Q_BLOCK2, &previous_option_number);
+        }
+
         /* * * * Build Proxy-Uri option * * * */
         sn_coap_builder_options_build_add_one_option(dst_packet_data_pptr, src_coap_msg_ptr->options_list_ptr->proxy_uri_len,
                      src_coap_msg_ptr->options_list_ptr->proxy_uri_ptr, COAP_OPTION_PROXY_URI, &previous_option_number);
@@ -639,6 +686,12 @@ static int8_t sn_coap_builder_options_build(uint8_t **dst_packet_data_pptr, sn_c
             sn_coap_builder_options_build_add_uint_option(dst_packet_data_pptr, src_coap_msg_ptr->options_list_ptr->size1,
                          COAP_OPTION_SIZE1, &previous_option_number);
         }
+
+        /* * * * Build Request-Tag option * * * */
+        if (src_coap_msg_ptr->options_list_ptr->use_request_tag) {
+            sn_coap_builder_options_build_add_one_option(dst_packet_data_pptr, src_coap_msg_ptr->options_list_ptr->request_tag_len,
+                         src_coap_msg_ptr->options_list_ptr->request_tag, COAP_OPTION_REQUEST_TAG, &previous_option_number);
+        }
     }
 
     /* Success */
@@ -697,7 +750,6 @@ static int16_t sn_coap_builder_options_build_add_one_option(uint8_t **dst_packet
             *(*dst_packet_data_pptr + 1) = (uint8_t)option_delta;
             *dst_packet_data_pptr += 2;
         }
-        //This is currently dead code (but possibly needed in future)
         else if (option_delta >= 269) {
             **dst_packet_data_pptr += 0xE0;
             option_delta -= 269;
@@ -250,7 +250,7 @@ static uint32_t sn_coap_parser_options_parse_uint(uint8_t **packet_data_pptr, ui
  */
 static int8_t sn_coap_parser_options_parse(struct coap_s *handle, uint8_t **packet_data_pptr, sn_coap_hdr_s *dst_coap_msg_ptr, uint8_t *packet_data_start_ptr, uint16_t packet_len)
 {
-    uint8_t previous_option_number = 0;
+    uint16_t previous_option_number = 0;
     uint8_t i                      = 0;
     int8_t  ret_status             = 0;
     uint16_t message_left          = 0;
@@ -332,9 +332,12 @@ static int8_t sn_coap_parser_options_parse(struct coap_s *handle, uint8_t **pack
             case COAP_OPTION_URI_QUERY:
             case COAP_OPTION_BLOCK2:
             case COAP_OPTION_BLOCK1:
+            case COAP_OPTION_Q_BLOCK2:
+            case COAP_OPTION_Q_BLOCK1:
             case COAP_OPTION_ACCEPT:
             case COAP_OPTION_SIZE1:
             case COAP_OPTION_SIZE2:
+            case COAP_OPTION_REQUEST_TAG:
                 if (sn_coap_parser_alloc_options(handle, dst_coap_msg_ptr) == NULL) {
                     return -1;
                 }
@@ -482,22 +485,28 @@ static int8_t sn_coap_parser_options_parse(struct coap_s *handle, uint8_t **pack
                 break;
 
             case COAP_OPTION_BLOCK2:
+            case COAP_OPTION_Q_BLOCK2:
+                /* Block2 and Q-Block2 must not be used together */
                 if ((option_len > 3) || dst_coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE) {
                     return -1;
                 }
                 (*packet_data_pptr)++;
 
                 dst_coap_msg_ptr->options_list_ptr->block2 = sn_coap_parser_options_parse_uint(packet_data_pptr, option_len);
+                dst_coap_msg_ptr->options_list_ptr->use_q_block2 = (option_number == COAP_OPTION_Q_BLOCK2);
 
                 break;
 
             case COAP_OPTION_BLOCK1:
+            case COAP_OPTION_Q_BLOCK1:
+                /* Block1 and Q-Block1 must not be used together */
                 if ((option_len > 3) || dst_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE) {
                     return -1;
                 }
                 (*packet_data_pptr)++;
 
                 dst_coap_msg_ptr->options_list_ptr->block1 = sn_coap_parser_options_parse_uint(packet_data_pptr, option_len);
+                dst_coap_msg_ptr->options_list_ptr->use_q_block1 = (option_number == COAP_OPTION_Q_BLOCK1);
 
                 break;
 
@@ -529,6 +538,19 @@ static int8_t sn_coap_parser_options_parse(struct coap_s *handle, uint8_t **pack
                 dst_coap_msg_ptr->options_list_ptr->size2 = sn_coap_parser_options_parse_uint(packet_data_pptr, option_len);
                 break;
 
+            case COAP_OPTION_REQUEST_TAG:
+                /* Only one Request-Tag is supported */
+                if ((option_len > 8) || dst_coap_msg_ptr->options_list_ptr->use_request_tag ||
+                        (*packet_data_pptr - packet_data_start_ptr) + 1 + option_len > packet_len) {
+                    return -1;
+                }
+                dst_coap_msg_ptr->options_list_ptr->use_request_tag = true;
+                dst_coap_msg_ptr->options_list_ptr->request_tag_len = option_len;
+                (*packet_data_pptr)++;
+                memcpy(dst_coap_msg_ptr->options_list_ptr->request_tag, *packet_data_pptr, option_len);
+                (*packet_data_pptr) += option_len;
+                break;
+
             default:
                 return -1;
         }
@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file sn_coap_peer_table.c
+ *
+ * \brief CoAP Peer table
+ *
+ * Functionality: Interns peer addresses to compact peer IDs. Peers are indexed
+ * by a chained hash table and unreferenced peers are kept in LRU order for
+ * idle timeout and replacement.
+ *
+ */
+
+/* * * * INCLUDE FILES * * * */
+#include <string.h> /* For memset() and memcpy() */
+
+#include "ns_types.h"
+#include "sn_coap_peer_table_internal.h"
+
+/* * * * * * * * * * * * * * * * * * * * */
+/* * * * LOCAL FUNCTION PROTOTYPES * * * */
+/* * * * * * * * * * * * * * * * * * * * */
+
+static sn_coap_peer_s   *sn_coap_peer_table_peer(const sn_coap_peer_table_s *table, uint32_t peer_id);
+static uint32_t         *sn_coap_peer_table_bucket(const sn_coap_peer_table_s *table, const sn_nsdl_addr_s *addr_ptr);
+static uint32_t          sn_coap_peer_table_hash(const sn_nsdl_addr_s *addr_ptr);
+static int8_t            sn_coap_peer_table_alloc_index(sn_coap_peer_table_s *table, uint32_t max_peers);
+static void              sn_coap_peer_table_free_index(sn_coap_peer_table_s *table, sn_coap_peer_s **chunks, uint32_t **buckets, uint32_t bucket_count);
+static void              sn_coap_peer_table_remove(sn_coap_peer_table_s *table, uint32_t peer_id);
+static void              sn_coap_peer_table_lru_append(sn_coap_peer_table_s *table, uint32_t peer_id);
+static void              sn_coap_peer_table_lru_unlink(sn_coap_peer_table_s *table, uint32_t peer_id);
+
+void sn_coap_peer_table_init(sn_coap_peer_table_s *table, void *(*used_malloc_func_ptr)(uint16_t),
+                             void (*used_free_func_ptr)(void *), uint32_t max_peers, uint32_t idle_timeout)
+{
+    memset(table, 0, sizeof(sn_coap_peer_table_s));
+    table->sn_coap_peer_table_malloc = used_malloc_func_ptr;
+    table->sn_coap_peer_table_free = used_free_func_ptr;
+    table->max_peers = max_peers;
+    table->idle_timeout = idle_timeout;
+}
+
+int8_t sn_coap_peer_table_set_size(sn_coap_peer_table_s *table, uint32_t max_peers, uint32_t idle_timeout)
+{
+    if (max_peers < table->slot_count) {
+        return -1;
+    }
+
+    /* Index is re-allocated only if it is already in use */
+    if (table->chunks && sn_coap_peer_table_alloc_index(table, max_peers) != 0) {
+        return -1;
+    }
+
+    table->max_peers = max_peers;
+    table->idle_timeout = idle_timeout;
+    return 0;
+}
+
+void sn_coap_peer_table_destroy(sn_coap_peer_table_s *table)
+{
+    sn_coap_peer_table_free_index(table, table->chunks, table->buckets, table->bucket_count);
+
+    table->chunks = NULL;
+    table->buckets = NULL;
+    table->bucket_count = 0;
+    table->slot_count = 0;
+    table->peer_count = 0;
+    table->free_list = 0;
+    table->lru_head = 0;
+    table->lru_tail = 0;
+}
+
+uint32_t sn_coap_peer_table_find(const sn_coap_peer_table_s *table, const sn_nsdl_addr_s *addr_ptr)
+{
+    uint32_t peer_id;
+
+    if (table->chunks == NULL || addr_ptr->addr_len > SN_COAP_PEER_MAX_ADDR_LEN) {
+        return 0;
+    }
+
+    for (peer_id = *sn_coap_peer_table_bucket(table, addr_ptr); peer_id; ) {
+        const sn_coap_peer_s *peer_ptr = sn_coap_peer_table_peer(table, peer_id);
+
+        if (peer_ptr->addr.port == addr_ptr->port && peer_ptr->addr.addr_len == addr_ptr->addr_len &&
+                peer_ptr->addr.type == addr_ptr->type &&
+                0 == memcmp(peer_ptr->addr_data, addr_ptr->addr_ptr, addr_ptr->addr_len)) {
+            return peer_id;
+        }
+        peer_id = peer_ptr->hash_next;
+    }
+
+    return 0;
+}
+
+uint32_t sn_coap_peer_table_intern(sn_coap_peer_table_s *table, const sn_nsdl_addr_s *addr_ptr, uint32_t current_time)
+{
+    sn_coap_peer_s *peer_ptr;
+    uint32_t *bucket_ptr;
+    uint32_t peer_id;
+
+    if (addr_ptr->addr_len > SN_COAP_PEER_MAX_ADDR_LEN || (addr_ptr->addr_len && addr_ptr->addr_ptr == NULL)) {
+        return 0;
+    }
+
+    if (table->chunks == NULL && sn_coap_peer_table_alloc_index(table, table->max_peers) != 0) {
+        return 0;
+    }
+
+    /* * * * Known peer * * * */
+    peer_id = sn_coap_peer_table_find(table, addr_ptr);
+    if (peer_id) {
+        peer_ptr = sn_coap_peer_table_peer(table, peer_id);
+        peer_ptr->last_used = current_time;
+        if (peer_ptr->ref_count == 0) {
+            sn_coap_peer_table_lru_unlink(table, peer_id);
+            sn_coap_peer_table_lru_append(table, peer_id);
+        }
+        return peer_id;
+    }
+
+    /* * * * New peer, replace least recently used one if table is full * * * */
+    if (table->peer_count >= table->max_peers) {
+        if (table->lru_head == 0) {
+            return 0;
+        }
+        sn_coap_peer_table_remove(table, table->lru_head);
+    }
+
+    if (table->free_list) {
+        peer_id = table->free_list;
+        table->free_list = sn_coap_peer_table_peer(table, peer_id)->hash_next;
+    } else {
+        sn_coap_peer_s **chunk_ptr = &table->chunks[table->slot_count / SN_COAP_PEER_CHUNK_SIZE];
+
+        if (*chunk_ptr == NULL) {
+            *chunk_ptr = table->sn_coap_peer_table_malloc(SN_COAP_PEER_CHUNK_SIZE * sizeof(sn_coap_peer_s));
+            if (*chunk_ptr == NULL) {
+                return 0;
+            }
+        }
+        peer_id = ++table->slot_count;
+    }
+
+    /* * * * Fill peer and add it to index * * * */
+    peer_ptr = sn_coap_peer_table_peer(table, peer_id);
+    memset(peer_ptr, 0, sizeof(sn_coap_peer_s));
+    peer_ptr->addr.type = addr_ptr->type;
+    peer_ptr->addr.port = addr_ptr->port;
+    peer_ptr->addr.addr_len = addr_ptr->addr_len;
+    peer_ptr->addr.addr_ptr = peer_ptr->addr_data;
+    memcpy(peer_ptr->addr_data, addr_ptr->addr_ptr, addr_ptr->addr_len);
+    peer_ptr->last_used = current_time;
+
+    bucket_ptr = sn_coap_peer_table_bucket(table, addr_ptr);
+    peer_ptr->hash_next = *bucket_ptr;
+    *bucket_ptr = peer_id;
+    sn_coap_peer_table_lru_append(table, peer_id);
+    ++table->peer_count;
+
+    return peer_id;
+}
+
+sn_nsdl_addr_s *sn_coap_peer_table_get_addr(const sn_coap_peer_table_s *table, uint32_t peer_id)
+{
+    return &sn_coap_peer_table_peer(table, peer_id)->addr;
+}
+
+sn_coap_peer_s *sn_coap_peer_table_get_peer(const sn_coap_peer_table_s *table, uint32_t peer_id)
+{
+    return sn_coap_peer_table_peer(table, peer_id);
+}
+
+void sn_coap_peer_table_ref(sn_coap_peer_table_s *table, uint32_t peer_id)
+{
+    sn_coap_peer_s *peer_ptr = sn_coap_peer_table_peer(table, peer_id);
+
+    if (peer_ptr->ref_count++ == 0) {
+        sn_coap_peer_table_lru_unlink(table, peer_id);
+    }
+}
+
+void sn_coap_peer_table_unref(sn_coap_peer_table_s *table, uint32_t peer_id, uint32_t current_time)
+{
+    sn_coap_peer_s *peer_ptr = sn_coap_peer_table_peer(table, peer_id);
+
+    if (peer_ptr->ref_count && --peer_ptr->ref_count == 0) {
+        peer_ptr->last_used = current_time;
+        sn_coap_peer_table_lru_append(table, peer_id);
+    }
+}
+
+void sn_coap_peer_table_remove_idle(sn_coap_peer_table_s *table, uint32_t current_time)
+{
+    if (table->idle_timeout == 0) {
+        return;
+    }
+
+    /* LRU list is in order of last use, so only its head needs to be checked */
+    while (table->lru_head &&
+            (current_time - sn_coap_peer_table_peer(table, table->lru_head)->last_used) > table->idle_timeout) {
+        sn_coap_peer_table_remove(table, table->lru_head);
+    }
+}
+
+/**************************************************************************//**
+ * \fn static sn_coap_peer_s *sn_coap_peer_table_peer(const sn_coap_peer_table_s *table, uint32_t peer_id)
+ *
+ * \brief Returns peer slot of given ID
+ *****************************************************************************/
+
+static sn_coap_peer_s *sn_coap_peer_table_peer(const sn_coap_peer_table_s *table, uint32_t peer_id)
+{
+    uint32_t index = peer_id - 1;
+
+    return &table->chunks[index / SN_COAP_PEER_CHUNK_SIZE][index % SN_COAP_PEER_CHUNK_SIZE];
+}
+
+/**************************************************************************//**
+ * \fn static uint32_t *sn_coap_peer_table_bucket(const sn_coap_peer_table_s *table, const sn_nsdl_addr_s *addr_ptr)
+ *
+ * \brief Returns hash bucket of given address
+ *****************************************************************************/
+
+static uint32_t *sn_coap_peer_table_bucket(const sn_coap_peer_table_s *table, const sn_nsdl_addr_s *addr_ptr)
+{
+    uint32_t bucket = sn_coap_peer_table_hash(addr_ptr) & (table->bucket_count - 1);
+
+    return &table->buckets[bucket / SN_COAP_PEER_BUCKET_CHUNK_SIZE][bucket % SN_COAP_PEER_BUCKET_CHUNK_SIZE];
+}
+
+/**************************************************************************//**
+ * \fn static uint32_t sn_coap_peer_table_hash(const sn_nsdl_addr_s *addr_ptr)
+ *
+ * \brief Calculates FNV-1a hash of address type, address and port
+ *****************************************************************************/
+
+static uint32_t sn_coap_peer_table_hash(const sn_nsdl_addr_s *addr_ptr)
+{
+    uint32_t hash = 2166136261u;
+    uint8_t i;
+
+    hash = (hash ^ (uint8_t)addr_ptr->type) * 16777619u;
+    for (i = 0; i < addr_ptr->addr_len; i++) {
+        hash = (hash ^ addr_ptr->addr_ptr[i]) * 16777619u;
+    }
+    hash = (hash ^ (addr_ptr->port & 0xff)) * 16777619u;
+    hash = (hash ^ (addr_ptr->port >> 8)) * 16777619u;
+
+    return hash;
+}
+
+/**************************************************************************//**
+ * \fn static int8_t sn_coap_peer_table_alloc_index(sn_coap_peer_table_s *table, uint32_t max_peers)
+ *
+ * \brief Allocates chunk pointers and hash buckets for given count of peers.
+ *        Allocated peer chunks are moved and stored peers are hashed to new buckets.
+ *
+ * \return 0 on success, -1 if max_peers is too big or out of memory
+ *****************************************************************************/
+
+static int8_t sn_coap_peer_table_alloc_index(sn_coap_peer_table_s *table, uint32_t max_peers)
+{
+    sn_coap_peer_s **old_chunks = table->chunks;
+    uint32_t **old_buckets = table->buckets;
+    uint32_t old_bucket_count = table->bucket_count;
+    uint32_t chunk_count = (max_peers + SN_COAP_PEER_CHUNK_SIZE - 1) / SN_COAP_PEER_CHUNK_SIZE;
+    uint32_t used_chunk_count = (table->slot_count + SN_COAP_PEER_CHUNK_SIZE - 1) / SN_COAP_PEER_CHUNK_SIZE;
+    uint32_t bucket_count = 16;
+    uint32_t bucket_chunk_count;
+    uint32_t bucket_chunk_size;
+    uint32_t i;
+
+    if (max_peers == 0 || chunk_count > UINT16_MAX / sizeof(sn_coap_peer_s *)) {
+        return -1;
+    }
+
+    /* Keep average bucket length at most one */
+    while (bucket_count < max_peers) {
+        bucket_count <<= 1;
+    }
+    bucket_chunk_size = bucket_count < SN_COAP_PEER_BUCKET_CHUNK_SIZE ? bucket_count : SN_COAP_PEER_BUCKET_CHUNK_SIZE;
+    bucket_chunk_count = bucket_count / bucket_chunk_size;
+    if (bucket_chunk_count > UINT16_MAX / sizeof(uint32_t *)) {
+        return -1;
+    }
+
+    /* * * * Allocate new index * * * */
+    table->chunks = table->sn_coap_peer_table_malloc(chunk_count * sizeof(sn_coap_peer_s *));
+    table->buckets = table->sn_coap_peer_table_malloc(bucket_chunk_count * sizeof(uint32_t *));
+    if (table->chunks == NULL || table->buckets == NULL) {
+        table->sn_coap_peer_table_free(table->chunks);
+        table->sn_coap_peer_table_free(table->buckets);
+        table->chunks = old_chunks;
+        table->buckets = old_buckets;
+        return -1;
+    }
+    memset(table->chunks, 0, chunk_count * sizeof(sn_coap_peer_s *));
+    memset(table->buckets, 0, bucket_chunk_count * sizeof(uint32_t *));
+    for (i = 0; i < bucket_chunk_count; i++) {
+        table->buckets[i] = table->sn_coap_peer_table_malloc(bucket_chunk_size * sizeof(uint32_t));
+        if (table->buckets[i] == NULL) {
+            sn_coap_peer_table_free_index(table, NULL, table->buckets, i * bucket_chunk_size);
+            table->sn_coap_peer_table_free(table->chunks);
+            table->chunks = old_chunks;
+            table->buckets = old_buckets;
+            return -1;
+        }
+        memset(table->buckets[i], 0, bucket_chunk_size * sizeof(uint32_t));
+    }
+    table->bucket_count = bucket_count;
+
+    /* * * * Move peer chunks and hash stored peers to new buckets * * * */
+    if (old_chunks) {
+        memcpy(table->chunks, old_chunks, used_chunk_count * sizeof(sn_coap_peer_s *));
+        for (i = 1; i <= table->slot_count; i++) {
+            sn_coap_peer_s *peer_ptr = sn_coap_peer_table_peer(table, i);
+
+            if (peer_ptr->addr.addr_ptr) {
+                uint32_t *bucket_ptr = sn_coap_peer_table_bucket(table, &peer_ptr->addr);
+                peer_ptr->hash_next = *bucket_ptr;
+                *bucket_ptr = i;
+            }
+        }
+        table->sn_coap_peer_table_free(old_chunks);
+        sn_coap_peer_table_free_index(table, NULL, old_buckets, old_bucket_count);
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_peer_table_free_index(sn_coap_peer_table_s *table, sn_coap_peer_s **chunks, uint32_t **buckets, uint32_t bucket_count)
+ *
+ * \brief Releases peer chunks and hash buckets
+ *
+ * \param **chunks is array of peer chunks to be released with its chunks, or NULL
+ * \param **buckets is array of bucket chunks to be released with its chunks, or NULL
+ * \param bucket_count is count of allocated buckets in bucket chunks
+ *****************************************************************************/
+
+static void sn_coap_peer_table_free_index(sn_coap_peer_table_s *table, sn_coap_peer_s **chunks, uint32_t **buckets, uint32_t bucket_count)
+{
+    uint32_t i;
+
+    if (chunks) {
+        for (i = 0; i < (table->slot_count + SN_COAP_PEER_CHUNK_SIZE - 1) / SN_COAP_PEER_CHUNK_SIZE; i++) {
+            table->sn_coap_peer_table_free(chunks[i]);
+        }
+        table->sn_coap_peer_table_free(chunks);
+    }
+    if (buckets) {
+        for (i = 0; i < (bucket_count + SN_COAP_PEER_BUCKET_CHUNK_SIZE - 1) / SN_COAP_PEER_BUCKET_CHUNK_SIZE; i++) {
+            table->sn_coap_peer_table_free(buckets[i]);
+        }
+        table->sn_coap_peer_table_free(buckets);
+    }
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_peer_table_remove(sn_coap_peer_table_s *table, uint32_t peer_id)
+ *
+ * \brief Removes unreferenced peer from table and releases its slot
+ *****************************************************************************/
+
+static void sn_coap_peer_table_remove(sn_coap_peer_table_s *table, uint32_t peer_id)
+{
+    sn_coap_peer_s *peer_ptr = sn_coap_peer_table_peer(table, peer_id);
+    uint32_t *next_ptr = sn_coap_peer_table_bucket(table, &peer_ptr->addr);
+
+    /* Unlink from bucket chain */
+    while (*next_ptr != peer_id) {
+        next_ptr = &sn_coap_peer_table_peer(table, *next_ptr)->hash_next;
+    }
+    *next_ptr = peer_ptr->hash_next;
+
+    sn_coap_peer_table_lru_unlink(table, peer_id);
+
+    /* Release slot */
+    peer_ptr->addr.addr_ptr = NULL;
+    peer_ptr->hash_next = table->free_list;
+    table->free_list = peer_id;
+    --table->peer_count;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_peer_table_lru_append(sn_coap_peer_table_s *table, uint32_t peer_id)
+ *
+ * \brief Adds peer to the most recently used end of LRU list
+ *****************************************************************************/
+
+static void sn_coap_peer_table_lru_append(sn_coap_peer_table_s *table, uint32_t peer_id)
+{
+    sn_coap_peer_s *peer_ptr = sn_coap_peer_table_peer(table, peer_id);
+
+    peer_ptr->lru_prev = table->lru_tail;
+    peer_ptr->lru_next = 0;
+    if (table->lru_tail) {
+        sn_coap_peer_table_peer(table, table->lru_tail)->lru_next = peer_id;
+    } else {
+        table->lru_head = peer_id;
+    }
+    table->lru_tail = peer_id;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_peer_table_lru_unlink(sn_coap_peer_table_s *table, uint32_t peer_id)
+ *
+ * \brief Removes peer from LRU list
+ *****************************************************************************/
+
+static void sn_coap_peer_table_lru_unlink(sn_coap_peer_table_s *table, uint32_t peer_id)
+{
+    sn_coap_peer_s *peer_ptr = sn_coap_peer_table_peer(table, peer_id);
+
+    if (peer_ptr->lru_prev) {
+        sn_coap_peer_table_peer(table, peer_ptr->lru_prev)->lru_next = peer_ptr->lru_next;
+    } else {
+        table->lru_head = peer_ptr->lru_next;
+    }
+    if (peer_ptr->lru_next) {
+        sn_coap_peer_table_peer(table, peer_ptr->lru_next)->lru_prev = peer_ptr->lru_prev;
+    } else {
+        table->lru_tail = peer_ptr->lru_prev;
+    }
+    peer_ptr->lru_prev = 0;
+    peer_ptr->lru_next = 0;
+}
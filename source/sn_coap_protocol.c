@@ -43,42 +43,152 @@
 #include "mbed-trace/mbed_trace.h"
 
 #define TRACE_GROUP "coap"
+
+/* Packets collected for batch TX callback, with copies of packets and addresses */
+typedef struct coap_tx_batch_ {
+    sn_coap_tx_entry_s  entries[SN_COAP_TX_BATCH_SIZE];
+    sn_nsdl_addr_s      addrs[SN_COAP_TX_BATCH_SIZE];
+    uint8_t             addr_data[SN_COAP_TX_BATCH_SIZE][SN_COAP_TX_BATCH_MAX_ADDR_LEN];
+    uint8_t             count;          /* Count of collected packets */
+    uint8_t             depth;          /* Nesting of calls collecting packets, 0 if packets are sent at once */
+} coap_tx_batch_s;
+
 /* * * * * * * * * * * * * * * * * * * * */
 /* * * * LOCAL FUNCTION PROTOTYPES * * * */
 /* * * * * * * * * * * * * * * * * * * * */
 
 static void                  sn_coap_protocol_send_rst(struct coap_s *handle, uint16_t msg_id, sn_nsdl_addr_s *addr_ptr, void *param);
+static void                  sn_coap_protocol_tx(struct coap_s *handle, uint8_t *packet_ptr, uint16_t packet_len, sn_nsdl_addr_s *dst_addr_ptr, void *param);
+static void                  sn_coap_protocol_tx_batch_begin(struct coap_s *handle);
+static void                  sn_coap_protocol_tx_batch_end(struct coap_s *handle);
+static void                  sn_coap_protocol_tx_batch_flush(struct coap_s *handle);
 #if SN_COAP_DUPLICATION_MAX_MSGS_COUNT/* If Message duplication detection is not used at all, this part of code will not be compiled */
+#if SN_COAP_SERVER_PROFILE
+static void                **sn_coap_protocol_duplication_chunks_alloc(struct coap_s *handle, uint32_t count, uint16_t element_size);
+static void                  sn_coap_protocol_duplication_chunks_free(struct coap_s *handle, void **chunks, uint32_t count);
+static coap_duplication_entry_s *sn_coap_protocol_duplication_entry(struct coap_s *handle, uint32_t position);
+static uint32_t             *sn_coap_protocol_duplication_slot(struct coap_s *handle, uint32_t slot);
+static coap_duplication_response_s **sn_coap_protocol_duplication_response(struct coap_s *handle, uint32_t position);
+static int8_t                sn_coap_protocol_duplication_cache_alloc(struct coap_s *handle, uint32_t capacity);
+static void                  sn_coap_protocol_duplication_cache_store(struct coap_s *handle, uint32_t peer_id, uint16_t msg_id);
+static int32_t               sn_coap_protocol_duplication_cache_search(struct coap_s *handle, uint32_t peer_id, uint16_t msg_id);
+static void                  sn_coap_protocol_duplication_cache_remove_oldest(struct coap_s *handle);
+static void                  sn_coap_protocol_duplication_cache_remove_old_ones(struct coap_s *handle);
+#else
 static void                  sn_coap_protocol_linked_list_duplication_info_store(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id);
-static int8_t                sn_coap_protocol_linked_list_duplication_info_search(struct coap_s *handle, sn_nsdl_addr_s *scr_addr_ptr, uint16_t msg_id);
+static coap_duplication_info_s *sn_coap_protocol_linked_list_duplication_info_search(struct coap_s *handle, sn_nsdl_addr_s *scr_addr_ptr, uint16_t msg_id);
 static void                  sn_coap_protocol_linked_list_duplication_info_remove(struct coap_s *handle, uint8_t *scr_addr_ptr, uint16_t port, uint16_t msg_id);
 static void                  sn_coap_protocol_linked_list_duplication_info_remove_old_ones(struct coap_s *handle);
 #endif
+static coap_duplication_response_s **sn_coap_protocol_duplication_response_find(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, uint16_t msg_id);
+static void                  sn_coap_protocol_duplication_response_store(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, uint16_t msg_id, uint8_t *packet_ptr, uint16_t packet_len);
+static void                  sn_coap_protocol_duplication_response_reserve(struct coap_s *handle, uint32_t packet_len);
+static void                  sn_coap_protocol_duplication_response_free(struct coap_s *handle, coap_duplication_response_s **response_ptr);
+#endif
 #if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
+static int8_t                sn_coap_protocol_linked_list_blockwise_msg_add(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, coap_blockwise_msg_s *stored_msg_ptr);
+static coap_blockwise_msg_s *sn_coap_protocol_linked_list_blockwise_msg_find(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr);
+static void                  sn_coap_protocol_linked_list_blockwise_request_store(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *request_ptr);
+static coap_blockwise_msg_s *sn_coap_protocol_linked_list_blockwise_request_find(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr);
+static void                  sn_coap_protocol_blockwise_request_release(struct coap_s *handle, sn_coap_hdr_s *request_ptr);
 static void                  sn_coap_protocol_linked_list_blockwise_msg_remove(struct coap_s *handle, coap_blockwise_msg_s *removed_msg_ptr);
-static void                  sn_coap_protocol_linked_list_blockwise_payload_store(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, uint16_t stored_payload_len, uint8_t *stored_payload_ptr);
-static uint8_t              *sn_coap_protocol_linked_list_blockwise_payload_search(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t *payload_length);
+static void                  sn_coap_protocol_linked_list_blockwise_payload_store(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr, uint32_t block_offset, uint32_t size_hint);
+static coap_blockwise_payload_s *sn_coap_protocol_linked_list_blockwise_payload_alloc(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr);
+static coap_blockwise_payload_s *sn_coap_protocol_linked_list_blockwise_payload_find(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr);
+#if SN_COAP_BLOCKWISE_REASSEMBLY
+static void                  sn_coap_protocol_linked_list_blockwise_payload_write(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr, uint32_t block_offset, uint32_t size_hint);
+#else
+static uint32_t              sn_coap_protocol_linked_list_blockwise_payloads_get_len(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *coap_msg_ptr);
+#endif
+static int8_t                sn_coap_protocol_linked_list_blockwise_payload_take(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *coap_msg_ptr, uint8_t **payload_pptr, uint16_t *payload_len);
 static void                  sn_coap_protocol_linked_list_blockwise_payload_remove(struct coap_s *handle, coap_blockwise_payload_s *removed_payload_ptr);
-static void                  sn_coap_protocol_linked_list_blockwise_payload_remove_oldest(struct coap_s *handle);
-static uint32_t              sn_coap_protocol_linked_list_blockwise_payloads_get_len(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr);
 static void                  sn_coap_protocol_linked_list_blockwise_remove_old_data(struct coap_s *handle);
+static uint32_t              sn_coap_protocol_blockwise_payload_source(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr);
+static bool                  sn_coap_protocol_blockwise_payload_from(const coap_blockwise_payload_s *payload_ptr, const sn_nsdl_addr_s *addr_ptr, uint32_t peer_id, const sn_coap_hdr_s *coap_msg_ptr);
+static uint8_t               sn_coap_protocol_request_tag_len(const sn_coap_hdr_s *coap_msg_ptr);
+static bool                  sn_coap_protocol_request_tag_match(const coap_blockwise_payload_s *payload_ptr, const sn_coap_hdr_s *coap_msg_ptr);
+#if SN_COAP_SERVER_PROFILE
+static uint32_t              sn_coap_protocol_blockwise_hash(uint32_t peer_id, const uint8_t *token_ptr, uint8_t token_len);
+static uint8_t               sn_coap_protocol_blockwise_token_len(const sn_coap_hdr_s *coap_msg_ptr);
+static bool                  sn_coap_protocol_blockwise_token_match(const uint8_t *token_ptr, uint8_t token_len, const sn_coap_hdr_s *coap_msg_ptr);
+static uint32_t              sn_coap_protocol_blockwise_session_hash(uint32_t peer_id, uint8_t request_tag_len, const uint8_t *request_tag_ptr, uint8_t token_len, const uint8_t *token_ptr);
+static void                  sn_coap_protocol_blockwise_payload_index(struct coap_s *handle, coap_blockwise_payload_s *payload_ptr);
+static void                  sn_coap_protocol_blockwise_payload_unindex(struct coap_s *handle, coap_blockwise_payload_s *payload_ptr);
+static bool                  sn_coap_protocol_blockwise_payload_same_session(const coap_blockwise_payload_s *payload_ptr, const coap_blockwise_payload_s *other_ptr);
+static uint32_t              sn_coap_protocol_blockwise_payload_end(struct coap_s *handle, const coap_blockwise_payload_s *payload_ptr);
+static int8_t                sn_coap_protocol_block1_session_continue(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *received_coap_msg_ptr);
+#endif
+static uint8_t              *sn_coap_protocol_blockwise_msg_payload(struct coap_s *handle, coap_blockwise_msg_s *msg_ptr, uint32_t offset, uint16_t length);
+static uint32_t             sn_coap_protocol_payload_total_len(struct coap_s *handle, const sn_coap_hdr_s *coap_msg_ptr);
+static int8_t                sn_coap_protocol_block_sink_deliver(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *received_coap_msg_ptr, uint32_t block_option, uint32_t total_size, void *param);
 static sn_coap_hdr_s        *sn_coap_handle_blockwise_message(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *received_coap_msg_ptr, void *param);
+#if SN_COAP_Q_BLOCK_MAX_PAYLOADS
+static int8_t                sn_coap_protocol_q_block1_send(struct coap_s *handle, coap_blockwise_msg_s *msg_ptr, sn_nsdl_addr_s *dst_addr_ptr, uint32_t block_number, void *param);
+static coap_blockwise_msg_s *sn_coap_protocol_q_block1_msg_find(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *received_coap_msg_ptr);
+static sn_coap_hdr_s        *sn_coap_protocol_q_block1_continue(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *received_coap_msg_ptr, coap_blockwise_msg_s *msg_ptr, void *param);
+static int8_t                sn_coap_protocol_cbor_uint_parse(const uint8_t **data_pptr, const uint8_t *end_ptr, uint32_t *value_ptr);
+#if SN_COAP_BLOCKWISE_REASSEMBLY
+static uint8_t               sn_coap_protocol_cbor_uint_build(uint8_t *dst_ptr, uint32_t value);
+static sn_coap_hdr_s        *sn_coap_protocol_q_block1_receive(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *received_coap_msg_ptr, void *param);
+static void                  sn_coap_protocol_q_block1_respond(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, const sn_coap_hdr_s *request_ptr, sn_coap_msg_code_e msg_code, int32_t block1, uint8_t *payload_ptr, uint16_t payload_len, void *param);
+static int8_t                sn_coap_protocol_q_block_mark(struct coap_s *handle, coap_blockwise_payload_s *payload_ptr, uint32_t block_number);
+static uint32_t              sn_coap_protocol_q_block_missing(const coap_blockwise_payload_s *payload_ptr, uint32_t block_end, uint8_t *list_ptr, uint16_t *list_len, uint32_t *last_missing_ptr);
+#endif
+#endif
 static int8_t                sn_coap_convert_block_size(uint16_t block_size);
+static int8_t                sn_coap_protocol_prepare_blockwise(struct coap_s *handle, sn_coap_hdr_s *src_coap_msg_ptr, uint16_t block_size);
+static uint16_t              sn_coap_protocol_block_size_limit(struct coap_s *handle);
+static uint16_t              sn_coap_protocol_block_size_get(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr);
+static uint16_t              sn_coap_protocol_block_size_select(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, sn_coap_hdr_s *coap_msg_ptr);
+static int8_t                sn_coap_protocol_stateless_block2_select(struct coap_s *handle, sn_coap_hdr_s *coap_msg_ptr, uint32_t payload_total_len, uint16_t *block_size_ptr, uint32_t *block_offset_ptr);
+#if SN_COAP_SERVER_PROFILE
+static void                  sn_coap_protocol_peer_block_size_update(struct coap_s *handle, uint32_t peer_id, uint16_t sent_block_size, uint16_t acked_block_size);
+#if SN_COAP_BLOCK_SIZE_TUNING
+static void                  sn_coap_protocol_peer_block_loss_update(sn_coap_peer_s *peer_ptr, uint16_t limit, bool lost);
+#endif
+#endif
 static sn_coap_hdr_s        *sn_coap_protocol_copy_header(struct coap_s *handle, sn_coap_hdr_s *source_header_ptr);
 #endif
+#if SN_COAP_OBSERVE_MAX_OBSERVERS
+static coap_observe_resource_s *sn_coap_protocol_observe_resource_find(struct coap_s *handle, const uint8_t *uri_path_ptr, uint16_t uri_path_len);
+static bool                  sn_coap_protocol_observer_addr_match(struct coap_s *handle, const coap_observer_s *observer_ptr, const sn_nsdl_addr_s *addr_ptr);
+static sn_nsdl_addr_s       *sn_coap_protocol_observer_addr(struct coap_s *handle, coap_observer_s *observer_ptr);
+static void                  sn_coap_protocol_observer_remove(struct coap_s *handle, coap_observe_resource_s *resource_ptr, coap_observer_s *observer_ptr);
+static void                  sn_coap_protocol_observer_reset(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id);
+static int32_t               sn_coap_protocol_observe_send(struct coap_s *handle, coap_observe_resource_s *resource_ptr, const sn_coap_hdr_s *notification_ptr, void *param);
+static int32_t               sn_coap_protocol_observe_send_value(struct coap_s *handle, coap_observe_resource_s *resource_ptr, bool forced);
+static void                  sn_coap_protocol_observe_schedule(struct coap_s *handle);
+#endif
+#if SN_COAP_CLIENT_MAX_EXCHANGES
+static coap_exchange_s      *sn_coap_protocol_exchange_find(struct coap_s *handle, uint32_t token);
+static bool                  sn_coap_protocol_exchange_addr_match(struct coap_s *handle, const coap_exchange_s *exchange_ptr, const sn_nsdl_addr_s *addr_ptr);
+static void                  sn_coap_protocol_exchange_unlink(struct coap_s *handle, coap_exchange_s *exchange_ptr);
+static void                  sn_coap_protocol_exchange_release(struct coap_s *handle, coap_exchange_s *exchange_ptr);
+static void                  sn_coap_protocol_exchange_complete(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *coap_msg_ptr);
+static void                  sn_coap_protocol_exchange_remove_old_ones(struct coap_s *handle);
+#if ENABLE_RESENDINGS
+static void                  sn_coap_protocol_exchange_send_failed(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, uint16_t msg_id);
+#endif
+#endif
 #if ENABLE_RESENDINGS
-static void                  sn_coap_protocol_linked_list_send_msg_store(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, uint16_t send_packet_data_len, uint8_t *send_packet_data_ptr, uint32_t sending_time, void *param, uint8_t *uri_path_ptr, uint8_t uri_path_len);
+static void                  sn_coap_protocol_linked_list_send_msg_store(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, uint16_t send_packet_data_len, uint8_t *send_packet_data_ptr, uint32_t sending_time, void *param, const sn_coap_hdr_s *coap_msg_ptr, uint8_t *uri_path_ptr, uint8_t uri_path_len);
 static sn_nsdl_transmit_s   *sn_coap_protocol_linked_list_send_msg_search(struct coap_s *handle,sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id);
+static coap_send_msg_s      *sn_coap_protocol_linked_list_send_msg_find(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id);
 static void                  sn_coap_protocol_linked_list_send_msg_remove(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id);
 static coap_send_msg_s      *sn_coap_protocol_allocate_mem_for_msg(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, uint16_t packet_data_len);
 static void                  sn_coap_protocol_release_allocated_send_msg_mem(struct coap_s *handle, coap_send_msg_s *freed_send_msg_ptr);
-static uint16_t              sn_coap_count_linked_list_size(const coap_send_msg_list_t *linked_list_ptr);
+static void                  sn_coap_protocol_linked_list_send_msg_unlink(struct coap_s *handle, coap_send_msg_s *unlinked_msg_ptr);
+static void                  sn_coap_protocol_send_failures_flush(struct coap_s *handle, sn_coap_send_failure_s *failures, uint8_t failure_count, coap_send_msg_list_t *failed_msgs);
 #endif
 
-/* * * * * * * * * * * * * * * * * */
-/* * * * GLOBAL DECLARATIONS * * * */
-/* * * * * * * * * * * * * * * * * */
-static uint16_t message_id;
+static sn_coap_hdr_s        *sn_coap_protocol_parse_message(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *returned_dst_coap_msg_ptr, coap_version_e coap_version, void *param);
+#if SN_COAP_INGRESS_QUEUE_MAX_SIZE
+static bool                  sn_coap_protocol_ingress_take(struct coap_s *handle, coap_ingress_slot_s *taken_ptr);
+#endif
+#if SN_COAP_EGRESS_QUEUE_MAX_SIZE
+static bool                  sn_coap_protocol_egress_take(struct coap_s *handle, coap_egress_slot_s *taken_ptr);
+static void                  sn_coap_protocol_egress_send(struct coap_s *handle, coap_egress_slot_s *taken_ptr);
+#endif
 
 int8_t sn_coap_protocol_destroy(struct coap_s *handle)
 {
@@ -88,16 +198,24 @@ int8_t sn_coap_protocol_destroy(struct coap_s *handle)
 #if ENABLE_RESENDINGS /* If Message resending is not used at all, this part of code will not be compiled */
 
     sn_coap_protocol_clear_retransmission_buffer(handle);
+#if SN_COAP_SERVER_PROFILE
+    handle->sn_coap_protocol_free(handle->resent_msgs_hash);
+    handle->resent_msgs_hash = 0;
+#endif
 
 #endif
 
 #if SN_COAP_DUPLICATION_MAX_MSGS_COUNT /* If Message duplication detection is not used at all, this part of code will not be compiled */
+#if SN_COAP_SERVER_PROFILE
+    sn_coap_protocol_duplication_cache_alloc(handle, 0);
+#else
     ns_list_foreach_safe(coap_duplication_info_s, tmp, &handle->linked_list_duplication_msgs) {
         if (tmp->coap == handle) {
             if (tmp->addr_ptr) {
                 handle->sn_coap_protocol_free(tmp->addr_ptr);
                 tmp->addr_ptr = 0;
             }
+            sn_coap_protocol_duplication_response_free(handle, &tmp->response_ptr);
             ns_list_remove(&handle->linked_list_duplication_msgs, tmp);
             handle->count_duplication_msgs--;
             handle->sn_coap_protocol_free(tmp);
@@ -105,8 +223,15 @@ int8_t sn_coap_protocol_destroy(struct coap_s *handle)
         }
     }
 #endif
+#endif
 
 #if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwise is not used at all, this part of code will not be compiled */
+#if SN_COAP_SERVER_PROFILE
+    handle->sn_coap_protocol_free(handle->blockwise_sent_hash);
+    handle->blockwise_sent_hash = 0;
+    handle->sn_coap_protocol_free(handle->blockwise_received_hash);
+    handle->blockwise_received_hash = 0;
+#endif
     ns_list_foreach_safe(coap_blockwise_msg_s, tmp, &handle->linked_list_blockwise_sent_msgs) {
         if (tmp->coap == handle) {
             if (tmp->coap_msg_ptr) {
@@ -117,6 +242,7 @@ int8_t sn_coap_protocol_destroy(struct coap_s *handle)
                 sn_coap_parser_release_allocated_coap_msg_mem(tmp->coap, tmp->coap_msg_ptr);
             }
             ns_list_remove(&handle->linked_list_blockwise_sent_msgs, tmp);
+            handle->sn_coap_protocol_free(tmp->uri_ptr);
             handle->sn_coap_protocol_free(tmp);
             tmp = 0;
         }
@@ -138,6 +264,37 @@ int8_t sn_coap_protocol_destroy(struct coap_s *handle)
     }
 #endif
 
+#if SN_COAP_INGRESS_QUEUE_MAX_SIZE /* If ingress queue is not used at all, this part of code will not be compiled */
+    sn_coap_protocol_set_ingress_queue_size(handle, 0);
+#endif
+
+#if SN_COAP_EGRESS_QUEUE_MAX_SIZE /* If egress queue is not used at all, this part of code will not be compiled */
+    sn_coap_protocol_set_egress_queue_size(handle, 0);
+#endif
+
+    sn_coap_protocol_set_tx_batch_callback(handle, NULL);
+
+#if SN_COAP_CLIENT_MAX_EXCHANGES /* If client exchanges are not used at all, this part of code will not be compiled */
+    ns_list_foreach_safe(coap_exchange_s, exchange_ptr, &handle->linked_list_exchanges) {
+        sn_coap_protocol_exchange_unlink(handle, exchange_ptr);
+        sn_coap_protocol_exchange_release(handle, exchange_ptr);
+    }
+    handle->sn_coap_protocol_free(handle->exchanges_hash);
+    handle->exchanges_hash = 0;
+#endif
+
+#if SN_COAP_OBSERVE_MAX_OBSERVERS
+    ns_list_foreach_safe(coap_observe_resource_s, resource_ptr, &handle->linked_list_observe_resources) {
+        ns_list_foreach_safe(coap_observer_s, observer_ptr, &resource_ptr->observers) {
+            sn_coap_protocol_observer_remove(handle, resource_ptr, observer_ptr);
+        }
+    }
+#endif
+
+#if SN_COAP_SERVER_PROFILE
+    sn_coap_peer_table_destroy(&handle->peer_table);
+#endif
+
     handle->sn_coap_protocol_free(handle);
     handle = 0;
     return 0;
@@ -170,7 +327,11 @@ struct coap_s *sn_coap_protocol_init(void *(*used_malloc_func_ptr)(uint16_t), vo
     /* If pointer = 0, then re-sending does not return error when failed */
     handle->sn_coap_rx_callback = used_rx_callback_ptr;
 
-
+#if SN_COAP_SERVER_PROFILE
+    /* * * * Peer table is allocated when first peer is stored * * * */
+    sn_coap_peer_table_init(&handle->peer_table, used_malloc_func_ptr, used_free_func_ptr,
+                            SN_COAP_PEER_TABLE_MAX_PEERS, SN_COAP_PEER_IDLE_TIMEOUT);
+#endif
 
 #if ENABLE_RESENDINGS  /* If Message resending is not used at all, this part of code will not be compiled */
 
@@ -181,30 +342,48 @@ struct coap_s *sn_coap_protocol_init(void *(*used_malloc_func_ptr)(uint16_t), vo
     handle->sn_coap_resending_intervall = DEFAULT_RESPONSE_TIMEOUT;
     handle->sn_coap_resending_count = SN_COAP_RESENDING_MAX_COUNT;
 
-
 #endif /* ENABLE_RESENDINGS */
 
 #if SN_COAP_DUPLICATION_MAX_MSGS_COUNT /* If Message duplication detection is not used at all, this part of code will not be compiled */
+    handle->sn_coap_duplication_response_cache_size = SN_COAP_DUPLICATION_RESPONSE_CACHE_SIZE;
+#if SN_COAP_SERVER_PROFILE
+    /* * * * Preallocate cache for storing Duplication info * * * */
+    if (sn_coap_protocol_duplication_cache_alloc(handle, SN_COAP_DUPLICATION_MAX_MSGS_COUNT) != 0) {
+        used_free_func_ptr(handle);
+        return NULL;
+    }
+#else
     /* * * * Create Linked list for storing Duplication info * * * */
     ns_list_init(&handle->linked_list_duplication_msgs);
     handle->sn_coap_duplication_buffer_size = SN_COAP_DUPLICATION_MAX_MSGS_COUNT;
 #endif
+#endif
 
 #if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
 
     ns_list_init(&handle->linked_list_blockwise_sent_msgs);
     ns_list_init(&handle->linked_list_blockwise_received_payloads);
     handle->sn_coap_block_data_size = SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE;
+    handle->sn_coap_path_mtu = SN_COAP_BLOCKWISE_PATH_MTU;
 
 #endif /* ENABLE_RESENDINGS */
 
-    /* Randomize global message ID */
+#if SN_COAP_OBSERVE_MAX_OBSERVERS /* If observer registry is not used at all, this part of code will not be compiled */
+    ns_list_init(&handle->linked_list_observe_resources);
+#endif
+
+    /* Randomize message ID */
     randLIB_seed_random();
-    message_id = randLIB_get_16bit();
-    if (message_id == 0) {
-        message_id = 1;
+    handle->message_id = randLIB_get_16bit();
+    if (handle->message_id == 0) {
+        handle->message_id = 1;
     }
-    tr_debug("Coap random msg ID: %d", message_id);
+    tr_debug("Coap random msg ID: %d", handle->message_id);
+
+#if SN_COAP_CLIENT_MAX_EXCHANGES /* If client exchanges are not used at all, this part of code will not be compiled */
+    ns_list_init(&handle->linked_list_exchanges);
+    handle->exchange_token = randLIB_get_32bit();
+#endif
 
     return handle;
 }
@@ -236,7 +415,27 @@ int8_t sn_coap_protocol_set_block_size(struct coap_s *handle, uint16_t block_siz
 
 }
 
+int8_t sn_coap_protocol_set_path_mtu(struct coap_s *handle, uint16_t path_mtu)
+{
+    (void) handle;
+    (void) path_mtu;
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
+    if (handle == NULL) {
+        return -1;
+    }
+    handle->sn_coap_path_mtu = path_mtu;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
 int8_t sn_coap_protocol_set_duplicate_buffer_size(struct coap_s *handle, uint8_t message_count)
+{
+    return sn_coap_protocol_set_duplicate_buffer_size_2(handle, message_count);
+}
+
+int8_t sn_coap_protocol_set_duplicate_buffer_size_2(struct coap_s *handle, uint32_t message_count)
 {
     (void) handle;
     (void) message_count;
@@ -245,22 +444,81 @@ int8_t sn_coap_protocol_set_duplicate_buffer_size(struct coap_s *handle, uint8_t
         return -1;
     }
     if (message_count <= SN_COAP_MAX_ALLOWED_DUPLICATION_MESSAGE_COUNT) {
+#if SN_COAP_SERVER_PROFILE
+        return sn_coap_protocol_duplication_cache_alloc(handle, message_count);
+#else
         handle->sn_coap_duplication_buffer_size = message_count;
         return 0;
+#endif
+    }
+#endif
+    return -1;
+}
+
+int8_t sn_coap_protocol_set_duplicate_response_cache_size(struct coap_s *handle, uint32_t size_bytes)
+{
+    (void) handle;
+    (void) size_bytes;
+#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT
+    if (handle == NULL) {
+        return -1;
+    }
+#if SN_COAP_SERVER_PROFILE
+    /* Acknowledgements are stored by ring position of the duplication cache */
+    if (size_bytes && handle->duplication_responses == NULL && handle->sn_coap_duplication_buffer_size) {
+        handle->duplication_responses = sn_coap_protocol_duplication_chunks_alloc(handle, handle->sn_coap_duplication_buffer_size,
+                                        sizeof(coap_duplication_response_s *));
+        if (handle->duplication_responses == NULL) {
+            return -1;
+        }
+    }
+#endif
+    handle->sn_coap_duplication_response_cache_size = size_bytes;
+    sn_coap_protocol_duplication_response_reserve(handle, 0);
+#if SN_COAP_SERVER_PROFILE
+    if (size_bytes == 0) {
+        sn_coap_protocol_duplication_chunks_free(handle, handle->duplication_responses, handle->sn_coap_duplication_buffer_size);
+        handle->duplication_responses = 0;
+    }
+#endif
+    return 0;
+#endif
+    return -1;
+}
+
+int8_t sn_coap_protocol_set_peer_table_size(struct coap_s *handle, uint32_t max_peers, uint32_t idle_timeout)
+{
+    (void) handle;
+    (void) max_peers;
+    (void) idle_timeout;
+#if SN_COAP_SERVER_PROFILE
+    if (handle == NULL) {
+        return -1;
     }
+    return sn_coap_peer_table_set_size(&handle->peer_table, max_peers, idle_timeout);
 #endif
     return -1;
 }
 
 int8_t sn_coap_protocol_set_retransmission_parameters(struct coap_s *handle,
         uint8_t resending_count, uint8_t resending_intervall)
+{
+    return sn_coap_protocol_set_retransmission_parameters_2(handle, resending_count, resending_intervall);
+}
+
+int8_t sn_coap_protocol_set_retransmission_parameters_2(struct coap_s *handle,
+        uint8_t resending_count, uint16_t resending_intervall)
 {
 #if ENABLE_RESENDINGS
     if (handle == NULL) {
         return -1;
     }
-    if (resending_count <= SN_COAP_MAX_ALLOWED_RESENDING_COUNT &&
-            resending_intervall <= SN_COAP_MAX_ALLOWED_RESPONSE_TIMEOUT) {
+#if SN_COAP_MAX_ALLOWED_RESPONSE_TIMEOUT < UINT16_MAX
+    if (resending_intervall > SN_COAP_MAX_ALLOWED_RESPONSE_TIMEOUT) {
+        return -1;
+    }
+#endif
+    if (resending_count <= SN_COAP_MAX_ALLOWED_RESENDING_COUNT) {
         handle->sn_coap_resending_count = resending_count;
 
         if (resending_intervall == 0) {
@@ -276,6 +534,12 @@ int8_t sn_coap_protocol_set_retransmission_parameters(struct coap_s *handle,
 
 int8_t sn_coap_protocol_set_retransmission_buffer(struct coap_s *handle,
         uint8_t buffer_size_messages, uint16_t buffer_size_bytes)
+{
+    return sn_coap_protocol_set_retransmission_buffer_2(handle, buffer_size_messages, buffer_size_bytes);
+}
+
+int8_t sn_coap_protocol_set_retransmission_buffer_2(struct coap_s *handle,
+        uint32_t buffer_size_messages, uint32_t buffer_size_bytes)
 {
 #if ENABLE_RESENDINGS
     if (handle == NULL) {
@@ -293,6 +557,116 @@ int8_t sn_coap_protocol_set_retransmission_buffer(struct coap_s *handle,
 
 }
 
+int8_t sn_coap_protocol_set_send_failure_callback(struct coap_s *handle,
+        void (*send_failure_cb)(struct coap_s *, const sn_coap_send_failure_s *, uint8_t))
+{
+    (void) send_failure_cb;
+#if ENABLE_RESENDINGS
+    if (handle == NULL) {
+        return -1;
+    }
+    handle->sn_coap_send_failure_callback = send_failure_cb;
+    return 0;
+#else
+    (void) handle;
+    return -1;
+#endif
+}
+
+int8_t sn_coap_protocol_set_tx_batch_callback(struct coap_s *handle,
+        void (*tx_batch_cb)(struct coap_s *, const sn_coap_tx_entry_s *, uint8_t))
+{
+    if (handle == NULL) {
+        return -1;
+    }
+
+    if (tx_batch_cb == NULL) {
+        if (handle->tx_batch) {
+            sn_coap_protocol_tx_batch_flush(handle);
+            handle->sn_coap_protocol_free(handle->tx_batch);
+            handle->tx_batch = NULL;
+        }
+    } else if (handle->tx_batch == NULL) {
+        handle->tx_batch = handle->sn_coap_protocol_malloc(sizeof(coap_tx_batch_s));
+        if (handle->tx_batch == NULL) {
+            return -2;
+        }
+        memset(handle->tx_batch, 0, sizeof(coap_tx_batch_s));
+    }
+    handle->sn_coap_tx_batch_callback = tx_batch_cb;
+
+    return 0;
+}
+
+int8_t sn_coap_protocol_set_block_sink_callback(struct coap_s *handle,
+        int8_t (*block_sink_cb)(struct coap_s *, const sn_coap_block_s *, void *))
+{
+    (void) block_sink_cb;
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
+    if (handle == NULL) {
+        return -1;
+    }
+    handle->sn_coap_block_sink_callback = block_sink_cb;
+    return 0;
+#else
+    (void) handle;
+    return -1;
+#endif
+}
+
+int8_t sn_coap_protocol_set_payload_provider(struct coap_s *handle,
+        const uint8_t *(*payload_provider_cb)(struct coap_s *, const uint8_t *, uint32_t, uint16_t))
+{
+    (void) payload_provider_cb;
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
+    if (handle == NULL) {
+        return -1;
+    }
+    handle->sn_coap_payload_provider_callback = payload_provider_cb;
+    return 0;
+#else
+    (void) handle;
+    return -1;
+#endif
+}
+
+int8_t sn_coap_protocol_set_stateless_block2(struct coap_s *handle, bool enable)
+{
+    (void) enable;
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
+    if (handle == NULL) {
+        return -1;
+    }
+    handle->sn_coap_block2_stateless = enable;
+    return 0;
+#else
+    (void) handle;
+    return -1;
+#endif
+}
+
+int8_t sn_coap_protocol_get_retransmission_buffer_usage(struct coap_s *handle,
+        uint32_t *msg_count, uint32_t *byte_count)
+{
+#if ENABLE_RESENDINGS
+    if (handle == NULL) {
+        return -1;
+    }
+    if (msg_count) {
+        *msg_count = handle->count_resent_msgs;
+    }
+    if (byte_count) {
+        *byte_count = handle->count_resent_bytes;
+    }
+    return 0;
+#else
+    (void) handle;
+    (void) msg_count;
+    (void) byte_count;
+    return -1;
+#endif
+}
+
 void sn_coap_protocol_clear_retransmission_buffer(struct coap_s *handle)
 {
 #if ENABLE_RESENDINGS /* If Message resending is not used at all, this part of code will not be compiled */
@@ -300,30 +674,8 @@ void sn_coap_protocol_clear_retransmission_buffer(struct coap_s *handle)
         return;
     }
     ns_list_foreach_safe(coap_send_msg_s, tmp, &handle->linked_list_resent_msgs) {
-        if (tmp->send_msg_ptr) {
-            if (tmp->send_msg_ptr->dst_addr_ptr) {
-                if (tmp->send_msg_ptr->dst_addr_ptr->addr_ptr) {
-                    handle->sn_coap_protocol_free(tmp->send_msg_ptr->dst_addr_ptr->addr_ptr);
-                    tmp->send_msg_ptr->dst_addr_ptr->addr_ptr = 0;
-                }
-                handle->sn_coap_protocol_free(tmp->send_msg_ptr->dst_addr_ptr);
-                tmp->send_msg_ptr->dst_addr_ptr = 0;
-            }
-            if (tmp->send_msg_ptr->packet_ptr) {
-                handle->sn_coap_protocol_free(tmp->send_msg_ptr->packet_ptr);
-                tmp->send_msg_ptr->packet_ptr = 0;
-            }
-            if (tmp->send_msg_ptr->uri_path_ptr) {
-                handle->sn_coap_protocol_free(tmp->send_msg_ptr->uri_path_ptr);
-                tmp->send_msg_ptr->uri_path_ptr = 0;
-            }
-            handle->sn_coap_protocol_free(tmp->send_msg_ptr);
-            tmp->send_msg_ptr = 0;
-        }
-        ns_list_remove(&handle->linked_list_resent_msgs, tmp);
-        --handle->count_resent_msgs;
-        handle->sn_coap_protocol_free(tmp);
-        tmp = 0;
+        sn_coap_protocol_linked_list_send_msg_unlink(handle, tmp);
+        sn_coap_protocol_release_allocated_send_msg_mem(handle, tmp);
     }
 #endif
 }
@@ -334,375 +686,1155 @@ int8_t sn_coap_protocol_delete_retransmission(struct coap_s *handle, uint16_t ms
     if (handle == NULL) {
         return -1;
     }
-    ns_list_foreach_safe(coap_send_msg_s, tmp, &handle->linked_list_resent_msgs) {
-        if (tmp->send_msg_ptr && tmp->send_msg_ptr->packet_ptr ) {
-            uint16_t temp_msg_id = (tmp->send_msg_ptr->packet_ptr[2] << 8);
-            temp_msg_id += (uint16_t)tmp->send_msg_ptr->packet_ptr[3];
-            if(temp_msg_id == msg_id){
-                ns_list_remove(&handle->linked_list_resent_msgs, tmp);
-                --handle->count_resent_msgs;
-                sn_coap_protocol_release_allocated_send_msg_mem(handle, tmp);
-                return 0;
-            }
-        }
+    coap_send_msg_s *tmp = sn_coap_protocol_linked_list_send_msg_find(handle, NULL, msg_id);
+    if (tmp) {
+        sn_coap_protocol_linked_list_send_msg_unlink(handle, tmp);
+        sn_coap_protocol_release_allocated_send_msg_mem(handle, tmp);
+        return 0;
     }
 #endif
     return -2;
 }
 
-#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
-int8_t prepare_blockwise_message(struct coap_s *handle, sn_coap_hdr_s *src_coap_msg_ptr)
+int32_t sn_coap_protocol_observe_register(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *request_ptr)
 {
-    if ((src_coap_msg_ptr->payload_len > handle->sn_coap_block_data_size) && (handle->sn_coap_block_data_size > 0)) {
-        /* * * * Add Blockwise option to send CoAP message * * */
-
-        /* Allocate memory for less used options */
-        if (sn_coap_parser_alloc_options(handle, src_coap_msg_ptr) == NULL) {
-            return -2;
-        }
-
-        /* Check if Request message */
-        if (src_coap_msg_ptr->msg_code < COAP_MSG_CODE_RESPONSE_CREATED) {
-            tr_debug("prepare_blockwise_message - block1 request");
-            /* Add Blockwise option, use Block1 because Request payload */
-            src_coap_msg_ptr->options_list_ptr->block1 = 0x08;      /* First block  (BLOCK NUMBER, 4 MSB bits) + More to come (MORE, 1 bit) */
-            src_coap_msg_ptr->options_list_ptr->block1 |= sn_coap_convert_block_size(handle->sn_coap_block_data_size);
+#if SN_COAP_OBSERVE_MAX_OBSERVERS /* If observer registry is not used at all, this part of code will not be compiled */
+    coap_observe_resource_s *resource_ptr;
+    coap_observer_s *observer_ptr;
+#if SN_COAP_SERVER_PROFILE
+    uint32_t peer_id;
+#endif
 
-            /* Add size1 parameter */
-            tr_debug("prepare_blockwise_message block1 request - payload len %d", src_coap_msg_ptr->payload_len);
+    if (handle == NULL || src_addr_ptr == NULL || src_addr_ptr->addr_ptr == NULL || request_ptr == NULL ||
+            request_ptr->msg_code != COAP_MSG_CODE_REQUEST_GET || request_ptr->options_list_ptr == NULL ||
+            request_ptr->options_list_ptr->observe != COAP_OBSERVE_REGISTER ||
+            request_ptr->token_len > sizeof(observer_ptr->token)) {
+        return -1;
+    }
 
-            src_coap_msg_ptr->options_list_ptr->use_size1 = true;
-            src_coap_msg_ptr->options_list_ptr->use_size2 = false;
-            src_coap_msg_ptr->options_list_ptr->size1 = src_coap_msg_ptr->payload_len;
-        } else { /* Response message */
-            tr_debug("prepare_blockwise_message - block2 response");
-            /* Add Blockwise option, use Block2 because Response payload */
-            src_coap_msg_ptr->options_list_ptr->block2 = 0x08;      /* First block  (BLOCK NUMBER, 4 MSB bits) + More to come (MORE, 1 bit) */
-            src_coap_msg_ptr->options_list_ptr->block2 |= sn_coap_convert_block_size(handle->sn_coap_block_data_size);
+    resource_ptr = sn_coap_protocol_observe_resource_find(handle, request_ptr->uri_path_ptr, request_ptr->uri_path_len);
 
-            src_coap_msg_ptr->options_list_ptr->use_size1 = false;
-            src_coap_msg_ptr->options_list_ptr->use_size2 = true;
-            src_coap_msg_ptr->options_list_ptr->size2 = src_coap_msg_ptr->payload_len;
+    /* Registering again keeps the existing registration */
+    if (resource_ptr) {
+        ns_list_foreach(coap_observer_s, tmp, &resource_ptr->observers) {
+            if (tmp->token_len == request_ptr->token_len &&
+                    (tmp->token_len == 0 || memcmp(tmp->token, request_ptr->token_ptr, tmp->token_len) == 0) &&
+                    sn_coap_protocol_observer_addr_match(handle, tmp, src_addr_ptr)) {
+                return resource_ptr->observe_seq;
+            }
         }
     }
-    return 0;
-}
-#endif
 
-int16_t sn_coap_protocol_build(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr,
-                               uint8_t *dst_packet_data_ptr, sn_coap_hdr_s *src_coap_msg_ptr, void *param)
-{
-    tr_debug("sn_coap_protocol_build - payload len %d", src_coap_msg_ptr->payload_len);
-    int16_t  byte_count_built     = 0;
-#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
-    uint16_t original_payload_len = 0;
-#endif
-    /* * * * Check given pointers  * * * */
-    if ((dst_addr_ptr == NULL) || (dst_packet_data_ptr == NULL) || (src_coap_msg_ptr == NULL) || handle == NULL) {
-        return -2;
+    if (handle->count_observers >= SN_COAP_OBSERVE_MAX_OBSERVERS) {
+        tr_debug("sn_coap_protocol_observe_register - registry full");
+        return -1;
     }
 
-    if (dst_addr_ptr->addr_ptr == NULL) {
-        return -2;
+    if (resource_ptr == NULL) {
+        resource_ptr = handle->sn_coap_protocol_malloc(sizeof(coap_observe_resource_s) + request_ptr->uri_path_len);
+        if (resource_ptr == NULL) {
+            return -1;
+        }
+        memset(resource_ptr, 0, sizeof(coap_observe_resource_s));
+        resource_ptr->uri_path_ptr = (uint8_t *)(resource_ptr + 1);
+        if (request_ptr->uri_path_len) {
+            memcpy(resource_ptr->uri_path_ptr, request_ptr->uri_path_ptr, request_ptr->uri_path_len);
+        }
+        resource_ptr->uri_path_len = request_ptr->uri_path_len;
+        ns_list_init(&resource_ptr->observers);
+        ns_list_add_to_end(&handle->linked_list_observe_resources, resource_ptr);
     }
 
-    /* Check if built Message type is else than Acknowledgement or Reset i.e. message type is Confirmable or Non-confirmable */
-    /* (for Acknowledgement and  Reset messages is written same Message ID than was in the Request message) */
-    if (src_coap_msg_ptr->msg_type != COAP_MSG_TYPE_ACKNOWLEDGEMENT &&
-            src_coap_msg_ptr->msg_type != COAP_MSG_TYPE_RESET &&
-            src_coap_msg_ptr->msg_id == 0) {
-        /* * * * Generate new Message ID and increase it by one  * * * */
-        src_coap_msg_ptr->msg_id = message_id;
-        message_id++;
-        if (message_id == 0) {
-            message_id = 1;
+    /* Address of observer is stored only once to peer table */
+#if SN_COAP_SERVER_PROFILE
+    peer_id = sn_coap_peer_table_intern(&handle->peer_table, src_addr_ptr, handle->system_time);
+    observer_ptr = peer_id ? handle->sn_coap_protocol_malloc(sizeof(coap_observer_s)) : NULL;
+#else
+    observer_ptr = handle->sn_coap_protocol_malloc(sizeof(coap_observer_s) + src_addr_ptr->addr_len);
+#endif
+    if (observer_ptr == NULL) {
+        if (ns_list_is_empty(&resource_ptr->observers)) {
+            ns_list_remove(&handle->linked_list_observe_resources, resource_ptr);
+            handle->sn_coap_protocol_free(resource_ptr);
         }
+        return -1;
+    }
+    memset(observer_ptr, 0, sizeof(coap_observer_s));
+
+#if SN_COAP_SERVER_PROFILE
+    observer_ptr->peer_id = peer_id;
+    sn_coap_peer_table_ref(&handle->peer_table, peer_id);
+#else
+    observer_ptr->addr = *src_addr_ptr;
+    observer_ptr->addr.addr_ptr = (uint8_t *)(observer_ptr + 1);
+    memcpy(observer_ptr->addr.addr_ptr, src_addr_ptr->addr_ptr, src_addr_ptr->addr_len);
+#endif
+    observer_ptr->token_len = request_ptr->token_len;
+    if (request_ptr->token_len) {
+        memcpy(observer_ptr->token, request_ptr->token_ptr, request_ptr->token_len);
     }
 
-#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
+    ns_list_add_to_end(&resource_ptr->observers, observer_ptr);
+    handle->count_observers++;
 
-    /* If blockwising needed */
-    if ((src_coap_msg_ptr->payload_len > handle->sn_coap_block_data_size) && (handle->sn_coap_block_data_size > 0)) {
-        /* Store original Payload length */
-        original_payload_len = src_coap_msg_ptr->payload_len;
-        /* Change Payload length of send message because Payload is blockwised */
-        src_coap_msg_ptr->payload_len = handle->sn_coap_block_data_size;
+    return resource_ptr->observe_seq;
+#else
+    (void) handle;
+    (void) src_addr_ptr;
+    (void) request_ptr;
+    return -1;
+#endif
+}
+
+int8_t sn_coap_protocol_observe_deregister(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const uint8_t *token_ptr, uint8_t token_len)
+{
+#if SN_COAP_OBSERVE_MAX_OBSERVERS /* If observer registry is not used at all, this part of code will not be compiled */
+    if (handle == NULL || addr_ptr == NULL || (token_ptr == NULL && token_len)) {
+        return -1;
     }
 
+    ns_list_foreach(coap_observe_resource_s, resource_ptr, &handle->linked_list_observe_resources) {
+        ns_list_foreach(coap_observer_s, observer_ptr, &resource_ptr->observers) {
+            if (observer_ptr->token_len == token_len &&
+                    (token_len == 0 || memcmp(observer_ptr->token, token_ptr, token_len) == 0) &&
+                    sn_coap_protocol_observer_addr_match(handle, observer_ptr, addr_ptr)) {
+                sn_coap_protocol_observer_remove(handle, resource_ptr, observer_ptr);
+                return 0;
+            }
+        }
+    }
+    return -2;
+#else
+    (void) handle;
+    (void) addr_ptr;
+    (void) token_ptr;
+    (void) token_len;
+    return -1;
 #endif
-    /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
-    /* * * * Build Packet data from CoAP message by using CoAP Header builder  * * * */
-    /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+}
 
-    byte_count_built = sn_coap_builder_2(dst_packet_data_ptr, src_coap_msg_ptr, handle->sn_coap_block_data_size);
+int32_t sn_coap_protocol_observe_notify(struct coap_s *handle, const sn_coap_hdr_s *notification_ptr, void *param)
+{
+#if SN_COAP_OBSERVE_MAX_OBSERVERS /* If observer registry is not used at all, this part of code will not be compiled */
+    coap_observe_resource_s *resource_ptr;
 
-    if (byte_count_built < 0) {
-        return byte_count_built;
+    if (handle == NULL || notification_ptr == NULL ||
+            (notification_ptr->msg_type != COAP_MSG_TYPE_CONFIRMABLE && notification_ptr->msg_type != COAP_MSG_TYPE_NON_CONFIRMABLE)) {
+        return -1;
     }
 
-#if ENABLE_RESENDINGS /* If Message resending is not used at all, this part of code will not be compiled */
+    /* Blockwise notifications are built for each observer with sn_coap_protocol_build() */
+    if (handle->sn_coap_block_data_size && notification_ptr->payload_len > handle->sn_coap_block_data_size) {
+        return -1;
+    }
 
-    /* Check if built Message type was confirmable, only these messages are resent */
-    if (src_coap_msg_ptr->msg_type == COAP_MSG_TYPE_CONFIRMABLE) {
-        /* Store message to Linked list for resending purposes */
-        sn_coap_protocol_linked_list_send_msg_store(handle, dst_addr_ptr, byte_count_built, dst_packet_data_ptr,
-                handle->system_time + (uint32_t)(handle->sn_coap_resending_intervall * RESPONSE_RANDOM_FACTOR),
-                param, src_coap_msg_ptr->uri_path_ptr, src_coap_msg_ptr->uri_path_len);
+    resource_ptr = sn_coap_protocol_observe_resource_find(handle, notification_ptr->uri_path_ptr, notification_ptr->uri_path_len);
+    if (resource_ptr == NULL) {
+        return 0;
     }
 
-#endif /* ENABLE_RESENDINGS */
-
-#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
-
-    /* If blockwising needed */
-    if ((original_payload_len > handle->sn_coap_block_data_size) && (handle->sn_coap_block_data_size > 0)) {
-
-        /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
-        /* * * * Manage rest blockwise messages sending by storing them to Linked list * * * */
-        /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+    return sn_coap_protocol_observe_send(handle, resource_ptr, notification_ptr, param);
+#else
+    (void) handle;
+    (void) notification_ptr;
+    (void) param;
+    return -1;
+#endif
+}
 
-        coap_blockwise_msg_s *stored_blockwise_msg_ptr;
+int8_t sn_coap_protocol_observe_set_rate(struct coap_s *handle, const uint8_t *uri_path_ptr, uint16_t uri_path_len, uint32_t pmin, uint32_t pmax)
+{
+#if SN_COAP_OBSERVE_MAX_OBSERVERS /* If observer registry is not used at all, this part of code will not be compiled */
+    coap_observe_resource_s *resource_ptr;
 
-        stored_blockwise_msg_ptr = handle->sn_coap_protocol_malloc(sizeof(coap_blockwise_msg_s));
-        if (!stored_blockwise_msg_ptr) {
-            //block paylaod save failed, only first block can be build. Perhaps we should return error.
-            return byte_count_built;
-        }
-        memset(stored_blockwise_msg_ptr, 0, sizeof(coap_blockwise_msg_s));
+    if (handle == NULL || (uri_path_ptr == NULL && uri_path_len) || (pmax && pmax < pmin)) {
+        return -1;
+    }
 
-        /* Fill struct */
-        stored_blockwise_msg_ptr->timestamp = handle->system_time;
+    resource_ptr = sn_coap_protocol_observe_resource_find(handle, uri_path_ptr, uri_path_len);
+    if (resource_ptr == NULL) {
+        return -2;
+    }
 
-        stored_blockwise_msg_ptr->coap_msg_ptr = sn_coap_protocol_copy_header(handle, src_coap_msg_ptr);
-        if( stored_blockwise_msg_ptr->coap_msg_ptr == NULL ){
-            handle->sn_coap_protocol_free(stored_blockwise_msg_ptr);
-            stored_blockwise_msg_ptr = 0;
-            return -2;
-        }
+    resource_ptr->pmin = pmin;
+    resource_ptr->pmax = pmax;
 
-        stored_blockwise_msg_ptr->coap_msg_ptr->payload_len = original_payload_len;
-        stored_blockwise_msg_ptr->coap_msg_ptr->payload_ptr = handle->sn_coap_protocol_malloc(stored_blockwise_msg_ptr->coap_msg_ptr->payload_len);
+    return 0;
+#else
+    (void) handle;
+    (void) uri_path_ptr;
+    (void) uri_path_len;
+    (void) pmin;
+    (void) pmax;
+    return -1;
+#endif
+}
 
-        if (!stored_blockwise_msg_ptr->coap_msg_ptr->payload_ptr) {
-            //block payload save failed, only first block can be build. Perhaps we should return error.
-            sn_coap_parser_release_allocated_coap_msg_mem(handle, stored_blockwise_msg_ptr->coap_msg_ptr);
-            handle->sn_coap_protocol_free(stored_blockwise_msg_ptr);
-            stored_blockwise_msg_ptr = 0;
-            return byte_count_built;
-        }
-        memcpy(stored_blockwise_msg_ptr->coap_msg_ptr->payload_ptr, src_coap_msg_ptr->payload_ptr, stored_blockwise_msg_ptr->coap_msg_ptr->payload_len);
+int8_t sn_coap_protocol_observe_changed(struct coap_s *handle, const sn_coap_hdr_s *notification_ptr, void *param)
+{
+#if SN_COAP_OBSERVE_MAX_OBSERVERS /* If observer registry is not used at all, this part of code will not be compiled */
+    coap_observe_resource_s *resource_ptr;
 
-        stored_blockwise_msg_ptr->coap = handle;
+    if (handle == NULL || notification_ptr == NULL || notification_ptr->msg_code == COAP_MSG_CODE_EMPTY ||
+            (notification_ptr->payload_ptr == NULL && notification_ptr->payload_len)) {
+        return -1;
+    }
 
-        ns_list_add_to_end(&handle->linked_list_blockwise_sent_msgs, stored_blockwise_msg_ptr);
+    /* Blockwise notifications are built for each observer with sn_coap_protocol_build() */
+    if (handle->sn_coap_block_data_size && notification_ptr->payload_len > handle->sn_coap_block_data_size) {
+        return -1;
     }
 
-    else if (src_coap_msg_ptr->msg_code == COAP_MSG_CODE_REQUEST_GET) {
-        /* Add message to linked list - response can be in blocks and we need header to build response.. */
-        coap_blockwise_msg_s *stored_blockwise_msg_ptr;
+    resource_ptr = sn_coap_protocol_observe_resource_find(handle, notification_ptr->uri_path_ptr, notification_ptr->uri_path_len);
+    if (resource_ptr == NULL) {
+        return 0;
+    }
 
-        stored_blockwise_msg_ptr = handle->sn_coap_protocol_malloc(sizeof(coap_blockwise_msg_s));
-        if (!stored_blockwise_msg_ptr) {
-            return byte_count_built;
+    /* * * * Only the latest value is kept * * * */
+    if (resource_ptr->value_len != notification_ptr->payload_len) {
+        uint8_t *value_ptr = NULL;
+        if (notification_ptr->payload_len) {
+            value_ptr = handle->sn_coap_protocol_malloc(notification_ptr->payload_len);
+            if (value_ptr == NULL) {
+                return -2;
+            }
         }
-        memset(stored_blockwise_msg_ptr, 0, sizeof(coap_blockwise_msg_s));
-
-        /* Fill struct */
-        stored_blockwise_msg_ptr->timestamp = handle->system_time;
+        handle->sn_coap_protocol_free(resource_ptr->value_ptr);
+        resource_ptr->value_ptr = value_ptr;
+        resource_ptr->value_len = notification_ptr->payload_len;
+    }
+    if (notification_ptr->payload_len) {
+        memcpy(resource_ptr->value_ptr, notification_ptr->payload_ptr, notification_ptr->payload_len);
+    }
+    resource_ptr->value_code = notification_ptr->msg_code;
+    resource_ptr->content_format = notification_ptr->content_format;
+    resource_ptr->max_age = COAP_OPTION_MAX_AGE_DEFAULT;
+    if (notification_ptr->options_list_ptr) {
+        resource_ptr->max_age = notification_ptr->options_list_ptr->max_age;
+    }
+    resource_ptr->param = param;
+    resource_ptr->value_pending = true;
 
-        stored_blockwise_msg_ptr->coap_msg_ptr = sn_coap_protocol_copy_header(handle, src_coap_msg_ptr);
-        if( stored_blockwise_msg_ptr->coap_msg_ptr == NULL ){
-            handle->sn_coap_protocol_free(stored_blockwise_msg_ptr);
-            stored_blockwise_msg_ptr = 0;
+    /* * * * Send right away if pmin has passed since the last notification * * * */
+    if (resource_ptr->observe_seq == 0 || handle->system_time - resource_ptr->notify_time >= resource_ptr->pmin) {
+        if (sn_coap_protocol_observe_send_value(handle, resource_ptr, false) < 0) {
             return -2;
         }
-
-        stored_blockwise_msg_ptr->coap = handle;
-
-        ns_list_add_to_end(&handle->linked_list_blockwise_sent_msgs, stored_blockwise_msg_ptr);
     }
 
-#endif /* SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE */
-
-    tr_debug("sn_coap_protocol_build - msg id: [%d], bytes: [%d]", src_coap_msg_ptr->msg_id, byte_count_built);
-
-    /* * * * Return built CoAP message Packet data length  * * * */
-    return byte_count_built;
+    return 0;
+#else
+    (void) handle;
+    (void) notification_ptr;
+    (void) param;
+    return -1;
+#endif
 }
 
-sn_coap_hdr_s *sn_coap_protocol_parse(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t packet_data_len, uint8_t *packet_data_ptr, void *param)
+int8_t sn_coap_protocol_send_request(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, sn_coap_hdr_s *request_ptr,
+        void (*response_cb)(struct coap_s *, const sn_coap_hdr_s *, void *), void *ctx, void *param)
 {
-    tr_debug("sn_coap_protocol_parse");
-    sn_coap_hdr_s   *returned_dst_coap_msg_ptr = NULL;
-    coap_version_e   coap_version              = COAP_VERSION_UNKNOWN;
+#if SN_COAP_CLIENT_MAX_EXCHANGES /* If client exchanges are not used at all, this part of code will not be compiled */
+    coap_exchange_s *exchange_ptr;
+    uint8_t         token[SN_COAP_CLIENT_TOKEN_LEN];
+    uint8_t         *original_token_ptr;
+    uint8_t         original_token_len;
+    uint8_t         *packet_ptr;
+    uint16_t        packet_len;
+    int16_t         byte_count_built;
+#if SN_COAP_SERVER_PROFILE
+    uint32_t        peer_id;
+#endif
 
-    /* * * * Check given pointer * * * */
-    if (src_addr_ptr == NULL || src_addr_ptr->addr_ptr == NULL ||
-        packet_data_ptr == NULL || handle == NULL) {
-        return NULL;
+    if (handle == NULL || dst_addr_ptr == NULL || dst_addr_ptr->addr_ptr == NULL || request_ptr == NULL || response_cb == NULL ||
+            request_ptr->msg_code == COAP_MSG_CODE_EMPTY || request_ptr->msg_code >= COAP_MSG_CODE_RESPONSE_CREATED ||
+            (request_ptr->msg_type != COAP_MSG_TYPE_CONFIRMABLE && request_ptr->msg_type != COAP_MSG_TYPE_NON_CONFIRMABLE)) {
+        return -1;
     }
 
-    /* * * * Parse Packet data to CoAP message by using CoAP Header parser * * * */
-    returned_dst_coap_msg_ptr = sn_coap_parser(handle, packet_data_len, packet_data_ptr, &coap_version);
+    if (handle->count_exchanges >= SN_COAP_CLIENT_MAX_EXCHANGES) {
+        tr_debug("sn_coap_protocol_send_request - too many pending requests");
+        return -1;
+    }
 
-    /* Check status of returned pointer */
-    if (returned_dst_coap_msg_ptr == NULL) {
-        /* Memory allocation error in parser */
-        return NULL;
+    /* Index for finding pending exchanges by token is created when first needed */
+    if (handle->exchanges_hash == NULL) {
+        handle->exchanges_hash = handle->sn_coap_protocol_malloc(SN_COAP_CLIENT_EXCHANGE_HASH_SIZE * sizeof(coap_exchange_s *));
+        if (handle->exchanges_hash == NULL) {
+            return -2;
+        }
+        memset(handle->exchanges_hash, 0, SN_COAP_CLIENT_EXCHANGE_HASH_SIZE * sizeof(coap_exchange_s *));
     }
-    /* * * * Send bad request response if parsing fails * * * */
-    if (returned_dst_coap_msg_ptr->coap_status == COAP_STATUS_PARSER_ERROR_IN_HEADER) {
-        sn_coap_protocol_send_rst(handle, returned_dst_coap_msg_ptr->msg_id, src_addr_ptr, param);
-        sn_coap_parser_release_allocated_coap_msg_mem(handle, returned_dst_coap_msg_ptr);
-        return NULL;
+
+    /* Destination address is stored only once to peer table */
+#if SN_COAP_SERVER_PROFILE
+    peer_id = sn_coap_peer_table_intern(&handle->peer_table, dst_addr_ptr, handle->system_time);
+    exchange_ptr = peer_id ? handle->sn_coap_protocol_malloc(sizeof(coap_exchange_s)) : NULL;
+#else
+    exchange_ptr = handle->sn_coap_protocol_malloc(sizeof(coap_exchange_s) + dst_addr_ptr->addr_len);
+#endif
+    if (exchange_ptr == NULL) {
+        return -2;
     }
+    memset(exchange_ptr, 0, sizeof(coap_exchange_s));
+
+#if SN_COAP_SERVER_PROFILE
+    exchange_ptr->peer_id = peer_id;
+    sn_coap_peer_table_ref(&handle->peer_table, peer_id);
+#else
+    exchange_ptr->addr = *dst_addr_ptr;
+    exchange_ptr->addr.addr_ptr = (uint8_t *)(exchange_ptr + 1);
+    memcpy(exchange_ptr->addr.addr_ptr, dst_addr_ptr->addr_ptr, dst_addr_ptr->addr_len);
+#endif
+    exchange_ptr->response_cb = response_cb;
+    exchange_ptr->ctx = ctx;
+    exchange_ptr->timeout = handle->system_time + SN_COAP_CLIENT_EXCHANGE_TIMEOUT;
 
-    /* * * * Check validity of parsed Header values  * * * */
-    if (sn_coap_header_validity_check(returned_dst_coap_msg_ptr, coap_version) != 0) {
-        /* If message code is in a reserved class (1, 6 or 7), send reset. Message code class is 3 MSB of the message code byte     */
-        if (((returned_dst_coap_msg_ptr->msg_code >> 5) == 1) ||        // if class == 1
-                ((returned_dst_coap_msg_ptr->msg_code >> 5) == 6) ||    // if class == 6
-                ((returned_dst_coap_msg_ptr->msg_code >> 5) == 7)) {    // if class == 7
-            sn_coap_protocol_send_rst(handle, returned_dst_coap_msg_ptr->msg_id, src_addr_ptr, param);
-        }
+    /* * * * Generate token which is not used by any pending exchange * * * */
+    while (sn_coap_protocol_exchange_find(handle, handle->exchange_token) != NULL) {
+        handle->exchange_token++;
+    }
+    exchange_ptr->token = handle->exchange_token++;
+    token[0] = (uint8_t)(exchange_ptr->token >> 24);
+    token[1] = (uint8_t)(exchange_ptr->token >> 16);
+    token[2] = (uint8_t)(exchange_ptr->token >> 8);
+    token[3] = (uint8_t)exchange_ptr->token;
+
+    original_token_ptr = request_ptr->token_ptr;
+    original_token_len = request_ptr->token_len;
+    request_ptr->token_ptr = token;
+    request_ptr->token_len = SN_COAP_CLIENT_TOKEN_LEN;
+
+    /* * * * Build and send request * * * */
+    byte_count_built = -2;
+    packet_len = sn_coap_builder_calc_needed_packet_data_size_2(request_ptr, handle->sn_coap_block_data_size);
+    packet_ptr = packet_len ? handle->sn_coap_protocol_malloc(packet_len) : NULL;
+    if (packet_ptr) {
+        byte_count_built = sn_coap_protocol_build(handle, dst_addr_ptr, packet_ptr, request_ptr, param);
+    }
 
-        /* Release memory of CoAP message */
-        sn_coap_parser_release_allocated_coap_msg_mem(handle, returned_dst_coap_msg_ptr);
+    request_ptr->token_ptr = original_token_ptr;
+    request_ptr->token_len = original_token_len;
 
-        /* Return NULL because Header validity check failed */
-        return NULL;
+    if (byte_count_built < 0) {
+        handle->sn_coap_protocol_free(packet_ptr);
+        sn_coap_protocol_exchange_release(handle, exchange_ptr);
+        return -2;
     }
 
-    /* Check if we need to send reset message */
-    /*  A recipient MUST acknowledge a Confirmable message with an Acknowledgement
-        message or, if it lacks context to process the message properly
-        (including the case where the message is Empty, uses a code with a
-        reserved class (1, 6 or 7), or has a message format error), MUST
-        reject it; rejecting a Confirmable message is effected by sending a
-        matching Reset message and otherwise ignoring it. */
-    if (returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_CONFIRMABLE) {
-        /* CoAP ping */
-        if (returned_dst_coap_msg_ptr->msg_code == COAP_MSG_CODE_EMPTY) {
-            sn_coap_protocol_send_rst(handle, returned_dst_coap_msg_ptr->msg_id, src_addr_ptr, param);
+    exchange_ptr->msg_id = request_ptr->msg_id;
+    exchange_ptr->hash_next = handle->exchanges_hash[exchange_ptr->token & (SN_COAP_CLIENT_EXCHANGE_HASH_SIZE - 1)];
+    handle->exchanges_hash[exchange_ptr->token & (SN_COAP_CLIENT_EXCHANGE_HASH_SIZE - 1)] = exchange_ptr;
+    ns_list_add_to_end(&handle->linked_list_exchanges, exchange_ptr);
+    handle->count_exchanges++;
 
-            /* Release memory of CoAP message */
-            sn_coap_parser_release_allocated_coap_msg_mem(handle, returned_dst_coap_msg_ptr);
+    sn_coap_protocol_tx(handle, packet_ptr, byte_count_built, dst_addr_ptr, param);
+    handle->sn_coap_protocol_free(packet_ptr);
 
-            /* Return NULL because Header validity check failed */
-            return NULL;
-        }
-    }
+    return 0;
+#else
+    (void) handle;
+    (void) dst_addr_ptr;
+    (void) request_ptr;
+    (void) response_cb;
+    (void) ctx;
+    (void) param;
+    return -1;
+#endif
+}
 
+int8_t sn_coap_protocol_set_ingress_queue_size(struct coap_s *handle, uint16_t queue_size)
+{
+#if SN_COAP_INGRESS_QUEUE_MAX_SIZE /* If ingress queue is not used at all, this part of code will not be compiled */
+    coap_ingress_slot_s taken;
+    coap_ingress_slot_s *queue_ptr = NULL;
 
-#if !SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is used, this part of code will not be compiled */
-    /* If blockwising used in received message */
-    if (returned_dst_coap_msg_ptr->options_list_ptr != NULL &&
-            (returned_dst_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE ||
-             returned_dst_coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE)) {
-        /* Set returned status to User */
-        returned_dst_coap_msg_ptr->coap_status = COAP_STATUS_PARSER_BLOCKWISE_MSG_REJECTED;
-        //todo: send response -> not implemented
-        return returned_dst_coap_msg_ptr;
+    if (handle == NULL || queue_size > SN_COAP_INGRESS_QUEUE_MAX_SIZE || (queue_size & (queue_size - 1)) ||
+            (uint32_t)queue_size * sizeof(coap_ingress_slot_s) > UINT16_MAX) {
+        return -1;
     }
-#endif /* !SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE */
 
-#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT/* If Message duplication is used, this part of code will not be compiled */
+    if (queue_size) {
+        queue_ptr = handle->sn_coap_protocol_malloc(queue_size * sizeof(coap_ingress_slot_s));
+        if (queue_ptr == NULL) {
+            return -1;
+        }
+        memset(queue_ptr, 0, queue_size * sizeof(coap_ingress_slot_s));
+        for (uint16_t i = 0; i < queue_size; i++) {
+            queue_ptr[i].sequence = i;
+        }
+    }
 
-    /* * * * Manage received CoAP message duplicate detection  * * * */
+    /* Messages in old queue are released */
+    if (handle->ingress_queue) {
+        while (sn_coap_protocol_ingress_take(handle, &taken)) {
+            sn_coap_parser_release_allocated_coap_msg_mem(handle, taken.coap_msg_ptr);
+        }
+        handle->sn_coap_protocol_free(handle->ingress_queue);
+    }
 
-    /* If no message duplication detected */
-    if (returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_CONFIRMABLE ||
-            returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_NON_CONFIRMABLE) {
+    handle->ingress_queue = queue_ptr;
+    handle->ingress_queue_mask = queue_size ? queue_size - 1 : 0;
+    handle->ingress_head = 0;
+    handle->ingress_tail = 0;
 
-        if (sn_coap_protocol_linked_list_duplication_info_search(handle, src_addr_ptr, returned_dst_coap_msg_ptr->msg_id) == -1) {
-            /* * * No Message duplication: Store received message for detecting later duplication * * */
+    return 0;
+#else
+    (void) handle;
+    (void) queue_size;
+    return -1;
+#endif
+}
 
-            /* Get count of stored duplication messages */
-            uint16_t stored_duplication_msgs_count = handle->count_duplication_msgs;
+int8_t sn_coap_protocol_ingress_submit(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t packet_data_len, uint8_t *packet_data_ptr, void *param)
+{
+#if SN_COAP_INGRESS_QUEUE_MAX_SIZE /* If ingress queue is not used at all, this part of code will not be compiled */
+    coap_ingress_slot_s *slot_ptr;
+    sn_coap_hdr_s       *coap_msg_ptr;
+    coap_version_e      coap_version = COAP_VERSION_UNKNOWN;
+    uint32_t            position;
+
+    if (handle == NULL || handle->ingress_queue == NULL || src_addr_ptr == NULL || src_addr_ptr->addr_ptr == NULL ||
+            src_addr_ptr->addr_len > SN_COAP_INGRESS_MAX_ADDR_LEN || packet_data_ptr == NULL) {
+        return -1;
+    }
 
-            /* Check if there is no room to store message for duplication detection purposes */
-            if (stored_duplication_msgs_count >= handle->sn_coap_duplication_buffer_size) {
-                /* Get oldest stored duplication message */
-                coap_duplication_info_s *stored_duplication_info_ptr = ns_list_get_first(&handle->linked_list_duplication_msgs);
+    /* * * * Parse Packet data on this thread, protocol state is handled by owner thread * * * */
+    coap_msg_ptr = sn_coap_parser(handle, packet_data_len, packet_data_ptr, &coap_version);
+    if (coap_msg_ptr == NULL) {
+        return -2;
+    }
 
-                /* Remove oldest stored duplication message for getting room for new duplication message */
-                sn_coap_protocol_linked_list_duplication_info_remove(handle, stored_duplication_info_ptr->addr_ptr, stored_duplication_info_ptr->port, stored_duplication_info_ptr->msg_id);
-            }
+    /* * * * Payload points to Packet data, it is copied after the header so that it is released with the message * * * */
+    if (coap_msg_ptr->payload_ptr && coap_msg_ptr->payload_len) {
+        sn_coap_hdr_s *owned_msg_ptr = NULL;
 
-            /* Store Duplication info to Linked list */
-            sn_coap_protocol_linked_list_duplication_info_store(handle, src_addr_ptr, returned_dst_coap_msg_ptr->msg_id);
-        } else { /* * * Message duplication detected * * */
-            /* Set returned status to User */
-            returned_dst_coap_msg_ptr->coap_status = COAP_STATUS_PARSER_DUPLICATED_MSG;
-            // todo: send ACK to confirmable messages
-            /* Because duplicate message, return with coap_status set */
-            return returned_dst_coap_msg_ptr;
+        if (coap_msg_ptr->payload_len <= UINT16_MAX - sizeof(sn_coap_hdr_s)) {
+            owned_msg_ptr = handle->sn_coap_protocol_malloc(sizeof(sn_coap_hdr_s) + coap_msg_ptr->payload_len);
+        }
+        if (owned_msg_ptr == NULL) {
+            sn_coap_parser_release_allocated_coap_msg_mem(handle, coap_msg_ptr);
+            return -2;
         }
+        *owned_msg_ptr = *coap_msg_ptr;
+        owned_msg_ptr->payload_ptr = (uint8_t *)(owned_msg_ptr + 1);
+        memcpy(owned_msg_ptr->payload_ptr, coap_msg_ptr->payload_ptr, coap_msg_ptr->payload_len);
+        handle->sn_coap_protocol_free(coap_msg_ptr);
+        coap_msg_ptr = owned_msg_ptr;
     }
-#endif
-
-    /*** And here we check if message was block message ***/
-    /*** If so, we call own block handling function and ***/
-    /*** return to caller.                              ***/
-#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
-
-    if (returned_dst_coap_msg_ptr->options_list_ptr != NULL &&
-            (returned_dst_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE ||
-             returned_dst_coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE)) {
-        returned_dst_coap_msg_ptr = sn_coap_handle_blockwise_message(handle, src_addr_ptr, returned_dst_coap_msg_ptr, param);
-    } else {
-        /* Get ... */
-        coap_blockwise_msg_s *stored_blockwise_msg_temp_ptr = NULL;
 
-        ns_list_foreach(coap_blockwise_msg_s, msg, &handle->linked_list_blockwise_sent_msgs) {
-            if (returned_dst_coap_msg_ptr->msg_id == msg->coap_msg_ptr->msg_id) {
-                stored_blockwise_msg_temp_ptr = msg;
+    /* * * * Reserve slot, producers race for head position with compare and swap * * * */
+    position = __atomic_load_n(&handle->ingress_head, __ATOMIC_RELAXED);
+    for (;;) {
+        slot_ptr = &handle->ingress_queue[position & handle->ingress_queue_mask];
+        int32_t diff = (int32_t)(__atomic_load_n(&slot_ptr->sequence, __ATOMIC_ACQUIRE) - position);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&handle->ingress_head, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
                 break;
             }
+        } else if (diff < 0) {
+            /* Queue is full */
+            sn_coap_parser_release_allocated_coap_msg_mem(handle, coap_msg_ptr);
+            return -1;
+        } else {
+            position = __atomic_load_n(&handle->ingress_head, __ATOMIC_RELAXED);
         }
+    }
 
-        if (stored_blockwise_msg_temp_ptr) {
-            tr_debug("sn_coap_protocol_parse - remove block message %d", stored_blockwise_msg_temp_ptr->coap_msg_ptr->msg_id);
-            ns_list_remove(&handle->linked_list_blockwise_sent_msgs, stored_blockwise_msg_temp_ptr);
+    slot_ptr->coap_msg_ptr = coap_msg_ptr;
+    slot_ptr->coap_version = coap_version;
+    slot_ptr->param = param;
+    slot_ptr->addr = *src_addr_ptr;
+    memcpy(slot_ptr->addr_data, src_addr_ptr->addr_ptr, src_addr_ptr->addr_len);
 
-            if (stored_blockwise_msg_temp_ptr->coap_msg_ptr) {
-                if(stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_ptr){
-                    handle->sn_coap_protocol_free(stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_ptr);
-                    stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_ptr = 0;
-                }
-                sn_coap_parser_release_allocated_coap_msg_mem(stored_blockwise_msg_temp_ptr->coap, stored_blockwise_msg_temp_ptr->coap_msg_ptr);
-            }
+    /* Slot is given to owner thread */
+    __atomic_store_n(&slot_ptr->sequence, position + 1, __ATOMIC_RELEASE);
 
-            handle->sn_coap_protocol_free(stored_blockwise_msg_temp_ptr);
-            stored_blockwise_msg_temp_ptr = 0;
-        }
-    }
+    return 0;
+#else
+    (void) handle;
+    (void) src_addr_ptr;
+    (void) packet_data_len;
+    (void) packet_data_ptr;
+    (void) param;
+    return -1;
+#endif
+}
 
-    if (!returned_dst_coap_msg_ptr) {
+sn_coap_hdr_s *sn_coap_protocol_ingress_process(struct coap_s *handle, sn_nsdl_addr_s **src_addr_ptr, void **param)
+{
+#if SN_COAP_INGRESS_QUEUE_MAX_SIZE /* If ingress queue is not used at all, this part of code will not be compiled */
+    coap_ingress_slot_s taken;
+    sn_coap_hdr_s       *returned_dst_coap_msg_ptr = NULL;
+
+    if (handle == NULL || handle->ingress_queue == NULL || src_addr_ptr == NULL || param == NULL) {
         return NULL;
     }
 
-#endif
+    sn_coap_protocol_tx_batch_begin(handle);
 
+    /* Messages handled by library are not returned, next message is taken instead */
+    while (returned_dst_coap_msg_ptr == NULL && sn_coap_protocol_ingress_take(handle, &taken)) {
+        *src_addr_ptr = &handle->ingress_addr;
+        *param = taken.param;
+        returned_dst_coap_msg_ptr = sn_coap_protocol_parse_message(handle, &handle->ingress_addr, taken.coap_msg_ptr,
+                                    taken.coap_version, taken.param);
+    }
 
-#if ENABLE_RESENDINGS  /* If Message resending is not used at all, this part of code will not be compiled */
+    sn_coap_protocol_tx_batch_end(handle);
 
-    /* Check if received Message type was acknowledgement */
-    if ((returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_ACKNOWLEDGEMENT) || (returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_RESET)) {
-        /* * * * Manage CoAP message resending by removing active resending message from Linked list * * */
+    return returned_dst_coap_msg_ptr;
+#else
+    (void) handle;
+    (void) src_addr_ptr;
+    (void) param;
+    return NULL;
+#endif
+}
 
-        /* Get node count i.e. count of active resending messages */
-        uint16_t stored_resending_msgs_count = handle->count_resent_msgs;
+int8_t sn_coap_protocol_set_egress_queue_size(struct coap_s *handle, uint16_t queue_size)
+{
+#if SN_COAP_EGRESS_QUEUE_MAX_SIZE /* If egress queue is not used at all, this part of code will not be compiled */
+    coap_egress_slot_s taken;
+    coap_egress_slot_s *queue_ptr = NULL;
 
-        /* Check if there is ongoing active message resendings */
-        if (stored_resending_msgs_count > 0) {
-            sn_nsdl_transmit_s *removed_msg_ptr = NULL;
+    if (handle == NULL || queue_size > SN_COAP_EGRESS_QUEUE_MAX_SIZE || (queue_size & (queue_size - 1)) ||
+            (uint32_t)queue_size * sizeof(coap_egress_slot_s) > UINT16_MAX) {
+        return -1;
+    }
 
-            /* Check if received message was confirmation for some active resending message */
-            removed_msg_ptr = sn_coap_protocol_linked_list_send_msg_search(handle, src_addr_ptr, returned_dst_coap_msg_ptr->msg_id);
+    if (queue_size) {
+        queue_ptr = handle->sn_coap_protocol_malloc(queue_size * sizeof(coap_egress_slot_s));
+        if (queue_ptr == NULL) {
+            return -1;
+        }
+        memset(queue_ptr, 0, queue_size * sizeof(coap_egress_slot_s));
+        for (uint16_t i = 0; i < queue_size; i++) {
+            queue_ptr[i].sequence = i;
+        }
+    }
 
-            if (removed_msg_ptr != NULL) {
-                if (returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_RESET) {
+    /* Messages in old queue are released without sending */
+    if (handle->egress_queue) {
+        while (sn_coap_protocol_egress_take(handle, &taken)) {
+            handle->sn_coap_protocol_free(taken.packet_ptr);
+        }
+        handle->sn_coap_protocol_free(handle->egress_queue);
+    }
+
+    handle->egress_queue = queue_ptr;
+    handle->egress_queue_mask = queue_size ? queue_size - 1 : 0;
+    handle->egress_head = 0;
+    handle->egress_tail = 0;
+
+    return 0;
+#else
+    (void) handle;
+    (void) queue_size;
+    return -1;
+#endif
+}
+
+int8_t sn_coap_protocol_egress_submit(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, sn_coap_hdr_s *src_coap_msg_ptr, void *param)
+{
+#if SN_COAP_EGRESS_QUEUE_MAX_SIZE /* If egress queue is not used at all, this part of code will not be compiled */
+    coap_egress_slot_s  *slot_ptr;
+    uint8_t             *packet_ptr;
+    uint16_t            packet_len;
+    uint16_t            uri_path_len = 0;
+    uint16_t            uri_query_len = 0;
+    int16_t             byte_count_built;
+    uint32_t            position;
+
+    if (handle == NULL || handle->egress_queue == NULL || dst_addr_ptr == NULL || dst_addr_ptr->addr_ptr == NULL ||
+            dst_addr_ptr->addr_len > SN_COAP_EGRESS_MAX_ADDR_LEN || src_coap_msg_ptr == NULL) {
+        return -1;
+    }
+
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
+    /* Blockwise transfers are stored by owner thread, so message must fit in one block */
+    if (handle->sn_coap_block_data_size &&
+            sn_coap_protocol_payload_total_len(handle, src_coap_msg_ptr) > sn_coap_protocol_block_size_limit(handle)) {
+        return -1;
+    }
+#endif
+
+    /* * * * Uri-Path and Uri-Query are stored after the packet for re-sending and blockwise records * * * */
+    if (src_coap_msg_ptr->uri_path_ptr) {
+        uri_path_len = src_coap_msg_ptr->uri_path_len;
+    }
+    if (src_coap_msg_ptr->options_list_ptr && src_coap_msg_ptr->options_list_ptr->uri_query_ptr) {
+        uri_query_len = src_coap_msg_ptr->options_list_ptr->uri_query_len;
+    }
+
+    /* * * * Build Packet data on this thread, Message ID is written by owner thread if it is not given * * * */
+    packet_len = sn_coap_builder_calc_needed_packet_data_size_2(src_coap_msg_ptr, handle->sn_coap_block_data_size);
+    if (packet_len == 0 || (uint32_t)packet_len + uri_path_len + uri_query_len > UINT16_MAX) {
+        return -2;
+    }
+    packet_ptr = handle->sn_coap_protocol_malloc(packet_len + uri_path_len + uri_query_len);
+    if (packet_ptr == NULL) {
+        return -2;
+    }
+    byte_count_built = sn_coap_builder_2(packet_ptr, src_coap_msg_ptr, handle->sn_coap_block_data_size);
+    if (byte_count_built < 0) {
+        handle->sn_coap_protocol_free(packet_ptr);
+        return -2;
+    }
+    if (uri_path_len) {
+        memcpy(packet_ptr + byte_count_built, src_coap_msg_ptr->uri_path_ptr, uri_path_len);
+    }
+    if (uri_query_len) {
+        memcpy(packet_ptr + byte_count_built + uri_path_len, src_coap_msg_ptr->options_list_ptr->uri_query_ptr, uri_query_len);
+    }
+
+    /* * * * Reserve slot, producers race for head position with compare and swap * * * */
+    position = __atomic_load_n(&handle->egress_head, __ATOMIC_RELAXED);
+    for (;;) {
+        slot_ptr = &handle->egress_queue[position & handle->egress_queue_mask];
+        int32_t diff = (int32_t)(__atomic_load_n(&slot_ptr->sequence, __ATOMIC_ACQUIRE) - position);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&handle->egress_head, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* Queue is full */
+            handle->sn_coap_protocol_free(packet_ptr);
+            return -1;
+        } else {
+            position = __atomic_load_n(&handle->egress_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot_ptr->packet_ptr = packet_ptr;
+    slot_ptr->packet_len = byte_count_built;
+    slot_ptr->uri_path_len = uri_path_len;
+    slot_ptr->uri_query_len = uri_query_len;
+    slot_ptr->msg_id_assign = src_coap_msg_ptr->msg_id == 0 &&
+                              (src_coap_msg_ptr->msg_type == COAP_MSG_TYPE_CONFIRMABLE ||
+                               src_coap_msg_ptr->msg_type == COAP_MSG_TYPE_NON_CONFIRMABLE);
+    slot_ptr->param = param;
+    slot_ptr->addr = *dst_addr_ptr;
+    memcpy(slot_ptr->addr_data, dst_addr_ptr->addr_ptr, dst_addr_ptr->addr_len);
+
+    /* Slot is given to owner thread */
+    __atomic_store_n(&slot_ptr->sequence, position + 1, __ATOMIC_RELEASE);
+
+    return 0;
+#else
+    (void) handle;
+    (void) dst_addr_ptr;
+    (void) src_coap_msg_ptr;
+    (void) param;
+    return -1;
+#endif
+}
+
+uint16_t sn_coap_protocol_egress_process(struct coap_s *handle)
+{
+#if SN_COAP_EGRESS_QUEUE_MAX_SIZE /* If egress queue is not used at all, this part of code will not be compiled */
+    coap_egress_slot_s  taken;
+    uint16_t            sent_count = 0;
+
+    if (handle == NULL || handle->egress_queue == NULL) {
+        return 0;
+    }
+
+    sn_coap_protocol_tx_batch_begin(handle);
+
+    /* Messages submitted while sending are left for the next call */
+    while (sent_count <= handle->egress_queue_mask && sn_coap_protocol_egress_take(handle, &taken)) {
+        sn_coap_protocol_egress_send(handle, &taken);
+        handle->sn_coap_protocol_free(taken.packet_ptr);
+        sent_count++;
+    }
+
+    sn_coap_protocol_tx_batch_end(handle);
+
+    return sent_count;
+#else
+    (void) handle;
+    return 0;
+#endif
+}
+
+int8_t sn_coap_protocol_get_stats(struct coap_s *handle, sn_coap_stats_s *stats_ptr)
+{
+    if (handle == NULL || stats_ptr == NULL) {
+        return -1;
+    }
+
+    memset(stats_ptr, 0, sizeof(sn_coap_stats_s));
+#if ENABLE_RESENDINGS
+    stats_ptr->resent_msgs = handle->count_resent_msgs;
+    stats_ptr->resent_bytes = handle->count_resent_bytes;
+#endif
+#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT
+    stats_ptr->duplication_msgs = handle->count_duplication_msgs;
+#endif
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
+    stats_ptr->blockwise_sent_msgs = ns_list_count(&handle->linked_list_blockwise_sent_msgs);
+    stats_ptr->blockwise_received_payloads = ns_list_count(&handle->linked_list_blockwise_received_payloads);
+#endif
+#if SN_COAP_OBSERVE_MAX_OBSERVERS
+    stats_ptr->observers = handle->count_observers;
+#endif
+#if SN_COAP_CLIENT_MAX_EXCHANGES
+    stats_ptr->exchanges = handle->count_exchanges;
+#endif
+#if SN_COAP_SERVER_PROFILE
+    stats_ptr->peers = handle->peer_table.peer_count;
+#endif
+
+    return 0;
+}
+
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
+int8_t prepare_blockwise_message(struct coap_s *handle, sn_coap_hdr_s *src_coap_msg_ptr)
+{
+    return sn_coap_protocol_prepare_blockwise(handle, src_coap_msg_ptr, handle->sn_coap_block_data_size);
+}
+
+static int8_t sn_coap_protocol_prepare_blockwise(struct coap_s *handle, sn_coap_hdr_s *src_coap_msg_ptr, uint16_t block_size)
+{
+    uint32_t payload_total_len = sn_coap_protocol_payload_total_len(handle, src_coap_msg_ptr);
+
+    if ((payload_total_len > block_size) && (block_size > 0)) {
+        /* * * * Add Blockwise option to send CoAP message * * */
+
+        /* Allocate memory for less used options */
+        if (sn_coap_parser_alloc_options(handle, src_coap_msg_ptr) == NULL) {
+            return -2;
+        }
+
+        /* Check if Request message */
+        if (src_coap_msg_ptr->msg_code < COAP_MSG_CODE_RESPONSE_CREATED) {
+            tr_debug("prepare_blockwise_message - block1 request");
+            /* Add Blockwise option, use Block1 because Request payload */
+            src_coap_msg_ptr->options_list_ptr->block1 = 0x08;      /* First block  (BLOCK NUMBER, 4 MSB bits) + More to come (MORE, 1 bit) */
+            src_coap_msg_ptr->options_list_ptr->block1 |= sn_coap_convert_block_size(block_size);
+
+            /* Add size1 parameter */
+            tr_debug("prepare_blockwise_message block1 request - payload len %lu", (unsigned long)payload_total_len);
+
+            src_coap_msg_ptr->options_list_ptr->use_size1 = true;
+            src_coap_msg_ptr->options_list_ptr->use_size2 = false;
+            src_coap_msg_ptr->options_list_ptr->size1 = payload_total_len;
+        } else { /* Response message */
+            tr_debug("prepare_blockwise_message - block2 response");
+            /* Add Blockwise option, use Block2 because Response payload */
+            src_coap_msg_ptr->options_list_ptr->block2 = 0x08;      /* First block  (BLOCK NUMBER, 4 MSB bits) + More to come (MORE, 1 bit) */
+            src_coap_msg_ptr->options_list_ptr->block2 |= sn_coap_convert_block_size(block_size);
+
+            src_coap_msg_ptr->options_list_ptr->use_size1 = false;
+            src_coap_msg_ptr->options_list_ptr->use_size2 = true;
+            src_coap_msg_ptr->options_list_ptr->size2 = payload_total_len;
+        }
+    }
+    return 0;
+}
+#endif
+
+int16_t sn_coap_protocol_build(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr,
+                               uint8_t *dst_packet_data_ptr, sn_coap_hdr_s *src_coap_msg_ptr, void *param)
+{
+    tr_debug("sn_coap_protocol_build - payload len %d", src_coap_msg_ptr->payload_len);
+    int16_t  byte_count_built     = 0;
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
+    uint32_t original_payload_len = 0;
+    uint8_t *original_payload_ptr = NULL;
+    bool     payload_provided     = false;
+    bool     block2_stateless     = false;
+    uint32_t block_offset         = 0;
+    uint16_t block_size           = 0;
+#endif
+    /* * * * Check given pointers  * * * */
+    if ((dst_addr_ptr == NULL) || (dst_packet_data_ptr == NULL) || (src_coap_msg_ptr == NULL) || handle == NULL) {
+        return -2;
+    }
+
+    if (dst_addr_ptr->addr_ptr == NULL) {
+        return -2;
+    }
+
+    /* Check if built Message type is else than Acknowledgement or Reset i.e. message type is Confirmable or Non-confirmable */
+    /* (for Acknowledgement and  Reset messages is written same Message ID than was in the Request message) */
+    if (src_coap_msg_ptr->msg_type != COAP_MSG_TYPE_ACKNOWLEDGEMENT &&
+            src_coap_msg_ptr->msg_type != COAP_MSG_TYPE_RESET &&
+            src_coap_msg_ptr->msg_id == 0) {
+        /* * * * Generate new Message ID and increase it by one  * * * */
+        src_coap_msg_ptr->msg_id = handle->message_id;
+        handle->message_id++;
+        if (handle->message_id == 0) {
+            handle->message_id = 1;
+        }
+    }
+
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
+
+    /* Block size can be smaller than the configured one because of path MTU or the peer */
+    block_size = sn_coap_protocol_block_size_select(handle, dst_addr_ptr, src_coap_msg_ptr);
+
+    /* If blockwising needed */
+    if ((sn_coap_protocol_payload_total_len(handle, src_coap_msg_ptr) > block_size) && (block_size > 0)) {
+        uint16_t header_payload_len = src_coap_msg_ptr->payload_len;
+        /* Store original Payload length, Size1 or Size2 gives it if payload is longer than payload_len can tell */
+        original_payload_len = sn_coap_protocol_payload_total_len(handle, src_coap_msg_ptr);
+
+        /* In stateless mode response is built again for each block, only the asked block is sent */
+        if (handle->sn_coap_block2_stateless && src_coap_msg_ptr->msg_code >= COAP_MSG_CODE_RESPONSE_CREATED) {
+            if (sn_coap_protocol_stateless_block2_select(handle, src_coap_msg_ptr, original_payload_len, &block_size, &block_offset) != 0) {
+                return -2;
+            }
+            block2_stateless = true;
+        }
+
+        /* Change Payload length of send message because Payload is blockwised */
+        src_coap_msg_ptr->payload_len = block_size;
+        if (original_payload_len - block_offset < block_size) {
+            src_coap_msg_ptr->payload_len = original_payload_len - block_offset;
+        }
+
+        /* First block is read from payload provider as well */
+        original_payload_ptr = src_coap_msg_ptr->payload_ptr;
+        if (handle->sn_coap_payload_provider_callback != NULL) {
+            payload_provided = true;
+            src_coap_msg_ptr->payload_ptr = (uint8_t *)handle->sn_coap_payload_provider_callback(handle, original_payload_ptr, block_offset, src_coap_msg_ptr->payload_len);
+            if (src_coap_msg_ptr->payload_ptr == NULL) {
+                src_coap_msg_ptr->payload_ptr = original_payload_ptr;
+                src_coap_msg_ptr->payload_len = header_payload_len;
+                return -2;
+            }
+        } else {
+            src_coap_msg_ptr->payload_ptr += block_offset;
+        }
+    }
+
+#endif
+    /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+    /* * * * Build Packet data from CoAP message by using CoAP Header builder  * * * */
+    /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
+    byte_count_built = sn_coap_builder_2(dst_packet_data_ptr, src_coap_msg_ptr, block_size);
+
+    if (payload_provided || block2_stateless) {
+        src_coap_msg_ptr->payload_ptr = original_payload_ptr;
+    }
+#else
+    byte_count_built = sn_coap_builder_2(dst_packet_data_ptr, src_coap_msg_ptr, handle->sn_coap_block_data_size);
+#endif
+
+    if (byte_count_built < 0) {
+        return byte_count_built;
+    }
+
+#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT /* If Message duplication detection is not used at all, this part of code will not be compiled */
+
+    /* Store Acknowledgement for replaying it if the request is received again */
+    if (src_coap_msg_ptr->msg_type == COAP_MSG_TYPE_ACKNOWLEDGEMENT && handle->sn_coap_duplication_response_cache_size) {
+        sn_coap_protocol_duplication_response_store(handle, dst_addr_ptr, src_coap_msg_ptr->msg_id,
+                dst_packet_data_ptr, byte_count_built);
+    }
+
+#endif
+
+#if ENABLE_RESENDINGS /* If Message resending is not used at all, this part of code will not be compiled */
+
+    /* Check if built Message type was confirmable, only these messages are resent */
+    if (src_coap_msg_ptr->msg_type == COAP_MSG_TYPE_CONFIRMABLE) {
+        /* Store message to Linked list for resending purposes */
+        sn_coap_protocol_linked_list_send_msg_store(handle, dst_addr_ptr, byte_count_built, dst_packet_data_ptr,
+                handle->system_time + (uint32_t)(handle->sn_coap_resending_intervall * RESPONSE_RANDOM_FACTOR),
+                param, src_coap_msg_ptr, src_coap_msg_ptr->uri_path_ptr, src_coap_msg_ptr->uri_path_len);
+    }
+
+#endif /* ENABLE_RESENDINGS */
+
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
+
+    /* If blockwising needed, stateless responses are built again by user for the rest of the blocks */
+    if ((original_payload_len > block_size) && (block_size > 0) && !block2_stateless) {
+
+        /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+        /* * * * Manage rest blockwise messages sending by storing them to Linked list * * * */
+        /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+        coap_blockwise_msg_s *stored_blockwise_msg_ptr;
+
+        stored_blockwise_msg_ptr = handle->sn_coap_protocol_malloc(sizeof(coap_blockwise_msg_s));
+        if (!stored_blockwise_msg_ptr) {
+            //block paylaod save failed, only first block can be build. Perhaps we should return error.
+            return byte_count_built;
+        }
+        memset(stored_blockwise_msg_ptr, 0, sizeof(coap_blockwise_msg_s));
+
+        /* Fill struct */
+        stored_blockwise_msg_ptr->timestamp = handle->system_time;
+
+        stored_blockwise_msg_ptr->coap_msg_ptr = sn_coap_protocol_copy_header(handle, src_coap_msg_ptr);
+        if( stored_blockwise_msg_ptr->coap_msg_ptr == NULL ){
+            handle->sn_coap_protocol_free(stored_blockwise_msg_ptr);
+            stored_blockwise_msg_ptr = 0;
+            return -2;
+        }
+
+        stored_blockwise_msg_ptr->payload_len = original_payload_len;
+
+        if (payload_provided) {
+            /* Following blocks are read from payload provider, payload is not copied */
+            stored_blockwise_msg_ptr->payload_provider = handle->sn_coap_payload_provider_callback;
+            stored_blockwise_msg_ptr->payload_ref = original_payload_ptr;
+        } else {
+            stored_blockwise_msg_ptr->coap_msg_ptr->payload_len = original_payload_len;
+            stored_blockwise_msg_ptr->coap_msg_ptr->payload_ptr = handle->sn_coap_protocol_malloc(stored_blockwise_msg_ptr->coap_msg_ptr->payload_len);
+
+            if (!stored_blockwise_msg_ptr->coap_msg_ptr->payload_ptr) {
+                //block payload save failed, only first block can be build. Perhaps we should return error.
+                sn_coap_parser_release_allocated_coap_msg_mem(handle, stored_blockwise_msg_ptr->coap_msg_ptr);
+                handle->sn_coap_protocol_free(stored_blockwise_msg_ptr);
+                stored_blockwise_msg_ptr = 0;
+                return byte_count_built;
+            }
+            memcpy(stored_blockwise_msg_ptr->coap_msg_ptr->payload_ptr, src_coap_msg_ptr->payload_ptr, stored_blockwise_msg_ptr->coap_msg_ptr->payload_len);
+        }
+
+        stored_blockwise_msg_ptr->coap = handle;
+
+#if SN_COAP_Q_BLOCK_MAX_PAYLOADS
+        /* Rest of the first set of Q-Block1 request is sent without waiting for responses, */
+        /* User sends the first block when this returns                                    */
+        if (sn_coap_protocol_linked_list_blockwise_msg_add(handle, dst_addr_ptr, stored_blockwise_msg_ptr) == 0 &&
+                src_coap_msg_ptr->msg_type == COAP_MSG_TYPE_NON_CONFIRMABLE &&
+                src_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE &&
+                src_coap_msg_ptr->options_list_ptr->use_q_block1) {
+            for (uint32_t block_number = 1; block_number < SN_COAP_Q_BLOCK_MAX_PAYLOADS; block_number++) {
+                if (sn_coap_protocol_q_block1_send(handle, stored_blockwise_msg_ptr, dst_addr_ptr, block_number, param) != 0) {
+                    break;
+                }
+            }
+        }
+#else
+        sn_coap_protocol_linked_list_blockwise_msg_add(handle, dst_addr_ptr, stored_blockwise_msg_ptr);
+#endif
+    }
+
+    else if (src_coap_msg_ptr->msg_code == COAP_MSG_CODE_REQUEST_GET) {
+        /* Response can be in blocks, keep what is needed for requesting the next block */
+        sn_coap_protocol_linked_list_blockwise_request_store(handle, dst_addr_ptr, src_coap_msg_ptr);
+    }
+
+#endif /* SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE */
+
+    tr_debug("sn_coap_protocol_build - msg id: [%d], bytes: [%d]", src_coap_msg_ptr->msg_id, byte_count_built);
+
+    /* * * * Return built CoAP message Packet data length  * * * */
+    return byte_count_built;
+}
+
+sn_coap_hdr_s *sn_coap_protocol_parse(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t packet_data_len, uint8_t *packet_data_ptr, void *param)
+{
+    tr_debug("sn_coap_protocol_parse");
+    sn_coap_hdr_s   *returned_dst_coap_msg_ptr = NULL;
+    coap_version_e   coap_version              = COAP_VERSION_UNKNOWN;
+
+    /* * * * Check given pointer * * * */
+    if (src_addr_ptr == NULL || src_addr_ptr->addr_ptr == NULL ||
+        packet_data_ptr == NULL || handle == NULL) {
+        return NULL;
+    }
+
+    /* * * * Parse Packet data to CoAP message by using CoAP Header parser * * * */
+    returned_dst_coap_msg_ptr = sn_coap_parser(handle, packet_data_len, packet_data_ptr, &coap_version);
+
+    /* Check status of returned pointer */
+    if (returned_dst_coap_msg_ptr == NULL) {
+        /* Memory allocation error in parser */
+        return NULL;
+    }
+
+    sn_coap_protocol_tx_batch_begin(handle);
+    returned_dst_coap_msg_ptr = sn_coap_protocol_parse_message(handle, src_addr_ptr, returned_dst_coap_msg_ptr, coap_version, param);
+    sn_coap_protocol_tx_batch_end(handle);
+
+    return returned_dst_coap_msg_ptr;
+}
+
+/**************************************************************************//**
+ * \fn static sn_coap_hdr_s *sn_coap_protocol_parse_message(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *returned_dst_coap_msg_ptr, coap_version_e coap_version, void *param)
+ *
+ * \brief Handles protocol state of parsed message: Reset and acknowledgements, duplicates, blockwise and resendings
+ *
+ * \return Message to return to user, NULL if message was handled by library
+ *****************************************************************************/
+static sn_coap_hdr_s *sn_coap_protocol_parse_message(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *returned_dst_coap_msg_ptr, coap_version_e coap_version, void *param)
+{
+    /* * * * Send bad request response if parsing fails * * * */
+    if (returned_dst_coap_msg_ptr->coap_status == COAP_STATUS_PARSER_ERROR_IN_HEADER) {
+        sn_coap_protocol_send_rst(handle, returned_dst_coap_msg_ptr->msg_id, src_addr_ptr, param);
+        sn_coap_parser_release_allocated_coap_msg_mem(handle, returned_dst_coap_msg_ptr);
+        return NULL;
+    }
+
+    /* * * * Check validity of parsed Header values  * * * */
+    if (sn_coap_header_validity_check(returned_dst_coap_msg_ptr, coap_version) != 0) {
+        /* If message code is in a reserved class (1, 6 or 7), send reset. Message code class is 3 MSB of the message code byte     */
+        if (((returned_dst_coap_msg_ptr->msg_code >> 5) == 1) ||        // if class == 1
+                ((returned_dst_coap_msg_ptr->msg_code >> 5) == 6) ||    // if class == 6
+                ((returned_dst_coap_msg_ptr->msg_code >> 5) == 7)) {    // if class == 7
+            sn_coap_protocol_send_rst(handle, returned_dst_coap_msg_ptr->msg_id, src_addr_ptr, param);
+        }
+
+        /* Release memory of CoAP message */
+        sn_coap_parser_release_allocated_coap_msg_mem(handle, returned_dst_coap_msg_ptr);
+
+        /* Return NULL because Header validity check failed */
+        return NULL;
+    }
+
+    /* Check if we need to send reset message */
+    /*  A recipient MUST acknowledge a Confirmable message with an Acknowledgement
+        message or, if it lacks context to process the message properly
+        (including the case where the message is Empty, uses a code with a
+        reserved class (1, 6 or 7), or has a message format error), MUST
+        reject it; rejecting a Confirmable message is effected by sending a
+        matching Reset message and otherwise ignoring it. */
+    if (returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_CONFIRMABLE) {
+        /* CoAP ping */
+        if (returned_dst_coap_msg_ptr->msg_code == COAP_MSG_CODE_EMPTY) {
+            sn_coap_protocol_send_rst(handle, returned_dst_coap_msg_ptr->msg_id, src_addr_ptr, param);
+
+            /* Release memory of CoAP message */
+            sn_coap_parser_release_allocated_coap_msg_mem(handle, returned_dst_coap_msg_ptr);
+
+            /* Return NULL because Header validity check failed */
+            return NULL;
+        }
+    }
+
+#if SN_COAP_OBSERVE_MAX_OBSERVERS
+    /* Reset to a notification cancels the observation */
+    if (returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_RESET) {
+        sn_coap_protocol_observer_reset(handle, src_addr_ptr, returned_dst_coap_msg_ptr->msg_id);
+    }
+#endif
+
+#if !SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is used, this part of code will not be compiled */
+    /* If blockwising used in received message */
+    if (returned_dst_coap_msg_ptr->options_list_ptr != NULL &&
+            (returned_dst_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE ||
+             returned_dst_coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE)) {
+        /* Set returned status to User */
+        returned_dst_coap_msg_ptr->coap_status = COAP_STATUS_PARSER_BLOCKWISE_MSG_REJECTED;
+        //todo: send response -> not implemented
+        return returned_dst_coap_msg_ptr;
+    }
+#endif /* !SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE */
+
+#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT/* If Message duplication is used, this part of code will not be compiled */
+
+    /* * * * Manage received CoAP message duplicate detection  * * * */
+
+    /* If no message duplication detected */
+    if (returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_CONFIRMABLE ||
+            returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_NON_CONFIRMABLE) {
+
+#if SN_COAP_SERVER_PROFILE
+        uint32_t peer_id = sn_coap_peer_table_intern(&handle->peer_table, src_addr_ptr, handle->system_time);
+
+        if (sn_coap_protocol_duplication_cache_search(handle, peer_id, returned_dst_coap_msg_ptr->msg_id) == -1) {
+            /* * * No Message duplication: Store received message for detecting later duplication * * */
+            sn_coap_protocol_duplication_cache_store(handle, peer_id, returned_dst_coap_msg_ptr->msg_id);
+        }
+#else
+        if (sn_coap_protocol_linked_list_duplication_info_search(handle, src_addr_ptr, returned_dst_coap_msg_ptr->msg_id) == NULL) {
+            /* * * No Message duplication: Store received message for detecting later duplication * * */
+
+            /* Get count of stored duplication messages */
+            uint32_t stored_duplication_msgs_count = handle->count_duplication_msgs;
+
+            /* Check if there is no room to store message for duplication detection purposes */
+            if (stored_duplication_msgs_count >= handle->sn_coap_duplication_buffer_size) {
+                /* Get oldest stored duplication message */
+                coap_duplication_info_s *stored_duplication_info_ptr = ns_list_get_first(&handle->linked_list_duplication_msgs);
+
+                /* Remove oldest stored duplication message for getting room for new duplication message */
+                sn_coap_protocol_linked_list_duplication_info_remove(handle, stored_duplication_info_ptr->addr_ptr, stored_duplication_info_ptr->port, stored_duplication_info_ptr->msg_id);
+            }
+
+            /* Store Duplication info to Linked list */
+            sn_coap_protocol_linked_list_duplication_info_store(handle, src_addr_ptr, returned_dst_coap_msg_ptr->msg_id);
+        }
+#endif
+        else { /* * * Message duplication detected * * */
+            /* Set returned status to User */
+            returned_dst_coap_msg_ptr->coap_status = COAP_STATUS_PARSER_DUPLICATED_MSG;
+
+            /* Send stored Acknowledgement again to confirmable messages */
+            if (returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_CONFIRMABLE && handle->sn_coap_duplication_response_cache_size) {
+                coap_duplication_response_s **response_ptr = sn_coap_protocol_duplication_response_find(handle, src_addr_ptr, returned_dst_coap_msg_ptr->msg_id);
+                if (response_ptr && *response_ptr) {
+                    sn_coap_protocol_tx(handle, (*response_ptr)->packet_ptr, (*response_ptr)->packet_len, src_addr_ptr, param);
+                }
+            }
+
+            /* Because duplicate message, return with coap_status set */
+            return returned_dst_coap_msg_ptr;
+        }
+    }
+#endif
+
+    /*** And here we check if message was block message ***/
+    /*** If so, we call own block handling function and ***/
+    /*** return to caller.                              ***/
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
+#if SN_COAP_Q_BLOCK_MAX_PAYLOADS
+    coap_blockwise_msg_s *q_block1_msg_ptr = sn_coap_protocol_q_block1_msg_find(handle, src_addr_ptr, returned_dst_coap_msg_ptr);
+
+    if (q_block1_msg_ptr) {
+        returned_dst_coap_msg_ptr = sn_coap_protocol_q_block1_continue(handle, src_addr_ptr, returned_dst_coap_msg_ptr, q_block1_msg_ptr, param);
+    } else
+#endif
+    if (returned_dst_coap_msg_ptr->options_list_ptr != NULL &&
+            (returned_dst_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE ||
+             returned_dst_coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE)) {
+        returned_dst_coap_msg_ptr = sn_coap_handle_blockwise_message(handle, src_addr_ptr, returned_dst_coap_msg_ptr, param);
+    } else {
+        /* Get ... */
+        coap_blockwise_msg_s *stored_blockwise_msg_temp_ptr = sn_coap_protocol_linked_list_blockwise_msg_find(handle, src_addr_ptr, returned_dst_coap_msg_ptr);
+
+        if (stored_blockwise_msg_temp_ptr) {
+            tr_debug("sn_coap_protocol_parse - remove block message %d", stored_blockwise_msg_temp_ptr->coap_msg_ptr->msg_id);
+            sn_coap_protocol_linked_list_blockwise_msg_remove(handle, stored_blockwise_msg_temp_ptr);
+            stored_blockwise_msg_temp_ptr = 0;
+        }
+    }
+
+    if (!returned_dst_coap_msg_ptr) {
+        return NULL;
+    }
+
+#endif
+
+
+#if ENABLE_RESENDINGS  /* If Message resending is not used at all, this part of code will not be compiled */
+
+    /* Check if received Message type was acknowledgement */
+    if ((returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_ACKNOWLEDGEMENT) || (returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_RESET)) {
+        /* * * * Manage CoAP message resending by removing active resending message from Linked list * * */
+
+        /* Get node count i.e. count of active resending messages */
+        uint32_t stored_resending_msgs_count = handle->count_resent_msgs;
+
+        /* Check if there is ongoing active message resendings */
+        if (stored_resending_msgs_count > 0) {
+            sn_nsdl_transmit_s *removed_msg_ptr = NULL;
+
+            /* Check if received message was confirmation for some active resending message */
+            removed_msg_ptr = sn_coap_protocol_linked_list_send_msg_search(handle, src_addr_ptr, returned_dst_coap_msg_ptr->msg_id);
+
+            if (removed_msg_ptr != NULL) {
+                if (returned_dst_coap_msg_ptr->msg_type == COAP_MSG_TYPE_RESET) {
                     if(removed_msg_ptr->uri_path_len) {
                         returned_dst_coap_msg_ptr->uri_path_ptr = handle->sn_coap_protocol_malloc(removed_msg_ptr->uri_path_len);
                         if (returned_dst_coap_msg_ptr->uri_path_ptr != NULL) {
@@ -711,615 +1843,2096 @@ sn_coap_hdr_s *sn_coap_protocol_parse(struct coap_s *handle, sn_nsdl_addr_s *src
                         }
                     }
                 }
-                /* Remove resending message from active message resending Linked list */
-                sn_coap_protocol_linked_list_send_msg_remove(handle, src_addr_ptr, returned_dst_coap_msg_ptr->msg_id);
+                /* Remove resending message from active message resending Linked list */
+                sn_coap_protocol_linked_list_send_msg_remove(handle, src_addr_ptr, returned_dst_coap_msg_ptr->msg_id);
+            }
+        }
+    }
+#endif /* ENABLE_RESENDINGS */
+
+#if SN_COAP_CLIENT_MAX_EXCHANGES
+    /* * * * Give response to callback of the request * * * */
+    sn_coap_protocol_exchange_complete(handle, src_addr_ptr, returned_dst_coap_msg_ptr);
+#endif
+
+    /* * * * Return parsed CoAP message  * * * */
+    return returned_dst_coap_msg_ptr;
+}
+
+
+int8_t sn_coap_protocol_exec(struct coap_s *handle, uint32_t current_time)
+{
+    if( !handle ){
+       return -1;
+    }
+
+    /* * * * Store current System time * * * */
+    handle->system_time = current_time;
+
+    sn_coap_protocol_tx_batch_begin(handle);
+
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
+    /* * * * Remove old blocwise data * * * */
+    sn_coap_protocol_linked_list_blockwise_remove_old_data(handle);
+#endif
+
+
+#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT
+    /* * * * Remove old duplication messages * * * */
+#if SN_COAP_SERVER_PROFILE
+    sn_coap_protocol_duplication_cache_remove_old_ones(handle);
+#else
+    sn_coap_protocol_linked_list_duplication_info_remove_old_ones(handle);
+#endif
+#endif
+
+#if SN_COAP_SERVER_PROFILE
+    /* * * * Remove peers which are not used anymore * * * */
+    sn_coap_peer_table_remove_idle(&handle->peer_table, current_time);
+#endif
+
+#if SN_COAP_OBSERVE_MAX_OBSERVERS
+    /* * * * Send notifications which are due * * * */
+    sn_coap_protocol_observe_schedule(handle);
+#endif
+
+#if SN_COAP_CLIENT_MAX_EXCHANGES
+    /* * * * Complete requests which have not been responded * * * */
+    sn_coap_protocol_exchange_remove_old_ones(handle);
+#endif
+
+#if ENABLE_RESENDINGS
+    sn_coap_send_failure_s failures[SN_COAP_SEND_FAILURE_BATCH_SIZE];
+    coap_send_msg_list_t failed_msgs;
+    uint8_t failure_count = 0;
+
+    ns_list_init(&failed_msgs);
+
+    /* Check if there is ongoing active message sendings */
+    ns_list_foreach_safe(coap_send_msg_s, stored_msg_ptr, &handle->linked_list_resent_msgs) {
+        // First check that msg belongs to handle
+        if( stored_msg_ptr->coap == handle ){
+            /* Check if it is time to send this message */
+            if (current_time >= stored_msg_ptr->resending_time) {
+                /* * * Increase Resending counter  * * */
+                stored_msg_ptr->resending_counter++;
+
+                /* Check if all re-sendings have been done */
+                if (stored_msg_ptr->resending_counter > handle->sn_coap_resending_count) {
+                    coap_version_e coap_version = COAP_VERSION_UNKNOWN;
+
+#if SN_COAP_CLIENT_MAX_EXCHANGES
+                    /* Pending exchange of the request is completed without waiting for its timeout */
+                    sn_coap_protocol_exchange_send_failed(handle, stored_msg_ptr->send_msg_ptr->dst_addr_ptr, stored_msg_ptr->msg_id);
+#endif
+
+                    /* If send failure callback have been defined, report failure from stored message info */
+                    if (handle->sn_coap_send_failure_callback != 0) {
+                        sn_coap_send_failure_s *failure = &failures[failure_count++];
+
+                        sn_coap_protocol_linked_list_send_msg_unlink(handle, stored_msg_ptr);
+
+                        failure->msg_id = stored_msg_ptr->msg_id;
+                        failure->msg_code = (sn_coap_msg_code_e)stored_msg_ptr->msg_code;
+                        failure->token_len = stored_msg_ptr->token_len;
+                        failure->token_ptr = stored_msg_ptr->token;
+                        failure->uri_path_len = stored_msg_ptr->send_msg_ptr->uri_path_len;
+                        failure->uri_path_ptr = stored_msg_ptr->send_msg_ptr->uri_path_ptr;
+                        failure->dst_addr_ptr = stored_msg_ptr->send_msg_ptr->dst_addr_ptr;
+                        failure->param = stored_msg_ptr->param;
+
+                        /* Message is released after callback, so that failure info stays valid */
+                        ns_list_add_to_end(&failed_msgs, stored_msg_ptr);
+
+                        if (failure_count == SN_COAP_SEND_FAILURE_BATCH_SIZE) {
+                            sn_coap_protocol_send_failures_flush(handle, failures, failure_count, &failed_msgs);
+                            failure_count = 0;
+                        }
+                        continue;
+                    }
+
+                    /* If RX callback have been defined.. */
+                    if (stored_msg_ptr->coap->sn_coap_rx_callback != 0) {
+                        sn_coap_hdr_s *tmp_coap_hdr_ptr;
+                        /* Parse CoAP message, set status and call RX callback */
+                        tmp_coap_hdr_ptr = sn_coap_parser(stored_msg_ptr->coap, stored_msg_ptr->send_msg_ptr->packet_len, stored_msg_ptr->send_msg_ptr->packet_ptr, &coap_version);
+
+                        if (tmp_coap_hdr_ptr != 0) {
+                            tmp_coap_hdr_ptr->coap_status = COAP_STATUS_BUILDER_MESSAGE_SENDING_FAILED;
+
+                            stored_msg_ptr->coap->sn_coap_rx_callback(tmp_coap_hdr_ptr, stored_msg_ptr->send_msg_ptr->dst_addr_ptr, stored_msg_ptr->param);
+
+                            sn_coap_parser_release_allocated_coap_msg_mem(stored_msg_ptr->coap, tmp_coap_hdr_ptr);
+                        }
+                    }
+                    /* Remove message from Linked list */
+                    sn_coap_protocol_linked_list_send_msg_remove(handle, stored_msg_ptr->send_msg_ptr->dst_addr_ptr, stored_msg_ptr->msg_id);
+                } else {
+#if SN_COAP_SERVER_PROFILE && SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE && SN_COAP_BLOCK_SIZE_TUNING
+                    /* Message or its response was lost, counted to loss ratio of the peer */
+                    sn_coap_protocol_peer_block_size_update(handle, stored_msg_ptr->peer_id, 0, 0);
+#endif
+                    /* Send message  */
+                    sn_coap_protocol_tx(handle, stored_msg_ptr->send_msg_ptr->packet_ptr,
+                                        stored_msg_ptr->send_msg_ptr->packet_len, stored_msg_ptr->send_msg_ptr->dst_addr_ptr, stored_msg_ptr->param);
+
+                    /* * * Count new Resending time  * * */
+                    stored_msg_ptr->resending_time = current_time + (((uint32_t)(handle->sn_coap_resending_intervall * RESPONSE_RANDOM_FACTOR)) <<
+                                                     stored_msg_ptr->resending_counter);
+                }
+
+            }
+        }
+    }
+
+    /* Report rest of the failed messages */
+    if (failure_count) {
+        sn_coap_protocol_send_failures_flush(handle, failures, failure_count, &failed_msgs);
+    }
+
+#endif /* ENABLE_RESENDINGS */
+
+    sn_coap_protocol_tx_batch_end(handle);
+
+    return 0;
+}
+
+#if ENABLE_RESENDINGS  /* If Message resending is not used at all, this part of code will not be compiled */
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_linked_list_send_msg_store(sn_nsdl_addr_s *dst_addr_ptr, uint16_t send_packet_data_len, uint8_t *send_packet_data_ptr, uint32_t sending_time)
+ *
+ * \brief Stores message to Linked list for sending purposes.
+
+ * \param *dst_addr_ptr is pointer to destination address where CoAP message will be sent
+ *
+ * \param send_packet_data_len is length of Packet data to be stored
+ *
+ * \param *send_packet_data_ptr is Packet data to be stored
+ *
+ * \param sending_time is stored sending time
+ *
+ * \param *coap_msg_ptr is CoAP message of the packet, its Message ID, code and Token are stored
+ *****************************************************************************/
+
+static void sn_coap_protocol_linked_list_send_msg_store(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, uint16_t send_packet_data_len,
+        uint8_t *send_packet_data_ptr, uint32_t sending_time, void *param, const sn_coap_hdr_s *coap_msg_ptr, uint8_t *uri_path_ptr, uint8_t uri_path_len)
+{
+
+    coap_send_msg_s *stored_msg_ptr              = NULL;
+#if SN_COAP_SERVER_PROFILE
+    uint32_t peer_id;
+#endif
+
+    /* If both queue parameters are "0" or resending count is "0", then re-sending is disabled */
+    if (((handle->sn_coap_resending_queue_msgs == 0) && (handle->sn_coap_resending_queue_bytes == 0)) || (handle->sn_coap_resending_count == 0)) {
+        return;
+    }
+
+    if (handle->sn_coap_resending_queue_msgs > 0) {
+        if (handle->count_resent_msgs >= handle->sn_coap_resending_queue_msgs) {
+            return;
+        }
+    }
+
+    /* Check resending queue size, if buffer size is defined */
+    if (handle->sn_coap_resending_queue_bytes > 0) {
+        if ((handle->count_resent_bytes + send_packet_data_len) > handle->sn_coap_resending_queue_bytes) {
+            return;
+        }
+    }
+
+#if SN_COAP_SERVER_PROFILE
+    /* Index for finding active resending messages by Message ID is created when first needed */
+    if (handle->resent_msgs_hash == NULL) {
+        handle->resent_msgs_hash = handle->sn_coap_protocol_malloc(SN_COAP_RESENDING_HASH_SIZE * sizeof(coap_send_msg_s *));
+        if (handle->resent_msgs_hash == NULL) {
+            return;
+        }
+        memset(handle->resent_msgs_hash, 0, SN_COAP_RESENDING_HASH_SIZE * sizeof(coap_send_msg_s *));
+    }
+
+    /* Destination address is stored only once to peer table */
+    peer_id = sn_coap_peer_table_intern(&handle->peer_table, dst_addr_ptr, handle->system_time);
+    if (peer_id == 0) {
+        return;
+    }
+#endif
+
+    /* Allocating memory for stored message */
+    stored_msg_ptr = sn_coap_protocol_allocate_mem_for_msg(handle, dst_addr_ptr, send_packet_data_len);
+
+    if (stored_msg_ptr == 0) {
+        return;
+    }
+
+    /* Filling of coap_send_msg_s with initialization values */
+    stored_msg_ptr->resending_counter = 0;
+    stored_msg_ptr->resending_time = sending_time;
+
+    /* Store message info needed for reporting failed sending */
+    stored_msg_ptr->msg_id = coap_msg_ptr->msg_id;
+    stored_msg_ptr->msg_code = coap_msg_ptr->msg_code;
+    if (coap_msg_ptr->token_ptr && coap_msg_ptr->token_len <= sizeof(stored_msg_ptr->token)) {
+        stored_msg_ptr->token_len = coap_msg_ptr->token_len;
+        memcpy(stored_msg_ptr->token, coap_msg_ptr->token_ptr, coap_msg_ptr->token_len);
+    }
+
+    /* Filling of sn_nsdl_transmit_s */
+    stored_msg_ptr->send_msg_ptr->protocol = SN_NSDL_PROTOCOL_COAP;
+    stored_msg_ptr->send_msg_ptr->packet_len = send_packet_data_len;
+    memcpy(stored_msg_ptr->send_msg_ptr->packet_ptr, send_packet_data_ptr, send_packet_data_len);
+
+    /* Filling of sn_nsdl_addr_s */
+#if SN_COAP_SERVER_PROFILE
+    stored_msg_ptr->peer_id = peer_id;
+    sn_coap_peer_table_ref(&handle->peer_table, peer_id);
+    stored_msg_ptr->send_msg_ptr->dst_addr_ptr = sn_coap_peer_table_get_addr(&handle->peer_table, peer_id);
+#else
+    stored_msg_ptr->send_msg_ptr->dst_addr_ptr->type = dst_addr_ptr->type;
+    stored_msg_ptr->send_msg_ptr->dst_addr_ptr->addr_len = dst_addr_ptr->addr_len;
+    memcpy(stored_msg_ptr->send_msg_ptr->dst_addr_ptr->addr_ptr, dst_addr_ptr->addr_ptr, dst_addr_ptr->addr_len);
+    stored_msg_ptr->send_msg_ptr->dst_addr_ptr->port = dst_addr_ptr->port;
+#endif
+
+    stored_msg_ptr->coap = handle;
+    stored_msg_ptr->param = param;
+
+    if (uri_path_len) {
+        stored_msg_ptr->send_msg_ptr->uri_path_ptr = handle->sn_coap_protocol_malloc(uri_path_len);
+        if (stored_msg_ptr->send_msg_ptr->uri_path_ptr == NULL){
+            return;
+        }
+        stored_msg_ptr->send_msg_ptr->uri_path_len = uri_path_len;
+        memcpy(stored_msg_ptr->send_msg_ptr->uri_path_ptr, uri_path_ptr, uri_path_len);
+    }
+
+
+    /* Storing Resending message to Linked list */
+    ns_list_add_to_end(&handle->linked_list_resent_msgs, stored_msg_ptr);
+    ++handle->count_resent_msgs;
+    handle->count_resent_bytes += send_packet_data_len;
+
+#if SN_COAP_SERVER_PROFILE
+    /* Add message to the head of its index bucket */
+    coap_send_msg_s **bucket = &handle->resent_msgs_hash[stored_msg_ptr->msg_id & (SN_COAP_RESENDING_HASH_SIZE - 1)];
+    stored_msg_ptr->hash_next = *bucket;
+    *bucket = stored_msg_ptr;
+#endif
+}
+
+/**************************************************************************//**
+ * \fn static sn_nsdl_transmit_s *sn_coap_protocol_linked_list_send_msg_search(sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id)
+ *
+ * \brief Searches stored resending message from Linked list
+ *
+ * \param *src_addr_ptr is searching key for searched message
+ *
+ * \param msg_id is searching key for searched message
+ *
+ * \return Return value is pointer to found stored resending message in Linked
+ *         list or NULL if message not found
+ *****************************************************************************/
+
+static sn_nsdl_transmit_s *sn_coap_protocol_linked_list_send_msg_search(struct coap_s *handle,
+        sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id)
+{
+    coap_send_msg_s *stored_msg_ptr = sn_coap_protocol_linked_list_send_msg_find(handle, src_addr_ptr, msg_id);
+
+    if (stored_msg_ptr) {
+        /* * * Message found, return pointer to that stored resending message * * * */
+        return stored_msg_ptr->send_msg_ptr;
+    }
+
+    /* Message not found */
+    return NULL;
+}
+
+/**************************************************************************//**
+ * \fn static coap_send_msg_s *sn_coap_protocol_linked_list_send_msg_find(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id)
+ *
+ * \brief Finds stored resending message. In server profile the Message ID index
+ *        is used, otherwise whole Linked list is searched.
+ *
+ * \param *src_addr_ptr is searching key for searched message, or NULL to match any address
+ *
+ * \param msg_id is searching key for searched message
+ *
+ * \return Return value is pointer to found message or NULL if message not found
+ *****************************************************************************/
+
+static coap_send_msg_s *sn_coap_protocol_linked_list_send_msg_find(struct coap_s *handle,
+        sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id)
+{
+#if SN_COAP_SERVER_PROFILE
+    uint32_t peer_id = 0;
+
+    if (handle->resent_msgs_hash == NULL) {
+        return NULL;
+    }
+    if (src_addr_ptr) {
+        peer_id = sn_coap_peer_table_find(&handle->peer_table, src_addr_ptr);
+        if (peer_id == 0) {
+            return NULL;
+        }
+    }
+    for (coap_send_msg_s *stored_msg_ptr = handle->resent_msgs_hash[msg_id & (SN_COAP_RESENDING_HASH_SIZE - 1)];
+            stored_msg_ptr != NULL; stored_msg_ptr = stored_msg_ptr->hash_next) {
+#else
+    /* Loop all stored resending messages Linked list */
+    ns_list_foreach(coap_send_msg_s, stored_msg_ptr, &handle->linked_list_resent_msgs) {
+#endif
+        /* If message's Message ID is same than is searched */
+        if (stored_msg_ptr->msg_id != msg_id) {
+            continue;
+        }
+        if (src_addr_ptr == NULL) {
+            return stored_msg_ptr;
+        }
+#if SN_COAP_SERVER_PROFILE
+        if (stored_msg_ptr->peer_id == peer_id) {
+            return stored_msg_ptr;
+        }
+#else
+        /* If message's Source address is same than is searched */
+        if (0 == memcmp(src_addr_ptr->addr_ptr, stored_msg_ptr->send_msg_ptr->dst_addr_ptr->addr_ptr, src_addr_ptr->addr_len)) {
+            /* If message's Source address port is same than is searched */
+            if (stored_msg_ptr->send_msg_ptr->dst_addr_ptr->port == src_addr_ptr->port) {
+                return stored_msg_ptr;
+            }
+        }
+#endif
+    }
+
+    return NULL;
+}
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_linked_list_send_msg_remove(sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id)
+ *
+ * \brief Removes stored resending message from Linked list
+ *
+ * \param *src_addr_ptr is searching key for searched message
+ * \param msg_id is searching key for removed message
+ *****************************************************************************/
+
+static void sn_coap_protocol_linked_list_send_msg_remove(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id)
+{
+    coap_send_msg_s *stored_msg_ptr = sn_coap_protocol_linked_list_send_msg_find(handle, src_addr_ptr, msg_id);
+
+    if (stored_msg_ptr) {
+        /* Remove message from Linked list */
+        sn_coap_protocol_linked_list_send_msg_unlink(handle, stored_msg_ptr);
+
+        /* Free memory of stored message */
+        sn_coap_protocol_release_allocated_send_msg_mem(handle, stored_msg_ptr);
+    }
+}
+#endif /* ENABLE_RESENDINGS */
+
+
+static void sn_coap_protocol_send_rst(struct coap_s *handle, uint16_t msg_id, sn_nsdl_addr_s *addr_ptr, void *param)
+{
+    uint8_t packet_ptr[4];
+
+    /* Add CoAP version and message type */
+    packet_ptr[0] = COAP_VERSION_1;
+    packet_ptr[0] |= COAP_MSG_TYPE_RESET;
+
+    /* Add message code */
+    packet_ptr[1] = COAP_MSG_CODE_EMPTY;
+
+    /* Add message ID */
+    packet_ptr[2] = msg_id >> 8;
+    packet_ptr[3] = (uint8_t)msg_id;
+
+    /* Send RST */
+    sn_coap_protocol_tx(handle, packet_ptr, 4, addr_ptr, param);
+
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_tx(struct coap_s *handle, uint8_t *packet_ptr, uint16_t packet_len, sn_nsdl_addr_s *dst_addr_ptr, void *param)
+ *
+ * \brief Sends packet generated by the library. Packet is copied to TX batch if packets
+ *        are being collected, otherwise it is given to TX callback.
+ *****************************************************************************/
+
+static void sn_coap_protocol_tx(struct coap_s *handle, uint8_t *packet_ptr, uint16_t packet_len, sn_nsdl_addr_s *dst_addr_ptr, void *param)
+{
+    coap_tx_batch_s *batch_ptr = handle->tx_batch;
+
+    if (batch_ptr && batch_ptr->depth && dst_addr_ptr->addr_len <= SN_COAP_TX_BATCH_MAX_ADDR_LEN) {
+        sn_coap_tx_entry_s *entry_ptr;
+
+        if (batch_ptr->count == SN_COAP_TX_BATCH_SIZE) {
+            sn_coap_protocol_tx_batch_flush(handle);
+        }
+
+        entry_ptr = &batch_ptr->entries[batch_ptr->count];
+        entry_ptr->packet_ptr = handle->sn_coap_protocol_malloc(packet_len);
+        if (entry_ptr->packet_ptr) {
+            memcpy(entry_ptr->packet_ptr, packet_ptr, packet_len);
+            entry_ptr->packet_len = packet_len;
+            entry_ptr->param = param;
+            entry_ptr->dst_addr_ptr = &batch_ptr->addrs[batch_ptr->count];
+            *entry_ptr->dst_addr_ptr = *dst_addr_ptr;
+            entry_ptr->dst_addr_ptr->addr_ptr = batch_ptr->addr_data[batch_ptr->count];
+            memcpy(entry_ptr->dst_addr_ptr->addr_ptr, dst_addr_ptr->addr_ptr, dst_addr_ptr->addr_len);
+            batch_ptr->count++;
+            return;
+        }
+
+        /* Out of memory, collected packets are sent first to keep the order */
+        sn_coap_protocol_tx_batch_flush(handle);
+    }
+
+    handle->sn_coap_tx_callback(packet_ptr, packet_len, dst_addr_ptr, param);
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_tx_batch_begin(struct coap_s *handle)
+ *
+ * \brief Starts collecting packets to TX batch, if batch TX callback is set
+ *****************************************************************************/
+
+static void sn_coap_protocol_tx_batch_begin(struct coap_s *handle)
+{
+    if (handle->tx_batch) {
+        handle->tx_batch->depth++;
+    }
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_tx_batch_end(struct coap_s *handle)
+ *
+ * \brief Gives collected packets to batch TX callback when outermost collecting call ends
+ *****************************************************************************/
+
+static void sn_coap_protocol_tx_batch_end(struct coap_s *handle)
+{
+    if (handle->tx_batch && handle->tx_batch->depth && --handle->tx_batch->depth == 0) {
+        sn_coap_protocol_tx_batch_flush(handle);
+    }
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_tx_batch_flush(struct coap_s *handle)
+ *
+ * \brief Gives collected packets to batch TX callback and releases the packet copies
+ *****************************************************************************/
+
+static void sn_coap_protocol_tx_batch_flush(struct coap_s *handle)
+{
+    coap_tx_batch_s *batch_ptr = handle->tx_batch;
+    uint8_t count = batch_ptr->count;
+    uint8_t depth = batch_ptr->depth;
+    uint8_t i;
+
+    if (count == 0) {
+        return;
+    }
+
+    /* Packets sent from the callback go to TX callback, entries stay valid during the call */
+    batch_ptr->count = 0;
+    batch_ptr->depth = 0;
+    handle->sn_coap_tx_batch_callback(handle, batch_ptr->entries, count);
+    batch_ptr->depth = depth;
+
+    for (i = 0; i < count; i++) {
+        handle->sn_coap_protocol_free(batch_ptr->entries[i].packet_ptr);
+    }
+}
+#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT /* If Message duplication detection is not used at all, this part of code will not be compiled */
+#if SN_COAP_SERVER_PROFILE
+
+/**************************************************************************//**
+ * \fn static uint32_t sn_coap_protocol_duplication_cache_hash(uint32_t peer_id, uint16_t msg_id)
+ *
+ * \brief Calculates FNV-1a hash of Duplication cache key
+ *****************************************************************************/
+
+static uint32_t sn_coap_protocol_duplication_cache_hash(uint32_t peer_id, uint16_t msg_id)
+{
+    uint32_t hash = 2166136261u;
+
+    hash = (hash ^ (peer_id & 0xffff)) * 16777619u;
+    hash = (hash ^ (peer_id >> 16)) * 16777619u;
+    hash = (hash ^ msg_id) * 16777619u;
+
+    return hash;
+}
+
+/**************************************************************************//**
+ * \fn static void **sn_coap_protocol_duplication_chunks_alloc(struct coap_s *handle, uint32_t count, uint16_t element_size)
+ *
+ * \brief Allocates zeroed array of count elements in chunks of SN_COAP_DUPLICATION_CHUNK_SIZE
+ *        elements, so that the array is not limited by the 16-bit allocator
+ *
+ * \return Pointer to chunk pointers, NULL if count is 0, too big or out of memory
+ *****************************************************************************/
+
+static void **sn_coap_protocol_duplication_chunks_alloc(struct coap_s *handle, uint32_t count, uint16_t element_size)
+{
+    uint32_t chunk_count = (count + SN_COAP_DUPLICATION_CHUNK_SIZE - 1) / SN_COAP_DUPLICATION_CHUNK_SIZE;
+    void **chunks;
+    uint32_t i;
+
+    if (chunk_count == 0 || chunk_count > UINT16_MAX / sizeof(void *)) {
+        return NULL;
+    }
+
+    chunks = handle->sn_coap_protocol_malloc(chunk_count * sizeof(void *));
+    if (chunks == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < chunk_count; i++) {
+        /* Last chunk is only as big as needed */
+        uint32_t elements = count - i * SN_COAP_DUPLICATION_CHUNK_SIZE;
+        if (elements > SN_COAP_DUPLICATION_CHUNK_SIZE) {
+            elements = SN_COAP_DUPLICATION_CHUNK_SIZE;
+        }
+        chunks[i] = handle->sn_coap_protocol_malloc(elements * element_size);
+        if (chunks[i] == NULL) {
+            while (i--) {
+                handle->sn_coap_protocol_free(chunks[i]);
+            }
+            handle->sn_coap_protocol_free(chunks);
+            return NULL;
+        }
+        memset(chunks[i], 0, elements * element_size);
+    }
+
+    return chunks;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_duplication_chunks_free(struct coap_s *handle, void **chunks, uint32_t count)
+ *
+ * \brief Releases array allocated with sn_coap_protocol_duplication_chunks_alloc()
+ *****************************************************************************/
+
+static void sn_coap_protocol_duplication_chunks_free(struct coap_s *handle, void **chunks, uint32_t count)
+{
+    uint32_t chunk_count = (count + SN_COAP_DUPLICATION_CHUNK_SIZE - 1) / SN_COAP_DUPLICATION_CHUNK_SIZE;
+    uint32_t i;
+
+    if (chunks == NULL) {
+        return;
+    }
+    for (i = 0; i < chunk_count; i++) {
+        handle->sn_coap_protocol_free(chunks[i]);
+    }
+    handle->sn_coap_protocol_free(chunks);
+}
+
+/**************************************************************************//**
+ * \fn static coap_duplication_entry_s *sn_coap_protocol_duplication_entry(struct coap_s *handle, uint32_t position)
+ *
+ * \brief Returns Duplication cache entry in given ring position
+ *****************************************************************************/
+
+static coap_duplication_entry_s *sn_coap_protocol_duplication_entry(struct coap_s *handle, uint32_t position)
+{
+    return (coap_duplication_entry_s *)handle->duplication_ring[position / SN_COAP_DUPLICATION_CHUNK_SIZE] +
+           (position & (SN_COAP_DUPLICATION_CHUNK_SIZE - 1));
+}
+
+/**************************************************************************//**
+ * \fn static uint32_t *sn_coap_protocol_duplication_slot(struct coap_s *handle, uint32_t slot)
+ *
+ * \brief Returns Duplication cache hash slot
+ *****************************************************************************/
+
+static uint32_t *sn_coap_protocol_duplication_slot(struct coap_s *handle, uint32_t slot)
+{
+    return (uint32_t *)handle->duplication_slots[slot / SN_COAP_DUPLICATION_CHUNK_SIZE] +
+           (slot & (SN_COAP_DUPLICATION_CHUNK_SIZE - 1));
+}
+
+/**************************************************************************//**
+ * \fn static coap_duplication_response_s **sn_coap_protocol_duplication_response(struct coap_s *handle, uint32_t position)
+ *
+ * \brief Returns place of stored Acknowledgement of entry in given ring position.
+ *        Acknowledgements must be enabled.
+ *****************************************************************************/
+
+static coap_duplication_response_s **sn_coap_protocol_duplication_response(struct coap_s *handle, uint32_t position)
+{
+    return (coap_duplication_response_s **)handle->duplication_responses[position / SN_COAP_DUPLICATION_CHUNK_SIZE] +
+           (position & (SN_COAP_DUPLICATION_CHUNK_SIZE - 1));
+}
+
+/**************************************************************************//**
+ * \fn static int8_t sn_coap_protocol_duplication_cache_alloc(struct coap_s *handle, uint32_t capacity)
+ *
+ * \brief Allocates Duplication cache for given number of entries. Cache is a ring
+ *        buffer of entries in arrival order, indexed by an open addressing hash
+ *        table of ring positions. Both are allocated in chunks. Newest entries
+ *        of the old cache are kept.
+ *
+ * \param capacity is maximum number of stored entries, 0 releases the cache
+ *
+ * \return 0 on success, -1 if capacity is too big or out of memory
+ *****************************************************************************/
+
+static int8_t sn_coap_protocol_duplication_cache_alloc(struct coap_s *handle, uint32_t capacity)
+{
+    void **old_ring = handle->duplication_ring;
+    void **old_slots = handle->duplication_slots;
+    void **old_responses = handle->duplication_responses;
+    uint32_t old_capacity = handle->sn_coap_duplication_buffer_size;
+    uint32_t old_slot_count = handle->duplication_slot_mask + 1;
+    uint32_t old_head = handle->duplication_ring_head;
+    uint32_t old_count = handle->count_duplication_msgs;
+    uint32_t slot_count = 2;
+    uint32_t i;
+
+    if (capacity > SN_COAP_MAX_ALLOWED_DUPLICATION_MESSAGE_COUNT) {
+        return -1;
+    }
+
+    /* Hash table is kept at most half full */
+    while (slot_count < capacity * 2) {
+        slot_count <<= 1;
+    }
+
+    handle->duplication_ring = NULL;
+    handle->duplication_slots = NULL;
+    handle->duplication_responses = NULL;
+    if (capacity) {
+        handle->duplication_ring = sn_coap_protocol_duplication_chunks_alloc(handle, capacity, sizeof(coap_duplication_entry_s));
+        handle->duplication_slots = sn_coap_protocol_duplication_chunks_alloc(handle, slot_count, sizeof(uint32_t));
+        if (handle->sn_coap_duplication_response_cache_size) {
+            handle->duplication_responses = sn_coap_protocol_duplication_chunks_alloc(handle, capacity, sizeof(coap_duplication_response_s *));
+        }
+        if (handle->duplication_ring == NULL || handle->duplication_slots == NULL ||
+                (handle->sn_coap_duplication_response_cache_size && handle->duplication_responses == NULL)) {
+            sn_coap_protocol_duplication_chunks_free(handle, handle->duplication_ring, capacity);
+            sn_coap_protocol_duplication_chunks_free(handle, handle->duplication_slots, slot_count);
+            sn_coap_protocol_duplication_chunks_free(handle, handle->duplication_responses, capacity);
+            handle->duplication_ring = old_ring;
+            handle->duplication_slots = old_slots;
+            handle->duplication_responses = old_responses;
+            return -1;
+        }
+    }
+
+    handle->sn_coap_duplication_buffer_size = capacity;
+    handle->duplication_slot_mask = slot_count - 1;
+    handle->duplication_ring_head = 0;
+    handle->count_duplication_msgs = 0;
+
+    /* Move stored entries to the new cache in arrival order */
+    for (i = 0; i < old_count; i++) {
+        uint32_t old_position = (old_head + i) % old_capacity;
+        coap_duplication_entry_s *old_entry = (coap_duplication_entry_s *)old_ring[old_position / SN_COAP_DUPLICATION_CHUNK_SIZE] +
+                                              (old_position & (SN_COAP_DUPLICATION_CHUNK_SIZE - 1));
+        coap_duplication_response_s *response_ptr = NULL;
+
+        if (old_responses) {
+            response_ptr = ((coap_duplication_response_s **)old_responses[old_position / SN_COAP_DUPLICATION_CHUNK_SIZE])
+                           [old_position & (SN_COAP_DUPLICATION_CHUNK_SIZE - 1)];
+        }
+
+        if (capacity) {
+            uint32_t position;
+
+            sn_coap_protocol_duplication_cache_store(handle, old_entry->peer_id, old_entry->msg_id);
+            position = (handle->duplication_ring_head + handle->count_duplication_msgs - 1) % capacity;
+            sn_coap_protocol_duplication_entry(handle, position)->timestamp = old_entry->timestamp;
+            if (handle->duplication_responses) {
+                *sn_coap_protocol_duplication_response(handle, position) = response_ptr;
+                response_ptr = NULL;
+            }
+        }
+        sn_coap_protocol_duplication_response_free(handle, &response_ptr);
+        /* New entry has its own reference to the peer */
+        sn_coap_peer_table_unref(&handle->peer_table, old_entry->peer_id, handle->system_time);
+    }
+
+    sn_coap_protocol_duplication_chunks_free(handle, old_ring, old_capacity);
+    sn_coap_protocol_duplication_chunks_free(handle, old_slots, old_slot_count);
+    sn_coap_protocol_duplication_chunks_free(handle, old_responses, old_capacity);
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_duplication_cache_store(struct coap_s *handle, uint32_t peer_id, uint16_t msg_id)
+ *
+ * \brief Stores Duplication info to cache. If cache is full, oldest entry is overwritten.
+ *        Nothing is stored for peers which could not be added to peer table.
+ *
+ * \param msg_id is Message ID to be stored
+ * \param peer_id is source peer to be stored, entry takes reference to it
+ *****************************************************************************/
+
+static void sn_coap_protocol_duplication_cache_store(struct coap_s *handle, uint32_t peer_id, uint16_t msg_id)
+{
+    coap_duplication_entry_s *entry;
+    uint32_t position;
+    uint32_t slot;
+
+    if (handle->sn_coap_duplication_buffer_size == 0 || peer_id == 0) {
+        return;
+    }
+
+    if (handle->count_duplication_msgs >= handle->sn_coap_duplication_buffer_size) {
+        sn_coap_protocol_duplication_cache_remove_oldest(handle);
+    }
+
+    /* * * * Fill entry at the end of the ring * * * */
+    position = (handle->duplication_ring_head + handle->count_duplication_msgs) % handle->sn_coap_duplication_buffer_size;
+    entry = sn_coap_protocol_duplication_entry(handle, position);
+    entry->timestamp = handle->system_time;
+    entry->peer_id = peer_id;
+    entry->msg_id = msg_id;
+    sn_coap_peer_table_ref(&handle->peer_table, peer_id);
+    ++handle->count_duplication_msgs;
+
+    /* * * * Index entry to first free slot * * * */
+    slot = sn_coap_protocol_duplication_cache_hash(peer_id, msg_id) & handle->duplication_slot_mask;
+    while (*sn_coap_protocol_duplication_slot(handle, slot)) {
+        slot = (slot + 1) & handle->duplication_slot_mask;
+    }
+    *sn_coap_protocol_duplication_slot(handle, slot) = position + 1;
+}
+
+/**************************************************************************//**
+ * \fn static int32_t sn_coap_protocol_duplication_cache_search(struct coap_s *handle, uint32_t peer_id, uint16_t msg_id)
+ *
+ * \brief Searches stored message from cache (Peer and Message ID as key)
+ *
+ * \param peer_id is Peer key to be searched
+ * \param msg_id is Message ID key to be searched
+ *
+ * \return Return value is ring position of the message when found and -1 if not found
+ *****************************************************************************/
+
+static int32_t sn_coap_protocol_duplication_cache_search(struct coap_s *handle, uint32_t peer_id, uint16_t msg_id)
+{
+    uint32_t slot;
+
+    if (handle->count_duplication_msgs == 0 || peer_id == 0) {
+        return -1;
+    }
+
+    slot = sn_coap_protocol_duplication_cache_hash(peer_id, msg_id) & handle->duplication_slot_mask;
+    while (*sn_coap_protocol_duplication_slot(handle, slot)) {
+        uint32_t position = *sn_coap_protocol_duplication_slot(handle, slot) - 1;
+        const coap_duplication_entry_s *entry = sn_coap_protocol_duplication_entry(handle, position);
+
+        if (entry->msg_id == msg_id && entry->peer_id == peer_id) {
+            /* * * Correct Duplication info found * * * */
+            return position;
+        }
+        slot = (slot + 1) & handle->duplication_slot_mask;
+    }
+
+    return -1;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_duplication_cache_remove_oldest(struct coap_s *handle)
+ *
+ * \brief Removes oldest entry from cache. Following entries of the same probe
+ *        sequence are shifted back, so no deleted markers are needed.
+ *****************************************************************************/
+
+static void sn_coap_protocol_duplication_cache_remove_oldest(struct coap_s *handle)
+{
+    const coap_duplication_entry_s *entry = sn_coap_protocol_duplication_entry(handle, handle->duplication_ring_head);
+    uint32_t mask = handle->duplication_slot_mask;
+    uint32_t slot = sn_coap_protocol_duplication_cache_hash(entry->peer_id, entry->msg_id) & mask;
+    uint32_t next;
+
+    while (*sn_coap_protocol_duplication_slot(handle, slot) != handle->duplication_ring_head + 1) {
+        slot = (slot + 1) & mask;
+    }
+
+    /* Backward shift deletion */
+    next = (slot + 1) & mask;
+    while (*sn_coap_protocol_duplication_slot(handle, next)) {
+        const coap_duplication_entry_s *moved = sn_coap_protocol_duplication_entry(handle, *sn_coap_protocol_duplication_slot(handle, next) - 1);
+        uint32_t home = sn_coap_protocol_duplication_cache_hash(moved->peer_id, moved->msg_id) & mask;
+
+        /* Entry can be moved to the free slot if its home slot is not between free slot and entry */
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            *sn_coap_protocol_duplication_slot(handle, slot) = *sn_coap_protocol_duplication_slot(handle, next);
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+    *sn_coap_protocol_duplication_slot(handle, slot) = 0;
+
+    if (handle->duplication_responses) {
+        sn_coap_protocol_duplication_response_free(handle, sn_coap_protocol_duplication_response(handle, handle->duplication_ring_head));
+    }
+    sn_coap_peer_table_unref(&handle->peer_table, entry->peer_id, handle->system_time);
+
+    handle->duplication_ring_head = (handle->duplication_ring_head + 1) % handle->sn_coap_duplication_buffer_size;
+    --handle->count_duplication_msgs;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_duplication_cache_remove_old_ones(struct coap_s *handle)
+ *
+ * \brief Removes old stored Duplication detection infos from cache. Entries are
+ *        in arrival order, so only the expired entries and one more are visited.
+ *****************************************************************************/
+
+static void sn_coap_protocol_duplication_cache_remove_old_ones(struct coap_s *handle)
+{
+    while (handle->count_duplication_msgs &&
+            (handle->system_time - sn_coap_protocol_duplication_entry(handle, handle->duplication_ring_head)->timestamp) > SN_COAP_DUPLICATION_MAX_TIME_MSGS_STORED) {
+        sn_coap_protocol_duplication_cache_remove_oldest(handle);
+    }
+}
+
+#else /* SN_COAP_SERVER_PROFILE */
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_linked_list_duplication_info_store(sn_nsdl_addr_s *addr_ptr, uint16_t msg_id)
+ *
+ * \brief Stores Duplication info to Linked list
+ *
+ * \param msg_id is Message ID to be stored
+ * \param *addr_ptr is pointer to Address information to be stored
+ *****************************************************************************/
+
+static void sn_coap_protocol_linked_list_duplication_info_store(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr,
+        uint16_t msg_id)
+{
+    coap_duplication_info_s *stored_duplication_info_ptr = NULL;
+
+    /* * * * Allocating memory for stored Duplication info * * * */
+
+    /* Allocate memory for stored Duplication info's structure */
+    stored_duplication_info_ptr = handle->sn_coap_protocol_malloc(sizeof(coap_duplication_info_s));
+
+    if (stored_duplication_info_ptr == NULL) {
+        return;
+    }
+
+    /* Allocate memory for stored Duplication info's address */
+    stored_duplication_info_ptr->addr_ptr = handle->sn_coap_protocol_malloc(addr_ptr->addr_len);
+
+    if (stored_duplication_info_ptr->addr_ptr == NULL) {
+        handle->sn_coap_protocol_free(stored_duplication_info_ptr);
+        stored_duplication_info_ptr = 0;
+        return;
+    }
+
+    /* * * * Filling fields of stored Duplication info * * * */
+
+    stored_duplication_info_ptr->timestamp = handle->system_time;
+    stored_duplication_info_ptr->addr_len = addr_ptr->addr_len;
+    memcpy(stored_duplication_info_ptr->addr_ptr, addr_ptr->addr_ptr, addr_ptr->addr_len);
+    stored_duplication_info_ptr->port = addr_ptr->port;
+    stored_duplication_info_ptr->msg_id = msg_id;
+    stored_duplication_info_ptr->response_ptr = NULL;
+
+    stored_duplication_info_ptr->coap = handle;
+
+    /* * * * Storing Duplication info to Linked list * * * */
+
+    ns_list_add_to_end(&handle->linked_list_duplication_msgs, stored_duplication_info_ptr);
+    ++handle->count_duplication_msgs;
+}
+
+/**************************************************************************//**
+ * \fn static coap_duplication_info_s *sn_coap_protocol_linked_list_duplication_info_search(sn_nsdl_addr_s *addr_ptr, uint16_t msg_id)
+ *
+ * \brief Searches stored message from Linked list (Address and Message ID as key)
+ *
+ * \param *addr_ptr is pointer to Address key to be searched
+ * \param msg_id is Message ID key to be searched
+ *
+ * \return Return value is pointer to found Duplication info and NULL if not found
+ *****************************************************************************/
+
+static coap_duplication_info_s *sn_coap_protocol_linked_list_duplication_info_search(struct coap_s *handle,
+        sn_nsdl_addr_s *addr_ptr, uint16_t msg_id)
+{
+    /* Loop all nodes in Linked list for searching Message ID */
+    ns_list_foreach(coap_duplication_info_s, stored_duplication_info_ptr, &handle->linked_list_duplication_msgs) {
+        /* If message's Message ID is same than is searched */
+        if (stored_duplication_info_ptr->msg_id == msg_id) {
+            /* If message's Source address is same than is searched */
+            if (0 == memcmp(addr_ptr->addr_ptr, stored_duplication_info_ptr->addr_ptr, addr_ptr->addr_len)) {
+                /* If message's Source address port is same than is searched */
+                if (stored_duplication_info_ptr->port == addr_ptr->port) {
+                    /* * * Correct Duplication info found * * * */
+                    return stored_duplication_info_ptr;
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_linked_list_duplication_info_remove(struct coap_s *handle, uint8_t *addr_ptr, uint16_t port, uint16_t msg_id)
+ *
+ * \brief Removes stored Duplication info from Linked list
+ *
+ * \param *addr_ptr is pointer to Address key to be removed
+ *
+ * \param port is Port key to be removed
+ *
+ * \param msg_id is Message ID key to be removed
+ *****************************************************************************/
+
+static void sn_coap_protocol_linked_list_duplication_info_remove(struct coap_s *handle, uint8_t *addr_ptr, uint16_t port, uint16_t msg_id)
+{
+    /* Loop all stored duplication messages in Linked list */
+    ns_list_foreach(coap_duplication_info_s, removed_duplication_info_ptr, &handle->linked_list_duplication_msgs) {
+        /* If message's Address is same than is searched */
+        if (handle == removed_duplication_info_ptr->coap && 0 == memcmp(addr_ptr, removed_duplication_info_ptr->addr_ptr, removed_duplication_info_ptr->addr_len)) {
+            /* If message's Address prt is same than is searched */
+            if (removed_duplication_info_ptr->port == port) {
+                /* If Message ID is same than is searched */
+                if (removed_duplication_info_ptr->msg_id == msg_id) {
+                    /* * * * Correct Duplication info found, remove it from Linked list * * * */
+                    ns_list_remove(&handle->linked_list_duplication_msgs, removed_duplication_info_ptr);
+                    --handle->count_duplication_msgs;
+
+                    /* Free memory of stored Duplication info */
+                    sn_coap_protocol_duplication_response_free(handle, &removed_duplication_info_ptr->response_ptr);
+                    handle->sn_coap_protocol_free(removed_duplication_info_ptr->addr_ptr);
+                    removed_duplication_info_ptr->addr_ptr = 0;
+                    handle->sn_coap_protocol_free(removed_duplication_info_ptr);
+                    removed_duplication_info_ptr = 0;
+
+                    return;
+                }
             }
         }
     }
-#endif /* ENABLE_RESENDINGS */
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_linked_list_duplication_info_remove_old_ones(struct coap_s *handle)
+ *
+ * \brief Removes old stored Duplication detection infos from Linked list
+ *****************************************************************************/
+
+static void sn_coap_protocol_linked_list_duplication_info_remove_old_ones(struct coap_s *handle)
+{
+    /* Loop all stored duplication messages in Linked list */
+    ns_list_foreach_safe(coap_duplication_info_s, removed_duplication_info_ptr, &handle->linked_list_duplication_msgs) {
+        if ((handle->system_time - removed_duplication_info_ptr->timestamp)  > SN_COAP_DUPLICATION_MAX_TIME_MSGS_STORED) {
+            /* * * * Old Duplication info found, remove it from Linked list * * * */
+            ns_list_remove(&handle->linked_list_duplication_msgs, removed_duplication_info_ptr);
+            --handle->count_duplication_msgs;
+
+            /* Free memory of stored Duplication info */
+            sn_coap_protocol_duplication_response_free(handle, &removed_duplication_info_ptr->response_ptr);
+            handle->sn_coap_protocol_free(removed_duplication_info_ptr->addr_ptr);
+            removed_duplication_info_ptr->addr_ptr = 0;
+            handle->sn_coap_protocol_free(removed_duplication_info_ptr);
+            removed_duplication_info_ptr = 0;
+        }
+    }
+}
+
+#endif /* SN_COAP_SERVER_PROFILE */
+
+/**************************************************************************//**
+ * \fn static coap_duplication_response_s **sn_coap_protocol_duplication_response_find(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, uint16_t msg_id)
+ *
+ * \brief Searches place of stored Acknowledgement from Duplication info (Address, port and Message ID as key)
+ *
+ * \param *addr_ptr is pointer to Address key to be searched
+ * \param msg_id is Message ID key to be searched
+ *
+ * \return Pointer to Acknowledgement pointer of found Duplication info, NULL if not found
+ *****************************************************************************/
+
+static coap_duplication_response_s **sn_coap_protocol_duplication_response_find(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, uint16_t msg_id)
+{
+#if SN_COAP_SERVER_PROFILE
+    int32_t position = sn_coap_protocol_duplication_cache_search(handle, sn_coap_peer_table_find(&handle->peer_table, addr_ptr), msg_id);
+
+    if (position < 0 || handle->duplication_responses == NULL) {
+        return NULL;
+    }
+    return sn_coap_protocol_duplication_response(handle, position);
+#else
+    coap_duplication_info_s *duplication_info_ptr = sn_coap_protocol_linked_list_duplication_info_search(handle, addr_ptr, msg_id);
+
+    if (duplication_info_ptr == NULL) {
+        return NULL;
+    }
+    return &duplication_info_ptr->response_ptr;
+#endif
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_duplication_response_store(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, uint16_t msg_id, uint8_t *packet_ptr, uint16_t packet_len)
+ *
+ * \brief Stores built Acknowledgement to Duplication info of the request it acknowledges.
+ *        Nothing is stored if the request has no Duplication info.
+ *
+ * \param *dst_addr_ptr is pointer to destination Address of the Acknowledgement
+ * \param msg_id is Message ID of the Acknowledgement
+ * \param *packet_ptr is pointer to built Acknowledgement
+ * \param packet_len is length of built Acknowledgement
+ *****************************************************************************/
+
+static void sn_coap_protocol_duplication_response_store(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, uint16_t msg_id,
+        uint8_t *packet_ptr, uint16_t packet_len)
+{
+    coap_duplication_response_s **response_ptr;
+    coap_duplication_response_s *stored_response_ptr;
+    uint32_t stored_size = sizeof(coap_duplication_response_s) + packet_len;
+
+    if (stored_size > handle->sn_coap_duplication_response_cache_size || stored_size > UINT16_MAX) {
+        return;
+    }
+
+    response_ptr = sn_coap_protocol_duplication_response_find(handle, dst_addr_ptr, msg_id);
+    if (response_ptr == NULL) {
+        return;
+    }
+
+    /* Latest Acknowledgement replaces the old one, i.e. separate response replaces empty ACK */
+    sn_coap_protocol_duplication_response_free(handle, response_ptr);
+    sn_coap_protocol_duplication_response_reserve(handle, stored_size);
+
+    stored_response_ptr = handle->sn_coap_protocol_malloc(stored_size);
+    if (stored_response_ptr == NULL) {
+        return;
+    }
+    stored_response_ptr->packet_len = packet_len;
+    stored_response_ptr->packet_ptr = (uint8_t *)(stored_response_ptr + 1);
+    memcpy(stored_response_ptr->packet_ptr, packet_ptr, packet_len);
+
+    *response_ptr = stored_response_ptr;
+    handle->count_duplication_response_bytes += stored_size;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_duplication_response_reserve(struct coap_s *handle, uint32_t packet_len)
+ *
+ * \brief Releases Acknowledgements of oldest Duplication infos until given amount
+ *        of bytes fits to response cache budget
+ *
+ * \param packet_len is amount of bytes to be reserved
+ *****************************************************************************/
+
+static void sn_coap_protocol_duplication_response_reserve(struct coap_s *handle, uint32_t packet_len)
+{
+#if SN_COAP_SERVER_PROFILE
+    uint32_t i;
+
+    if (handle->duplication_responses == NULL) {
+        return;
+    }
+    for (i = 0; i < handle->count_duplication_msgs &&
+            handle->count_duplication_response_bytes + packet_len > handle->sn_coap_duplication_response_cache_size; i++) {
+        uint32_t position = (handle->duplication_ring_head + i) % handle->sn_coap_duplication_buffer_size;
+        sn_coap_protocol_duplication_response_free(handle, sn_coap_protocol_duplication_response(handle, position));
+    }
+#else
+    ns_list_foreach(coap_duplication_info_s, duplication_info_ptr, &handle->linked_list_duplication_msgs) {
+        if (handle->count_duplication_response_bytes + packet_len <= handle->sn_coap_duplication_response_cache_size) {
+            break;
+        }
+        sn_coap_protocol_duplication_response_free(handle, &duplication_info_ptr->response_ptr);
+    }
+#endif
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_duplication_response_free(struct coap_s *handle, coap_duplication_response_s **response_ptr)
+ *
+ * \brief Releases stored Acknowledgement, if any
+ *
+ * \param **response_ptr is pointer to Acknowledgement pointer, set to NULL
+ *****************************************************************************/
+
+static void sn_coap_protocol_duplication_response_free(struct coap_s *handle, coap_duplication_response_s **response_ptr)
+{
+    if (*response_ptr) {
+        handle->count_duplication_response_bytes -= sizeof(coap_duplication_response_s) + (*response_ptr)->packet_len;
+        handle->sn_coap_protocol_free(*response_ptr);
+        *response_ptr = 0;
+    }
+}
+
+#endif /* SN_COAP_DUPLICATION_MAX_MSGS_COUNT */
+
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
+/**************************************************************************//**
+ * \fn static int8_t sn_coap_protocol_linked_list_blockwise_msg_add(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, coap_blockwise_msg_s *stored_msg_ptr)
+ *
+ * \brief Adds blockwise message to the end of Linked list. In server profile message is
+ *        also indexed by peer and token. If indexing fails, message is released.
+ *
+ * \param *addr_ptr is address of the peer message is sent to
+ * \param *stored_msg_ptr is message to be added
+ *
+ * \return 0 on success, -1 if out of memory
+ *****************************************************************************/
+
+static int8_t sn_coap_protocol_linked_list_blockwise_msg_add(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, coap_blockwise_msg_s *stored_msg_ptr)
+{
+    ns_list_add_to_end(&handle->linked_list_blockwise_sent_msgs, stored_msg_ptr);
+
+#if SN_COAP_SERVER_PROFILE
+    /* Index for finding blockwise messages by peer and token is created when first needed */
+    if (handle->blockwise_sent_hash == NULL) {
+        handle->blockwise_sent_hash = handle->sn_coap_protocol_malloc(SN_COAP_BLOCKWISE_HASH_SIZE * sizeof(coap_blockwise_msg_s *));
+        if (handle->blockwise_sent_hash == NULL) {
+            sn_coap_protocol_linked_list_blockwise_msg_remove(handle, stored_msg_ptr);
+            return -1;
+        }
+        memset(handle->blockwise_sent_hash, 0, SN_COAP_BLOCKWISE_HASH_SIZE * sizeof(coap_blockwise_msg_s *));
+    }
+
+    uint32_t peer_id = sn_coap_peer_table_intern(&handle->peer_table, addr_ptr, handle->system_time);
+    if (peer_id == 0) {
+        sn_coap_protocol_linked_list_blockwise_msg_remove(handle, stored_msg_ptr);
+        return -1;
+    }
+    stored_msg_ptr->peer_id = peer_id;
+    sn_coap_peer_table_ref(&handle->peer_table, peer_id);
+
+    /* Request records have their token already */
+    if (stored_msg_ptr->coap_msg_ptr) {
+        stored_msg_ptr->token_len = sn_coap_protocol_blockwise_token_len(stored_msg_ptr->coap_msg_ptr);
+        if (stored_msg_ptr->token_len) {
+            memcpy(stored_msg_ptr->token, stored_msg_ptr->coap_msg_ptr->token_ptr, stored_msg_ptr->token_len);
+        }
+    }
+
+    /* Add message to the head of its index bucket */
+    coap_blockwise_msg_s **bucket = &handle->blockwise_sent_hash[sn_coap_protocol_blockwise_hash(peer_id, stored_msg_ptr->token, stored_msg_ptr->token_len)];
+    stored_msg_ptr->hash_next = *bucket;
+    *bucket = stored_msg_ptr;
+#else
+    (void) addr_ptr;
+#endif
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * \fn static coap_blockwise_msg_s *sn_coap_protocol_linked_list_blockwise_msg_find(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr)
+ *
+ * \brief Finds stored blockwise message the received message belongs to. In server profile
+ *        the index is searched with peer and token, otherwise whole Linked list is
+ *        searched with Message ID.
+ *
+ * \param *addr_ptr is source address of received message
+ * \param *coap_msg_ptr is received message
+ *
+ * \return Return value is pointer to found message or NULL if message not found
+ *****************************************************************************/
+
+static coap_blockwise_msg_s *sn_coap_protocol_linked_list_blockwise_msg_find(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr)
+{
+#if SN_COAP_SERVER_PROFILE
+    uint32_t peer_id;
+
+    if (handle->blockwise_sent_hash == NULL) {
+        return NULL;
+    }
+    peer_id = sn_coap_peer_table_find(&handle->peer_table, addr_ptr);
+    if (peer_id == 0) {
+        return NULL;
+    }
+    for (coap_blockwise_msg_s *msg = handle->blockwise_sent_hash[sn_coap_protocol_blockwise_hash(peer_id, coap_msg_ptr->token_ptr, sn_coap_protocol_blockwise_token_len(coap_msg_ptr))];
+            msg != NULL; msg = msg->hash_next) {
+        if (msg->peer_id == peer_id && msg->coap_msg_ptr && sn_coap_protocol_blockwise_token_match(msg->token, msg->token_len, coap_msg_ptr)) {
+            return msg;
+        }
+    }
+#else
+    (void) addr_ptr;
+    ns_list_foreach(coap_blockwise_msg_s, msg, &handle->linked_list_blockwise_sent_msgs) {
+        if (msg->coap_msg_ptr && coap_msg_ptr->msg_id == msg->coap_msg_ptr->msg_id) {
+            return msg;
+        }
+    }
+#endif
+
+    return NULL;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_linked_list_blockwise_request_store(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *request_ptr)
+ *
+ * \brief Stores record of sent request, so that next block can be requested if response
+ *        comes with Block2. Only Message ID, code, token, Uri-Path and Uri-Query are stored,
+ *        header is not copied.
+ *
+ * \param *addr_ptr is address of the peer request is sent to
+ * \param *request_ptr is sent request
+ *****************************************************************************/
+
+static void sn_coap_protocol_linked_list_blockwise_request_store(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *request_ptr)
+{
+    coap_blockwise_msg_s *stored_msg_ptr = handle->sn_coap_protocol_malloc(sizeof(coap_blockwise_msg_s));
+
+    if (!stored_msg_ptr) {
+        return;
+    }
+    memset(stored_msg_ptr, 0, sizeof(coap_blockwise_msg_s));
+
+    stored_msg_ptr->timestamp = handle->system_time;
+    stored_msg_ptr->coap = handle;
+    stored_msg_ptr->msg_id = request_ptr->msg_id;
+    stored_msg_ptr->msg_code = request_ptr->msg_code;
+    if (request_ptr->token_ptr && request_ptr->token_len <= sizeof(stored_msg_ptr->token)) {
+        stored_msg_ptr->token_len = request_ptr->token_len;
+        memcpy(stored_msg_ptr->token, request_ptr->token_ptr, request_ptr->token_len);
+    }
+
+    /* Next blocks are requested from the same resource */
+    if (request_ptr->uri_path_ptr) {
+        stored_msg_ptr->uri_path_len = request_ptr->uri_path_len;
+    }
+    if (request_ptr->options_list_ptr && request_ptr->options_list_ptr->uri_query_ptr) {
+        stored_msg_ptr->uri_query_len = request_ptr->options_list_ptr->uri_query_len;
+    }
+    if (stored_msg_ptr->uri_path_len + stored_msg_ptr->uri_query_len) {
+        stored_msg_ptr->uri_ptr = handle->sn_coap_protocol_malloc(stored_msg_ptr->uri_path_len + stored_msg_ptr->uri_query_len);
+        if (stored_msg_ptr->uri_ptr == NULL) {
+            handle->sn_coap_protocol_free(stored_msg_ptr);
+            return;
+        }
+        if (stored_msg_ptr->uri_path_len) {
+            memcpy(stored_msg_ptr->uri_ptr, request_ptr->uri_path_ptr, stored_msg_ptr->uri_path_len);
+        }
+        if (stored_msg_ptr->uri_query_len) {
+            memcpy(stored_msg_ptr->uri_ptr + stored_msg_ptr->uri_path_len, request_ptr->options_list_ptr->uri_query_ptr, stored_msg_ptr->uri_query_len);
+        }
+    }
+
+    sn_coap_protocol_linked_list_blockwise_msg_add(handle, addr_ptr, stored_msg_ptr);
+}
+
+/**************************************************************************//**
+ * \fn static coap_blockwise_msg_s *sn_coap_protocol_linked_list_blockwise_request_find(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr)
+ *
+ * \brief Finds stored request record the received Block2 response belongs to. In server
+ *        profile the index is searched with peer and token, otherwise whole Linked list
+ *        is searched with Message ID.
+ *
+ * \param *addr_ptr is source address of received response
+ * \param *coap_msg_ptr is received response
+ *
+ * \return Return value is pointer to found record or NULL if record not found
+ *****************************************************************************/
+
+static coap_blockwise_msg_s *sn_coap_protocol_linked_list_blockwise_request_find(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr)
+{
+#if SN_COAP_SERVER_PROFILE
+    uint32_t peer_id;
+
+    if (handle->blockwise_sent_hash == NULL) {
+        return NULL;
+    }
+    peer_id = sn_coap_peer_table_find(&handle->peer_table, addr_ptr);
+    if (peer_id == 0) {
+        return NULL;
+    }
+    for (coap_blockwise_msg_s *msg = handle->blockwise_sent_hash[sn_coap_protocol_blockwise_hash(peer_id, coap_msg_ptr->token_ptr, sn_coap_protocol_blockwise_token_len(coap_msg_ptr))];
+            msg != NULL; msg = msg->hash_next) {
+        if (msg->peer_id == peer_id && msg->coap_msg_ptr == NULL && sn_coap_protocol_blockwise_token_match(msg->token, msg->token_len, coap_msg_ptr)) {
+            return msg;
+        }
+    }
+#else
+    (void) addr_ptr;
+    ns_list_foreach(coap_blockwise_msg_s, msg, &handle->linked_list_blockwise_sent_msgs) {
+        if (msg->coap_msg_ptr == NULL && coap_msg_ptr->msg_id == msg->msg_id) {
+            return msg;
+        }
+    }
+#endif
 
-    /* * * * Return parsed CoAP message  * * * */
-    return returned_dst_coap_msg_ptr;
+    return NULL;
 }
 
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_blockwise_request_release(struct coap_s *handle, sn_coap_hdr_s *request_ptr)
+ *
+ * \brief Releases request of next Block2 block built from request record. Uri-Path and
+ *        Uri-Query are owned by the record and are not released.
+ *****************************************************************************/
 
-int8_t sn_coap_protocol_exec(struct coap_s *handle, uint32_t current_time)
+static void sn_coap_protocol_blockwise_request_release(struct coap_s *handle, sn_coap_hdr_s *request_ptr)
 {
-    if( !handle ){
-       return -1;
+    request_ptr->uri_path_ptr = NULL;
+    if (request_ptr->options_list_ptr) {
+        request_ptr->options_list_ptr->uri_query_ptr = NULL;
     }
+    sn_coap_parser_release_allocated_coap_msg_mem(handle, request_ptr);
+}
 
-    /* * * * Store current System time * * * */
-    handle->system_time = current_time;
-
-#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
-    /* * * * Remove old blocwise data * * * */
-    sn_coap_protocol_linked_list_blockwise_remove_old_data(handle);
-#endif
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_linked_list_blockwise_msg_remove(struct coap_s *handle, coap_blockwise_msg_s *removed_msg_ptr)
+ *
+ * \brief Removes stored blockwise message from Linked list
+ *
+ * \param removed_msg_ptr is message to be removed
+ *****************************************************************************/
 
+static void sn_coap_protocol_linked_list_blockwise_msg_remove(struct coap_s *handle, coap_blockwise_msg_s *removed_msg_ptr)
+{
+    if( removed_msg_ptr->coap == handle ){
+        ns_list_remove(&handle->linked_list_blockwise_sent_msgs, removed_msg_ptr);
 
-#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT
-    /* * * * Remove old duplication messages * * * */
-    sn_coap_protocol_linked_list_duplication_info_remove_old_ones(handle);
+#if SN_COAP_SERVER_PROFILE
+        if (removed_msg_ptr->peer_id) {
+            coap_blockwise_msg_s **link_ptr = &handle->blockwise_sent_hash[sn_coap_protocol_blockwise_hash(removed_msg_ptr->peer_id, removed_msg_ptr->token, removed_msg_ptr->token_len)];
+            while (*link_ptr) {
+                if (*link_ptr == removed_msg_ptr) {
+                    *link_ptr = removed_msg_ptr->hash_next;
+                    break;
+                }
+                link_ptr = &(*link_ptr)->hash_next;
+            }
+            sn_coap_peer_table_unref(&handle->peer_table, removed_msg_ptr->peer_id, handle->system_time);
+        }
 #endif
 
-#if ENABLE_RESENDINGS
-    /* Check if there is ongoing active message sendings */
-    ns_list_foreach_safe(coap_send_msg_s, stored_msg_ptr, &handle->linked_list_resent_msgs) {
-        // First check that msg belongs to handle
-        if( stored_msg_ptr->coap == handle ){
-            /* Check if it is time to send this message */
-            if (current_time >= stored_msg_ptr->resending_time) {
-                /* * * Increase Resending counter  * * */
-                stored_msg_ptr->resending_counter++;
+        if( removed_msg_ptr->coap_msg_ptr ){
+            if (removed_msg_ptr->coap_msg_ptr->payload_ptr) {
+                handle->sn_coap_protocol_free(removed_msg_ptr->coap_msg_ptr->payload_ptr);
+                removed_msg_ptr->coap_msg_ptr->payload_ptr = 0;
+            }
 
-                /* Check if all re-sendings have been done */
-                if (stored_msg_ptr->resending_counter > handle->sn_coap_resending_count) {
-                    coap_version_e coap_version = COAP_VERSION_UNKNOWN;
+            sn_coap_parser_release_allocated_coap_msg_mem(handle, removed_msg_ptr->coap_msg_ptr);
+        }
 
-                    /* Get message ID from stored sending message */
-                    uint16_t temp_msg_id = (stored_msg_ptr->send_msg_ptr->packet_ptr[2] << 8);
-                    temp_msg_id += (uint16_t)stored_msg_ptr->send_msg_ptr->packet_ptr[3];
+        handle->sn_coap_protocol_free(removed_msg_ptr->uri_ptr);
+        handle->sn_coap_protocol_free(removed_msg_ptr);
+        removed_msg_ptr = 0;
+    }
+}
 
-                    /* If RX callback have been defined.. */
-                    if (stored_msg_ptr->coap->sn_coap_rx_callback != 0) {
-                        sn_coap_hdr_s *tmp_coap_hdr_ptr;
-                        /* Parse CoAP message, set status and call RX callback */
-                        tmp_coap_hdr_ptr = sn_coap_parser(stored_msg_ptr->coap, stored_msg_ptr->send_msg_ptr->packet_len, stored_msg_ptr->send_msg_ptr->packet_ptr, &coap_version);
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_linked_list_blockwise_payload_store(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr, uint32_t block_offset, uint32_t size_hint)
+ *
+ * \brief Stores blockwise payload to Linked list
+ *
+ * \param *addr_ptr is pointer to Address information to be stored
+ * \param *coap_msg_ptr is received message, its payload is stored
+ * \param block_offset is offset of the block in whole payload
+ * \param size_hint is size of whole payload told by the sender (Size1 or Size2), 0 if unknown
+ *****************************************************************************/
 
-                        if (tmp_coap_hdr_ptr != 0) {
-                            tmp_coap_hdr_ptr->coap_status = COAP_STATUS_BUILDER_MESSAGE_SENDING_FAILED;
+static void sn_coap_protocol_linked_list_blockwise_payload_store(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr,
+        const sn_coap_hdr_s *coap_msg_ptr,
+        uint32_t block_offset,
+        uint32_t size_hint)
+{
+    uint16_t stored_payload_len = coap_msg_ptr->payload_len;
+    uint8_t *stored_payload_ptr = coap_msg_ptr->payload_ptr;
 
-                            stored_msg_ptr->coap->sn_coap_rx_callback(tmp_coap_hdr_ptr, stored_msg_ptr->send_msg_ptr->dst_addr_ptr, stored_msg_ptr->param);
+    if (!addr_ptr || !stored_payload_len || !stored_payload_ptr) {
+        return;
+    }
 
-                            sn_coap_parser_release_allocated_coap_msg_mem(stored_msg_ptr->coap, tmp_coap_hdr_ptr);
-                        }
-                    }
-                    /* Remove message from Linked list */
-                    sn_coap_protocol_linked_list_send_msg_remove(handle, stored_msg_ptr->send_msg_ptr->dst_addr_ptr, temp_msg_id);
-                } else {
-                    /* Send message  */
-                    stored_msg_ptr->coap->sn_coap_tx_callback(stored_msg_ptr->send_msg_ptr->packet_ptr,
-                            stored_msg_ptr->send_msg_ptr->packet_len, stored_msg_ptr->send_msg_ptr->dst_addr_ptr, stored_msg_ptr->param);
+#if SN_COAP_BLOCKWISE_REASSEMBLY
+    sn_coap_protocol_linked_list_blockwise_payload_write(handle, addr_ptr, coap_msg_ptr, block_offset, size_hint);
+#else
+    (void) block_offset;
+    (void) size_hint;
 
-                    /* * * Count new Resending time  * * */
-                    stored_msg_ptr->resending_time = current_time + (((uint32_t)(handle->sn_coap_resending_intervall * RESPONSE_RANDOM_FACTOR)) <<
-                                                     stored_msg_ptr->resending_counter);
-                }
+    coap_blockwise_payload_s *stored_blockwise_payload_ptr = sn_coap_protocol_linked_list_blockwise_payload_alloc(handle, addr_ptr, coap_msg_ptr);
 
-            }
-        }
+    if (stored_blockwise_payload_ptr == NULL) {
+        return;
     }
 
-#endif /* ENABLE_RESENDINGS */
+    /* Allocate memory for stored Payload's data */
+    stored_blockwise_payload_ptr->payload_ptr = handle->sn_coap_protocol_malloc(stored_payload_len);
 
-    return 0;
-}
+    if (stored_blockwise_payload_ptr->payload_ptr == NULL) {
+        sn_coap_protocol_linked_list_blockwise_payload_remove(handle, stored_blockwise_payload_ptr);
+        return;
+    }
 
-#if ENABLE_RESENDINGS  /* If Message resending is not used at all, this part of code will not be compiled */
+    memcpy(stored_blockwise_payload_ptr->payload_ptr, stored_payload_ptr, stored_payload_len);
+    stored_blockwise_payload_ptr->payload_len = stored_payload_len;
+#endif
+}
 
 /**************************************************************************//**
- * \fn static void sn_coap_protocol_linked_list_send_msg_store(sn_nsdl_addr_s *dst_addr_ptr, uint16_t send_packet_data_len, uint8_t *send_packet_data_ptr, uint32_t sending_time)
- *
- * \brief Stores message to Linked list for sending purposes.
-
- * \param *dst_addr_ptr is pointer to destination address where CoAP message will be sent
+ * \fn static coap_blockwise_payload_s *sn_coap_protocol_linked_list_blockwise_payload_alloc(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr)
  *
- * \param send_packet_data_len is length of Packet data to be stored
+ * \brief Allocates empty blockwise payload for given source and Request-Tag and adds it to the end
+ *        of Linked list. In server profile payload is also indexed by source and Request-Tag, or
+ *        token if received message has no Request-Tag.
  *
- * \param *send_packet_data_ptr is Packet data to be stored
+ * \param *addr_ptr is pointer to Address information to be stored
+ * \param *coap_msg_ptr is received message
  *
- * \param sending_time is stored sending time
+ * \return Return value is pointer to added payload without data, NULL if out of memory
  *****************************************************************************/
 
-static void sn_coap_protocol_linked_list_send_msg_store(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, uint16_t send_packet_data_len,
-        uint8_t *send_packet_data_ptr, uint32_t sending_time, void *param, uint8_t *uri_path_ptr, uint8_t uri_path_len)
+static coap_blockwise_payload_s *sn_coap_protocol_linked_list_blockwise_payload_alloc(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr)
 {
+    coap_blockwise_payload_s *stored_blockwise_payload_ptr = NULL;
+#if SN_COAP_SERVER_PROFILE
+    uint32_t peer_id;
 
-    coap_send_msg_s *stored_msg_ptr              = NULL;
-
-    /* If both queue parameters are "0" or resending count is "0", then re-sending is disabled */
-    if (((handle->sn_coap_resending_queue_msgs == 0) && (handle->sn_coap_resending_queue_bytes == 0)) || (handle->sn_coap_resending_count == 0)) {
-        return;
+    /* Index for finding blockwise payloads by source and token is created when first needed */
+    if (handle->blockwise_received_hash == NULL) {
+        handle->blockwise_received_hash = handle->sn_coap_protocol_malloc(SN_COAP_BLOCKWISE_HASH_SIZE * sizeof(coap_blockwise_payload_s *));
+        if (handle->blockwise_received_hash == NULL) {
+            return NULL;
+        }
+        memset(handle->blockwise_received_hash, 0, SN_COAP_BLOCKWISE_HASH_SIZE * sizeof(coap_blockwise_payload_s *));
     }
 
-    if (handle->sn_coap_resending_queue_msgs > 0) {
-        if (handle->count_resent_msgs >= handle->sn_coap_resending_queue_msgs) {
-            return;
-        }
+    peer_id = sn_coap_peer_table_intern(&handle->peer_table, addr_ptr, handle->system_time);
+    if (peer_id == 0) {
+        return NULL;
     }
+#endif
 
-    /* Count resending queue size, if buffer size is defined */
-    if (handle->sn_coap_resending_queue_bytes > 0) {
-        if ((sn_coap_count_linked_list_size(&handle->linked_list_resent_msgs) + send_packet_data_len) > handle->sn_coap_resending_queue_bytes) {
-            return;
-        }
+    /* Allocate memory for stored Payload's structure */
+    stored_blockwise_payload_ptr = handle->sn_coap_protocol_malloc(sizeof(coap_blockwise_payload_s));
+
+    if (stored_blockwise_payload_ptr == NULL) {
+        return NULL;
     }
 
-    /* Allocating memory for stored message */
-    stored_msg_ptr = sn_coap_protocol_allocate_mem_for_msg(handle, dst_addr_ptr, send_packet_data_len);
+    memset(stored_blockwise_payload_ptr, 0, sizeof(coap_blockwise_payload_s));
 
-    if (stored_msg_ptr == 0) {
-        return;
+#if SN_COAP_SERVER_PROFILE
+    /* Address is referenced from peer table */
+    stored_blockwise_payload_ptr->peer_id = peer_id;
+    sn_coap_peer_table_ref(&handle->peer_table, peer_id);
+#else
+    /* Allocate memory for stored Payload's address */
+    stored_blockwise_payload_ptr->addr_ptr = handle->sn_coap_protocol_malloc(addr_ptr->addr_len);
+
+    if (stored_blockwise_payload_ptr->addr_ptr == NULL) {
+        handle->sn_coap_protocol_free(stored_blockwise_payload_ptr);
+        stored_blockwise_payload_ptr = 0;
+
+        return NULL;
     }
 
-    /* Filling of coap_send_msg_s with initialization values */
-    stored_msg_ptr->resending_counter = 0;
-    stored_msg_ptr->resending_time = sending_time;
+    memcpy(stored_blockwise_payload_ptr->addr_ptr, addr_ptr->addr_ptr, addr_ptr->addr_len);
+#endif
 
-    /* Filling of sn_nsdl_transmit_s */
-    stored_msg_ptr->send_msg_ptr->protocol = SN_NSDL_PROTOCOL_COAP;
-    stored_msg_ptr->send_msg_ptr->packet_len = send_packet_data_len;
-    memcpy(stored_msg_ptr->send_msg_ptr->packet_ptr, send_packet_data_ptr, send_packet_data_len);
+    /* * * * Filling fields of stored Payload  * * * */
 
-    /* Filling of sn_nsdl_addr_s */
-    stored_msg_ptr->send_msg_ptr->dst_addr_ptr->type = dst_addr_ptr->type;
-    stored_msg_ptr->send_msg_ptr->dst_addr_ptr->addr_len = dst_addr_ptr->addr_len;
-    memcpy(stored_msg_ptr->send_msg_ptr->dst_addr_ptr->addr_ptr, dst_addr_ptr->addr_ptr, dst_addr_ptr->addr_len);
-    stored_msg_ptr->send_msg_ptr->dst_addr_ptr->port = dst_addr_ptr->port;
+    stored_blockwise_payload_ptr->timestamp = handle->system_time;
+    stored_blockwise_payload_ptr->port = addr_ptr->port;
+    stored_blockwise_payload_ptr->coap = handle;
+    stored_blockwise_payload_ptr->request_tag_len = sn_coap_protocol_request_tag_len(coap_msg_ptr);
+    if (stored_blockwise_payload_ptr->request_tag_len != COAP_REQUEST_TAG_NONE) {
+        memcpy(stored_blockwise_payload_ptr->request_tag, coap_msg_ptr->options_list_ptr->request_tag, stored_blockwise_payload_ptr->request_tag_len);
+    }
 
-    stored_msg_ptr->coap = handle;
-    stored_msg_ptr->param = param;
+    /* * * * Storing Payload to Linked list  * * * */
 
-    if (uri_path_len) {
-        stored_msg_ptr->send_msg_ptr->uri_path_ptr = handle->sn_coap_protocol_malloc(uri_path_len);
-        if (stored_msg_ptr->send_msg_ptr->uri_path_ptr == NULL){
-            return;
+    ns_list_add_to_end(&handle->linked_list_blockwise_received_payloads, stored_blockwise_payload_ptr);
+
+#if SN_COAP_SERVER_PROFILE
+    /* Token is not part of the key when Request-Tag is used, client may change it between blocks */
+    if (stored_blockwise_payload_ptr->request_tag_len == COAP_REQUEST_TAG_NONE) {
+        stored_blockwise_payload_ptr->token_len = sn_coap_protocol_blockwise_token_len(coap_msg_ptr);
+        if (stored_blockwise_payload_ptr->token_len) {
+            memcpy(stored_blockwise_payload_ptr->token, coap_msg_ptr->token_ptr, stored_blockwise_payload_ptr->token_len);
         }
-        stored_msg_ptr->send_msg_ptr->uri_path_len = uri_path_len;
-        memcpy(stored_msg_ptr->send_msg_ptr->uri_path_ptr, uri_path_ptr, uri_path_len);
     }
 
+    sn_coap_protocol_blockwise_payload_index(handle, stored_blockwise_payload_ptr);
+#endif
 
-    /* Storing Resending message to Linked list */
-    ns_list_add_to_end(&handle->linked_list_resent_msgs, stored_msg_ptr);
-    ++handle->count_resent_msgs;
+    return stored_blockwise_payload_ptr;
 }
 
 /**************************************************************************//**
- * \fn static sn_nsdl_transmit_s *sn_coap_protocol_linked_list_send_msg_search(sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id)
- *
- * \brief Searches stored resending message from Linked list
+ * \fn static coap_blockwise_payload_s *sn_coap_protocol_linked_list_blockwise_payload_find(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr)
  *
- * \param *src_addr_ptr is searching key for searched message
+ * \brief Finds latest stored blockwise payload of the transfer received message belongs to.
+ *        In server profile the index is searched with source and Request-Tag or token,
+ *        otherwise Linked list is searched with source address and Request-Tag.
  *
- * \param msg_id is searching key for searched message
+ * \param *addr_ptr is source address of received message
+ * \param *coap_msg_ptr is received message
  *
- * \return Return value is pointer to found stored resending message in Linked
- *         list or NULL if message not found
+ * \return Return value is pointer to found payload or NULL if payload not found
  *****************************************************************************/
 
-static sn_nsdl_transmit_s *sn_coap_protocol_linked_list_send_msg_search(struct coap_s *handle,
-        sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id)
+static coap_blockwise_payload_s *sn_coap_protocol_linked_list_blockwise_payload_find(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr)
 {
-    /* Loop all stored resending messages Linked list */
-    ns_list_foreach(coap_send_msg_s, stored_msg_ptr, &handle->linked_list_resent_msgs) {
-        /* Get message ID from stored resending message */
-        uint16_t temp_msg_id = (stored_msg_ptr->send_msg_ptr->packet_ptr[2] << 8);
-        temp_msg_id += (uint16_t)stored_msg_ptr->send_msg_ptr->packet_ptr[3];
+    uint32_t peer_id = sn_coap_protocol_blockwise_payload_source(handle, addr_ptr);
 
-        /* If message's Message ID is same than is searched */
-        if (temp_msg_id == msg_id) {
-            /* If message's Source address is same than is searched */
-            if (0 == memcmp(src_addr_ptr->addr_ptr, stored_msg_ptr->send_msg_ptr->dst_addr_ptr->addr_ptr, src_addr_ptr->addr_len)) {
-                /* If message's Source address port is same than is searched */
-                if (stored_msg_ptr->send_msg_ptr->dst_addr_ptr->port == src_addr_ptr->port) {
-                    /* * * Message found, return pointer to that stored resending message * * * */
-                    return stored_msg_ptr->send_msg_ptr;
-                }
-            }
+#if SN_COAP_SERVER_PROFILE
+    if (handle->blockwise_received_hash == NULL || peer_id == 0) {
+        return NULL;
+    }
+    uint8_t request_tag_len = sn_coap_protocol_request_tag_len(coap_msg_ptr);
+    const uint8_t *request_tag_ptr = request_tag_len != COAP_REQUEST_TAG_NONE ? coap_msg_ptr->options_list_ptr->request_tag : NULL;
+    for (coap_blockwise_payload_s *stored_payload_info_ptr = handle->blockwise_received_hash[sn_coap_protocol_blockwise_session_hash(peer_id,
+            request_tag_len, request_tag_ptr, sn_coap_protocol_blockwise_token_len(coap_msg_ptr), coap_msg_ptr->token_ptr)];
+            stored_payload_info_ptr != NULL; stored_payload_info_ptr = stored_payload_info_ptr->hash_next) {
+#else
+    ns_list_foreach(coap_blockwise_payload_s, stored_payload_info_ptr, &handle->linked_list_blockwise_received_payloads) {
+#endif
+        if (sn_coap_protocol_blockwise_payload_from(stored_payload_info_ptr, addr_ptr, peer_id, coap_msg_ptr)) {
+            return stored_payload_info_ptr;
         }
     }
 
-    /* Message not found */
     return NULL;
 }
+
+#if SN_COAP_BLOCKWISE_REASSEMBLY
 /**************************************************************************//**
- * \fn static void sn_coap_protocol_linked_list_send_msg_remove(sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id)
+ * \fn static void sn_coap_protocol_linked_list_blockwise_payload_write(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const sn_coap_hdr_s *coap_msg_ptr, uint32_t block_offset, uint32_t size_hint)
  *
- * \brief Removes stored resending message from Linked list
+ * \brief Writes received block to its offset in the reassembly buffer of the source.
+ *        Buffer is allocated once when sender told the whole size, otherwise it
+ *        grows at least to double size, so blocks are copied O(1) times on average.
  *
- * \param *src_addr_ptr is searching key for searched message
- * \param msg_id is searching key for removed message
+ * \param block_offset is offset of the block in whole payload
+ * \param size_hint is size of whole payload told by the sender, 0 if unknown
  *****************************************************************************/
 
-static void sn_coap_protocol_linked_list_send_msg_remove(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id)
+static void sn_coap_protocol_linked_list_blockwise_payload_write(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr,
+        const sn_coap_hdr_s *coap_msg_ptr,
+        uint32_t block_offset,
+        uint32_t size_hint)
 {
-    /* Loop all stored resending messages in Linked list */
-    ns_list_foreach(coap_send_msg_s, stored_msg_ptr, &handle->linked_list_resent_msgs) {
-        /* Get message ID from stored resending message */
-        uint16_t temp_msg_id = (stored_msg_ptr->send_msg_ptr->packet_ptr[2] << 8);
-        temp_msg_id += (uint16_t)stored_msg_ptr->send_msg_ptr->packet_ptr[3];
+    coap_blockwise_payload_s *stored_blockwise_payload_ptr = sn_coap_protocol_linked_list_blockwise_payload_find(handle, addr_ptr, coap_msg_ptr);
+    uint16_t stored_payload_len = coap_msg_ptr->payload_len;
+    uint32_t max_size = SN_COAP_MAX_INCOMING_BLOCK_MESSAGE_SIZE < UINT16_MAX ? SN_COAP_MAX_INCOMING_BLOCK_MESSAGE_SIZE : UINT16_MAX;
+    uint32_t payload_offset = block_offset;
+    uint32_t write_offset;
+    uint32_t write_end;
+
+#if SN_COAP_Q_BLOCK_MAX_PAYLOADS
+    /* Q-Block1 blocks can arrive in any order, so buffer starts from the beginning of payload */
+    if (coap_msg_ptr->options_list_ptr && coap_msg_ptr->options_list_ptr->use_q_block1) {
+        payload_offset = 0;
+    }
+#endif
+    if (stored_blockwise_payload_ptr) {
+        payload_offset = stored_blockwise_payload_ptr->payload_offset;
+    }
 
-        /* If message's Message ID is same than is searched */
-        if (temp_msg_id == msg_id) {
-            /* If message's Source address is same than is searched */
-            if (0 == memcmp(src_addr_ptr->addr_ptr, stored_msg_ptr->send_msg_ptr->dst_addr_ptr->addr_ptr, src_addr_ptr->addr_len)) {
-                /* If message's Source address port is same than is searched */
-                if (stored_msg_ptr->send_msg_ptr->dst_addr_ptr->port == src_addr_ptr->port) {
-                    /* * * Message found * * */
+    /* Blocks before the buffer have already been removed by the application */
+    if (block_offset < payload_offset) {
+        return;
+    }
 
-                    /* Remove message from Linked list */
-                    ns_list_remove(&handle->linked_list_resent_msgs, stored_msg_ptr);
-                    --handle->count_resent_msgs;
+    write_offset = block_offset - payload_offset;
+    write_end = write_offset + stored_payload_len;
+    if (write_end > max_size) {
+        tr_debug("sn_coap_protocol_linked_list_blockwise_payload_write - payload too large");
+        return;
+    }
 
-                    /* Free memory of stored message */
-                    sn_coap_protocol_release_allocated_send_msg_mem(handle, stored_msg_ptr);
+    if (stored_blockwise_payload_ptr == NULL) {
+        stored_blockwise_payload_ptr = sn_coap_protocol_linked_list_blockwise_payload_alloc(handle, addr_ptr, coap_msg_ptr);
+        if (stored_blockwise_payload_ptr == NULL) {
+            return;
+        }
+        stored_blockwise_payload_ptr->payload_offset = payload_offset;
+    }
 
-                    return;
-                }
+    if (write_end > stored_blockwise_payload_ptr->payload_size) {
+        uint32_t new_size = 2 * (uint32_t)stored_blockwise_payload_ptr->payload_size;
+        uint8_t *new_payload_ptr;
+
+        if (size_hint > payload_offset && size_hint - payload_offset >= write_end) {
+            new_size = size_hint - payload_offset;
+        }
+        if (new_size < write_end) {
+            new_size = write_end;
+        }
+        if (new_size > max_size) {
+            new_size = max_size;
+        }
+
+        new_payload_ptr = handle->sn_coap_protocol_malloc(new_size);
+        if (new_payload_ptr == NULL) {
+            if (stored_blockwise_payload_ptr->payload_ptr == NULL) {
+                sn_coap_protocol_linked_list_blockwise_payload_remove(handle, stored_blockwise_payload_ptr);
             }
+            return;
         }
+
+        if (stored_blockwise_payload_ptr->payload_ptr != NULL) {
+            memcpy(new_payload_ptr, stored_blockwise_payload_ptr->payload_ptr, stored_blockwise_payload_ptr->payload_len);
+            handle->sn_coap_protocol_free(stored_blockwise_payload_ptr->payload_ptr);
+        }
+        stored_blockwise_payload_ptr->payload_ptr = new_payload_ptr;
+        stored_blockwise_payload_ptr->payload_size = new_size;
+    }
+
+    /* Missing blocks are left zeroed */
+    if (write_offset > stored_blockwise_payload_ptr->payload_len) {
+        memset(stored_blockwise_payload_ptr->payload_ptr + stored_blockwise_payload_ptr->payload_len, 0,
+               write_offset - stored_blockwise_payload_ptr->payload_len);
     }
+
+    memcpy(stored_blockwise_payload_ptr->payload_ptr + write_offset, coap_msg_ptr->payload_ptr, stored_payload_len);
+    if (write_end > stored_blockwise_payload_ptr->payload_len) {
+        stored_blockwise_payload_ptr->payload_len = write_end;
+    }
+    stored_blockwise_payload_ptr->timestamp = handle->system_time;
 }
-#endif /* ENABLE_RESENDINGS */
+#endif
 
+/**************************************************************************//**
+ * \fn static int8_t sn_coap_protocol_linked_list_blockwise_payload_take(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *coap_msg_ptr, uint8_t **payload_pptr, uint16_t *payload_len)
+ *
+ * \brief Gathers whole stored blockwise payload of the transfer and removes it from Linked list.
+ *        Freeing of the returned payload is left to the caller.
+ *
+ * \param *src_addr_ptr is pointer to Address key
+ * \param *coap_msg_ptr is received last block of the transfer
+ * \param **payload_pptr is pointer to returned whole payload
+ * \param *payload_len is pointer to returned whole payload length
+ *
+ * \return 0 on success, -1 if out of memory or payload is too large
+ *****************************************************************************/
 
-static void sn_coap_protocol_send_rst(struct coap_s *handle, uint16_t msg_id, sn_nsdl_addr_s *addr_ptr, void *param)
+static int8_t sn_coap_protocol_linked_list_blockwise_payload_take(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr,
+        const sn_coap_hdr_s *coap_msg_ptr,
+        uint8_t **payload_pptr,
+        uint16_t *payload_len)
 {
-    uint8_t packet_ptr[4];
+#if SN_COAP_BLOCKWISE_REASSEMBLY
+    coap_blockwise_payload_s *stored_payload_info_ptr = sn_coap_protocol_linked_list_blockwise_payload_find(handle, src_addr_ptr, coap_msg_ptr);
+
+    *payload_pptr = NULL;
+    *payload_len = 0;
+
+    if (stored_payload_info_ptr) {
+        /* Reassembly buffer is handed over as it is */
+        *payload_pptr = stored_payload_info_ptr->payload_ptr;
+        *payload_len = stored_payload_info_ptr->payload_len;
+        stored_payload_info_ptr->payload_ptr = NULL;
+        sn_coap_protocol_linked_list_blockwise_payload_remove(handle, stored_payload_info_ptr);
+    }
 
-    /* Add CoAP version and message type */
-    packet_ptr[0] = COAP_VERSION_1;
-    packet_ptr[0] |= COAP_MSG_TYPE_RESET;
+    return 0;
+#else
+    uint32_t peer_id = sn_coap_protocol_blockwise_payload_source(handle, src_addr_ptr);
+    uint32_t whole_payload_len = sn_coap_protocol_linked_list_blockwise_payloads_get_len(handle, src_addr_ptr, coap_msg_ptr);
+    uint8_t *temp_whole_payload_ptr = NULL;
 
-    /* Add message code */
-    packet_ptr[1] = COAP_MSG_CODE_EMPTY;
+    tr_debug("sn_coap_protocol_linked_list_blockwise_payload_take - whole_payload_len %d", whole_payload_len);
+    if (whole_payload_len > UINT16_MAX) {
+        return -1;
+    }
 
-    /* Add message ID */
-    packet_ptr[2] = msg_id >> 8;
-    packet_ptr[3] = (uint8_t)msg_id;
+    temp_whole_payload_ptr = handle->sn_coap_protocol_malloc(whole_payload_len);
+    if (temp_whole_payload_ptr == NULL) {
+        return -1;
+    }
 
-    /* Send RST */
-    handle->sn_coap_tx_callback(packet_ptr, 4, addr_ptr, param);
+    *payload_pptr = temp_whole_payload_ptr;
+    *payload_len = whole_payload_len;
+
+    /* Copy stored Blockwise payloads to returned whole Blockwise payload pointer */
+#if SN_COAP_SERVER_PROFILE
+    /* Index bucket has latest block first, so payload is copied from the end */
+    temp_whole_payload_ptr += whole_payload_len;
+    coap_blockwise_payload_s *next_payload_info_ptr;
+    for (coap_blockwise_payload_s *stored_payload_info_ptr = sn_coap_protocol_linked_list_blockwise_payload_find(handle, src_addr_ptr, coap_msg_ptr);
+            stored_payload_info_ptr != NULL; stored_payload_info_ptr = next_payload_info_ptr) {
+        next_payload_info_ptr = stored_payload_info_ptr->hash_next;
+        if (sn_coap_protocol_blockwise_payload_from(stored_payload_info_ptr, src_addr_ptr, peer_id, coap_msg_ptr)) {
+            temp_whole_payload_ptr -= stored_payload_info_ptr->payload_len;
+            memcpy(temp_whole_payload_ptr, stored_payload_info_ptr->payload_ptr, stored_payload_info_ptr->payload_len);
+            sn_coap_protocol_linked_list_blockwise_payload_remove(handle, stored_payload_info_ptr);
+        }
+    }
+#else
+    ns_list_foreach_safe(coap_blockwise_payload_s, stored_payload_info_ptr, &handle->linked_list_blockwise_received_payloads) {
+        if (sn_coap_protocol_blockwise_payload_from(stored_payload_info_ptr, src_addr_ptr, peer_id, coap_msg_ptr)) {
+            memcpy(temp_whole_payload_ptr, stored_payload_info_ptr->payload_ptr, stored_payload_info_ptr->payload_len);
+            temp_whole_payload_ptr += stored_payload_info_ptr->payload_len;
+            sn_coap_protocol_linked_list_blockwise_payload_remove(handle, stored_payload_info_ptr);
+        }
+    }
+#endif
 
+    return 0;
+#endif
 }
-#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT /* If Message duplication detection is not used at all, this part of code will not be compiled */
 
 /**************************************************************************//**
- * \fn static void sn_coap_protocol_linked_list_duplication_info_store(sn_nsdl_addr_s *addr_ptr, uint16_t msg_id)
+ * \fn static void sn_coap_protocol_linked_list_blockwise_payload_remove(struct coap_s *handle,
+ *                                                      coap_blockwise_msg_s *removed_msg_ptr)
  *
- * \brief Stores Duplication info to Linked list
+ * \brief Removes stored blockwise payload from Linked list
  *
- * \param msg_id is Message ID to be stored
- * \param *addr_ptr is pointer to Address information to be stored
+ * \param removed_payload_ptr is payload to be removed
  *****************************************************************************/
 
-static void sn_coap_protocol_linked_list_duplication_info_store(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr,
-        uint16_t msg_id)
+static void sn_coap_protocol_linked_list_blockwise_payload_remove(struct coap_s *handle,
+                                                                  coap_blockwise_payload_s *removed_payload_ptr)
 {
-    coap_duplication_info_s *stored_duplication_info_ptr = NULL;
-
-    /* * * * Allocating memory for stored Duplication info * * * */
+    ns_list_remove(&handle->linked_list_blockwise_received_payloads, removed_payload_ptr);
 
-    /* Allocate memory for stored Duplication info's structure */
-    stored_duplication_info_ptr = handle->sn_coap_protocol_malloc(sizeof(coap_duplication_info_s));
+#if SN_COAP_SERVER_PROFILE
+    sn_coap_protocol_blockwise_payload_unindex(handle, removed_payload_ptr);
+    sn_coap_peer_table_unref(&handle->peer_table, removed_payload_ptr->peer_id, handle->system_time);
+#endif
 
-    if (stored_duplication_info_ptr == NULL) {
-        return;
+    /* Free memory of stored payload */
+    if (removed_payload_ptr->addr_ptr != NULL) {
+        handle->sn_coap_protocol_free(removed_payload_ptr->addr_ptr);
+        removed_payload_ptr->addr_ptr = 0;
     }
 
-    /* Allocate memory for stored Duplication info's address */
-    stored_duplication_info_ptr->addr_ptr = handle->sn_coap_protocol_malloc(addr_ptr->addr_len);
-
-    if (stored_duplication_info_ptr->addr_ptr == NULL) {
-        handle->sn_coap_protocol_free(stored_duplication_info_ptr);
-        stored_duplication_info_ptr = 0;
-        return;
+    if (removed_payload_ptr->payload_ptr != NULL) {
+        handle->sn_coap_protocol_free(removed_payload_ptr->payload_ptr);
+        removed_payload_ptr->payload_ptr = 0;
     }
 
-    /* * * * Filling fields of stored Duplication info * * * */
-
-    stored_duplication_info_ptr->timestamp = handle->system_time;
-    stored_duplication_info_ptr->addr_len = addr_ptr->addr_len;
-    memcpy(stored_duplication_info_ptr->addr_ptr, addr_ptr->addr_ptr, addr_ptr->addr_len);
-    stored_duplication_info_ptr->port = addr_ptr->port;
-    stored_duplication_info_ptr->msg_id = msg_id;
-
-    stored_duplication_info_ptr->coap = handle;
-
-    /* * * * Storing Duplication info to Linked list * * * */
+#if SN_COAP_Q_BLOCK_MAX_PAYLOADS && SN_COAP_BLOCKWISE_REASSEMBLY
+    if (removed_payload_ptr->q_block_map != NULL) {
+        handle->sn_coap_protocol_free(removed_payload_ptr->q_block_map);
+        removed_payload_ptr->q_block_map = 0;
+    }
+#endif
 
-    ns_list_add_to_end(&handle->linked_list_duplication_msgs, stored_duplication_info_ptr);
-    ++handle->count_duplication_msgs;
+    handle->sn_coap_protocol_free(removed_payload_ptr);
+    removed_payload_ptr = 0;
 }
 
+#if !SN_COAP_BLOCKWISE_REASSEMBLY
 /**************************************************************************//**
- * \fn static int8_t sn_coap_protocol_linked_list_duplication_info_search(sn_nsdl_addr_s *addr_ptr, uint16_t msg_id)
+ * \fn static uint32_t sn_coap_protocol_linked_list_blockwise_payloads_get_len(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *coap_msg_ptr)
  *
- * \brief Searches stored message from Linked list (Address and Message ID as key)
+ * \brief Counts length of Payloads in Linked list (Address, and token in server profile, as key)
  *
- * \param *addr_ptr is pointer to Address key to be searched
- * \param msg_id is Message ID key to be searched
+ * \param *addr_ptr is pointer to Address key
+ * \param *coap_msg_ptr is received message
  *
- * \return Return value is 0 when message found and -1 if not found
+ * \return Return value is length of Payloads as bytes
  *****************************************************************************/
 
-static int8_t sn_coap_protocol_linked_list_duplication_info_search(struct coap_s *handle,
-        sn_nsdl_addr_s *addr_ptr, uint16_t msg_id)
+static uint32_t sn_coap_protocol_linked_list_blockwise_payloads_get_len(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *coap_msg_ptr)
 {
-    /* Loop all nodes in Linked list for searching Message ID */
-    ns_list_foreach(coap_duplication_info_s, stored_duplication_info_ptr, &handle->linked_list_duplication_msgs) {
-        /* If message's Message ID is same than is searched */
-        if (stored_duplication_info_ptr->msg_id == msg_id) {
-            /* If message's Source address is same than is searched */
-            if (0 == memcmp(addr_ptr->addr_ptr, stored_duplication_info_ptr->addr_ptr, addr_ptr->addr_len)) {
-                /* If message's Source address port is same than is searched */
-                if (stored_duplication_info_ptr->port == addr_ptr->port) {
-                    /* * * Correct Duplication info found * * * */
-                    return 0;
-                }
-            }
+    uint32_t ret_whole_payload_len = 0;
+    uint32_t peer_id = sn_coap_protocol_blockwise_payload_source(handle, src_addr_ptr);
+
+    /* Loop all stored blockwise payloads of the transfer */
+#if SN_COAP_SERVER_PROFILE
+    for (coap_blockwise_payload_s *searched_payload_info_ptr = sn_coap_protocol_linked_list_blockwise_payload_find(handle, src_addr_ptr, coap_msg_ptr);
+            searched_payload_info_ptr != NULL; searched_payload_info_ptr = searched_payload_info_ptr->hash_next) {
+#else
+    ns_list_foreach(coap_blockwise_payload_s, searched_payload_info_ptr, &handle->linked_list_blockwise_received_payloads) {
+#endif
+        /* If payload's Source address and port are same than is searched */
+        if (sn_coap_protocol_blockwise_payload_from(searched_payload_info_ptr, src_addr_ptr, peer_id, coap_msg_ptr)) {
+            /* * * Correct Payload found * * * */
+            ret_whole_payload_len += searched_payload_info_ptr->payload_len;
         }
     }
 
-    return -1;
+    return ret_whole_payload_len;
 }
+#endif
 
 /**************************************************************************//**
- * \fn static void sn_coap_protocol_linked_list_duplication_info_remove(struct coap_s *handle, uint8_t *addr_ptr, uint16_t port, uint16_t msg_id)
- *
- * \brief Removes stored Duplication info from Linked list
- *
- * \param *addr_ptr is pointer to Address key to be removed
+ * \fn static uint32_t sn_coap_protocol_blockwise_payload_source(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr)
  *
- * \param port is Port key to be removed
+ * \brief Finds key for matching stored blockwise payloads to given source
  *
- * \param msg_id is Message ID key to be removed
+ * \return ID of the source in peer table in server profile, 0 otherwise or if source is unknown
  *****************************************************************************/
 
-static void sn_coap_protocol_linked_list_duplication_info_remove(struct coap_s *handle, uint8_t *addr_ptr, uint16_t port, uint16_t msg_id)
+static uint32_t sn_coap_protocol_blockwise_payload_source(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr)
 {
-    /* Loop all stored duplication messages in Linked list */
-    ns_list_foreach(coap_duplication_info_s, removed_duplication_info_ptr, &handle->linked_list_duplication_msgs) {
-        /* If message's Address is same than is searched */
-        if (handle == removed_duplication_info_ptr->coap && 0 == memcmp(addr_ptr, removed_duplication_info_ptr->addr_ptr, removed_duplication_info_ptr->addr_len)) {
-            /* If message's Address prt is same than is searched */
-            if (removed_duplication_info_ptr->port == port) {
-                /* If Message ID is same than is searched */
-                if (removed_duplication_info_ptr->msg_id == msg_id) {
-                    /* * * * Correct Duplication info found, remove it from Linked list * * * */
-                    ns_list_remove(&handle->linked_list_duplication_msgs, removed_duplication_info_ptr);
-                    --handle->count_duplication_msgs;
+#if SN_COAP_SERVER_PROFILE
+    return sn_coap_peer_table_find(&handle->peer_table, addr_ptr);
+#else
+    (void) handle;
+    (void) addr_ptr;
+    return 0;
+#endif
+}
 
-                    /* Free memory of stored Duplication info */
-                    handle->sn_coap_protocol_free(removed_duplication_info_ptr->addr_ptr);
-                    removed_duplication_info_ptr->addr_ptr = 0;
-                    handle->sn_coap_protocol_free(removed_duplication_info_ptr);
-                    removed_duplication_info_ptr = 0;
+/**************************************************************************//**
+ * \fn static bool sn_coap_protocol_blockwise_payload_from(const coap_blockwise_payload_s *payload_ptr, const sn_nsdl_addr_s *addr_ptr, uint32_t peer_id, const sn_coap_hdr_s *coap_msg_ptr)
+ *
+ * \brief Checks if stored blockwise payload is from given source and belongs to the same
+ *        request, which has the same Request-Tag (RFC 9175). In server profile requests
+ *        without Request-Tag are separated by token as well.
+ *
+ * \param *addr_ptr is Address and port of the source
+ * \param peer_id is key returned by sn_coap_protocol_blockwise_payload_source() for the source
+ * \param *coap_msg_ptr is received message of the request, or NULL to match any request
+ *****************************************************************************/
 
-                    return;
-                }
-            }
-        }
-    }
+static bool sn_coap_protocol_blockwise_payload_from(const coap_blockwise_payload_s *payload_ptr, const sn_nsdl_addr_s *addr_ptr, uint32_t peer_id, const sn_coap_hdr_s *coap_msg_ptr)
+{
+#if SN_COAP_SERVER_PROFILE
+    (void) addr_ptr;
+    return peer_id && payload_ptr->peer_id == peer_id &&
+           (coap_msg_ptr == NULL ||
+            (sn_coap_protocol_request_tag_match(payload_ptr, coap_msg_ptr) &&
+             (payload_ptr->request_tag_len != COAP_REQUEST_TAG_NONE ||
+              sn_coap_protocol_blockwise_token_match(payload_ptr->token, payload_ptr->token_len, coap_msg_ptr))));
+#else
+    (void) peer_id;
+    return 0 == memcmp(addr_ptr->addr_ptr, payload_ptr->addr_ptr, addr_ptr->addr_len) && payload_ptr->port == addr_ptr->port &&
+           (coap_msg_ptr == NULL || sn_coap_protocol_request_tag_match(payload_ptr, coap_msg_ptr));
+#endif
 }
 
 /**************************************************************************//**
- * \fn static void sn_coap_protocol_linked_list_duplication_info_remove_old_ones(struct coap_s *handle)
+ * \fn static uint8_t sn_coap_protocol_request_tag_len(const sn_coap_hdr_s *coap_msg_ptr)
  *
- * \brief Removes old stored Duplication detection infos from Linked list
+ * \brief Gets length of Request-Tag of the message, COAP_REQUEST_TAG_NONE if message has none
  *****************************************************************************/
 
-static void sn_coap_protocol_linked_list_duplication_info_remove_old_ones(struct coap_s *handle)
+static uint8_t sn_coap_protocol_request_tag_len(const sn_coap_hdr_s *coap_msg_ptr)
 {
-    /* Loop all stored duplication messages in Linked list */
-    ns_list_foreach_safe(coap_duplication_info_s, removed_duplication_info_ptr, &handle->linked_list_duplication_msgs) {
-        if ((handle->system_time - removed_duplication_info_ptr->timestamp)  > SN_COAP_DUPLICATION_MAX_TIME_MSGS_STORED) {
-            /* * * * Old Duplication info found, remove it from Linked list * * * */
-            ns_list_remove(&handle->linked_list_duplication_msgs, removed_duplication_info_ptr);
-            --handle->count_duplication_msgs;
-
-            /* Free memory of stored Duplication info */
-            handle->sn_coap_protocol_free(removed_duplication_info_ptr->addr_ptr);
-            removed_duplication_info_ptr->addr_ptr = 0;
-            handle->sn_coap_protocol_free(removed_duplication_info_ptr);
-            removed_duplication_info_ptr = 0;
-        }
+    if (coap_msg_ptr->options_list_ptr == NULL || !coap_msg_ptr->options_list_ptr->use_request_tag ||
+            coap_msg_ptr->options_list_ptr->request_tag_len > sizeof(coap_msg_ptr->options_list_ptr->request_tag)) {
+        return COAP_REQUEST_TAG_NONE;
     }
-}
 
-#endif /* SN_COAP_DUPLICATION_MAX_MSGS_COUNT */
+    return coap_msg_ptr->options_list_ptr->request_tag_len;
+}
 
-#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
 /**************************************************************************//**
- * \fn static void sn_coap_protocol_linked_list_blockwise_msg_remove(struct coap_s *handle, coap_blockwise_msg_s *removed_msg_ptr)
- *
- * \brief Removes stored blockwise message from Linked list
+ * \fn static bool sn_coap_protocol_request_tag_match(const coap_blockwise_payload_s *payload_ptr, const sn_coap_hdr_s *coap_msg_ptr)
  *
- * \param removed_msg_ptr is message to be removed
+ * \brief Checks if stored payload has Request-Tag of given message. Absent Request-Tag
+ *        matches only absent Request-Tag, empty Request-Tag is a tag of its own.
  *****************************************************************************/
 
-static void sn_coap_protocol_linked_list_blockwise_msg_remove(struct coap_s *handle, coap_blockwise_msg_s *removed_msg_ptr)
+static bool sn_coap_protocol_request_tag_match(const coap_blockwise_payload_s *payload_ptr, const sn_coap_hdr_s *coap_msg_ptr)
 {
-    if( removed_msg_ptr->coap == handle ){
-        ns_list_remove(&handle->linked_list_blockwise_sent_msgs, removed_msg_ptr);
-
-        if( removed_msg_ptr->coap_msg_ptr ){
-            if (removed_msg_ptr->coap_msg_ptr->payload_ptr) {
-                handle->sn_coap_protocol_free(removed_msg_ptr->coap_msg_ptr->payload_ptr);
-                removed_msg_ptr->coap_msg_ptr->payload_ptr = 0;
-            }
-
-            sn_coap_parser_release_allocated_coap_msg_mem(handle, removed_msg_ptr->coap_msg_ptr);
-        }
+    uint8_t request_tag_len = sn_coap_protocol_request_tag_len(coap_msg_ptr);
 
-        handle->sn_coap_protocol_free(removed_msg_ptr);
-        removed_msg_ptr = 0;
-    }
+    return payload_ptr->request_tag_len == request_tag_len &&
+           (request_tag_len == COAP_REQUEST_TAG_NONE ||
+            0 == memcmp(payload_ptr->request_tag, coap_msg_ptr->options_list_ptr->request_tag, request_tag_len));
 }
 
+#if SN_COAP_SERVER_PROFILE
 /**************************************************************************//**
- * \fn static void sn_coap_protocol_linked_list_blockwise_payload_store(sn_nsdl_addr_s *addr_ptr, uint16_t stored_payload_len, uint8_t *stored_payload_ptr)
+ * \fn static uint32_t sn_coap_protocol_blockwise_hash(uint32_t peer_id, const uint8_t *token_ptr, uint8_t token_len)
  *
- * \brief Stores blockwise payload to Linked list
- *
- * \param *addr_ptr is pointer to Address information to be stored
- * \param stored_payload_len is length of stored Payload
- * \param *stored_payload_ptr is pointer to stored Payload
+ * \brief Calculates index bucket of blockwise transfer from FNV-1a hash of peer and token
  *****************************************************************************/
 
-static void sn_coap_protocol_linked_list_blockwise_payload_store(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr,
-        uint16_t stored_payload_len,
-        uint8_t *stored_payload_ptr)
+static uint32_t sn_coap_protocol_blockwise_hash(uint32_t peer_id, const uint8_t *token_ptr, uint8_t token_len)
 {
-    if (!addr_ptr || !stored_payload_len || !stored_payload_ptr) {
-        return;
-    }
+    uint32_t hash = 2166136261u;
 
-    coap_blockwise_payload_s *stored_blockwise_payload_ptr = NULL;
+    hash = (hash ^ (peer_id & 0xffff)) * 16777619u;
+    hash = (hash ^ (peer_id >> 16)) * 16777619u;
+    for (uint8_t i = 0; i < token_len; i++) {
+        hash = (hash ^ token_ptr[i]) * 16777619u;
+    }
 
-    /* * * * Allocating memory for stored Payload  * * * */
+    return hash & (SN_COAP_BLOCKWISE_HASH_SIZE - 1);
+}
 
-    /* Allocate memory for stored Payload's structure */
-    stored_blockwise_payload_ptr = handle->sn_coap_protocol_malloc(sizeof(coap_blockwise_payload_s));
+/**************************************************************************//**
+ * \fn static uint8_t sn_coap_protocol_blockwise_token_len(const sn_coap_hdr_s *coap_msg_ptr)
+ *
+ * \brief Gets length of token used as blockwise transfer key, 0 if message has no valid token
+ *****************************************************************************/
 
-    if (stored_blockwise_payload_ptr == NULL) {
-        return;
+static uint8_t sn_coap_protocol_blockwise_token_len(const sn_coap_hdr_s *coap_msg_ptr)
+{
+    if (coap_msg_ptr->token_ptr == NULL || coap_msg_ptr->token_len > 8) {
+        return 0;
     }
 
-    /* Allocate memory for stored Payload's data */
-    stored_blockwise_payload_ptr->payload_ptr = handle->sn_coap_protocol_malloc(stored_payload_len);
+    return coap_msg_ptr->token_len;
+}
 
-    if (stored_blockwise_payload_ptr->payload_ptr == NULL) {
-        handle->sn_coap_protocol_free(stored_blockwise_payload_ptr);
-        stored_blockwise_payload_ptr = 0;
-        return;
-    }
+/**************************************************************************//**
+ * \fn static bool sn_coap_protocol_blockwise_token_match(const uint8_t *token_ptr, uint8_t token_len, const sn_coap_hdr_s *coap_msg_ptr)
+ *
+ * \brief Checks if stored token is the token of given message
+ *****************************************************************************/
 
-    /* Allocate memory for stored Payload's address */
-    stored_blockwise_payload_ptr->addr_ptr = handle->sn_coap_protocol_malloc(addr_ptr->addr_len);
+static bool sn_coap_protocol_blockwise_token_match(const uint8_t *token_ptr, uint8_t token_len, const sn_coap_hdr_s *coap_msg_ptr)
+{
+    return token_len == sn_coap_protocol_blockwise_token_len(coap_msg_ptr) &&
+           (token_len == 0 || 0 == memcmp(token_ptr, coap_msg_ptr->token_ptr, token_len));
+}
 
-    if (stored_blockwise_payload_ptr->addr_ptr == NULL) {
-        handle->sn_coap_protocol_free(stored_blockwise_payload_ptr->payload_ptr);
-        stored_blockwise_payload_ptr->payload_ptr = 0;
-        handle->sn_coap_protocol_free(stored_blockwise_payload_ptr);
-        stored_blockwise_payload_ptr = 0;
+/**************************************************************************//**
+ * \fn static uint32_t sn_coap_protocol_blockwise_session_hash(uint32_t peer_id, uint8_t request_tag_len, const uint8_t *request_tag_ptr, uint8_t token_len, const uint8_t *token_ptr)
+ *
+ * \brief Calculates index bucket of received blockwise transfer. Request-Tag is used as
+ *        key if request has one, token otherwise.
+ *****************************************************************************/
 
-        return;
+static uint32_t sn_coap_protocol_blockwise_session_hash(uint32_t peer_id, uint8_t request_tag_len, const uint8_t *request_tag_ptr, uint8_t token_len, const uint8_t *token_ptr)
+{
+    if (request_tag_len != COAP_REQUEST_TAG_NONE) {
+        return sn_coap_protocol_blockwise_hash(peer_id, request_tag_ptr, request_tag_len);
     }
 
-    /* * * * Filling fields of stored Payload  * * * */
-
-    stored_blockwise_payload_ptr->timestamp = handle->system_time;
-
-    memcpy(stored_blockwise_payload_ptr->addr_ptr, addr_ptr->addr_ptr, addr_ptr->addr_len);
-    stored_blockwise_payload_ptr->port = addr_ptr->port;
-    memcpy(stored_blockwise_payload_ptr->payload_ptr, stored_payload_ptr, stored_payload_len);
-    stored_blockwise_payload_ptr->payload_len = stored_payload_len;
+    return sn_coap_protocol_blockwise_hash(peer_id, token_ptr, token_len);
+}
 
-    stored_blockwise_payload_ptr->coap = handle;
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_blockwise_payload_index(struct coap_s *handle, coap_blockwise_payload_s *payload_ptr)
+ *
+ * \brief Adds received blockwise payload to the head of its index bucket
+ *****************************************************************************/
 
-    /* * * * Storing Payload to Linked list  * * * */
+static void sn_coap_protocol_blockwise_payload_index(struct coap_s *handle, coap_blockwise_payload_s *payload_ptr)
+{
+    coap_blockwise_payload_s **bucket = &handle->blockwise_received_hash[sn_coap_protocol_blockwise_session_hash(payload_ptr->peer_id,
+                                        payload_ptr->request_tag_len, payload_ptr->request_tag, payload_ptr->token_len, payload_ptr->token)];
 
-    ns_list_add_to_end(&handle->linked_list_blockwise_received_payloads, stored_blockwise_payload_ptr);
+    payload_ptr->hash_next = *bucket;
+    *bucket = payload_ptr;
 }
 
 /**************************************************************************//**
- * \fn static uint8_t *sn_coap_protocol_linked_list_blockwise_payload_search(sn_nsdl_addr_s *src_addr_ptr, uint16_t *payload_length)
- *
- * \brief Searches stored blockwise payload from Linked list (Address as key)
- *
- * \param *addr_ptr is pointer to Address key to be searched
- * \param *payload_length is pointer to returned Payload length
+ * \fn static void sn_coap_protocol_blockwise_payload_unindex(struct coap_s *handle, coap_blockwise_payload_s *payload_ptr)
  *
- * \return Return value is pointer to found stored blockwise payload in Linked
- *         list or NULL if payload not found
+ * \brief Removes received blockwise payload from its index bucket
  *****************************************************************************/
 
-static uint8_t *sn_coap_protocol_linked_list_blockwise_payload_search(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t *payload_length)
+static void sn_coap_protocol_blockwise_payload_unindex(struct coap_s *handle, coap_blockwise_payload_s *payload_ptr)
 {
-    /* Loop all stored blockwise payloads in Linked list */
-    ns_list_foreach(coap_blockwise_payload_s, stored_payload_info_ptr, &handle->linked_list_blockwise_received_payloads) {
-        /* If payload's Source address is same than is searched */
-        if (0 == memcmp(src_addr_ptr->addr_ptr, stored_payload_info_ptr->addr_ptr, src_addr_ptr->addr_len)) {
-            /* If payload's Source address port is same than is searched */
-            if (stored_payload_info_ptr->port == src_addr_ptr->port) {
-                /* * * Correct Payload found * * * */
-                *payload_length = stored_payload_info_ptr->payload_len;
-
-                return stored_payload_info_ptr->payload_ptr;
-            }
+    coap_blockwise_payload_s **link_ptr = &handle->blockwise_received_hash[sn_coap_protocol_blockwise_session_hash(payload_ptr->peer_id,
+                                          payload_ptr->request_tag_len, payload_ptr->request_tag, payload_ptr->token_len, payload_ptr->token)];
+
+    while (*link_ptr) {
+        if (*link_ptr == payload_ptr) {
+            *link_ptr = payload_ptr->hash_next;
+            break;
         }
+        link_ptr = &(*link_ptr)->hash_next;
     }
+    payload_ptr->hash_next = NULL;
+}
 
-    return NULL;
+/**************************************************************************//**
+ * \fn static bool sn_coap_protocol_blockwise_payload_same_session(const coap_blockwise_payload_s *payload_ptr, const coap_blockwise_payload_s *other_ptr)
+ *
+ * \brief Checks if stored blockwise payloads belong to the same transfer
+ *****************************************************************************/
+
+static bool sn_coap_protocol_blockwise_payload_same_session(const coap_blockwise_payload_s *payload_ptr, const coap_blockwise_payload_s *other_ptr)
+{
+    return payload_ptr->peer_id == other_ptr->peer_id &&
+           payload_ptr->request_tag_len == other_ptr->request_tag_len &&
+           0 == memcmp(payload_ptr->request_tag, other_ptr->request_tag, sizeof(payload_ptr->request_tag)) &&
+           payload_ptr->token_len == other_ptr->token_len &&
+           0 == memcmp(payload_ptr->token, other_ptr->token, payload_ptr->token_len);
 }
 
 /**************************************************************************//**
- * \fn static void sn_coap_protocol_linked_list_blockwise_payload_remove_oldest(struct coap_s *handle)
+ * \fn static uint32_t sn_coap_protocol_blockwise_payload_end(struct coap_s *handle, const coap_blockwise_payload_s *payload_ptr)
  *
- * \brief Removes current stored blockwise paylod from Linked list
+ * \brief Gets offset following the received blocks of the transfer stored payload belongs to,
+ *        which is the offset where next block of the transfer must start
  *****************************************************************************/
 
-static void sn_coap_protocol_linked_list_blockwise_payload_remove_oldest(struct coap_s *handle)
+static uint32_t sn_coap_protocol_blockwise_payload_end(struct coap_s *handle, const coap_blockwise_payload_s *payload_ptr)
 {
-    coap_blockwise_payload_s *removed_payload_ptr;
-
-    /* Remove oldest node in Linked list*/
-    removed_payload_ptr = ns_list_get_first(&handle->linked_list_blockwise_received_payloads);
-
-    if (removed_payload_ptr != NULL) {
-        sn_coap_protocol_linked_list_blockwise_payload_remove(handle, removed_payload_ptr);
+    if (handle->sn_coap_block_sink_callback != NULL) {
+        return payload_ptr->sink_offset;
+    }
+#if SN_COAP_BLOCKWISE_REASSEMBLY
+    return payload_ptr->payload_offset + payload_ptr->payload_len;
+#else
+    uint32_t end = 0;
+
+    ns_list_foreach(coap_blockwise_payload_s, stored_payload_ptr, &handle->linked_list_blockwise_received_payloads) {
+        if (sn_coap_protocol_blockwise_payload_same_session(stored_payload_ptr, payload_ptr)) {
+            end += stored_payload_ptr->payload_len;
+        }
     }
+
+    return end;
+#endif
 }
 
 /**************************************************************************//**
- * \fn static void sn_coap_protocol_linked_list_blockwise_payload_remove(struct coap_s *handle,
- *                                                      coap_blockwise_msg_s *removed_msg_ptr)
+ * \fn static int8_t sn_coap_protocol_block1_session_continue(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *received_coap_msg_ptr)
  *
- * \brief Removes stored blockwise payload from Linked list
+ * \brief Finds the transfer received Block1 block continues. Requests without Request-Tag
+ *        may change token between blocks, so if there is no transfer with the token of the
+ *        block, transfer from the same peer ending where the block starts is moved under the
+ *        new token. Block must start where the stored blocks of its transfer end.
  *
- * \param removed_payload_ptr is payload to be removed
+ * \return 0 if block can be stored, -1 if blocks before it are missing (4.08)
  *****************************************************************************/
 
-static void sn_coap_protocol_linked_list_blockwise_payload_remove(struct coap_s *handle,
-                                                                  coap_blockwise_payload_s *removed_payload_ptr)
+static int8_t sn_coap_protocol_block1_session_continue(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *received_coap_msg_ptr)
 {
-    ns_list_remove(&handle->linked_list_blockwise_received_payloads, removed_payload_ptr);
+    uint32_t block1 = received_coap_msg_ptr->options_list_ptr->block1;
+    uint32_t block_offset = (block1 >> 4) << ((block1 & 0x07) + 4);
+    coap_blockwise_payload_s *session_ptr;
+    coap_blockwise_payload_s old_session;
+    uint32_t peer_id;
+    bool peer_has_sessions = false;
+
+    /* First block starts a new transfer, Q-Block1 blocks can arrive in any order */
+    if (block_offset == 0 || received_coap_msg_ptr->options_list_ptr->use_q_block1) {
+        return 0;
+    }
 
-    /* Free memory of stored payload */
-    if (removed_payload_ptr->addr_ptr != NULL) {
-        handle->sn_coap_protocol_free(removed_payload_ptr->addr_ptr);
-        removed_payload_ptr->addr_ptr = 0;
+    session_ptr = sn_coap_protocol_linked_list_blockwise_payload_find(handle, src_addr_ptr, received_coap_msg_ptr);
+    if (session_ptr) {
+        return sn_coap_protocol_blockwise_payload_end(handle, session_ptr) == block_offset ? 0 : -1;
     }
 
-    if (removed_payload_ptr->payload_ptr != NULL) {
-        handle->sn_coap_protocol_free(removed_payload_ptr->payload_ptr);
-        removed_payload_ptr->payload_ptr = 0;
+    peer_id = sn_coap_peer_table_find(&handle->peer_table, src_addr_ptr);
+    if (peer_id == 0 || sn_coap_protocol_request_tag_len(received_coap_msg_ptr) != COAP_REQUEST_TAG_NONE) {
+        return 0;
     }
 
-    handle->sn_coap_protocol_free(removed_payload_ptr);
-    removed_payload_ptr = 0;
-}
+    ns_list_foreach(coap_blockwise_payload_s, stored_payload_ptr, &handle->linked_list_blockwise_received_payloads) {
+        if (stored_payload_ptr->peer_id != peer_id || stored_payload_ptr->request_tag_len != COAP_REQUEST_TAG_NONE) {
+            continue;
+        }
+        peer_has_sessions = true;
+        if (sn_coap_protocol_blockwise_payload_end(handle, stored_payload_ptr) == block_offset) {
+            session_ptr = stored_payload_ptr;
+            break;
+        }
+    }
 
-/**************************************************************************//**
- * \fn static uint32_t sn_coap_protocol_linked_list_blockwise_payloads_get_len(sn_nsdl_addr_s *src_addr_ptr)
- *
- * \brief Counts length of Payloads in Linked list (Address as key)
- *
- * \param *addr_ptr is pointer to Address key
- *
- * \return Return value is length of Payloads as bytes
- *****************************************************************************/
+    if (session_ptr == NULL) {
+        /* Block would continue some other transfer of the peer, or blocks have been removed by the application */
+        return peer_has_sessions ? -1 : 0;
+    }
 
-static uint32_t sn_coap_protocol_linked_list_blockwise_payloads_get_len(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr)
-{
-    uint32_t ret_whole_payload_len = 0;
-    /* Loop all stored blockwise payloads in Linked list */
-    ns_list_foreach(coap_blockwise_payload_s, searched_payload_info_ptr, &handle->linked_list_blockwise_received_payloads) {
-        /* If payload's Source address is same than is searched */
-        if (0 == memcmp(src_addr_ptr->addr_ptr, searched_payload_info_ptr->addr_ptr, src_addr_ptr->addr_len)) {
-            /* If payload's Source address port is same than is searched */
-            if (searched_payload_info_ptr->port == src_addr_ptr->port) {
-                /* * * Correct Payload found * * * */
-                ret_whole_payload_len += searched_payload_info_ptr->payload_len;
+    /* Stored blocks of the transfer are moved under the new token */
+    old_session = *session_ptr;
+    ns_list_foreach(coap_blockwise_payload_s, stored_payload_ptr, &handle->linked_list_blockwise_received_payloads) {
+        if (sn_coap_protocol_blockwise_payload_same_session(stored_payload_ptr, &old_session)) {
+            sn_coap_protocol_blockwise_payload_unindex(handle, stored_payload_ptr);
+            stored_payload_ptr->token_len = sn_coap_protocol_blockwise_token_len(received_coap_msg_ptr);
+            if (stored_payload_ptr->token_len) {
+                memcpy(stored_payload_ptr->token, received_coap_msg_ptr->token_ptr, stored_payload_ptr->token_len);
             }
+            sn_coap_protocol_blockwise_payload_index(handle, stored_payload_ptr);
         }
     }
 
-    return ret_whole_payload_len;
+    return 0;
 }
+#endif
 
 /**************************************************************************//**
  * \fn static void sn_coap_protocol_linked_list_blockwise_remove_old_data(struct coap_s *handle)
@@ -1391,6 +4004,10 @@ coap_send_msg_s *sn_coap_protocol_allocate_mem_for_msg(struct coap_s *handle, sn
 
     memset(msg_ptr->send_msg_ptr, 0 , sizeof(sn_nsdl_transmit_s));
 
+#if SN_COAP_SERVER_PROFILE
+    /* Destination address is referenced from peer table */
+    (void) dst_addr_ptr;
+#else
     msg_ptr->send_msg_ptr->dst_addr_ptr = handle->sn_coap_protocol_malloc(sizeof(sn_nsdl_addr_s));
 
     if (msg_ptr->send_msg_ptr->dst_addr_ptr == NULL) {
@@ -1399,6 +4016,7 @@ coap_send_msg_s *sn_coap_protocol_allocate_mem_for_msg(struct coap_s *handle, sn
     }
 
     memset(msg_ptr->send_msg_ptr->dst_addr_ptr, 0, sizeof(sn_nsdl_addr_s));
+#endif
 
     msg_ptr->send_msg_ptr->packet_ptr = handle->sn_coap_protocol_malloc(packet_data_len);
 
@@ -1407,6 +4025,7 @@ coap_send_msg_s *sn_coap_protocol_allocate_mem_for_msg(struct coap_s *handle, sn
         return 0;
     }
 
+#if !SN_COAP_SERVER_PROFILE
     msg_ptr->send_msg_ptr->dst_addr_ptr->addr_ptr = handle->sn_coap_protocol_malloc(dst_addr_ptr->addr_len);
 
     if (msg_ptr->send_msg_ptr->dst_addr_ptr->addr_ptr == NULL) {
@@ -1415,6 +4034,7 @@ coap_send_msg_s *sn_coap_protocol_allocate_mem_for_msg(struct coap_s *handle, sn
     }
 
     memset(msg_ptr->send_msg_ptr->dst_addr_ptr->addr_ptr, 0, dst_addr_ptr->addr_len);
+#endif
 
     return msg_ptr;
 }
@@ -1432,6 +4052,12 @@ static void sn_coap_protocol_release_allocated_send_msg_mem(struct coap_s *handl
 {
     if (freed_send_msg_ptr != NULL) {
         if (freed_send_msg_ptr->send_msg_ptr != NULL) {
+#if SN_COAP_SERVER_PROFILE
+            if (freed_send_msg_ptr->peer_id) {
+                sn_coap_peer_table_unref(&handle->peer_table, freed_send_msg_ptr->peer_id, handle->system_time);
+            }
+            freed_send_msg_ptr->send_msg_ptr->dst_addr_ptr = 0;
+#else
             if (freed_send_msg_ptr->send_msg_ptr->dst_addr_ptr != NULL) {
                 if (freed_send_msg_ptr->send_msg_ptr->dst_addr_ptr->addr_ptr != NULL) {
                     handle->sn_coap_protocol_free(freed_send_msg_ptr->send_msg_ptr->dst_addr_ptr->addr_ptr);
@@ -1441,6 +4067,7 @@ static void sn_coap_protocol_release_allocated_send_msg_mem(struct coap_s *handl
                 handle->sn_coap_protocol_free(freed_send_msg_ptr->send_msg_ptr->dst_addr_ptr);
                 freed_send_msg_ptr->send_msg_ptr->dst_addr_ptr = 0;
             }
+#endif
 
             if (freed_send_msg_ptr->send_msg_ptr->packet_ptr != NULL) {
                 handle->sn_coap_protocol_free(freed_send_msg_ptr->send_msg_ptr->packet_ptr);
@@ -1462,23 +4089,53 @@ static void sn_coap_protocol_release_allocated_send_msg_mem(struct coap_s *handl
 }
 
 /**************************************************************************//**
- * \fn static uint16_t sn_coap_count_linked_list_size(const coap_send_msg_list_t *linked_list_ptr)
+ * \fn static void sn_coap_protocol_linked_list_send_msg_unlink(struct coap_s *handle, coap_send_msg_s *unlinked_msg_ptr)
  *
- * \brief Counts total message size of all messages in linked list
+ * \brief Removes message from resending Linked list and updates queue counters.
+ *        Memory of the message is not released.
  *
- * \param const coap_send_msg_list_t *linked_list_ptr pointer to linked list
+ * \param *unlinked_msg_ptr is pointer to removed message
  *****************************************************************************/
-static uint16_t sn_coap_count_linked_list_size(const coap_send_msg_list_t *linked_list_ptr)
+static void sn_coap_protocol_linked_list_send_msg_unlink(struct coap_s *handle, coap_send_msg_s *unlinked_msg_ptr)
 {
-    uint16_t total_size = 0;
+    ns_list_remove(&handle->linked_list_resent_msgs, unlinked_msg_ptr);
+    --handle->count_resent_msgs;
+    if (unlinked_msg_ptr->send_msg_ptr != NULL) {
+        handle->count_resent_bytes -= unlinked_msg_ptr->send_msg_ptr->packet_len;
+    }
 
-    ns_list_foreach(coap_send_msg_s, stored_msg_ptr, linked_list_ptr) {
-        if (stored_msg_ptr->send_msg_ptr) {
-            total_size += stored_msg_ptr->send_msg_ptr->packet_len;
+#if SN_COAP_SERVER_PROFILE
+    if (handle->resent_msgs_hash == NULL) {
+        return;
+    }
+    coap_send_msg_s **link_ptr = &handle->resent_msgs_hash[unlinked_msg_ptr->msg_id & (SN_COAP_RESENDING_HASH_SIZE - 1)];
+    while (*link_ptr) {
+        if (*link_ptr == unlinked_msg_ptr) {
+            *link_ptr = unlinked_msg_ptr->hash_next;
+            break;
         }
+        link_ptr = &(*link_ptr)->hash_next;
     }
+#endif
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_send_failures_flush(struct coap_s *handle, sn_coap_send_failure_s *failures, uint8_t failure_count, coap_send_msg_list_t *failed_msgs)
+ *
+ * \brief Reports failed messages to send failure callback and releases them
+ *
+ * \param *failures is array of failed message infos
+ * \param failure_count is count of failed message infos
+ * \param *failed_msgs is list of failed messages, emptied by this function
+ *****************************************************************************/
+static void sn_coap_protocol_send_failures_flush(struct coap_s *handle, sn_coap_send_failure_s *failures, uint8_t failure_count, coap_send_msg_list_t *failed_msgs)
+{
+    handle->sn_coap_send_failure_callback(handle, failures, failure_count);
 
-    return total_size;
+    ns_list_foreach_safe(coap_send_msg_s, failed_msg_ptr, failed_msgs) {
+        ns_list_remove(failed_msgs, failed_msg_ptr);
+        sn_coap_protocol_release_allocated_send_msg_mem(handle, failed_msg_ptr);
+    }
 }
 
 #endif
@@ -1490,31 +4147,539 @@ void sn_coap_protocol_block_remove(struct coap_s *handle, sn_nsdl_addr_s *source
         return;
     }
 
+    uint32_t peer_id = sn_coap_protocol_blockwise_payload_source(handle, source_address);
+
     /* Loop all stored blockwise payloads in Linked list */
     ns_list_foreach(coap_blockwise_payload_s, stored_payload_info_ptr, &handle->linked_list_blockwise_received_payloads) {
-        /* If payload's Source address is not the same than is searched */
-        if (memcmp(source_address->addr_ptr, stored_payload_info_ptr->addr_ptr, source_address->addr_len)) {
+        /* If payload's Source address or port is not the same than is searched */
+        if (!sn_coap_protocol_blockwise_payload_from(stored_payload_info_ptr, source_address, peer_id, NULL)) {
             continue;
         }
 
-        /* If payload's Source address port is not the same than is searched */
-        if (stored_payload_info_ptr->port != source_address->port) {
+#if SN_COAP_BLOCKWISE_REASSEMBLY
+        /* Only the latest block at the end of reassembly buffer can be removed */
+        if(payload_length > stored_payload_info_ptr->payload_len){
             continue;
         }
 
+        if(!memcmp(stored_payload_info_ptr->payload_ptr + stored_payload_info_ptr->payload_len - payload_length, payload, payload_length))
+        {
+            stored_payload_info_ptr->payload_len -= payload_length;
+            if (stored_payload_info_ptr->payload_len == 0) {
+                sn_coap_protocol_linked_list_blockwise_payload_remove(handle, stored_payload_info_ptr);
+            }
+            return;
+        }
+#else
         /* Check the payload */
         if(payload_length != stored_payload_info_ptr->payload_len){
             continue;
         }
-
-        if(!memcmp(stored_payload_info_ptr->payload_ptr, payload, stored_payload_info_ptr->payload_len))
-        {
-            /* Everything matches, remove and return. */
-            sn_coap_protocol_linked_list_blockwise_payload_remove(handle, stored_payload_info_ptr);
-            return;
+
+        if(!memcmp(stored_payload_info_ptr->payload_ptr, payload, stored_payload_info_ptr->payload_len))
+        {
+            /* Everything matches, remove and return. */
+            sn_coap_protocol_linked_list_blockwise_payload_remove(handle, stored_payload_info_ptr);
+            return;
+        }
+#endif
+    }
+}
+/**************************************************************************//**
+ * \fn static int8_t sn_coap_protocol_block_sink_deliver(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *received_coap_msg_ptr, uint32_t block_option, uint32_t total_size, void *param)
+ *
+ * \brief Delivers received block to block sink if it is the next block expected from the source.
+ *        Only the offset of the next block is stored for the source, not the payload.
+ *
+ * \param block_option is received Block1 or Block2 option
+ * \param total_size is size of whole payload told by the sender, 0 if unknown
+ *
+ * \return SN_COAP_BLOCK_SINK_ACCEPTED, SN_COAP_BLOCK_SINK_DUPLICATE, SN_COAP_BLOCK_SINK_OUT_OF_ORDER
+ *         or SN_COAP_BLOCK_SINK_REJECTED
+ *****************************************************************************/
+
+static int8_t sn_coap_protocol_block_sink_deliver(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *received_coap_msg_ptr,
+        uint32_t block_option, uint32_t total_size, void *param)
+{
+    coap_blockwise_payload_s *stream_ptr = sn_coap_protocol_linked_list_blockwise_payload_find(handle, src_addr_ptr, received_coap_msg_ptr);
+    uint32_t block_offset = (block_option >> 4) << ((block_option & 0x07) + 4);
+    sn_coap_block_s block;
+
+    /* First block starts a new transfer */
+    if (block_offset == 0) {
+        if (stream_ptr == NULL) {
+            stream_ptr = sn_coap_protocol_linked_list_blockwise_payload_alloc(handle, src_addr_ptr, received_coap_msg_ptr);
+            if (stream_ptr == NULL) {
+                return SN_COAP_BLOCK_SINK_REJECTED;
+            }
+        }
+        stream_ptr->sink_offset = 0;
+    }
+
+    if (stream_ptr == NULL || block_offset > stream_ptr->sink_offset) {
+        tr_debug("sn_coap_protocol_block_sink_deliver - block out of order");
+        return SN_COAP_BLOCK_SINK_OUT_OF_ORDER;
+    }
+
+    if (block_offset < stream_ptr->sink_offset) {
+        return SN_COAP_BLOCK_SINK_DUPLICATE;
+    }
+
+    block.coap_msg_ptr = received_coap_msg_ptr;
+    block.src_addr_ptr = src_addr_ptr;
+    block.offset = block_offset;
+    block.total_size = total_size;
+    block.payload_ptr = received_coap_msg_ptr->payload_ptr;
+    block.payload_len = received_coap_msg_ptr->payload_len;
+    block.last = (block_option & 0x08) ? 0 : 1;
+
+    if (handle->sn_coap_block_sink_callback(handle, &block, param) != 0) {
+        tr_debug("sn_coap_protocol_block_sink_deliver - block rejected");
+        sn_coap_protocol_linked_list_blockwise_payload_remove(handle, stream_ptr);
+        return SN_COAP_BLOCK_SINK_REJECTED;
+    }
+
+    if (block.last) {
+        sn_coap_protocol_linked_list_blockwise_payload_remove(handle, stream_ptr);
+    } else {
+        stream_ptr->sink_offset += received_coap_msg_ptr->payload_len;
+        stream_ptr->timestamp = handle->system_time;
+    }
+
+    return SN_COAP_BLOCK_SINK_ACCEPTED;
+}
+
+#if SN_COAP_Q_BLOCK_MAX_PAYLOADS
+/**************************************************************************//**
+ * \fn static int8_t sn_coap_protocol_q_block1_send(struct coap_s *handle, coap_blockwise_msg_s *msg_ptr, sn_nsdl_addr_s *dst_addr_ptr, uint32_t block_number, void *param)
+ *
+ * \brief Sends one block of stored Q-Block1 request with new Message ID
+ *
+ * \param *msg_ptr is stored request
+ * \param *dst_addr_ptr is address of the peer request is sent to
+ * \param block_number is number of sent block
+ *
+ * \return 0 on success, -1 if block is past the end of payload or out of memory
+ *****************************************************************************/
+
+static int8_t sn_coap_protocol_q_block1_send(struct coap_s *handle, coap_blockwise_msg_s *msg_ptr, sn_nsdl_addr_s *dst_addr_ptr, uint32_t block_number, void *param)
+{
+    sn_coap_hdr_s *coap_msg_ptr = msg_ptr->coap_msg_ptr;
+    uint8_t *original_payload_ptr = coap_msg_ptr->payload_ptr;
+    uint16_t original_payload_len = coap_msg_ptr->payload_len;
+    int32_t original_block1 = coap_msg_ptr->options_list_ptr->block1;
+    uint8_t block_temp = original_block1 & 0x07;
+    uint32_t block_size = 1u << (block_temp + 4);
+    uint32_t block_offset = block_number * block_size;
+    uint16_t packet_len = 0;
+    uint8_t *packet_ptr = NULL;
+
+    /* Block number is at most 20 bits */
+    if (block_number > 0xFFFFF || block_offset >= msg_ptr->payload_len) {
+        return -1;
+    }
+
+    coap_msg_ptr->options_list_ptr->block1 = (block_number << 4) | block_temp;
+    if (msg_ptr->payload_len - block_offset > block_size) {
+        coap_msg_ptr->options_list_ptr->block1 |= 0x08;
+        coap_msg_ptr->payload_len = block_size;
+    } else {
+        coap_msg_ptr->payload_len = msg_ptr->payload_len - block_offset;
+    }
+    coap_msg_ptr->payload_ptr = sn_coap_protocol_blockwise_msg_payload(handle, msg_ptr, block_offset, coap_msg_ptr->payload_len);
+
+    if (coap_msg_ptr->payload_ptr != NULL) {
+        packet_len = sn_coap_builder_calc_needed_packet_data_size_2(coap_msg_ptr, handle->sn_coap_block_data_size);
+        packet_ptr = handle->sn_coap_protocol_malloc(packet_len);
+    }
+
+    if (packet_ptr != NULL) {
+        coap_msg_ptr->msg_id = handle->message_id++;
+        if (handle->message_id == 0) {
+            handle->message_id = 1;
+        }
+
+        sn_coap_builder_2(packet_ptr, coap_msg_ptr, handle->sn_coap_block_data_size);
+        tr_debug("sn_coap_protocol_q_block1_send - block: [%lu], msg id: [%d]", (unsigned long)block_number, coap_msg_ptr->msg_id);
+        sn_coap_protocol_tx(handle, packet_ptr, packet_len, dst_addr_ptr, param);
+        handle->sn_coap_protocol_free(packet_ptr);
+    }
+
+    coap_msg_ptr->payload_ptr = original_payload_ptr;
+    coap_msg_ptr->payload_len = original_payload_len;
+    coap_msg_ptr->options_list_ptr->block1 = original_block1;
+
+    return packet_ptr != NULL ? 0 : -1;
+}
+
+/**************************************************************************//**
+ * \fn static coap_blockwise_msg_s *sn_coap_protocol_q_block1_msg_find(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *received_coap_msg_ptr)
+ *
+ * \brief Finds Q-Block1 request which received 2.31 or 4.08 response asks to continue.
+ *        Responses to Non-confirmable blocks have Message IDs of their own, so
+ *        request is matched with token.
+ *
+ * \return Stored request, or NULL if response does not continue Q-Block1 transfer
+ *****************************************************************************/
+
+static coap_blockwise_msg_s *sn_coap_protocol_q_block1_msg_find(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *received_coap_msg_ptr)
+{
+    if (received_coap_msg_ptr->msg_code != COAP_MSG_CODE_RESPONSE_CONTINUE &&
+            (received_coap_msg_ptr->msg_code != COAP_MSG_CODE_RESPONSE_REQUEST_ENTITY_INCOMPLETE ||
+             received_coap_msg_ptr->content_format != COAP_CT_MISSING_BLOCKS)) {
+        return NULL;
+    }
+
+#if SN_COAP_SERVER_PROFILE
+    coap_blockwise_msg_s *msg = sn_coap_protocol_linked_list_blockwise_msg_find(handle, src_addr_ptr, received_coap_msg_ptr);
+
+    if (msg && msg->coap_msg_ptr->options_list_ptr && msg->coap_msg_ptr->options_list_ptr->use_q_block1 &&
+            msg->coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE) {
+        return msg;
+    }
+#else
+    (void) src_addr_ptr;
+    ns_list_foreach(coap_blockwise_msg_s, msg, &handle->linked_list_blockwise_sent_msgs) {
+        if (msg->coap_msg_ptr && msg->coap_msg_ptr->options_list_ptr && msg->coap_msg_ptr->options_list_ptr->use_q_block1 &&
+                msg->coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE &&
+                msg->coap_msg_ptr->token_len == received_coap_msg_ptr->token_len &&
+                (received_coap_msg_ptr->token_len == 0 ||
+                 memcmp(msg->coap_msg_ptr->token_ptr, received_coap_msg_ptr->token_ptr, received_coap_msg_ptr->token_len) == 0)) {
+            return msg;
+        }
+    }
+#endif
+
+    return NULL;
+}
+
+/**************************************************************************//**
+ * \fn static sn_coap_hdr_s *sn_coap_protocol_q_block1_continue(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *received_coap_msg_ptr, coap_blockwise_msg_s *msg_ptr, void *param)
+ *
+ * \brief Continues sending of Q-Block1 request. After 2.31 the next set of blocks
+ *        is sent, after 4.08 the blocks it lists missing are sent again.
+ *        Confirmable requests are sent one block at a time.
+ *
+ * \param *received_coap_msg_ptr is received 2.31 or 4.08 response
+ * \param *msg_ptr is stored request
+ *****************************************************************************/
+
+static sn_coap_hdr_s *sn_coap_protocol_q_block1_continue(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *received_coap_msg_ptr, coap_blockwise_msg_s *msg_ptr, void *param)
+{
+    uint32_t set_size = msg_ptr->coap_msg_ptr->msg_type == COAP_MSG_TYPE_NON_CONFIRMABLE ? SN_COAP_Q_BLOCK_MAX_PAYLOADS : 1;
+    uint32_t block_number;
+    uint32_t count;
+
+    if (received_coap_msg_ptr->msg_code == COAP_MSG_CODE_RESPONSE_CONTINUE) {
+        /* 2.31 tells the last block of acknowledged set */
+        if (received_coap_msg_ptr->options_list_ptr != NULL &&
+                received_coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE) {
+            block_number = (received_coap_msg_ptr->options_list_ptr->block1 >> 4) + 1;
+            tr_debug("sn_coap_protocol_q_block1_continue - send set from block [%lu]", (unsigned long)block_number);
+            for (count = 0; count < set_size; count++, block_number++) {
+                if (sn_coap_protocol_q_block1_send(handle, msg_ptr, src_addr_ptr, block_number, param) != 0) {
+                    break;
+                }
+            }
+        }
+    } else {
+        /* Payload of 4.08 is CBOR sequence of missing block numbers */
+        const uint8_t *data_ptr = received_coap_msg_ptr->payload_ptr;
+        const uint8_t *end_ptr = data_ptr + received_coap_msg_ptr->payload_len;
+
+        for (count = 0; count < set_size && data_ptr < end_ptr; count++) {
+            if (sn_coap_protocol_cbor_uint_parse(&data_ptr, end_ptr, &block_number) != 0) {
+                break;
+            }
+            tr_debug("sn_coap_protocol_q_block1_continue - send missing block [%lu]", (unsigned long)block_number);
+            sn_coap_protocol_q_block1_send(handle, msg_ptr, src_addr_ptr, block_number, param);
+        }
+    }
+
+    msg_ptr->timestamp = handle->system_time;
+    received_coap_msg_ptr->coap_status = COAP_STATUS_PARSER_BLOCKWISE_ACK;
+
+    return received_coap_msg_ptr;
+}
+
+/**************************************************************************//**
+ * \fn static int8_t sn_coap_protocol_cbor_uint_parse(const uint8_t **data_pptr, const uint8_t *end_ptr, uint32_t *value_ptr)
+ *
+ * \brief Parses CBOR unsigned integer of at most 32 bits and moves data pointer past it
+ *
+ * \return 0 on success, -1 if data is not unsigned integer or is truncated
+ *****************************************************************************/
+
+static int8_t sn_coap_protocol_cbor_uint_parse(const uint8_t **data_pptr, const uint8_t *end_ptr, uint32_t *value_ptr)
+{
+    const uint8_t *data_ptr = *data_pptr;
+    uint8_t additional_info = *data_ptr & 0x1F;
+    uint8_t value_len = 0;
+
+    /* Major type 0 */
+    if ((*data_ptr >> 5) != 0 || additional_info > 26) {
+        return -1;
+    }
+    if (additional_info >= 24) {
+        value_len = 1u << (additional_info - 24);
+    }
+    if (end_ptr - data_ptr - 1 < value_len) {
+        return -1;
+    }
+
+    *value_ptr = value_len ? 0 : additional_info;
+    for (data_ptr++; value_len; value_len--, data_ptr++) {
+        *value_ptr = (*value_ptr << 8) | *data_ptr;
+    }
+    *data_pptr = data_ptr;
+
+    return 0;
+}
+
+#if SN_COAP_BLOCKWISE_REASSEMBLY
+/**************************************************************************//**
+ * \fn static sn_coap_hdr_s *sn_coap_protocol_q_block1_receive(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *received_coap_msg_ptr, void *param)
+ *
+ * \brief Handles received block of Non-confirmable Q-Block1 request. Blocks are written to
+ *        reassembly buffer in any order. When last block of a set is received, the set is
+ *        acknowledged with 2.31, or its missing blocks are asked with 4.08. Whole payload
+ *        is returned to User when all blocks have been received.
+ *****************************************************************************/
+
+static sn_coap_hdr_s *sn_coap_protocol_q_block1_receive(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *received_coap_msg_ptr, void *param)
+{
+    sn_coap_options_list_s *options_ptr = received_coap_msg_ptr->options_list_ptr;
+    uint32_t block_number = options_ptr->block1 >> 4;
+    uint8_t block_temp = options_ptr->block1 & 0x07;
+    uint32_t block_offset = block_number << (block_temp + 4);
+    bool set_end = !(options_ptr->block1 & 0x08) || ((block_number + 1) % SN_COAP_Q_BLOCK_MAX_PAYLOADS) == 0;
+    coap_blockwise_payload_s *stored_payload_ptr;
+    uint8_t missing_list[SN_COAP_Q_BLOCK_MAX_PAYLOADS * 3];  /* Block numbers of 64 KB payload fit in 3 bytes */
+    uint16_t missing_list_len = 0;
+    uint32_t last_missing = 0;
+    uint32_t check_end;
+
+    sn_coap_protocol_linked_list_blockwise_payload_store(handle, src_addr_ptr, received_coap_msg_ptr, block_offset,
+            options_ptr->use_size1 ? options_ptr->size1 : 0);
+
+    /* Block is marked received only if it was written to reassembly buffer */
+    stored_payload_ptr = sn_coap_protocol_linked_list_blockwise_payload_find(handle, src_addr_ptr, received_coap_msg_ptr);
+    if (stored_payload_ptr == NULL || stored_payload_ptr->payload_ptr == NULL ||
+            block_offset + received_coap_msg_ptr->payload_len > stored_payload_ptr->payload_size ||
+            sn_coap_protocol_q_block_mark(handle, stored_payload_ptr, block_number) != 0) {
+        tr_debug("sn_coap_protocol_q_block1_receive - block [%lu] not stored", (unsigned long)block_number);
+        sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
+        return NULL;
+    }
+
+    if (!(options_ptr->block1 & 0x08)) {
+        stored_payload_ptr->q_block_count = block_number + 1;
+    }
+
+    if (stored_payload_ptr->q_block_count &&
+            sn_coap_protocol_q_block_missing(stored_payload_ptr, stored_payload_ptr->q_block_count, NULL, NULL, NULL) == 0) {
+        tr_debug("sn_coap_protocol_q_block1_receive - all blocks received");
+        uint8_t *whole_payload_ptr = NULL;
+        uint16_t whole_payload_len = 0;
+
+        sn_coap_protocol_linked_list_blockwise_payload_take(handle, src_addr_ptr, received_coap_msg_ptr, &whole_payload_ptr, &whole_payload_len);
+
+        // In block message case, payload_ptr freeing must be done in application level
+        received_coap_msg_ptr->payload_ptr = whole_payload_ptr;
+        received_coap_msg_ptr->payload_len = whole_payload_len;
+        received_coap_msg_ptr->coap_status = COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED;
+        return received_coap_msg_ptr;
+    }
+
+    /* Sets up to the end of this set or of the set asked again must be complete */
+    check_end = set_end ? block_number + 1 : 0;
+    if (stored_payload_ptr->q_block_set_end > check_end) {
+        check_end = stored_payload_ptr->q_block_set_end;
+    }
+
+    if (check_end) {
+        if (sn_coap_protocol_q_block_missing(stored_payload_ptr, check_end, missing_list, &missing_list_len, &last_missing) == 0) {
+            tr_debug("sn_coap_protocol_q_block1_receive - blocks up to [%lu] received", (unsigned long)(check_end - 1));
+            stored_payload_ptr->q_block_set_end = 0;
+            sn_coap_protocol_q_block1_respond(handle, src_addr_ptr, received_coap_msg_ptr, COAP_MSG_CODE_RESPONSE_CONTINUE,
+                                              ((check_end - 1) << 4) | 0x08 | block_temp, NULL, 0, param);
+        } else if (set_end || block_number == stored_payload_ptr->q_block_last_missing) {
+            /* Blocks asked again are not asked again before the last of them has arrived or a set has ended */
+            tr_debug("sn_coap_protocol_q_block1_receive - blocks missing before [%lu]", (unsigned long)check_end);
+            stored_payload_ptr->q_block_set_end = check_end;
+            stored_payload_ptr->q_block_last_missing = last_missing;
+            sn_coap_protocol_q_block1_respond(handle, src_addr_ptr, received_coap_msg_ptr, COAP_MSG_CODE_RESPONSE_REQUEST_ENTITY_INCOMPLETE,
+                                              COAP_OPTION_BLOCK_NONE, missing_list, missing_list_len, param);
+        }
+    }
+
+    received_coap_msg_ptr->coap_status = COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING;
+
+    return received_coap_msg_ptr;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_q_block1_respond(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, const sn_coap_hdr_s *request_ptr, sn_coap_msg_code_e msg_code, int32_t block1, uint8_t *payload_ptr, uint16_t payload_len, void *param)
+ *
+ * \brief Sends Non-confirmable response to received Q-Block1 request
+ *
+ * \param block1 is value of Q-Block1 option, or COAP_OPTION_BLOCK_NONE
+ * \param *payload_ptr is list of missing blocks, or NULL
+ *****************************************************************************/
+
+static void sn_coap_protocol_q_block1_respond(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, const sn_coap_hdr_s *request_ptr, sn_coap_msg_code_e msg_code, int32_t block1, uint8_t *payload_ptr, uint16_t payload_len, void *param)
+{
+    sn_coap_hdr_s response;
+    sn_coap_options_list_s options;
+    uint16_t packet_len;
+    uint8_t *packet_ptr;
+
+    memset(&response, 0, sizeof(response));
+    memset(&options, 0, sizeof(options));
+
+    options.max_age = COAP_OPTION_MAX_AGE_DEFAULT;
+    options.uri_port = COAP_OPTION_URI_PORT_NONE;
+    options.observe = COAP_OBSERVE_NONE;
+    options.accept = COAP_CT_NONE;
+    options.block2 = COAP_OPTION_BLOCK_NONE;
+    options.block1 = block1;
+    options.use_q_block1 = true;
+
+    response.msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    response.msg_code = msg_code;
+    response.token_ptr = request_ptr->token_ptr;
+    response.token_len = request_ptr->token_len;
+    response.content_format = payload_ptr ? COAP_CT_MISSING_BLOCKS : COAP_CT_NONE;
+    response.payload_ptr = payload_ptr;
+    response.payload_len = payload_len;
+    response.options_list_ptr = &options;
+
+    response.msg_id = handle->message_id++;
+    if (handle->message_id == 0) {
+        handle->message_id = 1;
+    }
+
+    packet_len = sn_coap_builder_calc_needed_packet_data_size_2(&response, handle->sn_coap_block_data_size);
+    packet_ptr = handle->sn_coap_protocol_malloc(packet_len);
+    if (packet_ptr == NULL) {
+        return;
+    }
+
+    sn_coap_builder_2(packet_ptr, &response, handle->sn_coap_block_data_size);
+    tr_debug("sn_coap_protocol_q_block1_respond - code: [%d], msg id: [%d]", msg_code, response.msg_id);
+    sn_coap_protocol_tx(handle, packet_ptr, packet_len, dst_addr_ptr, param);
+    handle->sn_coap_protocol_free(packet_ptr);
+}
+
+/**************************************************************************//**
+ * \fn static int8_t sn_coap_protocol_q_block_mark(struct coap_s *handle, coap_blockwise_payload_s *payload_ptr, uint32_t block_number)
+ *
+ * \brief Marks block received in bitmap of the transfer. Bitmap grows at least
+ *        to double size when needed.
+ *
+ * \return 0 on success, -1 if out of memory
+ *****************************************************************************/
+
+static int8_t sn_coap_protocol_q_block_mark(struct coap_s *handle, coap_blockwise_payload_s *payload_ptr, uint32_t block_number)
+{
+    uint32_t byte_index = block_number >> 3;
+
+    if (byte_index >= payload_ptr->q_block_map_size) {
+        uint32_t new_size = 2 * (uint32_t)payload_ptr->q_block_map_size;
+        uint8_t *new_map_ptr;
+
+        if (new_size <= byte_index) {
+            new_size = byte_index + 1;
+        }
+        if (new_size > UINT16_MAX) {
+            return -1;
+        }
+
+        new_map_ptr = handle->sn_coap_protocol_malloc(new_size);
+        if (new_map_ptr == NULL) {
+            return -1;
+        }
+        memset(new_map_ptr, 0, new_size);
+        if (payload_ptr->q_block_map != NULL) {
+            memcpy(new_map_ptr, payload_ptr->q_block_map, payload_ptr->q_block_map_size);
+            handle->sn_coap_protocol_free(payload_ptr->q_block_map);
+        }
+        payload_ptr->q_block_map = new_map_ptr;
+        payload_ptr->q_block_map_size = new_size;
+    }
+
+    payload_ptr->q_block_map[byte_index] |= 1u << (block_number & 7);
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * \fn static uint8_t sn_coap_protocol_cbor_uint_build(uint8_t *dst_ptr, uint32_t value)
+ *
+ * \brief Builds CBOR unsigned integer
+ *
+ * \return Count of written bytes, at most 5
+ *****************************************************************************/
+
+static uint8_t sn_coap_protocol_cbor_uint_build(uint8_t *dst_ptr, uint32_t value)
+{
+    if (value < 24) {
+        dst_ptr[0] = (uint8_t)value;
+        return 1;
+    } else if (value <= 0xFF) {
+        dst_ptr[0] = 24;
+        dst_ptr[1] = (uint8_t)value;
+        return 2;
+    } else if (value <= 0xFFFF) {
+        dst_ptr[0] = 25;
+        dst_ptr[1] = (uint8_t)(value >> 8);
+        dst_ptr[2] = (uint8_t)value;
+        return 3;
+    }
+
+    dst_ptr[0] = 26;
+    dst_ptr[1] = (uint8_t)(value >> 24);
+    dst_ptr[2] = (uint8_t)(value >> 16);
+    dst_ptr[3] = (uint8_t)(value >> 8);
+    dst_ptr[4] = (uint8_t)value;
+    return 5;
+}
+
+/**************************************************************************//**
+ * \fn static uint32_t sn_coap_protocol_q_block_missing(const coap_blockwise_payload_s *payload_ptr, uint32_t block_end, uint8_t *list_ptr, uint16_t *list_len, uint32_t *last_missing_ptr)
+ *
+ * \brief Counts blocks missing before given block number. First SN_COAP_Q_BLOCK_MAX_PAYLOADS
+ *        of them are listed as CBOR sequence, if list is given.
+ *
+ * \param block_end is number of first block not checked
+ * \param *list_ptr is list of missing blocks to be built, or NULL
+ * \param *list_len is length of built list
+ * \param *last_missing_ptr is last listed block
+ *
+ * \return Count of missing blocks
+ *****************************************************************************/
+
+static uint32_t sn_coap_protocol_q_block_missing(const coap_blockwise_payload_s *payload_ptr, uint32_t block_end, uint8_t *list_ptr, uint16_t *list_len, uint32_t *last_missing_ptr)
+{
+    uint32_t missing_count = 0;
+
+    for (uint32_t block_number = 0; block_number < block_end; block_number++) {
+        if ((block_number >> 3) < payload_ptr->q_block_map_size &&
+                (payload_ptr->q_block_map[block_number >> 3] & (1u << (block_number & 7)))) {
+            continue;
+        }
+        if (list_ptr != NULL && missing_count < SN_COAP_Q_BLOCK_MAX_PAYLOADS) {
+            *list_len += sn_coap_protocol_cbor_uint_build(list_ptr + *list_len, block_number);
+            *last_missing_ptr = block_number;
         }
+        missing_count++;
     }
+
+    return missing_count;
 }
+#endif /* SN_COAP_BLOCKWISE_REASSEMBLY */
+#endif /* SN_COAP_Q_BLOCK_MAX_PAYLOADS */
+
 /**************************************************************************//**
  * \fn static int8_t sn_coap_handle_blockwise_message(void)
  *
@@ -1534,6 +4699,7 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
 
     uint16_t original_payload_len = 0;
     uint8_t *original_payload_ptr = NULL;
+    int8_t block_sink_result = SN_COAP_BLOCK_SINK_ACCEPTED;
 
     /* Block1 Option in a request (e.g., PUT or POST) */
     // Blocked request sending, received ACK, sending next block..
@@ -1542,27 +4708,46 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
         if (received_coap_msg_ptr->msg_code > COAP_MSG_CODE_REQUEST_DELETE) {
             tr_debug("sn_coap_handle_blockwise_message - send block1 request");
             if (received_coap_msg_ptr->options_list_ptr->block1 & 0x08) {
-                coap_blockwise_msg_s *stored_blockwise_msg_temp_ptr = NULL;
-
                 /* Get  */
-                ns_list_foreach(coap_blockwise_msg_s, msg, &handle->linked_list_blockwise_sent_msgs) {
-                    if (msg->coap_msg_ptr && received_coap_msg_ptr->msg_id == msg->coap_msg_ptr->msg_id) {
-                        stored_blockwise_msg_temp_ptr = msg;
-                        break;
-                    }
-                }
+                coap_blockwise_msg_s *stored_blockwise_msg_temp_ptr = sn_coap_protocol_linked_list_blockwise_msg_find(handle, src_addr_ptr, received_coap_msg_ptr);
 
                 if (stored_blockwise_msg_temp_ptr) {
                     /* Build response message */
 
                     uint16_t block_size;
+                    uint16_t peer_block_size;
                     uint32_t block_number;
+                    uint32_t block_offset;
+                    uint8_t sent_block_temp;
 
                     /* Get block option parameters from received message */
                     block_number = received_coap_msg_ptr->options_list_ptr->block1 >> 4;
                     block_temp = received_coap_msg_ptr->options_list_ptr->block1 & 0x07;
                     block_size = 1u << (block_temp + 4);
 
+                    /* Peer acknowledges the block that was sent, with the size it was sent or a smaller size */
+                    /* that peer asks to use. Continue after the sent block, with the asked size or with a    */
+                    /* smaller size tuned for the peer if the offset is aligned to it.                         */
+                    sent_block_temp = block_temp;
+                    if (stored_blockwise_msg_temp_ptr->coap_msg_ptr->options_list_ptr &&
+                            stored_blockwise_msg_temp_ptr->coap_msg_ptr->options_list_ptr->block1 != COAP_OPTION_BLOCK_NONE) {
+                        sent_block_temp = stored_blockwise_msg_temp_ptr->coap_msg_ptr->options_list_ptr->block1 & 0x07;
+                    }
+#if SN_COAP_SERVER_PROFILE
+                    sn_coap_protocol_peer_block_size_update(handle, sn_coap_peer_table_intern(&handle->peer_table, src_addr_ptr, handle->system_time),
+                                                            1u << (sent_block_temp + 4), block_size);
+#endif
+                    block_offset = (block_number + 1) << ((sent_block_temp > block_temp ? sent_block_temp : block_temp) + 4);
+                    peer_block_size = sn_coap_protocol_block_size_get(handle, src_addr_ptr);
+                    if (peer_block_size && peer_block_size < block_size) {
+                        block_size = peer_block_size;
+                    }
+                    while (block_offset % block_size) {
+                        block_size >>= 1;
+                    }
+                    block_temp = sn_coap_convert_block_size(block_size);
+                    block_number = (block_offset / block_size) - 1;
+
                     /* Build next block message */
                     src_coap_blockwise_ack_msg_ptr = stored_blockwise_msg_temp_ptr->coap_msg_ptr;
 
@@ -1582,9 +4767,8 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                     original_payload_len = stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_len;
                     original_payload_ptr = stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_ptr;
 
-                    if ((block_size * (block_number + 1)) > stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_len) {
-                        src_coap_blockwise_ack_msg_ptr->payload_len = stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_len - (block_size * (block_number));
-                        src_coap_blockwise_ack_msg_ptr->payload_ptr = src_coap_blockwise_ack_msg_ptr->payload_ptr + (block_size * block_number);
+                    if ((block_size * (block_number + 1)) >= stored_blockwise_msg_temp_ptr->payload_len) {
+                        src_coap_blockwise_ack_msg_ptr->payload_len = stored_blockwise_msg_temp_ptr->payload_len - (block_size * (block_number));
                     }
 
                     /* Not last block */
@@ -1592,7 +4776,15 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                         /* set more - bit */
                         src_coap_blockwise_ack_msg_ptr->options_list_ptr->block1 |= 0x08;
                         src_coap_blockwise_ack_msg_ptr->payload_len = block_size;
-                        src_coap_blockwise_ack_msg_ptr->payload_ptr = src_coap_blockwise_ack_msg_ptr->payload_ptr + (block_size * block_number);
+                    }
+                    src_coap_blockwise_ack_msg_ptr->payload_ptr = sn_coap_protocol_blockwise_msg_payload(handle, stored_blockwise_msg_temp_ptr,
+                            block_size * block_number, src_coap_blockwise_ack_msg_ptr->payload_len);
+
+                    if (src_coap_blockwise_ack_msg_ptr->payload_ptr == NULL) {
+                        tr_debug("sn_coap_handle_blockwise_message - block1 request, payload provider failed");
+                        sn_coap_protocol_linked_list_blockwise_msg_remove(handle, stored_blockwise_msg_temp_ptr);
+                        sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
+                        return NULL;
                     }
                     /* Build and send block message */
                     dst_packed_data_needed_mem = sn_coap_builder_calc_needed_packet_data_size_2(src_coap_blockwise_ack_msg_ptr, handle->sn_coap_block_data_size);
@@ -1609,14 +4801,28 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                         sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
                         return NULL;
                     }
-                    src_coap_blockwise_ack_msg_ptr->msg_id = message_id++;
-                    if (message_id == 0) {
-                        message_id = 1;
+                    src_coap_blockwise_ack_msg_ptr->msg_id = handle->message_id++;
+                    if (handle->message_id == 0) {
+                        handle->message_id = 1;
                     }
 
                     sn_coap_builder_2(dst_ack_packet_data_ptr, src_coap_blockwise_ack_msg_ptr, handle->sn_coap_block_data_size);
                     tr_debug("sn_coap_handle_blockwise_message - block1 request, send block msg id: [%d]", src_coap_blockwise_ack_msg_ptr->msg_id);
-                    handle->sn_coap_tx_callback(dst_ack_packet_data_ptr, dst_packed_data_needed_mem, src_addr_ptr, param);
+                    sn_coap_protocol_tx(handle, dst_ack_packet_data_ptr, dst_packed_data_needed_mem, src_addr_ptr, param);
+
+                    /* Transfer makes progress, stored message is kept until the last block */
+                    stored_blockwise_msg_temp_ptr->timestamp = handle->system_time;
+
+#if ENABLE_RESENDINGS
+                    /* Blocks after the first one are re-sent like the first one built by user */
+                    if (src_coap_blockwise_ack_msg_ptr->msg_type == COAP_MSG_TYPE_CONFIRMABLE) {
+                        sn_coap_protocol_linked_list_send_msg_store(handle, src_addr_ptr,
+                                dst_packed_data_needed_mem,
+                                dst_ack_packet_data_ptr,
+                                handle->system_time + (uint32_t)(handle->sn_coap_resending_intervall * RESPONSE_RANDOM_FACTOR), param,
+                                src_coap_blockwise_ack_msg_ptr, NULL, 0);
+                    }
+#endif
 
                     handle->sn_coap_protocol_free(dst_ack_packet_data_ptr);
                     dst_ack_packet_data_ptr = 0;
@@ -1641,10 +4847,34 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                 received_coap_msg_ptr->payload_len = handle->sn_coap_block_data_size;
             }
 
-            sn_coap_protocol_linked_list_blockwise_payload_store(handle, src_addr_ptr, received_coap_msg_ptr->payload_len, received_coap_msg_ptr->payload_ptr);
+#if SN_COAP_Q_BLOCK_MAX_PAYLOADS && SN_COAP_BLOCKWISE_REASSEMBLY
+            /* Confirmable Q-Block1 blocks are acknowledged one by one like Block1 */
+            if (received_coap_msg_ptr->options_list_ptr->use_q_block1 &&
+                    received_coap_msg_ptr->msg_type == COAP_MSG_TYPE_NON_CONFIRMABLE &&
+                    handle->sn_coap_block_sink_callback == NULL) {
+                return sn_coap_protocol_q_block1_receive(handle, src_addr_ptr, received_coap_msg_ptr, param);
+            }
+#endif
+
+#if SN_COAP_SERVER_PROFILE
+            if (sn_coap_protocol_block1_session_continue(handle, src_addr_ptr, received_coap_msg_ptr) != 0) {
+                tr_debug("sn_coap_handle_blockwise_message - block1 received, previous blocks missing");
+                block_sink_result = SN_COAP_BLOCK_SINK_OUT_OF_ORDER;
+            } else
+#endif
+            if (handle->sn_coap_block_sink_callback != NULL) {
+                block_sink_result = sn_coap_protocol_block_sink_deliver(handle, src_addr_ptr, received_coap_msg_ptr,
+                        received_coap_msg_ptr->options_list_ptr->block1,
+                        received_coap_msg_ptr->options_list_ptr->use_size1 ? received_coap_msg_ptr->options_list_ptr->size1 : 0, param);
+            } else {
+                block_temp = received_coap_msg_ptr->options_list_ptr->block1 & 0x07;
+                sn_coap_protocol_linked_list_blockwise_payload_store(handle, src_addr_ptr, received_coap_msg_ptr,
+                        (received_coap_msg_ptr->options_list_ptr->block1 >> 4) << (block_temp + 4),
+                        received_coap_msg_ptr->options_list_ptr->use_size1 ? received_coap_msg_ptr->options_list_ptr->size1 : 0);
+            }
             /* If not last block (more value is set) */
             /* Block option length can be 1-3 bytes. First 4-20 bits are for block number. Last 4 bits are ALWAYS more bit + block size. */
-            if (received_coap_msg_ptr->options_list_ptr->block1 & 0x08) {
+            if ((received_coap_msg_ptr->options_list_ptr->block1 & 0x08) || block_sink_result != SN_COAP_BLOCK_SINK_ACCEPTED) {
                 tr_debug("sn_coap_handle_blockwise_message - block1 received, send ack");
                 src_coap_blockwise_ack_msg_ptr = sn_coap_parser_alloc_message(handle);
                 if (src_coap_blockwise_ack_msg_ptr == NULL) {
@@ -1662,7 +4892,7 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                 // Response with COAP_MSG_CODE_RESPONSE_REQUEST_ENTITY_TOO_LARGE if the payload size is more than we can handle
                 tr_debug("sn_coap_handle_blockwise_message - block1 received - incoming size: [%d]", received_coap_msg_ptr->options_list_ptr->size1);
                 uint32_t max_size = SN_COAP_MAX_INCOMING_BLOCK_MESSAGE_SIZE;
-                if (received_coap_msg_ptr->options_list_ptr->size1 > max_size) {
+                if (handle->sn_coap_block_sink_callback == NULL && received_coap_msg_ptr->options_list_ptr->size1 > max_size) {
                     // Include maximum size that stack can handle into response
                     src_coap_blockwise_ack_msg_ptr->msg_code = COAP_MSG_CODE_RESPONSE_REQUEST_ENTITY_TOO_LARGE;
                     src_coap_blockwise_ack_msg_ptr->options_list_ptr->size1 = max_size;
@@ -1677,14 +4907,21 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                     src_coap_blockwise_ack_msg_ptr->msg_code = COAP_MSG_CODE_RESPONSE_DELETED;
                 }
 
+                if (block_sink_result == SN_COAP_BLOCK_SINK_OUT_OF_ORDER) {
+                    src_coap_blockwise_ack_msg_ptr->msg_code = COAP_MSG_CODE_RESPONSE_REQUEST_ENTITY_INCOMPLETE;
+                } else if (block_sink_result == SN_COAP_BLOCK_SINK_REJECTED) {
+                    src_coap_blockwise_ack_msg_ptr->msg_code = COAP_MSG_CODE_RESPONSE_INTERNAL_SERVER_ERROR;
+                }
+
                 src_coap_blockwise_ack_msg_ptr->options_list_ptr->block1 = received_coap_msg_ptr->options_list_ptr->block1;
                 src_coap_blockwise_ack_msg_ptr->msg_type = COAP_MSG_TYPE_ACKNOWLEDGEMENT;
 
-                /* Check block size */
+                /* Check block size, sender is asked to use smaller blocks when they do not fit to path MTU */
+                /* or messages to it have been retransmitted                                              */
                 block_temp = (src_coap_blockwise_ack_msg_ptr->options_list_ptr->block1 & 0x07);
-                if (block_temp > sn_coap_convert_block_size(handle->sn_coap_block_data_size)) {
+                if (block_temp > sn_coap_convert_block_size(sn_coap_protocol_block_size_get(handle, src_addr_ptr))) {
                     src_coap_blockwise_ack_msg_ptr->options_list_ptr->block1 &= 0xFFFFF8;
-                    src_coap_blockwise_ack_msg_ptr->options_list_ptr->block1 |= sn_coap_convert_block_size(handle->sn_coap_block_data_size);
+                    src_coap_blockwise_ack_msg_ptr->options_list_ptr->block1 |= sn_coap_convert_block_size(sn_coap_protocol_block_size_get(handle, src_addr_ptr));
                 }
 
                 src_coap_blockwise_ack_msg_ptr->msg_id = received_coap_msg_ptr->msg_id;
@@ -1703,12 +4940,26 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
 
                 sn_coap_builder_2(dst_ack_packet_data_ptr, src_coap_blockwise_ack_msg_ptr, handle->sn_coap_block_data_size);
                 tr_debug("sn_coap_handle_blockwise_message - block1 received - send msg id [%d]", src_coap_blockwise_ack_msg_ptr->msg_id);
-                handle->sn_coap_tx_callback(dst_ack_packet_data_ptr, dst_packed_data_needed_mem, src_addr_ptr, param);
+                sn_coap_protocol_tx(handle, dst_ack_packet_data_ptr, dst_packed_data_needed_mem, src_addr_ptr, param);
+
+#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT
+                /* Block is re-sent if this Acknowledgement is lost, it is replayed then */
+                if (handle->sn_coap_duplication_response_cache_size) {
+                    sn_coap_protocol_duplication_response_store(handle, src_addr_ptr, src_coap_blockwise_ack_msg_ptr->msg_id,
+                            dst_ack_packet_data_ptr, dst_packed_data_needed_mem);
+                }
+#endif
 
                 sn_coap_parser_release_allocated_coap_msg_mem(handle, src_coap_blockwise_ack_msg_ptr);
                 handle->sn_coap_protocol_free(dst_ack_packet_data_ptr);
                 dst_ack_packet_data_ptr = 0;
 
+                /* Transfer is not continued after error response */
+                if (block_sink_result < 0) {
+                    sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
+                    return NULL;
+                }
+
                 received_coap_msg_ptr->coap_status = COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING;
 
             } else {
@@ -1716,32 +4967,21 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                 /* * * This is the last block when whole Blockwise payload from received * * */
                 /* * * blockwise messages is gathered and returned to User               * * */
 
-                /* Store last Blockwise payload to Linked list */
-                uint16_t payload_len            = 0;
-                uint8_t *payload_ptr            = sn_coap_protocol_linked_list_blockwise_payload_search(handle, src_addr_ptr, &payload_len);
-                uint32_t whole_payload_len      = sn_coap_protocol_linked_list_blockwise_payloads_get_len(handle, src_addr_ptr);
-                uint8_t *temp_whole_payload_ptr = NULL;
+                /* Gather whole Blockwise payload from Linked list, unless it was delivered to block sink */
+                uint8_t *whole_payload_ptr      = NULL;
+                uint16_t whole_payload_len      = 0;
 
-                tr_debug("sn_coap_handle_blockwise_message - block1 received, whole_payload_len %d", whole_payload_len);
-                temp_whole_payload_ptr = handle->sn_coap_protocol_malloc(whole_payload_len);
-                if (temp_whole_payload_ptr == NULL || whole_payload_len > UINT16_MAX) {
+                if (handle->sn_coap_block_sink_callback == NULL &&
+                        sn_coap_protocol_linked_list_blockwise_payload_take(handle, src_addr_ptr, received_coap_msg_ptr, &whole_payload_ptr, &whole_payload_len) != 0) {
                     tr_debug("sn_coap_handle_blockwise_message - block1 received, last block received alloc fails");
                     sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
-                    handle->sn_coap_protocol_free(temp_whole_payload_ptr);
                     return 0;
                 }
 
                 // In block message case, payload_ptr freeing must be done in application level
-                received_coap_msg_ptr->payload_ptr = temp_whole_payload_ptr;
+                received_coap_msg_ptr->payload_ptr = whole_payload_ptr;
                 received_coap_msg_ptr->payload_len = whole_payload_len;
 
-                /* Copy stored Blockwise payloads to returned whole Blockwise payload pointer */
-                while (payload_ptr != NULL) {
-                    memcpy(temp_whole_payload_ptr, payload_ptr, payload_len);
-                    temp_whole_payload_ptr += payload_len;
-                    sn_coap_protocol_linked_list_blockwise_payload_remove_oldest(handle);
-                    payload_ptr = sn_coap_protocol_linked_list_blockwise_payload_search(handle, src_addr_ptr, &payload_len);
-                }
                 received_coap_msg_ptr->coap_status = COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED;
             }
         }
@@ -1757,9 +4997,29 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
             tr_debug("sn_coap_handle_blockwise_message - send block2 request");
             uint32_t block_number = 0;
 
-            /* Store blockwise payload to Linked list */
-            //todo: add block number to stored values - just to make sure all packets are in order
-            sn_coap_protocol_linked_list_blockwise_payload_store(handle, src_addr_ptr, received_coap_msg_ptr->payload_len, received_coap_msg_ptr->payload_ptr);
+            if (handle->sn_coap_block_sink_callback != NULL) {
+                block_sink_result = sn_coap_protocol_block_sink_deliver(handle, src_addr_ptr, received_coap_msg_ptr,
+                        received_coap_msg_ptr->options_list_ptr->block2,
+                        received_coap_msg_ptr->options_list_ptr->use_size2 ? received_coap_msg_ptr->options_list_ptr->size2 : 0, param);
+
+                if (block_sink_result == SN_COAP_BLOCK_SINK_DUPLICATE) {
+                    sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
+                    return NULL;
+                }
+
+                /* Next block is not requested */
+                if (block_sink_result != SN_COAP_BLOCK_SINK_ACCEPTED) {
+                    received_coap_msg_ptr->coap_status = COAP_STATUS_PARSER_BLOCKWISE_MSG_REJECTED;
+                    return received_coap_msg_ptr;
+                }
+            } else {
+                /* Store blockwise payload to Linked list */
+                //todo: add block number to stored values - just to make sure all packets are in order
+                block_temp = received_coap_msg_ptr->options_list_ptr->block2 & 0x07;
+                sn_coap_protocol_linked_list_blockwise_payload_store(handle, src_addr_ptr, received_coap_msg_ptr,
+                        (received_coap_msg_ptr->options_list_ptr->block2 >> 4) << (block_temp + 4),
+                        received_coap_msg_ptr->options_list_ptr->use_size2 ? received_coap_msg_ptr->options_list_ptr->size2 : 0);
+            }
 
             /* If not last block (more value is set) */
             if (received_coap_msg_ptr->options_list_ptr->block2 & 0x08) {
@@ -1767,14 +5027,9 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                 //build and send ack
                 received_coap_msg_ptr->coap_status = COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING;
 
-                ns_list_foreach(coap_blockwise_msg_s, msg, &handle->linked_list_blockwise_sent_msgs) {
-                    if (received_coap_msg_ptr->msg_id == msg->coap_msg_ptr->msg_id) {
-                        previous_blockwise_msg_ptr = msg;
-                        break;
-                    }
-                }
+                previous_blockwise_msg_ptr = sn_coap_protocol_linked_list_blockwise_request_find(handle, src_addr_ptr, received_coap_msg_ptr);
 
-                if (!previous_blockwise_msg_ptr || !previous_blockwise_msg_ptr->coap_msg_ptr) {
+                if (!previous_blockwise_msg_ptr) {
                     sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
                     return 0;
                 }
@@ -1784,30 +5039,42 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                     return 0;
                 }
 
-                ns_list_remove(&handle->linked_list_blockwise_sent_msgs, previous_blockwise_msg_ptr);
-                if( previous_blockwise_msg_ptr->coap_msg_ptr ){
-                    if(previous_blockwise_msg_ptr->coap_msg_ptr->payload_ptr){
-                        handle->sn_coap_protocol_free(previous_blockwise_msg_ptr->coap_msg_ptr->payload_ptr);
-                        previous_blockwise_msg_ptr->coap_msg_ptr->payload_ptr = 0;
+                /* Next block is requested with the code and token of the request */
+                src_coap_blockwise_ack_msg_ptr->msg_code = (sn_coap_msg_code_e)previous_blockwise_msg_ptr->msg_code;
+                if (previous_blockwise_msg_ptr->token_len) {
+                    src_coap_blockwise_ack_msg_ptr->token_ptr = handle->sn_coap_protocol_malloc(previous_blockwise_msg_ptr->token_len);
+                    if (src_coap_blockwise_ack_msg_ptr->token_ptr == NULL) {
+                        handle->sn_coap_protocol_free(src_coap_blockwise_ack_msg_ptr);
+                        src_coap_blockwise_ack_msg_ptr = 0;
+                        sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
+                        return NULL;
                     }
-                    sn_coap_parser_release_allocated_coap_msg_mem(handle, previous_blockwise_msg_ptr->coap_msg_ptr);
-                    previous_blockwise_msg_ptr->coap_msg_ptr = 0;
+                    memcpy(src_coap_blockwise_ack_msg_ptr->token_ptr, previous_blockwise_msg_ptr->token, previous_blockwise_msg_ptr->token_len);
+                    src_coap_blockwise_ack_msg_ptr->token_len = previous_blockwise_msg_ptr->token_len;
                 }
-                handle->sn_coap_protocol_free(previous_blockwise_msg_ptr);
-                previous_blockwise_msg_ptr = 0;
 
                 /* * * Then build CoAP Acknowledgement message * * */
 
                 if (sn_coap_parser_alloc_options(handle, src_coap_blockwise_ack_msg_ptr) == NULL) {
-                    handle->sn_coap_protocol_free(src_coap_blockwise_ack_msg_ptr);
+                    sn_coap_parser_release_allocated_coap_msg_mem(handle, src_coap_blockwise_ack_msg_ptr);
                     src_coap_blockwise_ack_msg_ptr = 0;
                     sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
                     return NULL;
                 }
 
-                src_coap_blockwise_ack_msg_ptr->msg_id = message_id++;
-                if (message_id == 0) {
-                    message_id = 1;
+                /* Uri-Path and Uri-Query are borrowed from request record until the request is built */
+                if (previous_blockwise_msg_ptr->uri_path_len) {
+                    src_coap_blockwise_ack_msg_ptr->uri_path_ptr = previous_blockwise_msg_ptr->uri_ptr;
+                    src_coap_blockwise_ack_msg_ptr->uri_path_len = previous_blockwise_msg_ptr->uri_path_len;
+                }
+                if (previous_blockwise_msg_ptr->uri_query_len) {
+                    src_coap_blockwise_ack_msg_ptr->options_list_ptr->uri_query_ptr = previous_blockwise_msg_ptr->uri_ptr + previous_blockwise_msg_ptr->uri_path_len;
+                    src_coap_blockwise_ack_msg_ptr->options_list_ptr->uri_query_len = previous_blockwise_msg_ptr->uri_query_len;
+                }
+
+                src_coap_blockwise_ack_msg_ptr->msg_id = handle->message_id++;
+                if (handle->message_id == 0) {
+                    handle->message_id = 1;
                 }
 
                 /* Update block option */
@@ -1825,9 +5092,7 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                 dst_ack_packet_data_ptr = handle->sn_coap_protocol_malloc(dst_packed_data_needed_mem);
 
                 if (dst_ack_packet_data_ptr == NULL) {
-                    handle->sn_coap_protocol_free(src_coap_blockwise_ack_msg_ptr->options_list_ptr);
-                    src_coap_blockwise_ack_msg_ptr->options_list_ptr = 0;
-                    handle->sn_coap_protocol_free(src_coap_blockwise_ack_msg_ptr);
+                    sn_coap_protocol_blockwise_request_release(handle, src_coap_blockwise_ack_msg_ptr);
                     src_coap_blockwise_ack_msg_ptr = 0;
                     sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
                     return NULL;
@@ -1838,49 +5103,31 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                 if ((sn_coap_builder_2(dst_ack_packet_data_ptr, src_coap_blockwise_ack_msg_ptr, handle->sn_coap_block_data_size)) < 0) {
                     handle->sn_coap_protocol_free(dst_ack_packet_data_ptr);
                     dst_ack_packet_data_ptr = 0;
-                    handle->sn_coap_protocol_free(src_coap_blockwise_ack_msg_ptr->options_list_ptr);
-                    src_coap_blockwise_ack_msg_ptr->options_list_ptr = 0;
-                    handle->sn_coap_protocol_free(src_coap_blockwise_ack_msg_ptr);
+                    sn_coap_protocol_blockwise_request_release(handle, src_coap_blockwise_ack_msg_ptr);
                     src_coap_blockwise_ack_msg_ptr = 0;
                     sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
                     return NULL;
                 }
 
-                /* * * Save to linked list * * */
-                coap_blockwise_msg_s *stored_blockwise_msg_ptr;
-
-                stored_blockwise_msg_ptr = handle->sn_coap_protocol_malloc(sizeof(coap_blockwise_msg_s));
-                if (!stored_blockwise_msg_ptr) {
-                    handle->sn_coap_protocol_free(dst_ack_packet_data_ptr);
-                    dst_ack_packet_data_ptr = 0;
-                    handle->sn_coap_protocol_free(src_coap_blockwise_ack_msg_ptr->options_list_ptr);
-                    src_coap_blockwise_ack_msg_ptr->options_list_ptr = 0;
-                    handle->sn_coap_protocol_free(src_coap_blockwise_ack_msg_ptr);
-                    src_coap_blockwise_ack_msg_ptr = 0;
-                    sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
-                    return 0;
-                }
-                memset(stored_blockwise_msg_ptr, 0, sizeof(coap_blockwise_msg_s));
-
-                stored_blockwise_msg_ptr->timestamp = handle->system_time;
-
-                stored_blockwise_msg_ptr->coap_msg_ptr = src_coap_blockwise_ack_msg_ptr;
-                stored_blockwise_msg_ptr->coap = handle;
-
-                ns_list_add_to_end(&handle->linked_list_blockwise_sent_msgs, stored_blockwise_msg_ptr);
+                /* * * Request record now stands for the request of the next block * * */
+                previous_blockwise_msg_ptr->msg_id = src_coap_blockwise_ack_msg_ptr->msg_id;
+                previous_blockwise_msg_ptr->timestamp = handle->system_time;
 
                 /* * * Then release memory of CoAP Acknowledgement message * * */
-                handle->sn_coap_tx_callback(dst_ack_packet_data_ptr,
+                sn_coap_protocol_tx(handle, dst_ack_packet_data_ptr,
                                             dst_packed_data_needed_mem, src_addr_ptr, param);
 
 #if ENABLE_RESENDINGS
                 sn_coap_protocol_linked_list_send_msg_store(handle, src_addr_ptr,
                         dst_packed_data_needed_mem,
                         dst_ack_packet_data_ptr,
-                        handle->system_time + (uint32_t)(handle->sn_coap_resending_intervall * RESPONSE_RANDOM_FACTOR), param, NULL, 0);
+                        handle->system_time + (uint32_t)(handle->sn_coap_resending_intervall * RESPONSE_RANDOM_FACTOR), param,
+                        src_coap_blockwise_ack_msg_ptr, NULL, 0);
 #endif
                 handle->sn_coap_protocol_free(dst_ack_packet_data_ptr);
                 dst_ack_packet_data_ptr = 0;
+                sn_coap_protocol_blockwise_request_release(handle, src_coap_blockwise_ack_msg_ptr);
+                src_coap_blockwise_ack_msg_ptr = 0;
             }
 
             //Last block received
@@ -1888,32 +5135,25 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                 /* * * This is the last block when whole Blockwise payload from received * * */
                 /* * * blockwise messages is gathered and returned to User               * * */
 
-                /* Store last Blockwise payload to Linked list */
-                uint16_t payload_len            = 0;
-                uint8_t *payload_ptr            = sn_coap_protocol_linked_list_blockwise_payload_search(handle, src_addr_ptr, &payload_len);
-                uint16_t whole_payload_len      = sn_coap_protocol_linked_list_blockwise_payloads_get_len(handle, src_addr_ptr);
-                uint8_t *temp_whole_payload_ptr = NULL;
+                /* Gather whole Blockwise payload from Linked list, unless it was delivered to block sink */
+                uint8_t *whole_payload_ptr      = NULL;
+                uint16_t whole_payload_len      = 0;
 
-                temp_whole_payload_ptr = handle->sn_coap_protocol_malloc(whole_payload_len);
-                if (!temp_whole_payload_ptr) {
+                if (handle->sn_coap_block_sink_callback == NULL &&
+                        sn_coap_protocol_linked_list_blockwise_payload_take(handle, src_addr_ptr, received_coap_msg_ptr, &whole_payload_ptr, &whole_payload_len) != 0) {
                     return 0;
                 }
 
-                received_coap_msg_ptr->payload_ptr = temp_whole_payload_ptr;
+                received_coap_msg_ptr->payload_ptr = whole_payload_ptr;
                 received_coap_msg_ptr->payload_len = whole_payload_len;
 
-                /* Copy stored Blockwise payloads to returned whole Blockwise payload pointer */
-                while (payload_ptr != NULL) {
-                    memcpy(temp_whole_payload_ptr, payload_ptr, payload_len);
-
-                    temp_whole_payload_ptr += payload_len;
-
-                    sn_coap_protocol_linked_list_blockwise_payload_remove_oldest(handle);
-                    payload_ptr = sn_coap_protocol_linked_list_blockwise_payload_search(handle, src_addr_ptr, &payload_len);
-                }
                 received_coap_msg_ptr->coap_status = COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED;
 
-                //todo: remove previous msg from list
+                /* Transfer has ended, request record is not needed anymore */
+                coap_blockwise_msg_s *request_msg_ptr = sn_coap_protocol_linked_list_blockwise_request_find(handle, src_addr_ptr, received_coap_msg_ptr);
+                if (request_msg_ptr) {
+                    sn_coap_protocol_linked_list_blockwise_msg_remove(handle, request_msg_ptr);
+                }
             }
 
         }
@@ -1921,11 +5161,38 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
         //Now we send data to request
         else {
             tr_debug("sn_coap_handle_blockwise_message - block2 received");
+            if (handle->sn_coap_block2_stateless) {
+                /* Request is returned to user, who builds the asked block from the whole representation */
+                return received_coap_msg_ptr;
+            }
+
             //Get message by using block number
+#if SN_COAP_SERVER_PROFILE
+            coap_blockwise_msg_s *stored_blockwise_msg_temp_ptr = sn_coap_protocol_linked_list_blockwise_msg_find(handle, src_addr_ptr, received_coap_msg_ptr);
+            if (stored_blockwise_msg_temp_ptr == NULL) {
+                /* Requests of next blocks may use new tokens, fall back to first message to the same peer */
+                uint32_t peer_id = sn_coap_peer_table_find(&handle->peer_table, src_addr_ptr);
+                ns_list_foreach(coap_blockwise_msg_s, msg, &handle->linked_list_blockwise_sent_msgs) {
+                    if (peer_id && msg->peer_id == peer_id && msg->coap_msg_ptr) {
+                        stored_blockwise_msg_temp_ptr = msg;
+                        break;
+                    }
+                }
+            }
+#else
             //NOTE: Getting the first from list might not be correct one
-            coap_blockwise_msg_s *stored_blockwise_msg_temp_ptr = ns_list_get_first(&handle->linked_list_blockwise_sent_msgs);
+            coap_blockwise_msg_s *stored_blockwise_msg_temp_ptr = NULL;
+            ns_list_foreach(coap_blockwise_msg_s, msg, &handle->linked_list_blockwise_sent_msgs) {
+                /* Request records have no response to send */
+                if (msg->coap_msg_ptr) {
+                    stored_blockwise_msg_temp_ptr = msg;
+                    break;
+                }
+            }
+#endif
             if (stored_blockwise_msg_temp_ptr) {
                 uint16_t block_size;
+                uint16_t peer_block_size;
                 uint32_t block_number;
 
                 /* Resolve block parameters */
@@ -1933,6 +5200,26 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                 block_temp = received_coap_msg_ptr->options_list_ptr->block2 & 0x07;
                 block_size = 1u << (block_temp + 4);
 
+#if SN_COAP_SERVER_PROFILE
+                /* Size of the previously sent block tells if peer asks for smaller blocks */
+                peer_block_size = block_size;
+                if (stored_blockwise_msg_temp_ptr->coap_msg_ptr->options_list_ptr &&
+                        stored_blockwise_msg_temp_ptr->coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE) {
+                    peer_block_size = 1u << ((stored_blockwise_msg_temp_ptr->coap_msg_ptr->options_list_ptr->block2 & 0x07) + 4);
+                }
+                sn_coap_protocol_peer_block_size_update(handle, sn_coap_peer_table_intern(&handle->peer_table, src_addr_ptr, handle->system_time),
+                                                        peer_block_size, block_size);
+#endif
+
+                /* Blocks smaller than the asked size are sent if blocks to the peer have been lost, */
+                /* block number is for the smaller size                                             */
+                peer_block_size = sn_coap_protocol_block_size_get(handle, src_addr_ptr);
+                if (peer_block_size && peer_block_size < block_size) {
+                    block_number <<= (block_temp - sn_coap_convert_block_size(peer_block_size));
+                    block_size = peer_block_size;
+                    block_temp = sn_coap_convert_block_size(block_size);
+                }
+
                 /* Build response message */
                 src_coap_blockwise_ack_msg_ptr = stored_blockwise_msg_temp_ptr->coap_msg_ptr;
 
@@ -1947,7 +5234,7 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
 
                 src_coap_blockwise_ack_msg_ptr->msg_id = received_coap_msg_ptr->msg_id;
 
-                src_coap_blockwise_ack_msg_ptr->options_list_ptr->block2 = received_coap_msg_ptr->options_list_ptr->block2;
+                src_coap_blockwise_ack_msg_ptr->options_list_ptr->block2 = (block_number << 4) | block_temp;
 
                 /* * Payload part * */
 
@@ -1956,16 +5243,23 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                 original_payload_len = stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_len;
                 original_payload_ptr = stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_ptr;
 
-                if ((block_size * (block_number + 1)) > stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_len) {
-                    src_coap_blockwise_ack_msg_ptr->payload_len = stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_len - (block_size * block_number);
-                    src_coap_blockwise_ack_msg_ptr->payload_ptr = stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_ptr + (block_size * block_number);
+                if ((block_size * (block_number + 1)) >= stored_blockwise_msg_temp_ptr->payload_len) {
+                    src_coap_blockwise_ack_msg_ptr->payload_len = stored_blockwise_msg_temp_ptr->payload_len - (block_size * block_number);
                 }
                 /* Not last block */
                 else {
                     /* set more - bit */
                     src_coap_blockwise_ack_msg_ptr->options_list_ptr->block2 |= 0x08;
                     src_coap_blockwise_ack_msg_ptr->payload_len = block_size;
-                    src_coap_blockwise_ack_msg_ptr->payload_ptr = stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_ptr + (block_size * block_number);
+                }
+                src_coap_blockwise_ack_msg_ptr->payload_ptr = sn_coap_protocol_blockwise_msg_payload(handle, stored_blockwise_msg_temp_ptr,
+                        block_size * block_number, src_coap_blockwise_ack_msg_ptr->payload_len);
+
+                if (src_coap_blockwise_ack_msg_ptr->payload_ptr == NULL) {
+                    tr_debug("sn_coap_handle_blockwise_message - block2 received, payload provider failed");
+                    sn_coap_protocol_linked_list_blockwise_msg_remove(handle, stored_blockwise_msg_temp_ptr);
+                    sn_coap_parser_release_allocated_coap_msg_mem(handle, received_coap_msg_ptr);
+                    return NULL;
                 }
 
                 /* Build and send block message */
@@ -1986,7 +5280,7 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
 
                 sn_coap_builder_2(dst_ack_packet_data_ptr, src_coap_blockwise_ack_msg_ptr, handle->sn_coap_block_data_size);
                 tr_debug("sn_coap_handle_blockwise_message - block2 received, send message: [%d]", src_coap_blockwise_ack_msg_ptr->msg_id);
-                handle->sn_coap_tx_callback(dst_ack_packet_data_ptr, dst_packed_data_needed_mem, src_addr_ptr, param);
+                sn_coap_protocol_tx(handle, dst_ack_packet_data_ptr, dst_packed_data_needed_mem, src_addr_ptr, param);
 
                 handle->sn_coap_protocol_free(dst_ack_packet_data_ptr);
                 dst_ack_packet_data_ptr = 0;
@@ -1994,7 +5288,7 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
                 stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_len = original_payload_len;
                 stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_ptr = original_payload_ptr;
 
-                if ((block_size * (block_number + 1)) > stored_blockwise_msg_temp_ptr->coap_msg_ptr->payload_len) {
+                if ((block_size * (block_number + 1)) >= stored_blockwise_msg_temp_ptr->payload_len) {
                     sn_coap_protocol_linked_list_blockwise_msg_remove(handle, stored_blockwise_msg_temp_ptr);
                 }
 
@@ -2005,26 +5299,335 @@ static sn_coap_hdr_s *sn_coap_handle_blockwise_message(struct coap_s *handle, sn
     return received_coap_msg_ptr;
 }
 
-static int8_t sn_coap_convert_block_size(uint16_t block_size)
-{
-    if (block_size == 16) {
-        return 0;
-    } else if (block_size == 32) {
-        return 1;
-    } else if (block_size == 64) {
-        return 2;
-    } else if (block_size == 128) {
-        return 3;
-    } else if (block_size == 256) {
-        return 4;
-    } else if (block_size == 512) {
-        return 5;
-    } else if (block_size == 1024) {
-        return 6;
+/**************************************************************************//**
+ * \fn static uint8_t *sn_coap_protocol_blockwise_msg_payload(struct coap_s *handle, coap_blockwise_msg_s *msg_ptr, uint32_t offset, uint16_t length)
+ *
+ * \brief Gets payload of a block of stored blockwise message, from payload provider if payload was not copied
+ *
+ * \return Pointer to block payload, NULL if payload provider failed
+ *****************************************************************************/
+
+static uint8_t *sn_coap_protocol_blockwise_msg_payload(struct coap_s *handle, coap_blockwise_msg_s *msg_ptr, uint32_t offset, uint16_t length)
+{
+    if (msg_ptr->payload_provider != NULL) {
+        return (uint8_t *)msg_ptr->payload_provider(handle, msg_ptr->payload_ref, offset, length);
+    }
+
+    return msg_ptr->coap_msg_ptr->payload_ptr + offset;
+}
+
+/**************************************************************************//**
+ * \fn static uint32_t sn_coap_protocol_payload_total_len(struct coap_s *handle, const sn_coap_hdr_s *coap_msg_ptr)
+ *
+ * \brief Gets total length of sent payload. With payload provider, Size1 of a request
+ *        or Size2 of a response tells the length if it is longer than payload_len.
+ *
+ * \return Total payload length
+ *****************************************************************************/
+
+static uint32_t sn_coap_protocol_payload_total_len(struct coap_s *handle, const sn_coap_hdr_s *coap_msg_ptr)
+{
+    const sn_coap_options_list_s *options_ptr = coap_msg_ptr->options_list_ptr;
+
+    if (handle->sn_coap_payload_provider_callback == NULL || options_ptr == NULL) {
+        return coap_msg_ptr->payload_len;
+    }
+
+    if (coap_msg_ptr->msg_code < COAP_MSG_CODE_RESPONSE_CREATED) {
+        if (options_ptr->use_size1 && options_ptr->size1 > coap_msg_ptr->payload_len) {
+            return options_ptr->size1;
+        }
+    } else if (options_ptr->use_size2 && options_ptr->size2 > coap_msg_ptr->payload_len) {
+        return options_ptr->size2;
+    }
+
+    return coap_msg_ptr->payload_len;
+}
+
+/**************************************************************************//**
+ * \fn static int8_t sn_coap_protocol_stateless_block2_select(struct coap_s *handle, sn_coap_hdr_s *coap_msg_ptr, uint32_t payload_total_len, uint16_t *block_size_ptr, uint32_t *block_offset_ptr)
+ *
+ * \brief Selects block of stateless Block2 response. Block is the one asked with Block2 option
+ *        user copied from the request, or the first one if option is not set. Block is not
+ *        larger than asked, nor larger than *block_size_ptr. Block2 and Size2 options are set.
+ *
+ * \param payload_total_len is length of the whole representation
+ * \param *block_size_ptr is largest block size to use, selected block size is returned in it
+ * \param *block_offset_ptr returns offset of the block in the whole representation
+ *
+ * \return 0 on success, -1 if asked block is past the end of representation or out of memory
+ *****************************************************************************/
+
+static int8_t sn_coap_protocol_stateless_block2_select(struct coap_s *handle, sn_coap_hdr_s *coap_msg_ptr, uint32_t payload_total_len, uint16_t *block_size_ptr, uint32_t *block_offset_ptr)
+{
+    uint16_t block_size = *block_size_ptr;
+    uint32_t block_number = 0;
+    uint8_t block_szx = sn_coap_convert_block_size(block_size);
+
+    if (sn_coap_parser_alloc_options(handle, coap_msg_ptr) == NULL) {
+        return -1;
+    }
+
+    if (coap_msg_ptr->options_list_ptr->block2 != COAP_OPTION_BLOCK_NONE) {
+        uint8_t asked_szx = coap_msg_ptr->options_list_ptr->block2 & 0x07;
+
+        block_number = (uint32_t)coap_msg_ptr->options_list_ptr->block2 >> 4;
+        if (asked_szx < block_szx) {
+            block_szx = asked_szx;
+            block_size = 1u << (block_szx + 4);
+        } else {
+            /* Larger asked block is sent in smaller blocks, block number is for the smaller size */
+            block_number <<= (asked_szx - block_szx);
+        }
+    }
+
+    if (block_number > 0xFFFFF || (uint64_t)block_number * block_size >= payload_total_len) {
+        tr_debug("sn_coap_protocol_stateless_block2_select - block %lu past the end", (unsigned long)block_number);
+        return -1;
+    }
+
+    coap_msg_ptr->options_list_ptr->block2 = (block_number << 4) | block_szx;
+    if (payload_total_len - block_number * block_size > block_size) {
+        coap_msg_ptr->options_list_ptr->block2 |= 0x08;
+    }
+    coap_msg_ptr->options_list_ptr->use_size1 = false;
+    coap_msg_ptr->options_list_ptr->use_size2 = true;
+    coap_msg_ptr->options_list_ptr->size2 = payload_total_len;
+
+    *block_size_ptr = block_size;
+    *block_offset_ptr = block_number * block_size;
+
+    return 0;
+}
+
+static int8_t sn_coap_convert_block_size(uint16_t block_size)
+{
+    if (block_size == 16) {
+        return 0;
+    } else if (block_size == 32) {
+        return 1;
+    } else if (block_size == 64) {
+        return 2;
+    } else if (block_size == 128) {
+        return 3;
+    } else if (block_size == 256) {
+        return 4;
+    } else if (block_size == 512) {
+        return 5;
+    } else if (block_size == 1024) {
+        return 6;
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * \fn static uint16_t sn_coap_protocol_block_size_limit(struct coap_s *handle)
+ *
+ * \brief Returns largest block size that fits in path MTU together with headers,
+ *        but is not larger than the configured block size
+ *****************************************************************************/
+static uint16_t sn_coap_protocol_block_size_limit(struct coap_s *handle)
+{
+    uint16_t block_size = handle->sn_coap_block_data_size;
+
+    if (handle->sn_coap_path_mtu) {
+        while (block_size > 16 && (uint32_t)block_size + SN_COAP_BLOCKWISE_MTU_OVERHEAD > handle->sn_coap_path_mtu) {
+            block_size >>= 1;
+        }
+    }
+
+    return block_size;
+}
+
+/**************************************************************************//**
+ * \fn static uint16_t sn_coap_protocol_block_size_get(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr)
+ *
+ * \brief Returns block size to be used for blocks sent to the peer, 0 if blockwise is disabled
+ *****************************************************************************/
+static uint16_t sn_coap_protocol_block_size_get(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr)
+{
+    uint16_t block_size = sn_coap_protocol_block_size_limit(handle);
+
+#if SN_COAP_SERVER_PROFILE
+    uint32_t peer_id = sn_coap_peer_table_find(&handle->peer_table, addr_ptr);
+
+    if (peer_id) {
+        const sn_coap_peer_s *peer_ptr = sn_coap_peer_table_get_peer(&handle->peer_table, peer_id);
+
+        if (peer_ptr->block_size && peer_ptr->block_size < block_size) {
+            block_size = peer_ptr->block_size;
+        }
+    }
+#else
+    (void) addr_ptr;
+#endif
+
+    return block_size;
+}
+
+/**************************************************************************//**
+ * \fn static uint16_t sn_coap_protocol_block_size_select(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, sn_coap_hdr_s *coap_msg_ptr)
+ *
+ * \brief Selects block size of built message. If selected size is smaller than
+ *        the configured one, first block prepared with prepare_blockwise_message()
+ *        is made smaller, and blockwise options are added if payload needs them
+ *        only with the smaller size. Messages that continue a transfer from a
+ *        later block keep the configured size.
+ *****************************************************************************/
+static uint16_t sn_coap_protocol_block_size_select(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, sn_coap_hdr_s *coap_msg_ptr)
+{
+    uint16_t block_size = sn_coap_protocol_block_size_get(handle, dst_addr_ptr);
+    int32_t *block_ptr;
+
+    if (block_size == 0 || block_size >= handle->sn_coap_block_data_size) {
+        return handle->sn_coap_block_data_size;
+    }
+
+    if (coap_msg_ptr->options_list_ptr == NULL) {
+        if (sn_coap_protocol_prepare_blockwise(handle, coap_msg_ptr, block_size) != 0) {
+            return handle->sn_coap_block_data_size;
+        }
+        return block_size;
+    }
+
+    if (coap_msg_ptr->msg_code < COAP_MSG_CODE_RESPONSE_CREATED) {
+        block_ptr = &coap_msg_ptr->options_list_ptr->block1;
+    } else {
+        block_ptr = &coap_msg_ptr->options_list_ptr->block2;
+    }
+
+    if (*block_ptr == COAP_OPTION_BLOCK_NONE) {
+        sn_coap_protocol_prepare_blockwise(handle, coap_msg_ptr, block_size);
+    } else if ((*block_ptr >> 4) != 0) {
+        return handle->sn_coap_block_data_size;
+    } else if ((*block_ptr & 0x07) > sn_coap_convert_block_size(block_size)) {
+        tr_debug("sn_coap_protocol_block_size_select - block size %d", block_size);
+        *block_ptr = (*block_ptr & ~0x07) | sn_coap_convert_block_size(block_size);
+    }
+
+    return block_size;
+}
+
+#if SN_COAP_SERVER_PROFILE
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_peer_block_size_update(struct coap_s *handle, uint32_t peer_id, uint16_t sent_block_size, uint16_t acked_block_size)
+ *
+ * \brief Updates block size of the peer. Block size follows smaller block sizes
+ *        asked by the peer. With SN_COAP_BLOCK_SIZE_TUNING, it is also tuned from
+ *        loss of messages to the peer.
+ *
+ * \param sent_block_size Size of the block sent to the peer
+ * \param acked_block_size Block size acknowledged or asked by the peer, 0 if message to the peer was retransmitted
+ *****************************************************************************/
+static void sn_coap_protocol_peer_block_size_update(struct coap_s *handle, uint32_t peer_id, uint16_t sent_block_size, uint16_t acked_block_size)
+{
+    uint16_t limit = sn_coap_protocol_block_size_limit(handle);
+    sn_coap_peer_s *peer_ptr;
+
+    if (peer_id == 0 || limit == 0) {
+        return;
+    }
+
+    peer_ptr = sn_coap_peer_table_get_peer(&handle->peer_table, peer_id);
+
+    if (peer_ptr->block_size == 0 || peer_ptr->block_size > limit) {
+        peer_ptr->block_size = limit;
+        peer_ptr->block_ack_count = 0;
+        peer_ptr->block_tx_count = 0;
+        peer_ptr->block_loss_count = 0;
+        peer_ptr->block_loss_larger = SN_COAP_BLOCK_LOSS_NOT_HALVED;
+    }
+
+    if (acked_block_size && acked_block_size < sent_block_size) {
+        if (acked_block_size < peer_ptr->block_size) {
+            peer_ptr->block_size = acked_block_size;
+        }
+        peer_ptr->block_size_max = acked_block_size;
+        peer_ptr->block_ack_count = 0;
+        peer_ptr->block_tx_count = 0;
+        peer_ptr->block_loss_count = 0;
+        peer_ptr->block_loss_larger = SN_COAP_BLOCK_LOSS_NOT_HALVED;
+        tr_debug("sn_coap_protocol_peer_block_size_update - peer asked block size %d", peer_ptr->block_size);
+        return;
+    }
+
+#if SN_COAP_BLOCK_SIZE_TUNING
+    sn_coap_protocol_peer_block_loss_update(peer_ptr, limit, acked_block_size == 0);
+#endif
+}
+
+#if SN_COAP_BLOCK_SIZE_TUNING
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_peer_block_loss_update(sn_coap_peer_s *peer_ptr, uint16_t limit, bool lost)
+ *
+ * \brief Tunes block size of the peer from its loss ratio. Every transmission to the
+ *        peer is either acknowledged or retransmitted, and loss ratio is counted over
+ *        SN_COAP_BLOCK_SIZE_TUNING_WINDOW of them.
+ *
+ *        Each lost block costs a retransmission timeout, so a transfer takes time in
+ *        proportion to the loss odds (lost / acknowledged) per byte. Halving the block
+ *        size saves time only if it more than halves the loss odds. Loss that does not
+ *        depend on packet size does not do that, bit errors on a long packet can.
+ *
+ *        Block size is halved when three quarters or more of a window was lost. The
+ *        next window is measured with the smaller size, and the larger size is
+ *        restored if loss odds did not fall below half. Block size is doubled after
+ *        SN_COAP_BLOCK_SIZE_INCREASE_INTERVAL blocks have been acknowledged without
+ *        retransmissions.
+ *
+ * \param limit Largest block size for the peer
+ * \param lost True if a message to the peer was retransmitted, false if it was acknowledged
+ *****************************************************************************/
+static void sn_coap_protocol_peer_block_loss_update(sn_coap_peer_s *peer_ptr, uint16_t limit, bool lost)
+{
+    uint32_t window = SN_COAP_BLOCK_SIZE_TUNING_WINDOW;
+    uint32_t loss;
+    uint32_t larger;
+
+    if (lost) {
+        peer_ptr->block_loss_count++;
+        peer_ptr->block_ack_count = 0;
+    } else if (++peer_ptr->block_ack_count >= SN_COAP_BLOCK_SIZE_INCREASE_INTERVAL) {
+        peer_ptr->block_ack_count = 0;
+        if (peer_ptr->block_size < limit &&
+                (peer_ptr->block_size_max == 0 || peer_ptr->block_size < peer_ptr->block_size_max)) {
+            peer_ptr->block_size <<= 1;
+            peer_ptr->block_tx_count = 0;
+            peer_ptr->block_loss_count = 0;
+            peer_ptr->block_loss_larger = SN_COAP_BLOCK_LOSS_NOT_HALVED;
+            tr_debug("sn_coap_protocol_peer_block_loss_update - no loss, block size %d", peer_ptr->block_size);
+            return;
+        }
+    }
+
+    if (++peer_ptr->block_tx_count < window) {
+        return;
+    }
+
+    loss = peer_ptr->block_loss_count;
+    larger = peer_ptr->block_loss_larger;
+    peer_ptr->block_tx_count = 0;
+    peer_ptr->block_loss_count = 0;
+    peer_ptr->block_loss_larger = SN_COAP_BLOCK_LOSS_NOT_HALVED;
+
+    /* Loss odds of smaller blocks compared to the larger ones: loss / (window - loss) < larger / (window - larger) / 2 */
+    if (larger != SN_COAP_BLOCK_LOSS_NOT_HALVED && 2 * loss * (window - larger) >= larger * (window - loss)) {
+        peer_ptr->block_size <<= 1;
+        peer_ptr->block_ack_count = 0;
+        tr_debug("sn_coap_protocol_peer_block_loss_update - loss %d/%d not lower, block size %d", (int)loss, (int)window, peer_ptr->block_size);
+        return;
     }
 
-    return 0;
+    if (4 * loss >= 3 * window && peer_ptr->block_size > 16) {
+        peer_ptr->block_size >>= 1;
+        peer_ptr->block_ack_count = 0;
+        peer_ptr->block_loss_larger = loss;
+        tr_debug("sn_coap_protocol_peer_block_loss_update - loss %d/%d, block size %d", (int)loss, (int)window, peer_ptr->block_size);
+    }
 }
+#endif
+#endif
 
 static sn_coap_hdr_s *sn_coap_protocol_copy_header(struct coap_s *handle, sn_coap_hdr_s *source_header_ptr)
 {
@@ -2138,8 +5741,564 @@ static sn_coap_hdr_s *sn_coap_protocol_copy_header(struct coap_s *handle, sn_coa
 
         destination_header_ptr->options_list_ptr->block1 = source_header_ptr->options_list_ptr->block1;
         destination_header_ptr->options_list_ptr->block2 = source_header_ptr->options_list_ptr->block2;
+        destination_header_ptr->options_list_ptr->use_q_block1 = source_header_ptr->options_list_ptr->use_q_block1;
+        destination_header_ptr->options_list_ptr->use_q_block2 = source_header_ptr->options_list_ptr->use_q_block2;
+
+        destination_header_ptr->options_list_ptr->use_request_tag = source_header_ptr->options_list_ptr->use_request_tag;
+        destination_header_ptr->options_list_ptr->request_tag_len = source_header_ptr->options_list_ptr->request_tag_len;
+        memcpy(destination_header_ptr->options_list_ptr->request_tag, source_header_ptr->options_list_ptr->request_tag, sizeof(destination_header_ptr->options_list_ptr->request_tag));
     }
 
     return destination_header_ptr;
 }
 #endif
+
+#if SN_COAP_OBSERVE_MAX_OBSERVERS /* If observer registry is not used at all, this part of code will not be compiled */
+/**************************************************************************//**
+ * \fn static coap_observe_resource_s *sn_coap_protocol_observe_resource_find(struct coap_s *handle, const uint8_t *uri_path_ptr, uint16_t uri_path_len)
+ *
+ * \brief Searches observed resource by Uri-Path
+ *
+ * \return Pointer to observed resource, NULL if resource has no observers
+ *****************************************************************************/
+static coap_observe_resource_s *sn_coap_protocol_observe_resource_find(struct coap_s *handle, const uint8_t *uri_path_ptr, uint16_t uri_path_len)
+{
+    ns_list_foreach(coap_observe_resource_s, resource_ptr, &handle->linked_list_observe_resources) {
+        if (resource_ptr->uri_path_len == uri_path_len &&
+                (uri_path_len == 0 || memcmp(resource_ptr->uri_path_ptr, uri_path_ptr, uri_path_len) == 0)) {
+            return resource_ptr;
+        }
+    }
+    return NULL;
+}
+
+/**************************************************************************//**
+ * \fn static int32_t sn_coap_protocol_observe_send(struct coap_s *handle, coap_observe_resource_s *resource_ptr, const sn_coap_hdr_s *notification_ptr, void *param)
+ *
+ * \brief Encodes notification once and sends it to all observers of the resource
+ *
+ * \return Count of observers notified, -2 if out of memory or failure in building
+ *****************************************************************************/
+static int32_t sn_coap_protocol_observe_send(struct coap_s *handle, coap_observe_resource_s *resource_ptr, const sn_coap_hdr_s *notification_ptr, void *param)
+{
+    sn_coap_hdr_s           encoded_hdr;
+    sn_coap_options_list_s  encoded_options;
+    uint8_t                 *packet_ptr;
+    uint8_t                 header[4];
+    uint16_t                packet_len;
+    int16_t                 byte_count_built;
+    int32_t                 notified_count = 0;
+
+    /* * * * Encode notification once, without token and with the next Observe value * * * */
+    encoded_hdr = *notification_ptr;
+    encoded_hdr.uri_path_ptr = NULL;
+    encoded_hdr.uri_path_len = 0;
+    encoded_hdr.token_ptr = NULL;
+    encoded_hdr.token_len = 0;
+    encoded_hdr.msg_id = 0;
+    if (notification_ptr->options_list_ptr) {
+        encoded_options = *notification_ptr->options_list_ptr;
+    } else {
+        memset(&encoded_options, 0, sizeof(sn_coap_options_list_s));
+        encoded_options.max_age = COAP_OPTION_MAX_AGE_DEFAULT;
+        encoded_options.uri_port = COAP_OPTION_URI_PORT_NONE;
+        encoded_options.accept = COAP_CT_NONE;
+        encoded_options.block2 = COAP_OPTION_BLOCK_NONE;
+        encoded_options.block1 = COAP_OPTION_BLOCK_NONE;
+    }
+    encoded_options.observe = (resource_ptr->observe_seq + 1) & COAP_OBSERVE__MAX;
+    encoded_hdr.options_list_ptr = &encoded_options;
+
+    packet_len = sn_coap_builder_calc_needed_packet_data_size_2(&encoded_hdr, handle->sn_coap_block_data_size);
+    if (packet_len == 0 || packet_len > UINT16_MAX - sizeof(encoded_hdr.msg_id) - 8) {
+        return -2;
+    }
+
+    /* Room for the longest token is left in front of the packet, token is written */
+    /* right before the options so that encoded part is not moved                  */
+    packet_ptr = handle->sn_coap_protocol_malloc(packet_len + 8);
+    if (packet_ptr == NULL) {
+        return -2;
+    }
+
+    byte_count_built = sn_coap_builder_2(packet_ptr + 8, &encoded_hdr, handle->sn_coap_block_data_size);
+    if (byte_count_built < 4) {
+        handle->sn_coap_protocol_free(packet_ptr);
+        return -2;
+    }
+    memcpy(header, packet_ptr + 8, sizeof(header));
+    resource_ptr->observe_seq = encoded_options.observe;
+    resource_ptr->notify_time = handle->system_time;
+    resource_ptr->value_pending = false;
+    if (encoded_hdr.msg_type == COAP_MSG_TYPE_CONFIRMABLE) {
+        resource_ptr->non_count = 0;
+    } else if (resource_ptr->non_count < UINT8_MAX) {
+        resource_ptr->non_count++;
+    }
+
+    /* * * * Write token and Message ID of each observer and send * * * */
+    ns_list_foreach(coap_observer_s, observer_ptr, &resource_ptr->observers) {
+        uint8_t *observer_packet_ptr = packet_ptr + 8 - observer_ptr->token_len;
+        uint16_t observer_packet_len = byte_count_built + observer_ptr->token_len;
+        sn_nsdl_addr_s *dst_addr_ptr = sn_coap_protocol_observer_addr(handle, observer_ptr);
+
+        observer_ptr->msg_id = handle->message_id++;
+        if (handle->message_id == 0) {
+            handle->message_id = 1;
+        }
+
+        observer_packet_ptr[0] = (header[0] & 0xF0) | observer_ptr->token_len;
+        observer_packet_ptr[1] = header[1];
+        observer_packet_ptr[2] = (uint8_t)(observer_ptr->msg_id >> 8);
+        observer_packet_ptr[3] = (uint8_t)observer_ptr->msg_id;
+        memcpy(observer_packet_ptr + 4, observer_ptr->token, observer_ptr->token_len);
+
+        sn_coap_protocol_tx(handle, observer_packet_ptr, observer_packet_len, dst_addr_ptr, param);
+
+#if ENABLE_RESENDINGS /* If Message resending is not used at all, this part of code will not be compiled */
+        if (encoded_hdr.msg_type == COAP_MSG_TYPE_CONFIRMABLE) {
+            encoded_hdr.msg_id = observer_ptr->msg_id;
+            encoded_hdr.token_ptr = observer_ptr->token;
+            encoded_hdr.token_len = observer_ptr->token_len;
+            sn_coap_protocol_linked_list_send_msg_store(handle, dst_addr_ptr, observer_packet_len, observer_packet_ptr,
+                    handle->system_time + (uint32_t)(handle->sn_coap_resending_intervall * RESPONSE_RANDOM_FACTOR),
+                    param, &encoded_hdr, NULL, 0);
+        }
+#endif
+        notified_count++;
+    }
+
+    handle->sn_coap_protocol_free(packet_ptr);
+
+    return notified_count;
+}
+
+/**************************************************************************//**
+ * \fn static int32_t sn_coap_protocol_observe_send_value(struct coap_s *handle, coap_observe_resource_s *resource_ptr, bool forced)
+ *
+ * \brief Sends the latest value of the resource to all observers. Every SN_COAP_OBSERVE_CON_INTERVAL'th
+ *        notification and notifications forced by pmax are Confirmable, if they fit in re-sending queue.
+ *
+ * \return Count of observers notified, -2 if out of memory or failure in building
+ *****************************************************************************/
+static int32_t sn_coap_protocol_observe_send_value(struct coap_s *handle, coap_observe_resource_s *resource_ptr, bool forced)
+{
+    sn_coap_hdr_s           notification;
+    sn_coap_options_list_s  options;
+
+    memset(&notification, 0, sizeof(sn_coap_hdr_s));
+    memset(&options, 0, sizeof(sn_coap_options_list_s));
+    options.max_age = resource_ptr->max_age;
+    options.uri_port = COAP_OPTION_URI_PORT_NONE;
+    options.accept = COAP_CT_NONE;
+    options.block2 = COAP_OPTION_BLOCK_NONE;
+    options.block1 = COAP_OPTION_BLOCK_NONE;
+
+    notification.msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    notification.msg_code = (sn_coap_msg_code_e)resource_ptr->value_code;
+    notification.content_format = resource_ptr->content_format;
+    notification.payload_ptr = resource_ptr->value_ptr;
+    notification.payload_len = resource_ptr->value_len;
+    notification.options_list_ptr = &options;
+
+    if (forced || resource_ptr->non_count + 1 >= SN_COAP_OBSERVE_CON_INTERVAL) {
+        notification.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+#if ENABLE_RESENDINGS
+        /* Re-sending state is bounded by sending Non-confirmable when queue would overflow */
+        if (handle->sn_coap_resending_queue_msgs &&
+                handle->count_resent_msgs + ns_list_count(&resource_ptr->observers) > handle->sn_coap_resending_queue_msgs) {
+            notification.msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+        }
+#endif
+    }
+
+    return sn_coap_protocol_observe_send(handle, resource_ptr, &notification, resource_ptr->param);
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_observe_schedule(struct coap_s *handle)
+ *
+ * \brief Sends changed values when pmin has passed, and the latest value again when pmax has passed
+ *****************************************************************************/
+static void sn_coap_protocol_observe_schedule(struct coap_s *handle)
+{
+    ns_list_foreach(coap_observe_resource_s, resource_ptr, &handle->linked_list_observe_resources) {
+        uint32_t elapsed = handle->system_time - resource_ptr->notify_time;
+
+        if (resource_ptr->value_pending && elapsed >= resource_ptr->pmin) {
+            sn_coap_protocol_observe_send_value(handle, resource_ptr, false);
+        } else if (resource_ptr->pmax && resource_ptr->value_code != COAP_MSG_CODE_EMPTY && elapsed >= resource_ptr->pmax) {
+            sn_coap_protocol_observe_send_value(handle, resource_ptr, true);
+        }
+    }
+}
+
+/**************************************************************************//**
+ * \fn static bool sn_coap_protocol_observer_addr_match(struct coap_s *handle, const coap_observer_s *observer_ptr, const sn_nsdl_addr_s *addr_ptr)
+ *
+ * \brief Checks if observer is registered from given address
+ *****************************************************************************/
+static bool sn_coap_protocol_observer_addr_match(struct coap_s *handle, const coap_observer_s *observer_ptr, const sn_nsdl_addr_s *addr_ptr)
+{
+#if SN_COAP_SERVER_PROFILE
+    return observer_ptr->peer_id == sn_coap_peer_table_find(&handle->peer_table, addr_ptr);
+#else
+    (void) handle;
+    return observer_ptr->addr.port == addr_ptr->port &&
+           observer_ptr->addr.addr_len == addr_ptr->addr_len &&
+           memcmp(observer_ptr->addr.addr_ptr, addr_ptr->addr_ptr, addr_ptr->addr_len) == 0;
+#endif
+}
+
+/**************************************************************************//**
+ * \fn static sn_nsdl_addr_s *sn_coap_protocol_observer_addr(struct coap_s *handle, coap_observer_s *observer_ptr)
+ *
+ * \brief Returns address notifications are sent to
+ *****************************************************************************/
+static sn_nsdl_addr_s *sn_coap_protocol_observer_addr(struct coap_s *handle, coap_observer_s *observer_ptr)
+{
+#if SN_COAP_SERVER_PROFILE
+    return sn_coap_peer_table_get_addr(&handle->peer_table, observer_ptr->peer_id);
+#else
+    (void) handle;
+    return &observer_ptr->addr;
+#endif
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_observer_remove(struct coap_s *handle, coap_observe_resource_s *resource_ptr, coap_observer_s *observer_ptr)
+ *
+ * \brief Removes observer, resource is removed with its last observer
+ *****************************************************************************/
+static void sn_coap_protocol_observer_remove(struct coap_s *handle, coap_observe_resource_s *resource_ptr, coap_observer_s *observer_ptr)
+{
+#if SN_COAP_SERVER_PROFILE
+    sn_coap_peer_table_unref(&handle->peer_table, observer_ptr->peer_id, handle->system_time);
+#endif
+    ns_list_remove(&resource_ptr->observers, observer_ptr);
+    handle->sn_coap_protocol_free(observer_ptr);
+    handle->count_observers--;
+
+    if (ns_list_is_empty(&resource_ptr->observers)) {
+        ns_list_remove(&handle->linked_list_observe_resources, resource_ptr);
+        handle->sn_coap_protocol_free(resource_ptr->value_ptr);
+        handle->sn_coap_protocol_free(resource_ptr);
+    }
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_observer_reset(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id)
+ *
+ * \brief Removes observer which answered to its last notification with Reset
+ *****************************************************************************/
+static void sn_coap_protocol_observer_reset(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t msg_id)
+{
+    ns_list_foreach(coap_observe_resource_s, resource_ptr, &handle->linked_list_observe_resources) {
+        ns_list_foreach(coap_observer_s, observer_ptr, &resource_ptr->observers) {
+            if (observer_ptr->msg_id && observer_ptr->msg_id == msg_id && sn_coap_protocol_observer_addr_match(handle, observer_ptr, src_addr_ptr)) {
+                tr_debug("sn_coap_protocol_observer_reset - observer removed");
+                sn_coap_protocol_observer_remove(handle, resource_ptr, observer_ptr);
+                return;
+            }
+        }
+    }
+}
+#endif
+
+#if SN_COAP_CLIENT_MAX_EXCHANGES /* If client exchanges are not used at all, this part of code will not be compiled */
+/**************************************************************************//**
+ * \fn static coap_exchange_s *sn_coap_protocol_exchange_find(struct coap_s *handle, uint32_t token)
+ *
+ * \brief Searches pending exchange by token
+ *
+ * \return Pointer to pending exchange, NULL if not found
+ *****************************************************************************/
+static coap_exchange_s *sn_coap_protocol_exchange_find(struct coap_s *handle, uint32_t token)
+{
+    for (coap_exchange_s *exchange_ptr = handle->exchanges_hash[token & (SN_COAP_CLIENT_EXCHANGE_HASH_SIZE - 1)];
+            exchange_ptr != NULL; exchange_ptr = exchange_ptr->hash_next) {
+        if (exchange_ptr->token == token) {
+            return exchange_ptr;
+        }
+    }
+    return NULL;
+}
+
+/**************************************************************************//**
+ * \fn static bool sn_coap_protocol_exchange_addr_match(struct coap_s *handle, const coap_exchange_s *exchange_ptr, const sn_nsdl_addr_s *addr_ptr)
+ *
+ * \brief Checks if request of the exchange was sent to given address
+ *****************************************************************************/
+static bool sn_coap_protocol_exchange_addr_match(struct coap_s *handle, const coap_exchange_s *exchange_ptr, const sn_nsdl_addr_s *addr_ptr)
+{
+#if SN_COAP_SERVER_PROFILE
+    return exchange_ptr->peer_id == sn_coap_peer_table_find(&handle->peer_table, addr_ptr);
+#else
+    (void) handle;
+    return exchange_ptr->addr.port == addr_ptr->port &&
+           exchange_ptr->addr.addr_len == addr_ptr->addr_len &&
+           memcmp(exchange_ptr->addr.addr_ptr, addr_ptr->addr_ptr, addr_ptr->addr_len) == 0;
+#endif
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_exchange_unlink(struct coap_s *handle, coap_exchange_s *exchange_ptr)
+ *
+ * \brief Removes exchange from pending exchanges and from token index
+ *****************************************************************************/
+static void sn_coap_protocol_exchange_unlink(struct coap_s *handle, coap_exchange_s *exchange_ptr)
+{
+    coap_exchange_s **link_ptr = &handle->exchanges_hash[exchange_ptr->token & (SN_COAP_CLIENT_EXCHANGE_HASH_SIZE - 1)];
+    while (*link_ptr) {
+        if (*link_ptr == exchange_ptr) {
+            *link_ptr = exchange_ptr->hash_next;
+            break;
+        }
+        link_ptr = &(*link_ptr)->hash_next;
+    }
+
+    ns_list_remove(&handle->linked_list_exchanges, exchange_ptr);
+    handle->count_exchanges--;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_exchange_release(struct coap_s *handle, coap_exchange_s *exchange_ptr)
+ *
+ * \brief Releases memory of unlinked exchange
+ *****************************************************************************/
+static void sn_coap_protocol_exchange_release(struct coap_s *handle, coap_exchange_s *exchange_ptr)
+{
+#if SN_COAP_SERVER_PROFILE
+    sn_coap_peer_table_unref(&handle->peer_table, exchange_ptr->peer_id, handle->system_time);
+#endif
+    handle->sn_coap_protocol_free(exchange_ptr);
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_exchange_complete(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *coap_msg_ptr)
+ *
+ * \brief Gives received response, or Reset to request, to callback of the pending exchange
+ *****************************************************************************/
+static void sn_coap_protocol_exchange_complete(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, sn_coap_hdr_s *coap_msg_ptr)
+{
+    coap_exchange_s *exchange_ptr = NULL;
+
+    if (handle->count_exchanges == 0) {
+        return;
+    }
+
+    if (coap_msg_ptr->msg_type == COAP_MSG_TYPE_RESET) {
+        /* Reset has no token, it is matched by Message ID of the request */
+        ns_list_foreach(coap_exchange_s, tmp, &handle->linked_list_exchanges) {
+            if (tmp->msg_id == coap_msg_ptr->msg_id) {
+                exchange_ptr = tmp;
+                break;
+            }
+        }
+    } else if (coap_msg_ptr->msg_code >= COAP_MSG_CODE_RESPONSE_CREATED &&
+               coap_msg_ptr->token_len == SN_COAP_CLIENT_TOKEN_LEN &&
+               (coap_msg_ptr->coap_status == COAP_STATUS_OK || coap_msg_ptr->coap_status == COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED)) {
+        exchange_ptr = sn_coap_protocol_exchange_find(handle, ((uint32_t)coap_msg_ptr->token_ptr[0] << 24) |
+                       ((uint32_t)coap_msg_ptr->token_ptr[1] << 16) |
+                       ((uint32_t)coap_msg_ptr->token_ptr[2] << 8) |
+                       coap_msg_ptr->token_ptr[3]);
+    }
+
+    if (exchange_ptr == NULL || !sn_coap_protocol_exchange_addr_match(handle, exchange_ptr, src_addr_ptr)) {
+        return;
+    }
+
+    /* Exchange is unlinked first, so that callback can send new requests */
+    sn_coap_protocol_exchange_unlink(handle, exchange_ptr);
+    exchange_ptr->response_cb(handle, coap_msg_ptr, exchange_ptr->ctx);
+    sn_coap_protocol_exchange_release(handle, exchange_ptr);
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_exchange_remove_old_ones(struct coap_s *handle)
+ *
+ * \brief Completes pending exchanges which have timed out, with NULL response
+ *****************************************************************************/
+static void sn_coap_protocol_exchange_remove_old_ones(struct coap_s *handle)
+{
+    /* Exchanges time out in sending order */
+    ns_list_foreach_safe(coap_exchange_s, exchange_ptr, &handle->linked_list_exchanges) {
+        if (handle->system_time < exchange_ptr->timeout) {
+            break;
+        }
+        sn_coap_protocol_exchange_unlink(handle, exchange_ptr);
+        exchange_ptr->response_cb(handle, NULL, exchange_ptr->ctx);
+        sn_coap_protocol_exchange_release(handle, exchange_ptr);
+    }
+}
+
+#if ENABLE_RESENDINGS
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_exchange_send_failed(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, uint16_t msg_id)
+ *
+ * \brief Completes pending exchange whose Confirmable request was not acknowledged after all re-sendings
+ *****************************************************************************/
+static void sn_coap_protocol_exchange_send_failed(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, uint16_t msg_id)
+{
+    sn_coap_hdr_s failed_msg;
+
+    if (handle->count_exchanges == 0) {
+        return;
+    }
+
+    ns_list_foreach(coap_exchange_s, exchange_ptr, &handle->linked_list_exchanges) {
+        if (exchange_ptr->msg_id == msg_id && sn_coap_protocol_exchange_addr_match(handle, exchange_ptr, dst_addr_ptr)) {
+            /* Callback gets an empty message telling the failure, like RX callback gets for other messages */
+            memset(&failed_msg, 0, sizeof(failed_msg));
+            failed_msg.msg_id = msg_id;
+            failed_msg.coap_status = COAP_STATUS_BUILDER_MESSAGE_SENDING_FAILED;
+
+            sn_coap_protocol_exchange_unlink(handle, exchange_ptr);
+            exchange_ptr->response_cb(handle, &failed_msg, exchange_ptr->ctx);
+            sn_coap_protocol_exchange_release(handle, exchange_ptr);
+            return;
+        }
+    }
+}
+#endif
+#endif
+
+#if SN_COAP_INGRESS_QUEUE_MAX_SIZE /* If ingress queue is not used at all, this part of code will not be compiled */
+/**************************************************************************//**
+ * \fn static bool sn_coap_protocol_ingress_take(struct coap_s *handle, coap_ingress_slot_s *taken_ptr)
+ *
+ * \brief Takes next message from ingress queue in owner thread. Source address is copied
+ *        to handle, and slot is given back to producers.
+ *
+ * \return true if message was taken, false if queue is empty
+ *****************************************************************************/
+static bool sn_coap_protocol_ingress_take(struct coap_s *handle, coap_ingress_slot_s *taken_ptr)
+{
+    coap_ingress_slot_s *slot_ptr = &handle->ingress_queue[handle->ingress_tail & handle->ingress_queue_mask];
+
+    if (__atomic_load_n(&slot_ptr->sequence, __ATOMIC_ACQUIRE) != handle->ingress_tail + 1) {
+        return false;
+    }
+
+    taken_ptr->coap_msg_ptr = slot_ptr->coap_msg_ptr;
+    taken_ptr->coap_version = slot_ptr->coap_version;
+    taken_ptr->param = slot_ptr->param;
+    handle->ingress_addr = slot_ptr->addr;
+    handle->ingress_addr.addr_ptr = handle->ingress_addr_data;
+    memcpy(handle->ingress_addr_data, slot_ptr->addr_data, slot_ptr->addr.addr_len);
+
+    __atomic_store_n(&slot_ptr->sequence, handle->ingress_tail + handle->ingress_queue_mask + 1, __ATOMIC_RELEASE);
+    handle->ingress_tail++;
+
+    return true;
+}
+#endif
+
+#if SN_COAP_EGRESS_QUEUE_MAX_SIZE /* If egress queue is not used at all, this part of code will not be compiled */
+/**************************************************************************//**
+ * \fn static bool sn_coap_protocol_egress_take(struct coap_s *handle, coap_egress_slot_s *taken_ptr)
+ *
+ * \brief Takes next message from egress queue in owner thread. Destination address is copied
+ *        to handle, and slot is given back to producers.
+ *
+ * \return true if message was taken, false if queue is empty
+ *****************************************************************************/
+static bool sn_coap_protocol_egress_take(struct coap_s *handle, coap_egress_slot_s *taken_ptr)
+{
+    coap_egress_slot_s *slot_ptr = &handle->egress_queue[handle->egress_tail & handle->egress_queue_mask];
+
+    if (__atomic_load_n(&slot_ptr->sequence, __ATOMIC_ACQUIRE) != handle->egress_tail + 1) {
+        return false;
+    }
+
+    taken_ptr->packet_ptr = slot_ptr->packet_ptr;
+    taken_ptr->packet_len = slot_ptr->packet_len;
+    taken_ptr->uri_path_len = slot_ptr->uri_path_len;
+    taken_ptr->uri_query_len = slot_ptr->uri_query_len;
+    taken_ptr->msg_id_assign = slot_ptr->msg_id_assign;
+    taken_ptr->param = slot_ptr->param;
+    handle->egress_addr = slot_ptr->addr;
+    handle->egress_addr.addr_ptr = handle->egress_addr_data;
+    memcpy(handle->egress_addr_data, slot_ptr->addr_data, slot_ptr->addr.addr_len);
+
+    __atomic_store_n(&slot_ptr->sequence, handle->egress_tail + handle->egress_queue_mask + 1, __ATOMIC_RELEASE);
+    handle->egress_tail++;
+
+    return true;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_protocol_egress_send(struct coap_s *handle, coap_egress_slot_s *taken_ptr)
+ *
+ * \brief Sends message taken from egress queue to the address in handle. Message ID is
+ *        written to the packet if needed, and message is stored as sn_coap_protocol_build()
+ *        stores it. Header with the fields used by the stores is read from the packet.
+ *****************************************************************************/
+static void sn_coap_protocol_egress_send(struct coap_s *handle, coap_egress_slot_s *taken_ptr)
+{
+    uint8_t                 *packet_ptr = taken_ptr->packet_ptr;
+    sn_coap_hdr_s           sent_msg;
+    sn_coap_options_list_s  sent_options;
+
+    /* * * * Generate new Message ID and increase it by one  * * * */
+    if (taken_ptr->msg_id_assign) {
+        packet_ptr[2] = (uint8_t)(handle->message_id >> COAP_HEADER_MSG_ID_MSB_SHIFT);
+        packet_ptr[3] = (uint8_t)handle->message_id;
+        handle->message_id++;
+        if (handle->message_id == 0) {
+            handle->message_id = 1;
+        }
+    }
+
+    memset(&sent_msg, 0, sizeof(sn_coap_hdr_s));
+    memset(&sent_options, 0, sizeof(sn_coap_options_list_s));
+    sent_msg.msg_type = (sn_coap_msg_type_e)(packet_ptr[0] & COAP_HEADER_MSG_TYPE_MASK);
+    sent_msg.token_len = packet_ptr[0] & COAP_HEADER_TOKEN_LENGTH_MASK;
+    sent_msg.msg_code = (sn_coap_msg_code_e)packet_ptr[1];
+    sent_msg.msg_id = (uint16_t)(packet_ptr[2] << COAP_HEADER_MSG_ID_MSB_SHIFT) | packet_ptr[3];
+    if (sent_msg.token_len) {
+        sent_msg.token_ptr = packet_ptr + COAP_HEADER_LENGTH;
+    }
+    if (taken_ptr->uri_path_len) {
+        sent_msg.uri_path_ptr = packet_ptr + taken_ptr->packet_len;
+        sent_msg.uri_path_len = taken_ptr->uri_path_len;
+    }
+    if (taken_ptr->uri_query_len) {
+        sent_options.uri_query_ptr = packet_ptr + taken_ptr->packet_len + taken_ptr->uri_path_len;
+        sent_options.uri_query_len = taken_ptr->uri_query_len;
+        sent_msg.options_list_ptr = &sent_options;
+    }
+
+#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT /* If Message duplication detection is not used at all, this part of code will not be compiled */
+
+    /* Store Acknowledgement for replaying it if the request is received again */
+    if (sent_msg.msg_type == COAP_MSG_TYPE_ACKNOWLEDGEMENT && handle->sn_coap_duplication_response_cache_size) {
+        sn_coap_protocol_duplication_response_store(handle, &handle->egress_addr, sent_msg.msg_id,
+                packet_ptr, taken_ptr->packet_len);
+    }
+
+#endif
+
+#if ENABLE_RESENDINGS /* If Message resending is not used at all, this part of code will not be compiled */
+
+    /* Check if built Message type was confirmable, only these messages are resent */
+    if (sent_msg.msg_type == COAP_MSG_TYPE_CONFIRMABLE) {
+        sn_coap_protocol_linked_list_send_msg_store(handle, &handle->egress_addr, taken_ptr->packet_len, packet_ptr,
+                handle->system_time + (uint32_t)(handle->sn_coap_resending_intervall * RESPONSE_RANDOM_FACTOR),
+                taken_ptr->param, &sent_msg, sent_msg.uri_path_ptr, sent_msg.uri_path_len);
+    }
+
+#endif /* ENABLE_RESENDINGS */
+
+#if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE /* If Message blockwising is not used at all, this part of code will not be compiled */
+
+    if (sent_msg.msg_code == COAP_MSG_CODE_REQUEST_GET) {
+        /* Response can be in blocks, keep what is needed for requesting the next block */
+        sn_coap_protocol_linked_list_blockwise_request_store(handle, &handle->egress_addr, &sent_msg);
+    }
+
+#endif /* SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE */
+
+    sn_coap_protocol_tx(handle, packet_ptr, taken_ptr->packet_len, &handle->egress_addr, taken_ptr->param);
+}
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file sn_coap_shard.c
+ *
+ * \brief CoAP Shards
+ *
+ * Functionality: Creates a CoAP library handle per shard and selects the
+ * shard of a peer from hash of the peer address.
+ *
+ */
+
+/* * * * INCLUDE FILES * * * */
+#include <string.h> /* For memset() */
+
+#include "ns_types.h"
+#include "mbed-coap/sn_coap_shard.h"
+
+/* * * * * * * * * * * * * * * */
+/* * * * ENUMS & STRUCTS * * * */
+/* * * * * * * * * * * * * * * */
+
+struct sn_coap_shards_ {
+    void (*sn_coap_shards_free)(void *);
+    uint16_t            count;
+    struct coap_s       *handles[];     /* Handle of each shard */
+};
+
+/* * * * * * * * * * * * * * * * * * * * */
+/* * * * LOCAL FUNCTION PROTOTYPES * * * */
+/* * * * * * * * * * * * * * * * * * * * */
+
+static uint32_t          sn_coap_shards_hash(const sn_nsdl_addr_s *addr_ptr);
+
+/* * * * * * * * * * * * * * * * * * * * */
+/* * * * GLOBAL FUNCTIONS * * * * * * * */
+/* * * * * * * * * * * * * * * * * * * * */
+
+sn_coap_shards_s *sn_coap_shards_init(uint16_t shard_count, void *(*used_malloc_func_ptr)(uint16_t), void (*used_free_func_ptr)(void *),
+                                      uint8_t (*used_tx_callback_ptr)(uint8_t *, uint16_t, sn_nsdl_addr_s *, void *),
+                                      int8_t (*used_rx_callback_ptr)(sn_coap_hdr_s *, sn_nsdl_addr_s *, void *))
+{
+    sn_coap_shards_s *shards;
+    uint32_t size = sizeof(sn_coap_shards_s) + (uint32_t)shard_count * sizeof(struct coap_s *);
+
+    if (shard_count == 0 || used_malloc_func_ptr == NULL || used_free_func_ptr == NULL || size > UINT16_MAX) {
+        return NULL;
+    }
+
+    shards = used_malloc_func_ptr(size);
+    if (shards == NULL) {
+        return NULL;
+    }
+    memset(shards, 0, size);
+    shards->sn_coap_shards_free = used_free_func_ptr;
+
+    for (shards->count = 0; shards->count < shard_count; shards->count++) {
+        shards->handles[shards->count] = sn_coap_protocol_init(used_malloc_func_ptr, used_free_func_ptr,
+                                         used_tx_callback_ptr, used_rx_callback_ptr);
+        if (shards->handles[shards->count] == NULL) {
+            sn_coap_shards_destroy(shards);
+            return NULL;
+        }
+    }
+
+    return shards;
+}
+
+void sn_coap_shards_destroy(sn_coap_shards_s *shards)
+{
+    uint16_t i;
+
+    if (shards == NULL) {
+        return;
+    }
+
+    for (i = 0; i < shards->count; i++) {
+        sn_coap_protocol_destroy(shards->handles[i]);
+    }
+    shards->sn_coap_shards_free(shards);
+}
+
+uint16_t sn_coap_shards_count(const sn_coap_shards_s *shards)
+{
+    return shards ? shards->count : 0;
+}
+
+struct coap_s *sn_coap_shards_get(const sn_coap_shards_s *shards, uint16_t index)
+{
+    if (shards == NULL || index >= shards->count) {
+        return NULL;
+    }
+    return shards->handles[index];
+}
+
+uint16_t sn_coap_shards_index(const sn_coap_shards_s *shards, const sn_nsdl_addr_s *addr_ptr)
+{
+    if (shards == NULL || addr_ptr == NULL || addr_ptr->addr_ptr == NULL) {
+        return 0;
+    }
+    return sn_coap_shards_hash(addr_ptr) % shards->count;
+}
+
+struct coap_s *sn_coap_shards_route(const sn_coap_shards_s *shards, const sn_nsdl_addr_s *addr_ptr)
+{
+    return sn_coap_shards_get(shards, sn_coap_shards_index(shards, addr_ptr));
+}
+
+int8_t sn_coap_shards_get_stats(const sn_coap_shards_s *shards, sn_coap_stats_s *stats_ptr)
+{
+    sn_coap_stats_s shard_stats;
+    uint16_t i;
+
+    if (shards == NULL || stats_ptr == NULL) {
+        return -1;
+    }
+
+    memset(stats_ptr, 0, sizeof(sn_coap_stats_s));
+    for (i = 0; i < shards->count; i++) {
+        sn_coap_protocol_get_stats(shards->handles[i], &shard_stats);
+        stats_ptr->resent_msgs += shard_stats.resent_msgs;
+        stats_ptr->resent_bytes += shard_stats.resent_bytes;
+        stats_ptr->duplication_msgs += shard_stats.duplication_msgs;
+        stats_ptr->blockwise_sent_msgs += shard_stats.blockwise_sent_msgs;
+        stats_ptr->blockwise_received_payloads += shard_stats.blockwise_received_payloads;
+        stats_ptr->observers += shard_stats.observers;
+        stats_ptr->exchanges += shard_stats.exchanges;
+        stats_ptr->peers += shard_stats.peers;
+    }
+
+    return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * */
+/* * * * LOCAL FUNCTIONS * * * * * * * * */
+/* * * * * * * * * * * * * * * * * * * * */
+
+/**************************************************************************//**
+ * \fn static uint32_t sn_coap_shards_hash(const sn_nsdl_addr_s *addr_ptr)
+ *
+ * \brief Calculates FNV-1a hash of address type, address and port. Steering program
+ * of sn_coap_udp_steer_shards() calculates the same hash, keep them in sync.
+ *****************************************************************************/
+
+static uint32_t sn_coap_shards_hash(const sn_nsdl_addr_s *addr_ptr)
+{
+    uint32_t hash = 2166136261u;
+    uint8_t i;
+
+    hash = (hash ^ (uint8_t)addr_ptr->type) * 16777619u;
+    for (i = 0; i < addr_ptr->addr_len; i++) {
+        hash = (hash ^ addr_ptr->addr_ptr[i]) * 16777619u;
+    }
+    hash = (hash ^ (addr_ptr->port & 0xff)) * 16777619u;
+    hash = (hash ^ (addr_ptr->port >> 8)) * 16777619u;
+
+    return hash;
+}
@@ -0,0 +1,571 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file sn_coap_udp.c
+ *
+ * \brief CoAP UDP transport for Linux
+ *
+ * Functionality: Receives and sends CoAP packets in batches with recvmmsg() and
+ * sendmmsg(), and runs sn_coap_protocol_exec() from a timerfd in an epoll loop.
+ *
+ */
+
+#ifdef __linux__
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* For recvmmsg() and sendmmsg() */
+#endif
+
+/* * * * INCLUDE FILES * * * */
+#include <string.h> /* For memset() and memcpy() */
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <linux/filter.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "ns_types.h"
+#include "mbed-coap/sn_coap_udp.h"
+#include "sn_coap_protocol_internal.h"
+
+/* * * * * * * * * * * */
+/* * * * DEFINES * * * */
+/* * * * * * * * * * * */
+
+/* Count of packets received or sent with one system call */
+#ifndef SN_COAP_UDP_BATCH_SIZE
+#define SN_COAP_UDP_BATCH_SIZE                      32
+#endif
+
+/* Maximum size of received and sent packets, larger received packets are truncated and dropped */
+#ifndef SN_COAP_UDP_MAX_PACKET_SIZE
+#define SN_COAP_UDP_MAX_PACKET_SIZE                 1280
+#endif
+
+#if SN_COAP_UDP_BATCH_SIZE * SN_COAP_UDP_MAX_PACKET_SIZE > 0xffff
+#error "SN_COAP_UDP_BATCH_SIZE * SN_COAP_UDP_MAX_PACKET_SIZE must fit to one allocation of 64 KiB"
+#endif
+
+/* Interval of sn_coap_protocol_exec() calls in milliseconds */
+#define SN_COAP_UDP_EXEC_INTERVAL_MS                1000
+
+/* FNV-1a parameters of shard hash, must match sn_coap_shards_hash() */
+#define SN_COAP_UDP_FNV_OFFSET                      2166136261u
+#define SN_COAP_UDP_FNV_PRIME                       16777619u
+
+/* Maximum length of shard steering program, which takes 111 instructions */
+#define SN_COAP_UDP_STEERING_MAX_LEN                128
+
+/* * * * * * * * * * * * * * */
+/* * * * ENUMS & STRUCTS * * * */
+/* * * * * * * * * * * * * * */
+
+/* Batch of packets for recvmmsg() or sendmmsg() */
+typedef struct sn_coap_udp_batch_ {
+    uint8_t             *buffer;        /* SN_COAP_UDP_BATCH_SIZE packets of SN_COAP_UDP_MAX_PACKET_SIZE */
+    struct mmsghdr      msgs[SN_COAP_UDP_BATCH_SIZE];
+    struct iovec        iovs[SN_COAP_UDP_BATCH_SIZE];
+    struct sockaddr_in6 addrs[SN_COAP_UDP_BATCH_SIZE];
+    uint16_t            count;          /* Count of pending packets in TX batch */
+} sn_coap_udp_batch_s;
+
+struct sn_coap_udp_ {
+    struct coap_s       *coap;
+    void (*msg_cb)(sn_coap_udp_s *, sn_coap_hdr_s *, sn_nsdl_addr_s *, void *);
+    void                *ctx;
+
+    int                 socket_fd;
+    int                 epoll_fd;
+    int                 timer_fd;
+
+    sn_coap_udp_batch_s rx;
+    sn_coap_udp_batch_s tx;
+};
+
+/* * * * * * * * * * * * * * * * * * * * */
+/* * * * LOCAL FUNCTION PROTOTYPES * * * */
+/* * * * * * * * * * * * * * * * * * * * */
+
+static int               sn_coap_udp_open(sn_coap_udp_s *udp, uint16_t port, bool reuse_port);
+static void              sn_coap_udp_batch_init(sn_coap_udp_batch_s *batch);
+static int8_t            sn_coap_udp_receive(sn_coap_udp_s *udp);
+static void              sn_coap_udp_exec(sn_coap_udp_s *udp);
+static void              sn_coap_udp_addr_from_sockaddr(sn_nsdl_addr_s *addr_ptr, struct sockaddr_in6 *sockaddr_ptr);
+static int               sn_coap_udp_addr_to_sockaddr(struct sockaddr_in6 *sockaddr_ptr, const sn_nsdl_addr_s *addr_ptr);
+static uint16_t          sn_coap_udp_steering_hash_byte(struct sock_filter *code, uint16_t len, uint32_t offset);
+static uint16_t          sn_coap_udp_steering_hash_port_byte(struct sock_filter *code, uint16_t len, uint32_t offset);
+
+/* * * * * * * * * * * * * * * * * * * * */
+/* * * * GLOBAL FUNCTIONS * * * * * * * */
+/* * * * * * * * * * * * * * * * * * * * */
+
+sn_coap_udp_s *sn_coap_udp_init(struct coap_s *handle, uint16_t port, bool reuse_port,
+                                void (*msg_cb)(sn_coap_udp_s *, sn_coap_hdr_s *, sn_nsdl_addr_s *, void *), void *ctx)
+{
+    sn_coap_udp_s *udp;
+
+    if (handle == NULL || msg_cb == NULL || sizeof(sn_coap_udp_s) > 0xffff) {
+        return NULL;
+    }
+
+    udp = handle->sn_coap_protocol_malloc(sizeof(sn_coap_udp_s));
+    if (udp == NULL) {
+        return NULL;
+    }
+    memset(udp, 0, sizeof(sn_coap_udp_s));
+    udp->coap = handle;
+    udp->msg_cb = msg_cb;
+    udp->ctx = ctx;
+    udp->socket_fd = -1;
+    udp->epoll_fd = -1;
+    udp->timer_fd = -1;
+
+    udp->rx.buffer = handle->sn_coap_protocol_malloc(SN_COAP_UDP_BATCH_SIZE * SN_COAP_UDP_MAX_PACKET_SIZE);
+    udp->tx.buffer = handle->sn_coap_protocol_malloc(SN_COAP_UDP_BATCH_SIZE * SN_COAP_UDP_MAX_PACKET_SIZE);
+    if (udp->rx.buffer == NULL || udp->tx.buffer == NULL || sn_coap_udp_open(udp, port, reuse_port) < 0) {
+        sn_coap_udp_destroy(udp);
+        return NULL;
+    }
+    sn_coap_udp_batch_init(&udp->rx);
+    sn_coap_udp_batch_init(&udp->tx);
+
+    return udp;
+}
+
+void sn_coap_udp_destroy(sn_coap_udp_s *udp)
+{
+    if (udp == NULL) {
+        return;
+    }
+
+    if (udp->socket_fd >= 0) {
+        sn_coap_udp_flush(udp);
+        close(udp->socket_fd);
+    }
+    if (udp->timer_fd >= 0) {
+        close(udp->timer_fd);
+    }
+    if (udp->epoll_fd >= 0) {
+        close(udp->epoll_fd);
+    }
+    if (udp->rx.buffer) {
+        udp->coap->sn_coap_protocol_free(udp->rx.buffer);
+    }
+    if (udp->tx.buffer) {
+        udp->coap->sn_coap_protocol_free(udp->tx.buffer);
+    }
+    udp->coap->sn_coap_protocol_free(udp);
+}
+
+int sn_coap_udp_get_fd(const sn_coap_udp_s *udp)
+{
+    return udp ? udp->epoll_fd : -1;
+}
+
+uint16_t sn_coap_udp_get_port(const sn_coap_udp_s *udp)
+{
+    struct sockaddr_in6 local_addr;
+    socklen_t addr_len = sizeof(local_addr);
+
+    if (udp == NULL || getsockname(udp->socket_fd, (struct sockaddr *)&local_addr, &addr_len) < 0) {
+        return 0;
+    }
+    return ntohs(local_addr.sin6_port);
+}
+
+void *sn_coap_udp_get_context(const sn_coap_udp_s *udp)
+{
+    return udp ? udp->ctx : NULL;
+}
+
+int8_t sn_coap_udp_steer_shards(sn_coap_udp_s *udp, uint16_t shard_count)
+{
+    struct sock_filter code[SN_COAP_UDP_STEERING_MAX_LEN];
+    struct sock_fprog prog;
+    uint16_t version_jump;
+    uint16_t len = 0;
+    uint8_t i;
+
+    if (udp == NULL || shard_count == 0) {
+        return -1;
+    }
+
+    /* Data of the program starts at UDP payload, headers are read relative to SKF_NET_OFF */
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4);
+    version_jump = len++;
+
+    /* IPv6: type, source address and source port, low byte first */
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_IMM,
+                  (SN_COAP_UDP_FNV_OFFSET ^ SN_NSDL_ADDRESS_TYPE_IPV6) * SN_COAP_UDP_FNV_PRIME);
+    for (i = 0; i < 16; i++) {
+        len = sn_coap_udp_steering_hash_byte(code, len, SKF_NET_OFF + 8 + i);
+    }
+    len = sn_coap_udp_steering_hash_byte(code, len, SKF_NET_OFF + 40 + 1);
+    len = sn_coap_udp_steering_hash_byte(code, len, SKF_NET_OFF + 40);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, shard_count);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+
+    code[version_jump] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 4, len - version_jump - 1, 0);
+
+    /* IPv4: UDP header follows options of IPv4 header */
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_IMM,
+                  (SN_COAP_UDP_FNV_OFFSET ^ SN_NSDL_ADDRESS_TYPE_IPV4) * SN_COAP_UDP_FNV_PRIME);
+    for (i = 0; i < 4; i++) {
+        len = sn_coap_udp_steering_hash_byte(code, len, SKF_NET_OFF + 12 + i);
+    }
+    len = sn_coap_udp_steering_hash_port_byte(code, len, SKF_NET_OFF + 1);
+    len = sn_coap_udp_steering_hash_port_byte(code, len, SKF_NET_OFF);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, shard_count);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+
+    prog.len = len;
+    prog.filter = code;
+    if (setsockopt(udp->socket_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int8_t sn_coap_udp_run(sn_coap_udp_s *udp, int timeout_ms)
+{
+    struct epoll_event events[2];
+    int8_t ret_val = 0;
+    int event_count;
+    int i;
+
+    if (udp == NULL) {
+        return -1;
+    }
+
+    event_count = epoll_wait(udp->epoll_fd, events, 2, timeout_ms);
+    if (event_count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (i = 0; i < event_count; i++) {
+        if (events[i].data.fd == udp->timer_fd) {
+            sn_coap_udp_exec(udp);
+        } else if (sn_coap_udp_receive(udp) < 0) {
+            ret_val = -1;
+        }
+    }
+
+    if (sn_coap_udp_flush(udp) < 0) {
+        ret_val = -1;
+    }
+
+    return ret_val;
+}
+
+int8_t sn_coap_udp_flush(sn_coap_udp_s *udp)
+{
+    int8_t ret_val = 0;
+    uint16_t sent = 0;
+    int count;
+
+    if (udp == NULL) {
+        return -1;
+    }
+
+    while (sent < udp->tx.count) {
+        count = sendmmsg(udp->socket_fd, &udp->tx.msgs[sent], udp->tx.count - sent, 0);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* Drop the packet which failed, e.g. because of unreachable destination */
+            ret_val = -1;
+            count = 1;
+        }
+        sent += count;
+    }
+    udp->tx.count = 0;
+
+    return ret_val;
+}
+
+uint8_t sn_coap_udp_tx(uint8_t *packet_ptr, uint16_t packet_len, sn_nsdl_addr_s *dst_addr_ptr, void *param)
+{
+    sn_coap_udp_s *udp = param;
+    uint16_t index;
+
+    if (udp == NULL || packet_ptr == NULL || dst_addr_ptr == NULL || packet_len > SN_COAP_UDP_MAX_PACKET_SIZE) {
+        return 0;
+    }
+
+    if (udp->tx.count == SN_COAP_UDP_BATCH_SIZE) {
+        sn_coap_udp_flush(udp);
+    }
+
+    index = udp->tx.count;
+    if (sn_coap_udp_addr_to_sockaddr(&udp->tx.addrs[index], dst_addr_ptr) < 0) {
+        return 0;
+    }
+    memcpy(udp->tx.iovs[index].iov_base, packet_ptr, packet_len);
+    udp->tx.iovs[index].iov_len = packet_len;
+    udp->tx.count++;
+
+    return 1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * */
+/* * * * LOCAL FUNCTIONS * * * * * * * * */
+/* * * * * * * * * * * * * * * * * * * * */
+
+/**************************************************************************//**
+ * \fn static int sn_coap_udp_open(sn_coap_udp_s *udp, uint16_t port, bool reuse_port)
+ *
+ * \brief Opens socket, timer and epoll descriptors of transport
+ *
+ * \return 0 on success, -1 on failure
+ *****************************************************************************/
+
+static int sn_coap_udp_open(sn_coap_udp_s *udp, uint16_t port, bool reuse_port)
+{
+    struct sockaddr_in6 local_addr;
+    struct itimerspec interval;
+    struct epoll_event event;
+    int off = 0;
+    int on = 1;
+
+    udp->socket_fd = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (udp->socket_fd < 0) {
+        return -1;
+    }
+    /* Dual-stack socket, IPv4 peers have IPv4-mapped addresses */
+    setsockopt(udp->socket_fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+    if (reuse_port && setsockopt(udp->socket_fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        return -1;
+    }
+
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin6_family = AF_INET6;
+    local_addr.sin6_addr = in6addr_any;
+    local_addr.sin6_port = htons(port);
+    if (bind(udp->socket_fd, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
+        return -1;
+    }
+
+    udp->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (udp->timer_fd < 0) {
+        return -1;
+    }
+    memset(&interval, 0, sizeof(interval));
+    interval.it_interval.tv_sec = SN_COAP_UDP_EXEC_INTERVAL_MS / 1000;
+    interval.it_interval.tv_nsec = (SN_COAP_UDP_EXEC_INTERVAL_MS % 1000) * 1000000L;
+    interval.it_value = interval.it_interval;
+    if (timerfd_settime(udp->timer_fd, 0, &interval, NULL) < 0) {
+        return -1;
+    }
+
+    udp->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (udp->epoll_fd < 0) {
+        return -1;
+    }
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = udp->socket_fd;
+    if (epoll_ctl(udp->epoll_fd, EPOLL_CTL_ADD, udp->socket_fd, &event) < 0) {
+        return -1;
+    }
+    event.data.fd = udp->timer_fd;
+    if (epoll_ctl(udp->epoll_fd, EPOLL_CTL_ADD, udp->timer_fd, &event) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_udp_batch_init(sn_coap_udp_batch_s *batch)
+ *
+ * \brief Points each message of batch to its own address and part of buffer
+ *****************************************************************************/
+
+static void sn_coap_udp_batch_init(sn_coap_udp_batch_s *batch)
+{
+    uint16_t i;
+
+    for (i = 0; i < SN_COAP_UDP_BATCH_SIZE; i++) {
+        batch->iovs[i].iov_base = batch->buffer + i * SN_COAP_UDP_MAX_PACKET_SIZE;
+        batch->iovs[i].iov_len = SN_COAP_UDP_MAX_PACKET_SIZE;
+        batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+        batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    batch->count = 0;
+}
+
+/**************************************************************************//**
+ * \fn static int8_t sn_coap_udp_receive(sn_coap_udp_s *udp)
+ *
+ * \brief Reads received packets in batches until socket is empty, and gives
+ *        each packet to sn_coap_protocol_parse() and returned message to
+ *        message callback
+ *
+ * \return 0 on success, -1 on socket error
+ *****************************************************************************/
+
+static int8_t sn_coap_udp_receive(sn_coap_udp_s *udp)
+{
+    sn_nsdl_addr_s src_addr;
+    sn_coap_hdr_s *msg_ptr;
+    int count;
+    int i;
+
+    do {
+        for (i = 0; i < SN_COAP_UDP_BATCH_SIZE; i++) {
+            udp->rx.msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+            udp->rx.msgs[i].msg_hdr.msg_flags = 0;
+        }
+
+        count = recvmmsg(udp->socket_fd, udp->rx.msgs, SN_COAP_UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            return -1;
+        }
+
+        for (i = 0; i < count; i++) {
+            if (udp->rx.msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                continue;
+            }
+            sn_coap_udp_addr_from_sockaddr(&src_addr, &udp->rx.addrs[i]);
+            msg_ptr = sn_coap_protocol_parse(udp->coap, &src_addr, udp->rx.msgs[i].msg_len,
+                                             udp->rx.iovs[i].iov_base, udp);
+            if (msg_ptr) {
+                udp->msg_cb(udp, msg_ptr, &src_addr, udp->ctx);
+            }
+        }
+    } while (count == SN_COAP_UDP_BATCH_SIZE);
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_udp_exec(sn_coap_udp_s *udp)
+ *
+ * \brief Clears expirations of timer and calls sn_coap_protocol_exec() with
+ *        monotonic time in seconds
+ *****************************************************************************/
+
+static void sn_coap_udp_exec(sn_coap_udp_s *udp)
+{
+    struct timespec now;
+    uint64_t expirations;
+
+    if (read(udp->timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    sn_coap_protocol_exec(udp->coap, (uint32_t)now.tv_sec);
+}
+
+/**************************************************************************//**
+ * \fn static void sn_coap_udp_addr_from_sockaddr(sn_nsdl_addr_s *addr_ptr, struct sockaddr_in6 *sockaddr_ptr)
+ *
+ * \brief Fills CoAP address pointing to socket address, IPv4-mapped addresses are given as IPv4
+ *****************************************************************************/
+
+static void sn_coap_udp_addr_from_sockaddr(sn_nsdl_addr_s *addr_ptr, struct sockaddr_in6 *sockaddr_ptr)
+{
+    if (IN6_IS_ADDR_V4MAPPED(&sockaddr_ptr->sin6_addr)) {
+        addr_ptr->type = SN_NSDL_ADDRESS_TYPE_IPV4;
+        addr_ptr->addr_ptr = &sockaddr_ptr->sin6_addr.s6_addr[12];
+        addr_ptr->addr_len = 4;
+    } else {
+        addr_ptr->type = SN_NSDL_ADDRESS_TYPE_IPV6;
+        addr_ptr->addr_ptr = sockaddr_ptr->sin6_addr.s6_addr;
+        addr_ptr->addr_len = 16;
+    }
+    addr_ptr->port = ntohs(sockaddr_ptr->sin6_port);
+}
+
+/**************************************************************************//**
+ * \fn static int sn_coap_udp_addr_to_sockaddr(struct sockaddr_in6 *sockaddr_ptr, const sn_nsdl_addr_s *addr_ptr)
+ *
+ * \brief Fills socket address from CoAP address, IPv4 addresses are mapped to IPv6
+ *
+ * \return 0 on success, -1 if address type or length is not supported
+ *****************************************************************************/
+
+static int sn_coap_udp_addr_to_sockaddr(struct sockaddr_in6 *sockaddr_ptr, const sn_nsdl_addr_s *addr_ptr)
+{
+    memset(sockaddr_ptr, 0, sizeof(struct sockaddr_in6));
+    sockaddr_ptr->sin6_family = AF_INET6;
+    sockaddr_ptr->sin6_port = htons(addr_ptr->port);
+
+    if (addr_ptr->type == SN_NSDL_ADDRESS_TYPE_IPV4 && addr_ptr->addr_len == 4) {
+        sockaddr_ptr->sin6_addr.s6_addr[10] = 0xff;
+        sockaddr_ptr->sin6_addr.s6_addr[11] = 0xff;
+        memcpy(&sockaddr_ptr->sin6_addr.s6_addr[12], addr_ptr->addr_ptr, 4);
+    } else if (addr_ptr->type == SN_NSDL_ADDRESS_TYPE_IPV6 && addr_ptr->addr_len == 16) {
+        memcpy(sockaddr_ptr->sin6_addr.s6_addr, addr_ptr->addr_ptr, 16);
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * \fn static uint16_t sn_coap_udp_steering_hash_byte(struct sock_filter *code, uint16_t len, uint32_t offset)
+ *
+ * \brief Appends instructions mixing byte at offset to FNV-1a hash in accumulator
+ *
+ * \return New length of program
+ *****************************************************************************/
+
+static uint16_t sn_coap_udp_steering_hash_byte(struct sock_filter *code, uint16_t len, uint32_t offset)
+{
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_MISC | BPF_TAX, 0);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_ABS, offset);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, SN_COAP_UDP_FNV_PRIME);
+    return len;
+}
+
+/**************************************************************************//**
+ * \fn static uint16_t sn_coap_udp_steering_hash_port_byte(struct sock_filter *code, uint16_t len, uint32_t offset)
+ *
+ * \brief Appends instructions mixing byte at offset from end of IPv4 header to FNV-1a hash
+ *        in accumulator. Hash is kept in scratch memory while index register holds header length.
+ *
+ * \return New length of program
+ *****************************************************************************/
+
+static uint16_t sn_coap_udp_steering_hash_port_byte(struct sock_filter *code, uint16_t len, uint32_t offset)
+{
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_ST, 0);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, SKF_NET_OFF);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_IND, offset);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_MISC | BPF_TAX, 0);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_MEM, 0);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, SN_COAP_UDP_FNV_PRIME);
+    return len;
+}
+
+#endif /* __linux__ */
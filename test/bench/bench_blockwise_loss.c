@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Transfer time of a Block1 PUT under simulated loss.
+ *
+ * Client and server handles are connected by a simulated link with limited bandwidth
+ * and delay, which drops packets either at a fixed rate or by bit errors, so that long
+ * packets are lost more often. Time is simulated, sn_coap_protocol_exec() is called
+ * once a simulated second. Both ends use the server profile. Block size is tuned per peer
+ * from loss with SN_COAP_BLOCK_SIZE_TUNING; bench_blockwise_loss_static is the baseline
+ * with block size selected from path MTU only. Mean and p90 are over completed transfers,
+ * "all" is the mean over all runs with failed transfers counted until they failed.
+ *
+ * usage: bench_blockwise_loss [payload bytes] [runs per scenario]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ns_types.h"
+#include "sn_coap_header.h"
+#include "sn_coap_protocol.h"
+#include "sn_coap_protocol_internal.h"
+#include "bench_common.h"
+
+#define BENCH_LINK_BPS              250000  /* Link bandwidth, bits per second */
+#define BENCH_LINK_DELAY_US         20000   /* One-way delay */
+#define BENCH_IP_UDP_OVERHEAD       48      /* Bytes of IPv6 and UDP headers on the link */
+#define BENCH_PATH_MTU              1280
+#define BENCH_BLOCK_SIZE            1024
+#define BENCH_RESEND_COUNT          6
+#define BENCH_RESEND_INTERVAL       2       /* Seconds */
+#define BENCH_TIME_LIMIT_US         (3600ULL * 1000000)
+#define BENCH_MAX_IN_FLIGHT         64
+#define BENCH_MAX_PACKET            1400
+
+#ifdef BENCH_STATIC_BLOCK_SIZE
+#define BENCH_MODE                  "static"
+#else
+#define BENCH_MODE                  "tuned"
+#endif
+
+typedef struct bench_node_ {
+    struct coap_s       *handle;
+    sn_nsdl_addr_s      addr;
+    uint8_t             addr_bytes[16];
+    struct bench_node_  *peer;
+    uint64_t            link_free_us;   /* Time when uplink of node has sent queued packets */
+} bench_node_s;
+
+typedef struct bench_packet_ {
+    uint64_t            deliver_us;
+    bench_node_s        *dst;
+    uint16_t            len;
+    uint8_t             data[BENCH_MAX_PACKET];
+} bench_packet_s;
+
+typedef struct bench_scenario_ {
+    const char          *name;
+    double              packet_loss;    /* Probability to lose any packet */
+    double              bit_error_rate; /* Probability to lose each bit of a packet */
+} bench_scenario_s;
+
+static const bench_scenario_s scenarios[] = {
+    {"no loss",     0.0,  0.0},
+    {"loss 1%",     0.01, 0.0},
+    {"loss 5%",     0.05, 0.0},
+    {"loss 10%",    0.10, 0.0},
+    {"loss 20%",    0.20, 0.0},
+    {"BER 1e-5",    0.0,  1e-5},
+    {"BER 3e-5",    0.0,  3e-5},
+    {"BER 1e-4",    0.0,  1e-4},
+};
+
+static bench_node_s client;
+static bench_node_s server;
+static bench_packet_s in_flight[BENCH_MAX_IN_FLIGHT];
+static uint16_t in_flight_count;
+static const bench_scenario_s *scenario;
+static uint64_t now_us;
+static uint32_t sent_packets;
+static uint32_t sent_bytes;
+static uint32_t lost_packets;
+static uint16_t payload_len;
+static bool transfer_done;
+static bool transfer_failed;
+
+static uint8_t bench_tx(uint8_t *packet_ptr, uint16_t packet_len, sn_nsdl_addr_s *dst_addr_ptr, void *param)
+{
+    bench_node_s *node = param;
+    double loss;
+
+    (void) dst_addr_ptr;
+
+    if (node == NULL || packet_len > BENCH_MAX_PACKET || in_flight_count == BENCH_MAX_IN_FLIGHT) {
+        return 0;
+    }
+
+    /* Packet occupies the uplink of sender, lost packets too */
+    if (node->link_free_us < now_us) {
+        node->link_free_us = now_us;
+    }
+    node->link_free_us += (uint64_t)(packet_len + BENCH_IP_UDP_OVERHEAD) * 8 * 1000000 / BENCH_LINK_BPS;
+    sent_packets++;
+    sent_bytes += packet_len;
+
+    loss = 1.0 - (1.0 - scenario->packet_loss) * pow(1.0 - scenario->bit_error_rate, (packet_len + BENCH_IP_UDP_OVERHEAD) * 8.0);
+    if (bench_random_unit() < loss) {
+        lost_packets++;
+        return 1;
+    }
+
+    bench_packet_s *pkt = &in_flight[in_flight_count++];
+    pkt->deliver_us = node->link_free_us + BENCH_LINK_DELAY_US;
+    pkt->dst = node->peer;
+    pkt->len = packet_len;
+    memcpy(pkt->data, packet_ptr, packet_len);
+    return 1;
+}
+
+static int8_t bench_rx(sn_coap_hdr_s *msg_ptr, sn_nsdl_addr_s *addr_ptr, void *param)
+{
+    (void) addr_ptr;
+    (void) param;
+
+    /* Re-sendings of a block were not acknowledged */
+    if (msg_ptr && msg_ptr->coap_status == COAP_STATUS_BUILDER_MESSAGE_SENDING_FAILED) {
+        transfer_failed = true;
+    }
+    return 0;
+}
+
+static void bench_node_init(bench_node_s *node, uint8_t id)
+{
+    memset(node, 0, sizeof(bench_node_s));
+    node->addr_bytes[15] = id;
+    node->addr.addr_ptr = node->addr_bytes;
+    node->addr.addr_len = sizeof(node->addr_bytes);
+    node->addr.port = 5683;
+    node->addr.type = SN_NSDL_ADDRESS_TYPE_IPV6;
+    node->handle = sn_coap_protocol_init(bench_malloc, bench_free, bench_tx, bench_rx);
+    sn_coap_protocol_set_block_size(node->handle, BENCH_BLOCK_SIZE);
+    sn_coap_protocol_set_path_mtu(node->handle, BENCH_PATH_MTU);
+    sn_coap_protocol_set_retransmission_parameters(node->handle, BENCH_RESEND_COUNT, BENCH_RESEND_INTERVAL);
+}
+
+static void bench_deliver(bench_packet_s *pkt)
+{
+    bench_node_s *node = pkt->dst;
+    sn_coap_hdr_s *msg = sn_coap_protocol_parse(node->handle, &node->peer->addr, pkt->len, pkt->data, node);
+
+    if (msg == NULL) {
+        return;
+    }
+
+    if (node == &server && msg->msg_code == COAP_MSG_CODE_REQUEST_PUT &&
+            (msg->coap_status == COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED || msg->coap_status == COAP_STATUS_OK)) {
+        /* Whole payload is received, server answers last block */
+        uint8_t packet[BENCH_MAX_PACKET];
+        sn_coap_hdr_s *response = sn_coap_build_response(node->handle, msg,
+                                  msg->payload_len == payload_len ? COAP_MSG_CODE_RESPONSE_CHANGED : COAP_MSG_CODE_RESPONSE_BAD_REQUEST);
+        if (response) {
+            int16_t len = sn_coap_protocol_build(node->handle, &node->peer->addr, packet, response, node);
+            if (len > 0) {
+                bench_tx(packet, len, &node->peer->addr, node);
+            }
+            sn_coap_parser_release_allocated_coap_msg_mem(node->handle, response);
+        }
+    } else if (node == &client && msg->msg_type == COAP_MSG_TYPE_ACKNOWLEDGEMENT) {
+        if (msg->msg_code == COAP_MSG_CODE_RESPONSE_CHANGED) {
+            transfer_done = true;
+        } else if (msg->msg_code != COAP_MSG_CODE_RESPONSE_CONTINUE) {
+            transfer_failed = true;
+        }
+    }
+
+    if (msg->payload_ptr && msg->coap_status == COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED) {
+        /* Reassembled payload is allocated by the library */
+        bench_free(msg->payload_ptr);
+        msg->payload_ptr = NULL;
+    }
+    sn_coap_parser_release_allocated_coap_msg_mem(node->handle, msg);
+}
+
+/* Runs one transfer until it completes or fails, returns simulated time in microseconds */
+static uint64_t bench_transfer(uint8_t *payload)
+{
+    uint8_t packet[BENCH_MAX_PACKET];
+    sn_coap_hdr_s request;
+    uint64_t next_exec_us;
+
+    bench_node_init(&client, 1);
+    bench_node_init(&server, 2);
+    client.peer = &server;
+    server.peer = &client;
+    in_flight_count = 0;
+    now_us = 0;
+    transfer_done = false;
+    transfer_failed = false;
+
+    memset(&request, 0, sizeof(request));
+    request.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    request.msg_code = COAP_MSG_CODE_REQUEST_PUT;
+    request.content_format = COAP_CT_NONE;
+    request.uri_path_ptr = (uint8_t *)"fw";
+    request.uri_path_len = 2;
+    request.payload_ptr = payload;
+    request.payload_len = payload_len;
+
+    /* Block1 option is added as applications do, before building the first block */
+    int16_t len = -1;
+    if (prepare_blockwise_message(client.handle, &request) == 0) {
+        len = sn_coap_protocol_build(client.handle, &server.addr, packet, &request, &client);
+    }
+    bench_free(request.options_list_ptr);
+    if (len > 0) {
+        bench_tx(packet, len, &server.addr, &client);
+    } else {
+        transfer_failed = true;
+    }
+
+    next_exec_us = 1000000;
+    while (!transfer_done && !transfer_failed && now_us < BENCH_TIME_LIMIT_US) {
+        uint16_t first = 0;
+        for (uint16_t i = 1; i < in_flight_count; i++) {
+            if (in_flight[i].deliver_us < in_flight[first].deliver_us) {
+                first = i;
+            }
+        }
+
+        if (in_flight_count && in_flight[first].deliver_us < next_exec_us) {
+            bench_packet_s pkt = in_flight[first];
+            in_flight[first] = in_flight[--in_flight_count];
+            now_us = pkt.deliver_us;
+            bench_deliver(&pkt);
+        } else {
+            now_us = next_exec_us;
+            next_exec_us += 1000000;
+            sn_coap_protocol_exec(client.handle, (uint32_t)(now_us / 1000000));
+            sn_coap_protocol_exec(server.handle, (uint32_t)(now_us / 1000000));
+        }
+    }
+
+    sn_coap_protocol_destroy(client.handle);
+    sn_coap_protocol_destroy(server.handle);
+
+    return now_us;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t runs = 20;
+    uint8_t *payload;
+
+    payload_len = 16384;
+    if (argc > 1) {
+        payload_len = (uint16_t)atoi(argv[1]);
+    }
+    if (argc > 2) {
+        runs = (uint32_t)atoi(argv[2]);
+    }
+    if (payload_len == 0 || runs == 0) {
+        fprintf(stderr, "usage: %s [payload bytes] [runs per scenario]\n", argv[0]);
+        return 1;
+    }
+
+    payload = malloc(payload_len);
+    for (uint16_t i = 0; i < payload_len; i++) {
+        payload[i] = (uint8_t)i;
+    }
+
+    printf("Block1 PUT of %u bytes, %s block size, %u kbit/s link, %u ms one-way delay, %u runs\n",
+           payload_len, BENCH_MODE, BENCH_LINK_BPS / 1000, BENCH_LINK_DELAY_US / 1000, runs);
+    printf("%-10s %10s %10s %10s %10s %10s %8s %8s\n", "scenario", "mean s", "p90 s", "all s", "packets", "bytes", "lost %", "failed");
+
+    uint64_t *times = malloc(runs * sizeof(uint64_t));
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+        uint64_t total_us = 0;
+        uint64_t all_us = 0;
+        uint32_t completed = 0;
+        uint32_t failed = 0;
+
+        scenario = &scenarios[s];
+        sent_packets = 0;
+        sent_bytes = 0;
+        lost_packets = 0;
+        for (uint32_t run = 0; run < runs; run++) {
+            bench_seed(run + 1);
+            uint64_t time_us = bench_transfer(payload);
+            all_us += time_us;
+            if (transfer_done) {
+                times[completed++] = time_us;
+                total_us += time_us;
+            } else {
+                failed++;
+            }
+        }
+
+        printf("%-10s %10.2f %10.2f %10.2f %10u %10u %8.1f %8u\n", scenario->name,
+               completed ? total_us / 1e6 / completed : 0.0,
+               bench_percentile(times, completed, 90) / 1e6,
+               all_us / 1e6 / runs,
+               sent_packets / runs, sent_bytes / runs,
+               sent_packets ? 100.0 * lost_packets / sent_packets : 0.0, failed);
+    }
+
+    free(times);
+    free(payload);
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench_common.h"
+#include "randLIB.h"
+
+static uint64_t rand_state = 0x9e3779b97f4a7c15ULL;
+
+void *bench_malloc(uint16_t size)
+{
+    return malloc(size);
+}
+
+void bench_free(void *ptr)
+{
+    free(ptr);
+}
+
+uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void bench_seed(uint64_t seed)
+{
+    rand_state = seed ? seed : 0x9e3779b97f4a7c15ULL;
+}
+
+/* xorshift64* */
+static uint64_t bench_random_64(void)
+{
+    rand_state ^= rand_state >> 12;
+    rand_state ^= rand_state << 25;
+    rand_state ^= rand_state >> 27;
+    return rand_state * 0x2545f4914f6cdd1dULL;
+}
+
+uint32_t bench_random(void)
+{
+    return (uint32_t)(bench_random_64() >> 32);
+}
+
+double bench_random_unit(void)
+{
+    return (bench_random_64() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int bench_compare_u64(const void *a, const void *b)
+{
+    uint64_t va = *(const uint64_t *)a;
+    uint64_t vb = *(const uint64_t *)b;
+    return va < vb ? -1 : va > vb;
+}
+
+uint64_t bench_percentile(uint64_t *values, uint32_t count, uint8_t percentile)
+{
+    if (count == 0) {
+        return 0;
+    }
+    qsort(values, count, sizeof(uint64_t), bench_compare_u64);
+    return values[(uint64_t)(count - 1) * percentile / 100];
+}
+
+/* * * * randLIB functions used by the library, from the seeded generator * * * */
+
+void randLIB_seed_random(void)
+{
+}
+
+uint16_t randLIB_get_16bit(void)
+{
+    return (uint16_t)bench_random();
+}
+
+uint32_t randLIB_get_32bit(void)
+{
+    return bench_random();
+}
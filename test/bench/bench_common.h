@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file bench_common.h
+ *
+ * \brief Helpers shared by the benchmarks: allocation functions for library handles,
+ *        monotonic clock and a seeded random generator. randLIB used by the library is
+ *        implemented with the same generator, so that runs are repeatable.
+ */
+
+#ifndef BENCH_COMMON_H_
+#define BENCH_COMMON_H_
+
+#include <stdint.h>
+
+/** \brief Allocation functions given to sn_coap_protocol_init() */
+void *bench_malloc(uint16_t size);
+void bench_free(void *ptr);
+
+/** \brief Monotonic time in nanoseconds */
+uint64_t bench_now_ns(void);
+
+/** \brief Seeds generator of bench_random() and randLIB */
+void bench_seed(uint64_t seed);
+
+/** \brief Random 32-bit value */
+uint32_t bench_random(void);
+
+/** \brief Random value in [0, 1) */
+double bench_random_unit(void);
+
+/** \brief Sorts latencies and returns the given percentile, 0 - 100 */
+uint64_t bench_percentile(uint64_t *values, uint32_t count, uint8_t percentile);
+
+#endif /* BENCH_COMMON_H_ */
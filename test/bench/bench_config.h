@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BENCH_CONFIG_H
+#define BENCH_CONFIG_H
+
+/* Library configuration of the benchmarks, given with MBED_CLIENT_USER_CONFIG_FILE */
+
+#define SN_COAP_SERVER_PROFILE                  1
+#define SN_COAP_DUPLICATION_MAX_MSGS_COUNT      64
+
+/**
+ * \def SN_COAP_BLOCK_SIZE_TUNING
+ * \brief Block size tuned per peer from loss. BENCH_STATIC_BLOCK_SIZE builds
+ *        the baseline with block size selected from path MTU only.
+ */
+#ifndef BENCH_STATIC_BLOCK_SIZE
+#define SN_COAP_BLOCK_SIZE_TUNING               1
+#endif
+
+/**
+ * \def SN_COAP_BLOCKWISE_MAX_TIME_DATA_STORED
+ * \brief Transfer state is kept over all resendings of one block, which take
+ *        254 seconds with 6 resendings at 2 second interval.
+ */
+#define SN_COAP_BLOCKWISE_MAX_TIME_DATA_STORED  300
+
+#define SN_COAP_DUPLICATION_RESPONSE_CACHE_SIZE 512
+#define SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE      1024
+
+#endif
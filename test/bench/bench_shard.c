@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Request rate of a sharded server from 1 thread up to count of online cores.
+ *
+ * Each thread owns one shard and serves Confirmable GET requests of the peers routed to
+ * it: request is parsed, a piggybacked response is built and handed to the transport.
+ * Baseline is one handle shared by all threads under a mutex. Same 4096 peers are used
+ * with any count of threads, and each thread is pinned to its own core. Counts of threads
+ * above online cores are not run, as they would only measure time slicing of one core.
+ *
+ * usage: bench_shard [max threads] [milliseconds per run]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "ns_types.h"
+#include "sn_coap_header.h"
+#include "sn_coap_protocol.h"
+#include "sn_coap_shard.h"
+#include "bench_common.h"
+
+#define BENCH_PEERS                 4096
+#define BENCH_MAX_THREADS           32
+#define BENCH_EXEC_INTERVAL         4096    /* Requests between sn_coap_protocol_exec() calls */
+#define BENCH_MAX_PACKET            64
+
+typedef struct bench_peer_ {
+    sn_nsdl_addr_s      addr;
+    uint8_t             addr_bytes[16];
+} bench_peer_s;
+
+typedef struct bench_thread_ {
+    pthread_t           thread;
+    uint16_t            index;
+    struct coap_s       *handle;
+    pthread_mutex_t     *lock;          /* Lock of shared handle, NULL if handle is owned */
+    bench_peer_s        **peers;
+    uint32_t            peer_count;
+    uint64_t            requests;
+    uint64_t            responses;
+} bench_thread_s;
+
+static bench_peer_s peers[BENCH_PEERS];
+static bench_thread_s threads[BENCH_MAX_THREADS];
+static bench_peer_s *peer_lists[BENCH_MAX_THREADS][BENCH_PEERS];
+static pthread_barrier_t start_barrier;
+static volatile int running;
+static long cpu_count;
+
+static uint8_t bench_tx(uint8_t *packet_ptr, uint16_t packet_len, sn_nsdl_addr_s *dst_addr_ptr, void *param)
+{
+    (void) packet_ptr;
+    (void) packet_len;
+    (void) dst_addr_ptr;
+    (void) param;
+    return 1;
+}
+
+static int8_t bench_rx(sn_coap_hdr_s *msg_ptr, sn_nsdl_addr_s *addr_ptr, void *param)
+{
+    (void) msg_ptr;
+    (void) addr_ptr;
+    (void) param;
+    return 0;
+}
+
+/* Confirmable GET /r with one byte token */
+static uint16_t bench_request(uint8_t *packet, uint16_t msg_id, uint8_t token)
+{
+    packet[0] = 0x41;
+    packet[1] = COAP_MSG_CODE_REQUEST_GET;
+    packet[2] = (uint8_t)(msg_id >> 8);
+    packet[3] = (uint8_t)msg_id;
+    packet[4] = token;
+    packet[5] = 0xb1;
+    packet[6] = 'r';
+    return 7;
+}
+
+static void bench_serve(bench_thread_s *t, bench_peer_s *peer, uint8_t *request, uint16_t request_len)
+{
+    static const uint8_t payload[] = "21.5";
+    uint8_t response_packet[BENCH_MAX_PACKET];
+    sn_coap_hdr_s *msg;
+    sn_coap_hdr_s *response;
+
+    msg = sn_coap_protocol_parse(t->handle, &peer->addr, request_len, request, NULL);
+    if (msg == NULL) {
+        return;
+    }
+    if (msg->coap_status == COAP_STATUS_OK && msg->msg_code == COAP_MSG_CODE_REQUEST_GET) {
+        response = sn_coap_build_response(t->handle, msg, COAP_MSG_CODE_RESPONSE_CONTENT);
+        if (response) {
+            response->payload_ptr = (uint8_t *)payload;
+            response->payload_len = sizeof(payload) - 1;
+            if (sn_coap_protocol_build(t->handle, &peer->addr, response_packet, response, NULL) > 0) {
+                t->responses++;
+            }
+            response->payload_ptr = NULL;
+            sn_coap_parser_release_allocated_coap_msg_mem(t->handle, response);
+        }
+    }
+    sn_coap_parser_release_allocated_coap_msg_mem(t->handle, msg);
+}
+
+static void *bench_thread(void *arg)
+{
+    bench_thread_s *t = arg;
+    uint8_t request[BENCH_MAX_PACKET];
+    uint32_t peer_index = 0;
+    uint16_t msg_id = 0;
+
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(t->index, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+
+    pthread_barrier_wait(&start_barrier);
+
+    while (t->peer_count && __atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        bench_peer_s *peer = t->peers[peer_index];
+        uint16_t request_len = bench_request(request, msg_id, (uint8_t)peer_index);
+
+        /* Message ID advances after all peers have sent a request, so none is a duplicate */
+        if (++peer_index == t->peer_count) {
+            peer_index = 0;
+            msg_id++;
+        }
+
+        if (t->lock) {
+            pthread_mutex_lock(t->lock);
+        }
+        bench_serve(t, peer, request, request_len);
+        if (++t->requests % BENCH_EXEC_INTERVAL == 0) {
+            sn_coap_protocol_exec(t->handle, (uint32_t)(bench_now_ns() / 1000000000));
+        }
+        if (t->lock) {
+            pthread_mutex_unlock(t->lock);
+        }
+    }
+
+    return NULL;
+}
+
+/* Runs thread_count threads for duration_ms, returns requests per second */
+static double bench_run(uint16_t thread_count, bool shared, uint32_t duration_ms, uint64_t *responses)
+{
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    sn_coap_shards_s *shards;
+    uint64_t requests = 0;
+    uint64_t start_ns;
+    double elapsed_s;
+
+    shards = sn_coap_shards_init(shared ? 1 : thread_count, bench_malloc, bench_free, bench_tx, bench_rx);
+    if (shards == NULL) {
+        return 0;
+    }
+
+    memset(threads, 0, sizeof(threads));
+    for (uint16_t i = 0; i < thread_count; i++) {
+        threads[i].index = i;
+        threads[i].peers = peer_lists[i];
+        threads[i].lock = shared ? &lock : NULL;
+        threads[i].handle = sn_coap_shards_get(shards, shared ? 0 : i);
+    }
+
+    /* Peers of a thread are the ones routed to its shard */
+    for (uint32_t p = 0; p < BENCH_PEERS; p++) {
+        bench_thread_s *t = &threads[shared ? p % thread_count : sn_coap_shards_index(shards, &peers[p].addr)];
+        t->peers[t->peer_count++] = &peers[p];
+    }
+
+    pthread_barrier_init(&start_barrier, NULL, thread_count + 1);
+    running = 1;
+    for (uint16_t i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i].thread, NULL, bench_thread, &threads[i]);
+    }
+
+    pthread_barrier_wait(&start_barrier);
+    start_ns = bench_now_ns();
+    usleep(duration_ms * 1000);
+    __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+
+    *responses = 0;
+    for (uint16_t i = 0; i < thread_count; i++) {
+        pthread_join(threads[i].thread, NULL);
+        requests += threads[i].requests;
+        *responses += threads[i].responses;
+    }
+    elapsed_s = (bench_now_ns() - start_ns) / 1e9;
+
+    pthread_barrier_destroy(&start_barrier);
+    sn_coap_shards_destroy(shards);
+
+    return requests / elapsed_s;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t max_threads;
+    uint32_t duration_ms = 1000;
+    double sharded_base = 0;
+    double shared_base = 0;
+
+    cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count < 1) {
+        cpu_count = 1;
+    }
+    max_threads = cpu_count < BENCH_MAX_THREADS ? (uint32_t)cpu_count : BENCH_MAX_THREADS;
+
+    if (argc > 1) {
+        max_threads = (uint32_t)atoi(argv[1]);
+    }
+    if (argc > 2) {
+        duration_ms = (uint32_t)atoi(argv[2]);
+    }
+    if (max_threads == 0 || max_threads > BENCH_MAX_THREADS || duration_ms == 0) {
+        fprintf(stderr, "usage: %s [max threads, 1 - %u] [milliseconds per run]\n", argv[0], BENCH_MAX_THREADS);
+        return 1;
+    }
+
+    for (uint32_t p = 0; p < BENCH_PEERS; p++) {
+        peers[p].addr_bytes[0] = 0x20;
+        peers[p].addr_bytes[1] = 0x01;
+        peers[p].addr_bytes[14] = (uint8_t)(p >> 8);
+        peers[p].addr_bytes[15] = (uint8_t)p;
+        peers[p].addr.addr_ptr = peers[p].addr_bytes;
+        peers[p].addr.addr_len = sizeof(peers[p].addr_bytes);
+        peers[p].addr.port = 5683;
+        peers[p].addr.type = SN_NSDL_ADDRESS_TYPE_IPV6;
+    }
+
+    if (max_threads > cpu_count) {
+        fprintf(stderr, "only %ld cores online, running up to %ld threads\n", cpu_count, cpu_count);
+        max_threads = (uint32_t)cpu_count;
+    }
+
+    printf("Confirmable GET served with piggybacked response, %u peers, %ld cores online\n", BENCH_PEERS, cpu_count);
+    printf("%-8s %14s %8s %10s %14s %8s\n", "threads", "sharded req/s", "speedup", "efficiency", "mutex req/s", "speedup");
+
+    for (uint32_t thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+        uint64_t sharded_responses;
+        uint64_t shared_responses;
+        double sharded = bench_run(thread_count, false, duration_ms, &sharded_responses);
+        double shared = bench_run(thread_count, true, duration_ms, &shared_responses);
+
+        if (thread_count == 1) {
+            sharded_base = sharded;
+            shared_base = shared;
+        }
+        if (sharded_responses == 0 || shared_responses == 0) {
+            fprintf(stderr, "no responses built with %u threads\n", thread_count);
+            return 1;
+        }
+
+        printf("%-8u %14.0f %8.2f %9.0f%% %14.0f %8.2f\n", thread_count,
+               sharded, sharded / sharded_base, 100.0 * sharded / sharded_base / thread_count,
+               shared, shared / shared_base);
+    }
+
+    return 0;
+}
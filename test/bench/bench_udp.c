@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Loopback packet rate and latency of the UDP transport.
+ *
+ * A server thread answers Confirmable GET requests with piggybacked responses, either
+ * with sn_coap_udp transport or with a baseline calling recvfrom() and sendto() once
+ * a packet. Library work per request is the same in both. Client sends requests from
+ * 16 sockets in rounds of window requests and waits for the responses, so window 1
+ * measures round trip latency and larger windows measure packet rate. Request token
+ * carries send time, latency is measured from the token of the response.
+ *
+ * usage: bench_udp [milliseconds per run]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "ns_types.h"
+#include "sn_coap_header.h"
+#include "sn_coap_protocol.h"
+#include "sn_coap_udp.h"
+#include "bench_common.h"
+
+#define BENCH_CLIENT_SOCKETS        16
+#define BENCH_MAX_WINDOW            256
+#define BENCH_RESPONSE_TIMEOUT_MS   50
+#define BENCH_MAX_PACKET            128
+#define BENCH_MAX_LATENCIES         1000000
+
+typedef enum bench_server_type_ {
+    BENCH_SERVER_TRANSPORT,
+    BENCH_SERVER_PER_PACKET
+} bench_server_type_e;
+
+typedef struct bench_server_ {
+    bench_server_type_e type;
+    struct coap_s       *handle;
+    sn_coap_udp_s       *udp;
+    int                 socket_fd;      /* Socket of per packet server */
+    uint16_t            port;
+    pthread_t           thread;
+    volatile int        running;
+} bench_server_s;
+
+static const uint32_t windows[] = {1, 8, 64, 256};
+static const uint8_t response_payload[] = "21.5";
+static uint64_t latencies[BENCH_MAX_LATENCIES];
+
+static int8_t bench_rx(sn_coap_hdr_s *msg_ptr, sn_nsdl_addr_s *addr_ptr, void *param)
+{
+    (void) msg_ptr;
+    (void) addr_ptr;
+    (void) param;
+    return 0;
+}
+
+static uint16_t bench_build_response(struct coap_s *handle, sn_coap_hdr_s *msg, sn_nsdl_addr_s *addr, uint8_t *packet, void *param)
+{
+    sn_coap_hdr_s *response;
+    int16_t len = 0;
+
+    if (msg->coap_status != COAP_STATUS_OK || msg->msg_code != COAP_MSG_CODE_REQUEST_GET) {
+        return 0;
+    }
+    response = sn_coap_build_response(handle, msg, COAP_MSG_CODE_RESPONSE_CONTENT);
+    if (response) {
+        response->payload_ptr = (uint8_t *)response_payload;
+        response->payload_len = sizeof(response_payload) - 1;
+        len = sn_coap_protocol_build(handle, addr, packet, response, param);
+        response->payload_ptr = NULL;
+        sn_coap_parser_release_allocated_coap_msg_mem(handle, response);
+    }
+    return len > 0 ? (uint16_t)len : 0;
+}
+
+/* * * * Server with sn_coap_udp transport * * * */
+
+static void bench_transport_msg(sn_coap_udp_s *udp, sn_coap_hdr_s *msg, sn_nsdl_addr_s *addr, void *ctx)
+{
+    bench_server_s *server = ctx;
+    uint8_t packet[BENCH_MAX_PACKET];
+    uint16_t len = bench_build_response(server->handle, msg, addr, packet, udp);
+
+    if (len) {
+        sn_coap_udp_tx(packet, len, addr, udp);
+    }
+    sn_coap_parser_release_allocated_coap_msg_mem(server->handle, msg);
+}
+
+/* * * * Baseline server, one system call per packet * * * */
+
+static uint8_t bench_sendto_tx(uint8_t *packet_ptr, uint16_t packet_len, sn_nsdl_addr_s *dst_addr_ptr, void *param)
+{
+    bench_server_s *server = param;
+    struct sockaddr_in6 dst;
+
+    if (server == NULL || dst_addr_ptr->addr_len != sizeof(dst.sin6_addr)) {
+        return 0;
+    }
+    memset(&dst, 0, sizeof(dst));
+    dst.sin6_family = AF_INET6;
+    dst.sin6_port = htons(dst_addr_ptr->port);
+    memcpy(&dst.sin6_addr, dst_addr_ptr->addr_ptr, sizeof(dst.sin6_addr));
+
+    return sendto(server->socket_fd, packet_ptr, packet_len, 0, (struct sockaddr *)&dst, sizeof(dst)) == packet_len;
+}
+
+static void bench_per_packet_serve(bench_server_s *server)
+{
+    uint8_t request[BENCH_MAX_PACKET];
+    uint8_t packet[BENCH_MAX_PACKET];
+    struct sockaddr_in6 src;
+    socklen_t src_len = sizeof(src);
+    sn_nsdl_addr_s addr;
+    sn_coap_hdr_s *msg;
+    ssize_t len;
+
+    len = recvfrom(server->socket_fd, request, sizeof(request), 0, (struct sockaddr *)&src, &src_len);
+    if (len <= 0) {
+        return;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.addr_ptr = src.sin6_addr.s6_addr;
+    addr.addr_len = sizeof(src.sin6_addr);
+    addr.port = ntohs(src.sin6_port);
+    addr.type = SN_NSDL_ADDRESS_TYPE_IPV6;
+
+    msg = sn_coap_protocol_parse(server->handle, &addr, (uint16_t)len, request, server);
+    if (msg == NULL) {
+        return;
+    }
+    uint16_t response_len = bench_build_response(server->handle, msg, &addr, packet, server);
+    if (response_len) {
+        bench_sendto_tx(packet, response_len, &addr, server);
+    }
+    sn_coap_parser_release_allocated_coap_msg_mem(server->handle, msg);
+}
+
+static int bench_bind_loopback(uint16_t port)
+{
+    struct sockaddr_in6 local;
+    socklen_t local_len = sizeof(local);
+    int fd = socket(AF_INET6, SOCK_DGRAM, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&local, 0, sizeof(local));
+    local.sin6_family = AF_INET6;
+    local.sin6_addr = in6addr_loopback;
+    local.sin6_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) != 0 ||
+            getsockname(fd, (struct sockaddr *)&local, &local_len) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* * * * Server thread * * * */
+
+static void *bench_server_thread(void *arg)
+{
+    bench_server_s *server = arg;
+
+    while (__atomic_load_n(&server->running, __ATOMIC_RELAXED)) {
+        if (server->type == BENCH_SERVER_TRANSPORT) {
+            sn_coap_udp_run(server->udp, 10);
+        } else {
+            bench_per_packet_serve(server);
+        }
+    }
+    return NULL;
+}
+
+static int bench_server_start(bench_server_s *server, bench_server_type_e type)
+{
+    memset(server, 0, sizeof(bench_server_s));
+    server->type = type;
+    server->socket_fd = -1;
+
+    if (type == BENCH_SERVER_TRANSPORT) {
+        server->handle = sn_coap_protocol_init(bench_malloc, bench_free, sn_coap_udp_tx, bench_rx);
+        server->udp = server->handle ? sn_coap_udp_init(server->handle, 0, false, bench_transport_msg, server) : NULL;
+        if (server->udp == NULL) {
+            return -1;
+        }
+        server->port = sn_coap_udp_get_port(server->udp);
+    } else {
+        struct timeval timeout = {0, 10000};
+        struct sockaddr_in6 local;
+        socklen_t local_len = sizeof(local);
+
+        server->handle = sn_coap_protocol_init(bench_malloc, bench_free, bench_sendto_tx, bench_rx);
+        server->socket_fd = bench_bind_loopback(0);
+        if (server->handle == NULL || server->socket_fd < 0) {
+            return -1;
+        }
+        /* Receive returns now and then, so that thread sees when to stop */
+        setsockopt(server->socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        getsockname(server->socket_fd, (struct sockaddr *)&local, &local_len);
+        server->port = ntohs(local.sin6_port);
+    }
+
+    server->running = 1;
+    return pthread_create(&server->thread, NULL, bench_server_thread, server) == 0 ? 0 : -1;
+}
+
+static void bench_server_stop(bench_server_s *server)
+{
+    __atomic_store_n(&server->running, 0, __ATOMIC_RELAXED);
+    pthread_join(server->thread, NULL);
+    if (server->udp) {
+        sn_coap_udp_destroy(server->udp);
+    }
+    if (server->socket_fd >= 0) {
+        close(server->socket_fd);
+    }
+    sn_coap_protocol_destroy(server->handle);
+}
+
+/* * * * Client * * * */
+
+/* Confirmable GET /r with send time as 8 byte token */
+static uint16_t bench_request(uint8_t *packet, uint16_t msg_id, uint64_t send_ns)
+{
+    packet[0] = 0x48;
+    packet[1] = COAP_MSG_CODE_REQUEST_GET;
+    packet[2] = (uint8_t)(msg_id >> 8);
+    packet[3] = (uint8_t)msg_id;
+    memcpy(&packet[4], &send_ns, sizeof(send_ns));
+    packet[12] = 0xb1;
+    packet[13] = 'r';
+    return 14;
+}
+
+typedef struct bench_result_ {
+    double              responses_per_s;
+    uint64_t            p50_ns;
+    uint64_t            p99_ns;
+    uint64_t            lost;
+} bench_result_s;
+
+static int bench_client(uint16_t port, uint32_t window, uint32_t duration_ms, bench_result_s *result)
+{
+    struct pollfd fds[BENCH_CLIENT_SOCKETS];
+    struct sockaddr_in6 server_addr;
+    uint8_t requests[BENCH_MAX_WINDOW][BENCH_MAX_PACKET];
+    uint8_t responses[BENCH_MAX_WINDOW][BENCH_MAX_PACKET];
+    struct mmsghdr msgs[BENCH_MAX_WINDOW];
+    struct iovec iovs[BENCH_MAX_WINDOW];
+    uint16_t msg_ids[BENCH_CLIENT_SOCKETS] = {0};
+    uint64_t responses_total = 0;
+    uint32_t latency_count = 0;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint32_t next_socket = 0;
+
+    memset(result, 0, sizeof(bench_result_s));
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin6_family = AF_INET6;
+    server_addr.sin6_addr = in6addr_loopback;
+    server_addr.sin6_port = htons(port);
+
+    for (uint32_t i = 0; i < BENCH_CLIENT_SOCKETS; i++) {
+        fds[i].fd = bench_bind_loopback(0);
+        fds[i].events = POLLIN;
+        if (fds[i].fd < 0 || connect(fds[i].fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) != 0) {
+            return -1;
+        }
+    }
+
+    start_ns = bench_now_ns();
+    end_ns = start_ns + (uint64_t)duration_ms * 1000000;
+    while (bench_now_ns() < end_ns) {
+        uint32_t sent = 0;
+        uint32_t received = 0;
+
+        /* Round of window requests is spread over client sockets */
+        while (sent < window) {
+            uint32_t socket_index = next_socket++ % BENCH_CLIENT_SOCKETS;
+            uint32_t count = (window - sent + BENCH_CLIENT_SOCKETS - 1) / BENCH_CLIENT_SOCKETS;
+
+            for (uint32_t i = 0; i < count; i++) {
+                iovs[sent + i].iov_base = requests[sent + i];
+                iovs[sent + i].iov_len = bench_request(requests[sent + i], msg_ids[socket_index]++, bench_now_ns());
+                memset(&msgs[sent + i], 0, sizeof(struct mmsghdr));
+                msgs[sent + i].msg_hdr.msg_iov = &iovs[sent + i];
+                msgs[sent + i].msg_hdr.msg_iovlen = 1;
+            }
+            int ret = sendmmsg(fds[socket_index].fd, &msgs[sent], count, 0);
+            if (ret <= 0) {
+                break;
+            }
+            sent += ret;
+        }
+
+        while (received < sent && poll(fds, BENCH_CLIENT_SOCKETS, BENCH_RESPONSE_TIMEOUT_MS) > 0) {
+            for (uint32_t s = 0; s < BENCH_CLIENT_SOCKETS; s++) {
+                if (!(fds[s].revents & POLLIN)) {
+                    continue;
+                }
+                for (uint32_t i = 0; i < sent - received; i++) {
+                    iovs[i].iov_base = responses[i];
+                    iovs[i].iov_len = BENCH_MAX_PACKET;
+                    memset(&msgs[i], 0, sizeof(struct mmsghdr));
+                    msgs[i].msg_hdr.msg_iov = &iovs[i];
+                    msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+                int count = recvmmsg(fds[s].fd, msgs, sent - received, MSG_DONTWAIT, NULL);
+                uint64_t now_ns = bench_now_ns();
+                for (int i = 0; i < count; i++) {
+                    uint64_t send_ns;
+                    if (msgs[i].msg_len < 12 || responses[i][1] != COAP_MSG_CODE_RESPONSE_CONTENT) {
+                        continue;
+                    }
+                    memcpy(&send_ns, &responses[i][4], sizeof(send_ns));
+                    if (latency_count < BENCH_MAX_LATENCIES) {
+                        latencies[latency_count++] = now_ns - send_ns;
+                    }
+                    responses_total++;
+                }
+                if (count > 0) {
+                    received += count;
+                }
+            }
+        }
+        result->lost += sent - received;
+    }
+
+    result->responses_per_s = responses_total / ((bench_now_ns() - start_ns) / 1e9);
+    result->p50_ns = bench_percentile(latencies, latency_count, 50);
+    result->p99_ns = bench_percentile(latencies, latency_count, 99);
+
+    for (uint32_t i = 0; i < BENCH_CLIENT_SOCKETS; i++) {
+        close(fds[i].fd);
+    }
+    return 0;
+}
+
+static const char *bench_server_name(const bench_server_s *server)
+{
+    if (server->type == BENCH_SERVER_PER_PACKET) {
+        return "per packet";
+    }
+    return "transport";
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t duration_ms = 1000;
+    static const bench_server_type_e types[] = {BENCH_SERVER_TRANSPORT, BENCH_SERVER_PER_PACKET};
+
+    if (argc > 1) {
+        duration_ms = (uint32_t)atoi(argv[1]);
+    }
+    if (duration_ms == 0) {
+        fprintf(stderr, "usage: %s [milliseconds per run]\n", argv[0]);
+        return 1;
+    }
+
+    printf("Confirmable GET over IPv6 loopback, %u client sockets\n", BENCH_CLIENT_SOCKETS);
+    printf("%-12s %8s %14s %10s %10s %8s\n", "server", "window", "responses/s", "p50 us", "p99 us", "lost");
+
+    for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+            bench_server_s server;
+            bench_result_s result;
+
+            if (bench_server_start(&server, types[t]) != 0) {
+                fprintf(stderr, "failed to start server: %s\n", strerror(errno));
+                return 1;
+            }
+            int ret = bench_client(server.port, windows[w], duration_ms, &result);
+            const char *name = bench_server_name(&server);
+            bench_server_stop(&server);
+            if (ret != 0) {
+                fprintf(stderr, "failed to open client sockets: %s\n", strerror(errno));
+                return 1;
+            }
+
+            printf("%-12s %8u %14.0f %10.1f %10.1f %8llu\n", name, windows[w], result.responses_per_s,
+                   result.p50_ns / 1e3, result.p99_ns / 1e3, (unsigned long long)result.lost);
+        }
+    }
+
+    return 0;
+}
@@ -265,6 +265,74 @@ TEST(libCoap_builder, build_message_options_block2)
     CHECK( 5 == sn_coap_builder(buffer, &coap_header) );
 }
 
+TEST(libCoap_builder, build_message_options_request_tag)
+{
+    // Request-Tag follows Block1, delta 265 needs one extended byte
+    coap_header.options_list_ptr->use_request_tag = true;
+    coap_header.options_list_ptr->request_tag_len = 2;
+    coap_header.options_list_ptr->request_tag[0] = 0xab;
+    coap_header.options_list_ptr->request_tag[1] = 0xcd;
+    CHECK(sn_coap_builder(buffer, &coap_header) == 15);
+    CHECK(sn_coap_builder_calc_needed_packet_data_size(&coap_header) == 15);
+    CHECK(buffer[11] == 0xd2);
+    CHECK(buffer[12] == 0xfc);
+    CHECK(buffer[13] == 0xab);
+    CHECK(buffer[14] == 0xcd);
+
+    // Empty Request-Tag
+    coap_header.options_list_ptr->request_tag_len = 0;
+    CHECK(sn_coap_builder(buffer, &coap_header) == 13);
+    CHECK(sn_coap_builder_calc_needed_packet_data_size(&coap_header) == 13);
+
+    // Request-Tag as only option, delta 292 needs two extended bytes
+    coap_header.options_list_ptr->max_age = COAP_OPTION_MAX_AGE_DEFAULT;
+    coap_header.options_list_ptr->uri_port = COAP_OPTION_URI_PORT_NONE;
+    coap_header.options_list_ptr->observe = COAP_OBSERVE_NONE;
+    coap_header.options_list_ptr->accept = COAP_CT_NONE;
+    coap_header.options_list_ptr->block1 = COAP_OPTION_BLOCK_NONE;
+    coap_header.options_list_ptr->block2 = COAP_OPTION_BLOCK_NONE;
+    coap_header.content_format = COAP_CT_NONE;
+    coap_header.options_list_ptr->request_tag_len = 1;
+    CHECK(sn_coap_builder(buffer, &coap_header) == 8);
+    CHECK(sn_coap_builder_calc_needed_packet_data_size(&coap_header) == 8);
+    CHECK(buffer[4] == 0xe1);
+    CHECK(buffer[5] == 0x00);
+    CHECK(buffer[6] == 0x17);
+    CHECK(buffer[7] == 0xab);
+
+    coap_header.options_list_ptr->request_tag_len = 9;
+    CHECK(sn_coap_builder_calc_needed_packet_data_size(&coap_header) == 0);
+}
+
+TEST(libCoap_builder, build_message_options_q_block)
+{
+    coap_header.options_list_ptr->max_age = COAP_OPTION_MAX_AGE_DEFAULT;
+    coap_header.options_list_ptr->uri_port = COAP_OPTION_URI_PORT_NONE;
+    coap_header.options_list_ptr->observe = COAP_OBSERVE_NONE;
+    coap_header.options_list_ptr->accept = COAP_CT_NONE;
+    coap_header.content_format = COAP_CT_NONE;
+    coap_header.options_list_ptr->block1 = 0x08;
+    coap_header.options_list_ptr->block2 = 0x18;
+
+    // Q-Block1 is option 19, Q-Block2 option 31
+    coap_header.options_list_ptr->use_q_block1 = true;
+    coap_header.options_list_ptr->use_q_block2 = true;
+    CHECK(sn_coap_builder(buffer, &coap_header) == 9);
+    CHECK(sn_coap_builder_calc_needed_packet_data_size(&coap_header) == 9);
+    CHECK(buffer[4] == 0xd1);
+    CHECK(buffer[5] == 0x06);
+    CHECK(buffer[6] == 0x08);
+    CHECK(buffer[7] == 0xc1);
+    CHECK(buffer[8] == 0x18);
+
+    // Block2 (23) is built between Q-Block1 and Block1 options
+    coap_header.options_list_ptr->use_q_block2 = false;
+    CHECK(sn_coap_builder(buffer, &coap_header) == 9);
+    CHECK(sn_coap_builder_calc_needed_packet_data_size(&coap_header) == 9);
+    CHECK(buffer[7] == 0x41);
+    CHECK(buffer[8] == 0x18);
+}
+
 TEST(libCoap_builder, sn_coap_builder_calc_needed_packet_data_size)
 {
     CHECK(sn_coap_builder_calc_needed_packet_data_size(NULL) == 0);
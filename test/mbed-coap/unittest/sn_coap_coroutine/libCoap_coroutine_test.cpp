@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CppUTest/TestHarness.h"
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sn_coap_coroutine.h"
+#include "sn_coap_protocol_internal.h"
+
+static coap_s *server_handle = NULL;
+static coap_s *client_handle = NULL;
+static uint8_t client_addr_bytes[16] = {1};
+static uint8_t server_addr_bytes[16] = {2};
+static sn_nsdl_addr_s client_addr;
+static sn_nsdl_addr_s server_addr;
+static uint8_t last_packet[256];
+static uint16_t last_packet_len;
+static uint16_t tx_count;
+
+static sn_coap::executor executor;
+static sn_coap::response results[3];
+static uint8_t result_count;
+static bool flow_done;
+static bool in_library;
+static bool resumed_in_library;
+
+static void *myMalloc(uint16_t size)
+{
+    return malloc(size);
+}
+
+static void myFree(void *addr)
+{
+    if (addr) {
+        free(addr);
+    }
+}
+
+static uint8_t tx_cb(uint8_t *packet, uint16_t len, sn_nsdl_addr_s *addr, void *param)
+{
+    if (len > sizeof(last_packet)) {
+        return 0;
+    }
+    memcpy(last_packet, packet, len);
+    last_packet_len = len;
+    tx_count++;
+    return 1;
+}
+
+static int8_t null_rx_cb(sn_coap_hdr_s *a, sn_nsdl_addr_s *b, void *c)
+{
+    return 0;
+}
+
+static sn_coap::task get_then_put(sn_coap::client &client, sn_nsdl_addr_s peer)
+{
+    static const uint8_t value[] = {'4', '3'};
+
+    results[0] = co_await client.get(peer, "/3/0/1");
+    result_count++;
+    results[1] = co_await client.put(peer, "3/0/1", value, sizeof(value));
+    result_count++;
+    flow_done = true;
+}
+
+static sn_coap::task get_one(sn_coap::client &client, sn_nsdl_addr_s peer, uint8_t index)
+{
+    results[index] = co_await client.get(peer, "1");
+    result_count++;
+}
+
+static sn_coap::task get_until_response(sn_coap::client &client, sn_nsdl_addr_s peer)
+{
+    // Request is sent again from the resumed coroutine until a response arrives
+    for (uint8_t i = 0; i < 3; i++) {
+        results[i] = co_await client.get(peer, "1");
+        resumed_in_library |= in_library;
+        result_count++;
+        if (results[i]) {
+            break;
+        }
+    }
+    flow_done = true;
+}
+
+static void exec(uint32_t time)
+{
+    in_library = true;
+    sn_coap_protocol_exec(client_handle, time);
+    in_library = false;
+}
+
+/* Parses request sent by client in server, and gives response built by server to client */
+static void respond(uint8_t msg_code, const char *payload, uint8_t *uri_path_len)
+{
+    sn_coap_hdr_s *request = sn_coap_protocol_parse(server_handle, &client_addr, last_packet_len, last_packet, NULL);
+    CHECK(request != NULL);
+    *uri_path_len = request->uri_path_len;
+
+    sn_coap_hdr_s *response = sn_coap_build_response(server_handle, request, msg_code);
+    if (msg_code == COAP_MSG_CODE_EMPTY) {
+        // Empty Acknowledgement, response is sent later
+        myFree(response->token_ptr);
+        response->token_ptr = NULL;
+        response->token_len = 0;
+    }
+    response->payload_ptr = (uint8_t *)payload;
+    response->payload_len = payload ? strlen(payload) : 0;
+    CHECK(0 < sn_coap_protocol_build(server_handle, &client_addr, last_packet, response, NULL));
+    last_packet_len = sn_coap_builder_calc_needed_packet_data_size(response);
+    response->payload_ptr = NULL;
+    sn_coap_parser_release_allocated_coap_msg_mem(server_handle, response);
+    sn_coap_parser_release_allocated_coap_msg_mem(server_handle, request);
+
+    in_library = true;
+    sn_coap_hdr_s *parsed = sn_coap_protocol_parse(client_handle, &server_addr, last_packet_len, last_packet, NULL);
+    in_library = false;
+    CHECK(parsed != NULL);
+    sn_coap_parser_release_allocated_coap_msg_mem(client_handle, parsed);
+}
+
+TEST_GROUP(libCoap_coroutine)
+{
+    void setup() {
+        client_handle = sn_coap_protocol_init(myMalloc, myFree, tx_cb, null_rx_cb);
+        server_handle = sn_coap_protocol_init(myMalloc, myFree, tx_cb, null_rx_cb);
+        memset(&client_addr, 0, sizeof(client_addr));
+        client_addr.addr_ptr = client_addr_bytes;
+        client_addr.addr_len = sizeof(client_addr_bytes);
+        client_addr.port = 5683;
+        client_addr.type = SN_NSDL_ADDRESS_TYPE_IPV6;
+        server_addr = client_addr;
+        server_addr.addr_ptr = server_addr_bytes;
+        tx_count = 0;
+        result_count = 0;
+        flow_done = false;
+        in_library = false;
+        resumed_in_library = false;
+        for (uint8_t i = 0; i < 3; i++) {
+            results[i] = sn_coap::response();
+        }
+    }
+
+    void teardown() {
+        sn_coap_protocol_destroy(client_handle);
+        sn_coap_protocol_destroy(server_handle);
+    }
+};
+
+TEST(libCoap_coroutine, coroutine_resumed_with_response)
+{
+    sn_coap::client client(client_handle, executor);
+    uint8_t uri_path_len;
+
+    get_then_put(client, server_addr);
+    CHECK(1 == tx_count);
+    CHECK(0 == result_count);
+
+    // Response queues coroutine, which sends next request when resumed after parse
+    respond(COAP_MSG_CODE_RESPONSE_CONTENT, "42", &uri_path_len);
+    CHECK(5 == uri_path_len);
+    CHECK(0 == result_count);
+    CHECK(1 == tx_count);
+    CHECK(!executor.empty());
+    CHECK(1 == executor.run());
+    CHECK(executor.empty());
+    CHECK(1 == result_count);
+    CHECK(2 == tx_count);
+    CHECK(results[0]);
+    CHECK(sn_coap::response::RESPONSE == results[0].result);
+    CHECK(COAP_MSG_TYPE_ACKNOWLEDGEMENT == results[0].msg_type);
+    CHECK(COAP_MSG_CODE_RESPONSE_CONTENT == results[0].msg_code);
+    CHECK(2 == results[0].payload.size());
+    CHECK(0 == memcmp(results[0].payload.data(), "42", 2));
+    CHECK(!flow_done);
+
+    respond(COAP_MSG_CODE_RESPONSE_CHANGED, NULL, &uri_path_len);
+    CHECK(5 == uri_path_len);
+    CHECK(!flow_done);
+    CHECK(1 == executor.run());
+    CHECK(flow_done);
+    CHECK(COAP_MSG_CODE_RESPONSE_CHANGED == results[1].msg_code);
+    CHECK(results[1].payload.empty());
+}
+
+TEST(libCoap_coroutine, coroutine_resumed_without_response)
+{
+    sn_coap::client client(client_handle, executor);
+    uint8_t uri_path_len;
+    uint32_t time;
+
+    // Only two requests can be pending
+    get_one(client, server_addr, 0);
+    get_one(client, server_addr, 1);
+    get_one(client, server_addr, 2);
+    CHECK(2 == tx_count);
+    CHECK(1 == result_count);
+    CHECK(sn_coap::response::NOT_SENT == results[2].result);
+    CHECK(!results[2]);
+
+    // Second request is acknowledged, but its response never arrives
+    respond(COAP_MSG_CODE_EMPTY, NULL, &uri_path_len);
+    CHECK(0 == executor.run());
+    CHECK(1 == result_count);
+
+    // First request is not acknowledged
+    CHECK(0 == sn_coap_protocol_set_retransmission_parameters(client_handle, 1, 1));
+    for (time = 1; time < SN_COAP_CLIENT_EXCHANGE_TIMEOUT && result_count < 2; time++) {
+        exec(time);
+        executor.run();
+    }
+    CHECK(2 == result_count);
+    CHECK(sn_coap::response::SENDING_FAILED == results[0].result);
+
+    exec(SN_COAP_CLIENT_EXCHANGE_TIMEOUT);
+    CHECK(2 == result_count);
+    CHECK(1 == executor.run());
+    CHECK(3 == result_count);
+    CHECK(sn_coap::response::TIMEOUT == results[1].result);
+
+    // Reset completes the request
+    get_one(client, server_addr, 0);
+    sn_coap_hdr_s *request = sn_coap_protocol_parse(server_handle, &client_addr, last_packet_len, last_packet, NULL);
+    sn_coap_hdr_s reset;
+    memset(&reset, 0, sizeof(reset));
+    reset.msg_type = COAP_MSG_TYPE_RESET;
+    reset.msg_id = request->msg_id;
+    sn_coap_parser_release_allocated_coap_msg_mem(server_handle, request);
+    last_packet_len = sn_coap_protocol_build(server_handle, &client_addr, last_packet, &reset, NULL);
+    sn_coap_parser_release_allocated_coap_msg_mem(client_handle,
+            sn_coap_protocol_parse(client_handle, &server_addr, last_packet_len, last_packet, NULL));
+    CHECK(3 == result_count);
+    CHECK(1 == executor.run());
+    CHECK(4 == result_count);
+    CHECK(sn_coap::response::RESET == results[0].result);
+}
+
+TEST(libCoap_coroutine, coroutine_awaits_again_after_resume)
+{
+    sn_coap::client client(client_handle, executor);
+    sn_coap_stats_s stats;
+    uint8_t uri_path_len;
+
+    get_until_response(client, server_addr);
+    CHECK(1 == tx_count);
+
+    // Timeout in exec queues coroutine, which sends the request again when resumed
+    CHECK(0 == sn_coap_protocol_set_retransmission_parameters(client_handle, 0, 1));
+    exec(SN_COAP_CLIENT_EXCHANGE_TIMEOUT);
+    CHECK(0 == result_count);
+    CHECK(1 == tx_count);
+    CHECK(1 == executor.run());
+    CHECK(1 == result_count);
+    CHECK(sn_coap::response::TIMEOUT == results[0].result);
+    CHECK(2 == tx_count);
+    CHECK(0 == sn_coap_protocol_get_stats(client_handle, &stats));
+    CHECK(1 == stats.exchanges);
+
+    // Response to second request ends the flow
+    respond(COAP_MSG_CODE_RESPONSE_CONTENT, "42", &uri_path_len);
+    CHECK(!flow_done);
+    CHECK(1 == executor.run());
+    CHECK(flow_done);
+    CHECK(2 == result_count);
+    CHECK(results[1]);
+    CHECK(!resumed_in_library);
+    CHECK(0 == sn_coap_protocol_get_stats(client_handle, &stats));
+    CHECK(0 == stats.exchanges);
+}
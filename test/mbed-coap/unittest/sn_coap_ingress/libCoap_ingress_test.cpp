@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CppUTest/TestHarness.h"
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "sn_coap_protocol.h"
+#include "sn_coap_header.h"
+#include "sn_coap_protocol_internal.h"
+
+#define PRODUCER_COUNT      8
+#define PRODUCER_MSG_COUNT  2000
+
+static coap_s *handle = NULL;
+static uint8_t producer_addr_bytes[PRODUCER_COUNT][16];
+
+static void *myMalloc(uint16_t size)
+{
+    return malloc(size);
+}
+
+static void myFree(void *addr)
+{
+    if (addr) {
+        free(addr);
+    }
+}
+
+static uint8_t null_tx_cb(uint8_t *a, uint16_t b, sn_nsdl_addr_s *c, void *d)
+{
+    return 0;
+}
+
+static int8_t null_rx_cb(sn_coap_hdr_s *a, sn_nsdl_addr_s *b, void *c)
+{
+    return 0;
+}
+
+/* Builds Non-confirmable POST with producer and message index as payload */
+static uint16_t build_post(uint8_t *packet, uint16_t msg_id, const uint8_t *payload, uint16_t payload_len)
+{
+    sn_coap_hdr_s msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    msg.msg_code = COAP_MSG_CODE_REQUEST_POST;
+    msg.msg_id = msg_id;
+    msg.content_format = COAP_CT_NONE;
+    msg.uri_path_ptr = (uint8_t *)"q";
+    msg.uri_path_len = 1;
+    msg.payload_ptr = (uint8_t *)payload;
+    msg.payload_len = payload_len;
+
+    return (uint16_t)sn_coap_builder(packet, &msg);
+}
+
+static void *producer(void *arg)
+{
+    uint8_t index = (uint8_t)(uintptr_t)arg;
+    sn_nsdl_addr_s addr;
+    uint8_t packet[32];
+    uint8_t payload[3];
+
+    memset(&addr, 0, sizeof(addr));
+    addr.addr_ptr = producer_addr_bytes[index];
+    addr.addr_len = sizeof(producer_addr_bytes[index]);
+    addr.port = 5683 + index;
+    addr.type = SN_NSDL_ADDRESS_TYPE_IPV6;
+
+    for (uint16_t i = 0; i < PRODUCER_MSG_COUNT; i++) {
+        payload[0] = index;
+        payload[1] = i >> 8;
+        payload[2] = i & 0xff;
+        uint16_t len = build_post(packet, i, payload, sizeof(payload));
+
+        int8_t ret;
+        while ((ret = sn_coap_protocol_ingress_submit(handle, &addr, len, packet, (void *)(uintptr_t)index)) == -1) {
+            sched_yield();
+        }
+        if (ret != 0) {
+            return (void *)1;
+        }
+        /* Packet buffer is reused for next message while this one may still be queued */
+        memset(packet, 0xff, sizeof(packet));
+    }
+    return NULL;
+}
+
+TEST_GROUP(libCoap_ingress)
+{
+    void setup() {
+        handle = sn_coap_protocol_init(myMalloc, myFree, null_tx_cb, null_rx_cb);
+        for (uint8_t i = 0; i < PRODUCER_COUNT; i++) {
+            memset(producer_addr_bytes[i], 0, sizeof(producer_addr_bytes[i]));
+            producer_addr_bytes[i][15] = i + 1;
+        }
+    }
+
+    void teardown() {
+        sn_coap_protocol_destroy(handle);
+    }
+};
+
+TEST(libCoap_ingress, payload_kept_after_packet_overwritten)
+{
+    static const uint8_t value[] = {'4', '2', '4', '2'};
+    sn_nsdl_addr_s addr;
+    sn_nsdl_addr_s *src_addr_ptr = NULL;
+    void *param = NULL;
+    uint8_t packet[32];
+
+    CHECK(0 == sn_coap_protocol_set_ingress_queue_size(handle, 4));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.addr_ptr = producer_addr_bytes[0];
+    addr.addr_len = sizeof(producer_addr_bytes[0]);
+    addr.port = 5683;
+    addr.type = SN_NSDL_ADDRESS_TYPE_IPV6;
+
+    uint16_t len = build_post(packet, 1, value, sizeof(value));
+    CHECK(0 == sn_coap_protocol_ingress_submit(handle, &addr, len, packet, &addr));
+
+    // Producer reuses its buffer before owner thread takes the message
+    memset(packet, 0xff, sizeof(packet));
+
+    sn_coap_hdr_s *msg = sn_coap_protocol_ingress_process(handle, &src_addr_ptr, &param);
+    CHECK(msg != NULL);
+    CHECK(param == &addr);
+    CHECK(5683 == src_addr_ptr->port);
+    CHECK(COAP_MSG_CODE_REQUEST_POST == msg->msg_code);
+    CHECK(sizeof(value) == msg->payload_len);
+    CHECK(msg->payload_ptr < packet || msg->payload_ptr >= packet + sizeof(packet));
+    CHECK(0 == memcmp(msg->payload_ptr, value, sizeof(value)));
+    sn_coap_parser_release_allocated_coap_msg_mem(handle, msg);
+
+    CHECK(NULL == sn_coap_protocol_ingress_process(handle, &src_addr_ptr, &param));
+}
+
+TEST(libCoap_ingress, every_message_received_once_from_producer_threads)
+{
+    static uint8_t received[PRODUCER_COUNT][PRODUCER_MSG_COUNT];
+    pthread_t threads[PRODUCER_COUNT];
+    sn_nsdl_addr_s *src_addr_ptr;
+    void *param;
+    uint32_t received_count = 0;
+    uint32_t duplicate_count = 0;
+    uint32_t invalid_count = 0;
+
+    // Queue smaller than message count, producers have to wait for owner thread
+    CHECK(0 == sn_coap_protocol_set_ingress_queue_size(handle, 64));
+    memset(received, 0, sizeof(received));
+
+    for (uint8_t i = 0; i < PRODUCER_COUNT; i++) {
+        CHECK(0 == pthread_create(&threads[i], NULL, producer, (void *)(uintptr_t)i));
+    }
+
+    while (received_count + duplicate_count + invalid_count < PRODUCER_COUNT * PRODUCER_MSG_COUNT) {
+        sn_coap_hdr_s *msg = sn_coap_protocol_ingress_process(handle, &src_addr_ptr, &param);
+        if (msg == NULL) {
+            sched_yield();
+            continue;
+        }
+
+        uint8_t index = (uint8_t)(uintptr_t)param;
+        if (index >= PRODUCER_COUNT || msg->payload_len != 3 || msg->payload_ptr[0] != index ||
+                src_addr_ptr->port != 5683 + index || src_addr_ptr->addr_ptr[15] != index + 1) {
+            invalid_count++;
+        } else {
+            uint16_t msg_index = (msg->payload_ptr[1] << 8) | msg->payload_ptr[2];
+            if (msg_index != msg->msg_id || msg_index >= PRODUCER_MSG_COUNT) {
+                invalid_count++;
+            } else if (received[index][msg_index]++) {
+                duplicate_count++;
+            } else {
+                received_count++;
+            }
+        }
+        sn_coap_parser_release_allocated_coap_msg_mem(handle, msg);
+    }
+
+    for (uint8_t i = 0; i < PRODUCER_COUNT; i++) {
+        void *thread_ret;
+        CHECK(0 == pthread_join(threads[i], &thread_ret));
+        CHECK(NULL == thread_ret);
+    }
+
+    CHECK(0 == invalid_count);
+    CHECK(0 == duplicate_count);
+    CHECK(PRODUCER_COUNT * PRODUCER_MSG_COUNT == received_count);
+    CHECK(NULL == sn_coap_protocol_ingress_process(handle, &src_addr_ptr, &param));
+}
+
+static pthread_t owner_thread;
+static uint8_t last_packet[64];
+static uint16_t last_packet_len;
+static uint32_t tx_count;
+static uint32_t tx_foreign_count;
+static uint8_t sent[PRODUCER_COUNT][PRODUCER_MSG_COUNT];
+static uint8_t sent_msg_ids[UINT16_MAX + 1];
+
+static uint8_t tx_cb(uint8_t *packet, uint16_t len, sn_nsdl_addr_s *addr, void *param)
+{
+    if (!pthread_equal(pthread_self(), owner_thread)) {
+        tx_foreign_count++;
+    }
+    if (len <= sizeof(last_packet)) {
+        memcpy(last_packet, packet, len);
+        last_packet_len = len;
+    }
+    tx_count++;
+    return 1;
+}
+
+/* Records Non-confirmable POST sent for egress producer, payload ends the packet */
+static uint8_t producer_tx_cb(uint8_t *packet, uint16_t len, sn_nsdl_addr_s *addr, void *param)
+{
+    uint8_t index = (uint8_t)(uintptr_t)param;
+
+    tx_cb(packet, len, addr, param);
+    if (index < PRODUCER_COUNT && len > 3 && packet[len - 3] == index && addr->port == 5683 + index &&
+            addr->addr_ptr[15] == index + 1) {
+        uint16_t msg_index = (packet[len - 2] << 8) | packet[len - 1];
+        if (msg_index < PRODUCER_MSG_COUNT) {
+            sent[index][msg_index]++;
+        }
+    }
+    sent_msg_ids[(packet[2] << 8) | packet[3]]++;
+    return 1;
+}
+
+static void *egress_producer(void *arg)
+{
+    uint8_t index = (uint8_t)(uintptr_t)arg;
+    sn_nsdl_addr_s addr;
+    sn_coap_hdr_s msg;
+    uint8_t payload[3];
+
+    memset(&addr, 0, sizeof(addr));
+    addr.addr_ptr = producer_addr_bytes[index];
+    addr.addr_len = sizeof(producer_addr_bytes[index]);
+    addr.port = 5683 + index;
+    addr.type = SN_NSDL_ADDRESS_TYPE_IPV6;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    msg.msg_code = COAP_MSG_CODE_REQUEST_POST;
+    msg.content_format = COAP_CT_NONE;
+    msg.uri_path_ptr = (uint8_t *)"q";
+    msg.uri_path_len = 1;
+    msg.payload_ptr = payload;
+    msg.payload_len = sizeof(payload);
+
+    for (uint16_t i = 0; i < PRODUCER_MSG_COUNT; i++) {
+        payload[0] = index;
+        payload[1] = i >> 8;
+        payload[2] = i & 0xff;
+
+        int8_t ret;
+        while ((ret = sn_coap_protocol_egress_submit(handle, &addr, &msg, (void *)(uintptr_t)index)) == -1) {
+            sched_yield();
+        }
+        if (ret != 0 || msg.msg_id != 0) {
+            return (void *)1;
+        }
+    }
+    return NULL;
+}
+
+TEST_GROUP(libCoap_egress)
+{
+    sn_nsdl_addr_s addr;
+
+    void setup() {
+        handle = sn_coap_protocol_init(myMalloc, myFree, tx_cb, null_rx_cb);
+        owner_thread = pthread_self();
+        for (uint8_t i = 0; i < PRODUCER_COUNT; i++) {
+            memset(producer_addr_bytes[i], 0, sizeof(producer_addr_bytes[i]));
+            producer_addr_bytes[i][15] = i + 1;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.addr_ptr = producer_addr_bytes[0];
+        addr.addr_len = sizeof(producer_addr_bytes[0]);
+        addr.port = 5683;
+        addr.type = SN_NSDL_ADDRESS_TYPE_IPV6;
+        last_packet_len = 0;
+        tx_count = 0;
+        tx_foreign_count = 0;
+    }
+
+    void teardown() {
+        sn_coap_protocol_destroy(handle);
+    }
+};
+
+TEST(libCoap_egress, message_id_assigned_and_stored_when_sent)
+{
+    uint8_t value[] = {'4', '2'};
+    sn_coap_stats_s stats;
+    sn_coap_hdr_s msg;
+
+    CHECK(-1 == sn_coap_protocol_egress_submit(handle, &addr, &msg, NULL));
+    CHECK(0 == sn_coap_protocol_set_egress_queue_size(handle, 4));
+    CHECK(0 == sn_coap_protocol_egress_process(handle));
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    msg.msg_code = COAP_MSG_CODE_REQUEST_PUT;
+    msg.content_format = COAP_CT_NONE;
+    msg.uri_path_ptr = (uint8_t *)"q";
+    msg.uri_path_len = 1;
+    msg.payload_ptr = value;
+    msg.payload_len = sizeof(value);
+    CHECK(0 == sn_coap_protocol_egress_submit(handle, &addr, &msg, NULL));
+    CHECK(0 == msg.msg_id);
+
+    // Producer reuses its payload before owner thread sends the message
+    value[0] = 'x';
+    CHECK(0 == tx_count);
+
+    uint16_t msg_id = handle->message_id;
+    CHECK(1 == sn_coap_protocol_egress_process(handle));
+    CHECK(1 == tx_count);
+    CHECK(msg_id == ((last_packet[2] << 8) | last_packet[3]));
+    CHECK('4' == last_packet[last_packet_len - 2]);
+    CHECK(0 == sn_coap_protocol_get_stats(handle, &stats));
+    CHECK(1 == stats.resent_msgs);
+
+    // Acknowledgement of the message removes it from re-sending queue
+    sn_coap_hdr_s ack;
+    uint8_t packet[8];
+    memset(&ack, 0, sizeof(ack));
+    ack.msg_type = COAP_MSG_TYPE_ACKNOWLEDGEMENT;
+    ack.msg_id = msg_id;
+    uint16_t len = sn_coap_builder(packet, &ack);
+    sn_coap_parser_release_allocated_coap_msg_mem(handle, sn_coap_protocol_parse(handle, &addr, len, packet, NULL));
+    CHECK(0 == sn_coap_protocol_get_stats(handle, &stats));
+    CHECK(0 == stats.resent_msgs);
+
+    // Given Message ID is kept, queue holds only its size
+    msg.msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    for (uint8_t i = 0; i < 4; i++) {
+        msg.msg_id = 100 + i;
+        CHECK(0 == sn_coap_protocol_egress_submit(handle, &addr, &msg, NULL));
+    }
+    CHECK(-1 == sn_coap_protocol_egress_submit(handle, &addr, &msg, NULL));
+    CHECK(4 == sn_coap_protocol_egress_process(handle));
+    CHECK(5 == tx_count);
+    CHECK(103 == ((last_packet[2] << 8) | last_packet[3]));
+    CHECK(msg_id + 1 == handle->message_id);
+
+    // Messages left in queue are released without sending
+    CHECK(0 == sn_coap_protocol_egress_submit(handle, &addr, &msg, NULL));
+    CHECK(0 == sn_coap_protocol_set_egress_queue_size(handle, 0));
+    CHECK(5 == tx_count);
+}
+
+TEST(libCoap_egress, every_message_sent_once_by_owner_thread)
+{
+    pthread_t threads[PRODUCER_COUNT];
+    uint32_t duplicate_count = 0;
+    uint32_t missing_count = 0;
+
+    sn_coap_protocol_destroy(handle);
+    handle = sn_coap_protocol_init(myMalloc, myFree, producer_tx_cb, null_rx_cb);
+
+    // Queue smaller than message count, producers have to wait for owner thread
+    CHECK(0 == sn_coap_protocol_set_egress_queue_size(handle, 64));
+    memset(sent, 0, sizeof(sent));
+    memset(sent_msg_ids, 0, sizeof(sent_msg_ids));
+
+    for (uint8_t i = 0; i < PRODUCER_COUNT; i++) {
+        CHECK(0 == pthread_create(&threads[i], NULL, egress_producer, (void *)(uintptr_t)i));
+    }
+
+    while (tx_count < PRODUCER_COUNT * PRODUCER_MSG_COUNT) {
+        if (sn_coap_protocol_egress_process(handle) == 0) {
+            sched_yield();
+        }
+    }
+
+    for (uint8_t i = 0; i < PRODUCER_COUNT; i++) {
+        void *thread_ret;
+        CHECK(0 == pthread_join(threads[i], &thread_ret));
+        CHECK(NULL == thread_ret);
+    }
+
+    for (uint8_t i = 0; i < PRODUCER_COUNT; i++) {
+        for (uint16_t j = 0; j < PRODUCER_MSG_COUNT; j++) {
+            if (sent[i][j] == 0) {
+                missing_count++;
+            } else if (sent[i][j] > 1) {
+                duplicate_count++;
+            }
+        }
+    }
+    for (uint32_t i = 0; i <= UINT16_MAX; i++) {
+        if (sent_msg_ids[i] > 1) {
+            duplicate_count++;
+        }
+    }
+
+    CHECK(0 == tx_foreign_count);
+    CHECK(0 == missing_count);
+    CHECK(0 == duplicate_count);
+    CHECK(0 == sn_coap_protocol_egress_process(handle));
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEST_CONFIG_H
+#define TEST_CONFIG_H
+
+/**
+ * \def SN_COAP_INGRESS_QUEUE_MAX_SIZE
+ * \brief Producer threads submit received messages to ingress queue
+ */
+#define SN_COAP_INGRESS_QUEUE_MAX_SIZE  256
+
+/**
+ * \def SN_COAP_EGRESS_QUEUE_MAX_SIZE
+ * \brief Producer threads submit outgoing messages to egress queue
+ */
+#define SN_COAP_EGRESS_QUEUE_MAX_SIZE   256
+
+#endif
@@ -45,6 +45,16 @@ TEST(sn_coap_parser, test_sn_coap_parser_parsing)
     CHECK(test_sn_coap_parser_parsing());
 }
 
+TEST(sn_coap_parser, test_sn_coap_parser_request_tag)
+{
+    CHECK(test_sn_coap_parser_request_tag());
+}
+
+TEST(sn_coap_parser, test_sn_coap_parser_q_block)
+{
+    CHECK(test_sn_coap_parser_q_block());
+}
+
 TEST(sn_coap_parser, test_sn_coap_parser_release_allocated_coap_msg_mem)
 {
     CHECK(test_sn_coap_parser_release_allocated_coap_msg_mem());
@@ -951,6 +951,89 @@ end3:
     return ret;
 }
 
+bool test_sn_coap_parser_request_tag()
+{
+    bool ret = true;
+    struct coap_s* coap = (struct coap_s*)malloc(sizeof(struct coap_s));
+    coap->sn_coap_protocol_malloc = myMalloc;
+    coap->sn_coap_protocol_free = myFree;
+    coap_version_e* ver = (coap_version_e*)malloc(sizeof(coap_version_e));
+
+    // PUT with Block1 and Request-Tag, which has delta 265 from Block1
+    uint8_t packet[] = {0x40, 0x03, 0x00, 0x01, 0xd1, 0x0e, 0x08, 0xd2, 0xfc, 0xab, 0xcd, 0xff, 0x01};
+    retCounter = 4;
+    sn_coap_hdr_s *hdr = sn_coap_parser(coap, sizeof(packet), packet, ver);
+    if (!hdr || hdr->coap_status != COAP_STATUS_OK || !hdr->options_list_ptr->use_request_tag ||
+            hdr->options_list_ptr->request_tag_len != 2 || hdr->options_list_ptr->request_tag[0] != 0xab ||
+            hdr->options_list_ptr->request_tag[1] != 0xcd || hdr->options_list_ptr->block1 != 0x08 || hdr->payload_len != 1) {
+        ret = false;
+    }
+    sn_coap_parser_release_allocated_coap_msg_mem(coap, hdr);
+
+    // Empty Request-Tag is not the same as no Request-Tag
+    uint8_t empty_tag_packet[] = {0x40, 0x03, 0x00, 0x01, 0xd1, 0x0e, 0x08, 0xd0, 0xfc};
+    retCounter = 4;
+    hdr = sn_coap_parser(coap, sizeof(empty_tag_packet), empty_tag_packet, ver);
+    if (!hdr || hdr->coap_status != COAP_STATUS_OK || !hdr->options_list_ptr->use_request_tag ||
+            hdr->options_list_ptr->request_tag_len != 0) {
+        ret = false;
+    }
+    sn_coap_parser_release_allocated_coap_msg_mem(coap, hdr);
+
+    // Repeated Request-Tag and Request-Tag over packet end are errors
+    uint8_t repeated_packet[] = {0x40, 0x03, 0x00, 0x01, 0xe1, 0x00, 0x17, 0x01, 0x01, 0x02};
+    retCounter = 4;
+    hdr = sn_coap_parser(coap, sizeof(repeated_packet), repeated_packet, ver);
+    if (!hdr || hdr->coap_status != COAP_STATUS_PARSER_ERROR_IN_HEADER) {
+        ret = false;
+    }
+    sn_coap_parser_release_allocated_coap_msg_mem(coap, hdr);
+
+    retCounter = 4;
+    hdr = sn_coap_parser(coap, sizeof(repeated_packet) - 3, repeated_packet, ver);
+    if (!hdr || hdr->coap_status != COAP_STATUS_PARSER_ERROR_IN_HEADER) {
+        ret = false;
+    }
+    sn_coap_parser_release_allocated_coap_msg_mem(coap, hdr);
+
+    free(ver);
+    free(coap);
+    return ret;
+}
+
+bool test_sn_coap_parser_q_block()
+{
+    bool ret = true;
+    struct coap_s* coap = (struct coap_s*)malloc(sizeof(struct coap_s));
+    coap->sn_coap_protocol_malloc = myMalloc;
+    coap->sn_coap_protocol_free = myFree;
+    coap_version_e* ver = (coap_version_e*)malloc(sizeof(coap_version_e));
+
+    // NON PUT with Q-Block1 and Q-Block2
+    uint8_t packet[] = {0x50, 0x03, 0x00, 0x01, 0xd1, 0x06, 0x08, 0xc1, 0x18};
+    retCounter = 4;
+    sn_coap_hdr_s *hdr = sn_coap_parser(coap, sizeof(packet), packet, ver);
+    if (!hdr || hdr->coap_status != COAP_STATUS_OK || !hdr->options_list_ptr->use_q_block1 ||
+            hdr->options_list_ptr->block1 != 0x08 || !hdr->options_list_ptr->use_q_block2 ||
+            hdr->options_list_ptr->block2 != 0x18) {
+        ret = false;
+    }
+    sn_coap_parser_release_allocated_coap_msg_mem(coap, hdr);
+
+    // Block1 and Q-Block1 must not be used together
+    uint8_t both_packet[] = {0x50, 0x03, 0x00, 0x01, 0xd1, 0x06, 0x08, 0x81, 0x18};
+    retCounter = 4;
+    hdr = sn_coap_parser(coap, sizeof(both_packet), both_packet, ver);
+    if (!hdr || hdr->coap_status != COAP_STATUS_PARSER_ERROR_IN_HEADER) {
+        ret = false;
+    }
+    sn_coap_parser_release_allocated_coap_msg_mem(coap, hdr);
+
+    free(ver);
+    free(coap);
+    return ret;
+}
+
 bool test_sn_coap_parser_release_allocated_coap_msg_mem()
 {
     struct coap_s* coap = (struct coap_s*)malloc(sizeof(struct coap_s));
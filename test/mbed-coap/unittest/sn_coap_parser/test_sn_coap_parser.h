@@ -23,6 +23,10 @@ bool test_sn_coap_parser_options_parse_multiple_options();
 bool test_sn_coap_parser_parsing();
 //<- split
 
+bool test_sn_coap_parser_request_tag();
+
+bool test_sn_coap_parser_q_block();
+
 bool test_sn_coap_parser_release_allocated_coap_msg_mem();
 
 
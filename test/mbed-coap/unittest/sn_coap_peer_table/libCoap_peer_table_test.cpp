@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CppUTest/TestHarness.h"
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sn_coap_peer_table_internal.h"
+
+static int retCounter = 0;
+static sn_coap_peer_table_s table;
+static uint8_t addr_bytes[16];
+static sn_nsdl_addr_s addr;
+
+static void *myMalloc(uint16_t size)
+{
+    if (retCounter > 0) {
+        retCounter--;
+        return malloc(size);
+    } else {
+        return NULL;
+    }
+}
+
+static void myFree(void *addr)
+{
+    if (addr) {
+        free(addr);
+    }
+}
+
+static void set_addr(uint32_t n)
+{
+    addr_bytes[12] = n >> 24;
+    addr_bytes[13] = n >> 16;
+    addr_bytes[14] = n >> 8;
+    addr_bytes[15] = n;
+}
+
+TEST_GROUP(libCoap_peer_table)
+{
+    void setup() {
+        retCounter = 1000;
+        sn_coap_peer_table_init(&table, myMalloc, myFree, 4, 0);
+        memset(addr_bytes, 1, sizeof(addr_bytes));
+        memset(&addr, 0, sizeof(addr));
+        addr.addr_ptr = addr_bytes;
+        addr.addr_len = 16;
+        addr.port = 5683;
+        addr.type = SN_NSDL_ADDRESS_TYPE_IPV6;
+    }
+
+    void teardown() {
+        sn_coap_peer_table_destroy(&table);
+        retCounter = 0;
+    }
+};
+
+TEST(libCoap_peer_table, intern_and_find)
+{
+    CHECK(0 == sn_coap_peer_table_find(&table, &addr));
+
+    uint32_t id = sn_coap_peer_table_intern(&table, &addr, 0);
+    CHECK(0 != id);
+    CHECK(id == sn_coap_peer_table_intern(&table, &addr, 1));
+    CHECK(id == sn_coap_peer_table_find(&table, &addr));
+    CHECK(1 == table.peer_count);
+
+    sn_nsdl_addr_s *stored = sn_coap_peer_table_get_addr(&table, id);
+    CHECK(stored->addr_ptr != addr.addr_ptr);
+    CHECK(0 == memcmp(stored->addr_ptr, addr_bytes, 16));
+    CHECK(5683 == stored->port);
+
+    // Per peer state starts from zero
+    sn_coap_peer_s *peer = sn_coap_peer_table_get_peer(&table, id);
+    CHECK(&peer->addr == stored);
+    CHECK(0 == peer->block_size);
+
+    // Port and address type are part of peer identity
+    addr.port++;
+    CHECK(0 == sn_coap_peer_table_find(&table, &addr));
+    CHECK(id != sn_coap_peer_table_intern(&table, &addr, 0));
+    addr.type = SN_NSDL_ADDRESS_TYPE_IPV4;
+    addr.addr_len = 4;
+    CHECK(0 == sn_coap_peer_table_find(&table, &addr));
+
+    // Too long addresses are not interned
+    uint8_t long_addr[SN_COAP_PEER_MAX_ADDR_LEN + 1];
+    memset(long_addr, 'a', sizeof(long_addr));
+    addr.addr_ptr = long_addr;
+    addr.addr_len = sizeof(long_addr);
+    CHECK(0 == sn_coap_peer_table_intern(&table, &addr, 0));
+}
+
+TEST(libCoap_peer_table, out_of_memory)
+{
+    retCounter = 0;
+    CHECK(0 == sn_coap_peer_table_intern(&table, &addr, 0));
+    retCounter = 1;
+    CHECK(0 == sn_coap_peer_table_intern(&table, &addr, 0));
+    CHECK(NULL == table.chunks);
+    retCounter = 3;
+    CHECK(0 == sn_coap_peer_table_intern(&table, &addr, 0));
+    CHECK(0 == table.peer_count);
+    retCounter = 1;
+    CHECK(0 != sn_coap_peer_table_intern(&table, &addr, 0));
+}
+
+TEST(libCoap_peer_table, lru_peer_replaced_when_full)
+{
+    uint32_t ids[5];
+    uint32_t i;
+
+    for (i = 0; i < 4; i++) {
+        set_addr(i);
+        ids[i] = sn_coap_peer_table_intern(&table, &addr, i);
+    }
+    sn_coap_peer_table_ref(&table, ids[0]);
+
+    // Peer 1 is least recently used unreferenced peer
+    set_addr(4);
+    ids[4] = sn_coap_peer_table_intern(&table, &addr, 4);
+    CHECK(ids[1] == ids[4]);
+    CHECK(4 == table.peer_count);
+    set_addr(1);
+    CHECK(0 == sn_coap_peer_table_find(&table, &addr));
+    set_addr(0);
+    CHECK(ids[0] == sn_coap_peer_table_find(&table, &addr));
+
+    // Table full of referenced peers
+    for (i = 1; i < 4; i++) {
+        sn_coap_peer_table_ref(&table, ids[i == 1 ? 4 : i]);
+    }
+    set_addr(5);
+    CHECK(0 == sn_coap_peer_table_intern(&table, &addr, 5));
+
+    sn_coap_peer_table_unref(&table, ids[2], 6);
+    CHECK(ids[2] == sn_coap_peer_table_intern(&table, &addr, 6));
+}
+
+TEST(libCoap_peer_table, idle_peers_removed)
+{
+    CHECK(0 == sn_coap_peer_table_set_size(&table, 4, 10));
+
+    set_addr(1);
+    uint32_t id1 = sn_coap_peer_table_intern(&table, &addr, 0);
+    set_addr(2);
+    CHECK(0 != sn_coap_peer_table_intern(&table, &addr, 5));
+    sn_coap_peer_table_ref(&table, id1);
+
+    sn_coap_peer_table_remove_idle(&table, 16);
+    CHECK(1 == table.peer_count);
+    CHECK(0 == sn_coap_peer_table_find(&table, &addr));
+
+    // Referenced peer stays, idle time starts when last reference is removed
+    sn_coap_peer_table_unref(&table, id1, 20);
+    sn_coap_peer_table_remove_idle(&table, 30);
+    CHECK(1 == table.peer_count);
+    sn_coap_peer_table_remove_idle(&table, 31);
+    CHECK(0 == table.peer_count);
+
+    // Released slot is reused
+    CHECK(id1 == sn_coap_peer_table_intern(&table, &addr, 31));
+    CHECK(2 == table.slot_count);
+}
+
+TEST(libCoap_peer_table, resize_keeps_ids)
+{
+    uint32_t ids[4];
+    uint32_t i;
+
+    for (i = 0; i < 4; i++) {
+        set_addr(i);
+        ids[i] = sn_coap_peer_table_intern(&table, &addr, 0);
+    }
+
+    CHECK(-1 == sn_coap_peer_table_set_size(&table, 3, 0));
+    retCounter = 0;
+    CHECK(-1 == sn_coap_peer_table_set_size(&table, 2000, 0));
+    CHECK(4 == table.max_peers);
+
+    retCounter = 1000;
+    CHECK(0 == sn_coap_peer_table_set_size(&table, 2000, 0));
+    CHECK(2048 == table.bucket_count);
+    for (i = 0; i < 4; i++) {
+        set_addr(i);
+        CHECK(ids[i] == sn_coap_peer_table_find(&table, &addr));
+    }
+
+    CHECK(0 == sn_coap_peer_table_set_size(&table, 4, 0));
+    set_addr(3);
+    CHECK(ids[3] == sn_coap_peer_table_find(&table, &addr));
+}
+
+TEST(libCoap_peer_table, hundred_thousand_peers)
+{
+    const uint32_t count = 100000;
+    uint32_t i;
+
+    CHECK(0 == sn_coap_peer_table_set_size(&table, count, 0));
+    for (i = 0; i < count; i++) {
+        set_addr(i);
+        uint32_t id = sn_coap_peer_table_intern(&table, &addr, i);
+        CHECK(i + 1 == id);
+        sn_coap_peer_table_ref(&table, id);
+    }
+    CHECK(count == table.peer_count);
+
+    for (i = 0; i < count; i += 997) {
+        set_addr(i);
+        CHECK(i + 1 == sn_coap_peer_table_find(&table, &addr));
+        CHECK(0 == memcmp(sn_coap_peer_table_get_addr(&table, i + 1)->addr_ptr, addr_bytes, 16));
+    }
+
+    set_addr(count);
+    CHECK(0 == sn_coap_peer_table_intern(&table, &addr, count));
+}
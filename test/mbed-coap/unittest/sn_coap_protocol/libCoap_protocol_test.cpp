@@ -78,13 +78,21 @@ TEST(libCoap_protocol, sn_coap_protocol_destroy)
     handle->sn_coap_protocol_free = &myFree;
     handle->sn_coap_protocol_malloc = &myMalloc;
     ns_list_init(&handle->linked_list_resent_msgs);
+#if SN_COAP_SERVER_PROFILE
+    handle->resent_msgs_hash = NULL;
+#endif
+    handle->tx_batch = NULL;
     coap_send_msg_s *msg_ptr = (coap_send_msg_s*)malloc(sizeof(coap_send_msg_s));
     memset(msg_ptr, 0, sizeof(coap_send_msg_s));
     msg_ptr->send_msg_ptr = (sn_nsdl_transmit_s*)malloc(sizeof(sn_nsdl_transmit_s));
     memset(msg_ptr->send_msg_ptr, 0 , sizeof(sn_nsdl_transmit_s));
 
     ns_list_add_to_end(&handle->linked_list_resent_msgs, msg_ptr);
-#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT
+#if SN_COAP_SERVER_PROFILE
+    handle->duplication_ring = NULL;
+    handle->duplication_slots = NULL;
+    handle->duplication_responses = NULL;
+#elif SN_COAP_DUPLICATION_MAX_MSGS_COUNT
     ns_list_init(&handle->linked_list_duplication_msgs);
 #endif
 #if SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
@@ -147,6 +155,164 @@ TEST(libCoap_protocol, sn_coap_protocol_set_retransmission_buffer)
     CHECK( -1 == sn_coap_protocol_set_retransmission_buffer(coap_handle,3,999) );
 }
 
+TEST(libCoap_protocol, sn_coap_protocol_set_limits_2)
+{
+#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT
+    CHECK( 0 == sn_coap_protocol_set_duplicate_buffer_size_2(coap_handle, SN_COAP_MAX_ALLOWED_DUPLICATION_MESSAGE_COUNT) );
+    CHECK( -1 == sn_coap_protocol_set_duplicate_buffer_size_2(NULL, 3) );
+#endif
+#if ENABLE_RESENDINGS
+    CHECK( 0 == sn_coap_protocol_set_retransmission_parameters_2(coap_handle, 3, SN_COAP_MAX_ALLOWED_RESPONSE_TIMEOUT) );
+    CHECK( SN_COAP_MAX_ALLOWED_RESPONSE_TIMEOUT == coap_handle->sn_coap_resending_intervall );
+    CHECK( -1 == sn_coap_protocol_set_retransmission_parameters_2(NULL, 3, 0) );
+    CHECK( 0 == sn_coap_protocol_set_retransmission_buffer_2(coap_handle, SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_MSGS, SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES) );
+    CHECK( SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES == coap_handle->sn_coap_resending_queue_bytes );
+    CHECK( -1 == sn_coap_protocol_set_retransmission_buffer_2(NULL, 3, 3) );
+#endif
+#if !SN_COAP_SERVER_PROFILE
+    CHECK( -1 == sn_coap_protocol_set_duplicate_buffer_size_2(coap_handle, SN_COAP_MAX_ALLOWED_DUPLICATION_MESSAGE_COUNT + 1) );
+    CHECK( -1 == sn_coap_protocol_set_retransmission_parameters_2(coap_handle, 3, SN_COAP_MAX_ALLOWED_RESPONSE_TIMEOUT + 1) );
+    CHECK( -1 == sn_coap_protocol_set_retransmission_buffer_2(coap_handle, 3, SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_BYTES + 1) );
+    CHECK( -1 == sn_coap_protocol_set_retransmission_buffer_2(coap_handle, SN_COAP_MAX_ALLOWED_RESENDING_BUFF_SIZE_MSGS + 1, 3) );
+#endif
+}
+
+TEST(libCoap_protocol, sn_coap_protocol_get_retransmission_buffer_usage)
+{
+    uint32_t msgs = 1;
+    uint32_t bytes = 1;
+
+    CHECK( -1 == sn_coap_protocol_get_retransmission_buffer_usage(NULL, &msgs, &bytes) );
+    CHECK( 0 == sn_coap_protocol_get_retransmission_buffer_usage(coap_handle, NULL, NULL) );
+    CHECK( 0 == sn_coap_protocol_get_retransmission_buffer_usage(coap_handle, &msgs, &bytes) );
+    CHECK( 0 == msgs );
+    CHECK( 0 == bytes );
+
+    sn_nsdl_addr_s dst_addr;
+    sn_coap_hdr_s hdr;
+    uint8_t temp_addr[4] = {0};
+    uint8_t packet[5] = {0};
+    memset(&dst_addr, 0, sizeof(sn_nsdl_addr_s));
+    memset(&hdr, 0, sizeof(sn_coap_hdr_s));
+    dst_addr.addr_ptr = temp_addr;
+    dst_addr.addr_len = 4;
+
+    CHECK( 0 == sn_coap_protocol_set_retransmission_buffer(coap_handle, 6, 12) );
+    sn_coap_builder_stub.expectedInt16 = 5;
+
+    retCounter = 5;
+    hdr.msg_id = 1;
+    CHECK( 5 == sn_coap_protocol_build(coap_handle, &dst_addr, packet, &hdr, NULL) );
+    retCounter = 5;
+    hdr.msg_id = 2;
+    CHECK( 5 == sn_coap_protocol_build(coap_handle, &dst_addr, packet, &hdr, NULL) );
+    CHECK( 0 == sn_coap_protocol_get_retransmission_buffer_usage(coap_handle, &msgs, &bytes) );
+    CHECK( 2 == msgs );
+    CHECK( 10 == bytes );
+
+    // Byte limit exceeded, message is not stored
+    retCounter = 5;
+    hdr.msg_id = 3;
+    CHECK( 5 == sn_coap_protocol_build(coap_handle, &dst_addr, packet, &hdr, NULL) );
+    CHECK( 0 == sn_coap_protocol_get_retransmission_buffer_usage(coap_handle, &msgs, &bytes) );
+    CHECK( 2 == msgs );
+    CHECK( 10 == bytes );
+
+    CHECK( 0 == sn_coap_protocol_delete_retransmission(coap_handle, 1) );
+    CHECK( 0 == sn_coap_protocol_get_retransmission_buffer_usage(coap_handle, &msgs, &bytes) );
+    CHECK( 1 == msgs );
+    CHECK( 5 == bytes );
+
+    sn_coap_protocol_clear_retransmission_buffer(coap_handle);
+    CHECK( 0 == sn_coap_protocol_get_retransmission_buffer_usage(coap_handle, &msgs, &bytes) );
+    CHECK( 0 == msgs );
+    CHECK( 0 == bytes );
+    sn_coap_builder_stub.expectedInt16 = 0;
+}
+
+static uint8_t replay_tx_count;
+static uint8_t replay_tx_packet[4];
+
+uint8_t replay_tx_cb(uint8_t *a, uint16_t b, sn_nsdl_addr_s *c, void *d)
+{
+    replay_tx_count++;
+    if (b == sizeof(replay_tx_packet)) {
+        memcpy(replay_tx_packet, a, b);
+    }
+    return 0;
+}
+
+TEST(libCoap_protocol, sn_coap_protocol_duplicate_response_replay)
+{
+#if SN_COAP_DUPLICATION_MAX_MSGS_COUNT
+    CHECK( -1 == sn_coap_protocol_set_duplicate_response_cache_size(NULL, 64) );
+
+    retCounter = 1;
+    struct coap_s *handle = sn_coap_protocol_init(myMalloc, myFree, replay_tx_cb, NULL);
+    CHECK( 0 == sn_coap_protocol_set_duplicate_response_cache_size(handle, 64) );
+
+    sn_nsdl_addr_s addr;
+    uint8_t addr_bytes[4] = {1, 2, 3, 4};
+    memset(&addr, 0, sizeof(sn_nsdl_addr_s));
+    addr.addr_ptr = addr_bytes;
+    addr.addr_len = 4;
+    addr.port = 5683;
+    uint8_t packet[4] = {0x40, 0x01, 0x00, 0x07};
+    uint8_t ack_packet[4] = {0x60, 0x45, 0x00, 0x07};
+
+    sn_coap_hdr_s *req = (sn_coap_hdr_s *)malloc(sizeof(sn_coap_hdr_s));
+    memset(req, 0, sizeof(sn_coap_hdr_s));
+    req->msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    req->msg_code = COAP_MSG_CODE_REQUEST_GET;
+    req->msg_id = 7;
+    sn_coap_parser_stub.expectedHeader = req;
+    retCounter = 2;
+    sn_coap_hdr_s *ret = sn_coap_protocol_parse(handle, &addr, sizeof(packet), packet, NULL);
+    CHECK( COAP_STATUS_OK == ret->coap_status );
+
+    sn_coap_hdr_s ack;
+    memset(&ack, 0, sizeof(sn_coap_hdr_s));
+    ack.msg_type = COAP_MSG_TYPE_ACKNOWLEDGEMENT;
+    ack.msg_code = COAP_MSG_CODE_RESPONSE_CONTENT;
+    ack.msg_id = 7;
+    sn_coap_builder_stub.expectedInt16 = sizeof(ack_packet);
+    retCounter = 1;
+    CHECK( sizeof(ack_packet) == sn_coap_protocol_build(handle, &addr, ack_packet, &ack, NULL) );
+    CHECK( sizeof(coap_duplication_response_s) + sizeof(ack_packet) == handle->count_duplication_response_bytes );
+
+    // Duplicate request is acknowledged again with stored Acknowledgement
+    replay_tx_count = 0;
+    memset(replay_tx_packet, 0, sizeof(replay_tx_packet));
+    memset(req, 0, sizeof(sn_coap_hdr_s));
+    req->msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    req->msg_code = COAP_MSG_CODE_REQUEST_GET;
+    req->msg_id = 7;
+    ret = sn_coap_protocol_parse(handle, &addr, sizeof(packet), packet, NULL);
+    CHECK( COAP_STATUS_PARSER_DUPLICATED_MSG == ret->coap_status );
+    CHECK( 1 == replay_tx_count );
+    CHECK( 0 == memcmp(ack_packet, replay_tx_packet, sizeof(ack_packet)) );
+
+    // Acknowledgement which does not fit to new budget is dropped
+    CHECK( 0 == sn_coap_protocol_set_duplicate_response_cache_size(handle, sizeof(ack_packet)) );
+    CHECK( 0 == handle->count_duplication_response_bytes );
+    replay_tx_count = 0;
+    req->coap_status = COAP_STATUS_OK;
+    ret = sn_coap_protocol_parse(handle, &addr, sizeof(packet), packet, NULL);
+    CHECK( COAP_STATUS_PARSER_DUPLICATED_MSG == ret->coap_status );
+    CHECK( 0 == replay_tx_count );
+
+    retCounter = 1;
+    CHECK( sizeof(ack_packet) == sn_coap_protocol_build(handle, &addr, ack_packet, &ack, NULL) );
+    CHECK( 0 == handle->count_duplication_response_bytes );
+    CHECK( 0 == sn_coap_protocol_set_duplicate_response_cache_size(handle, 0) );
+
+    sn_coap_builder_stub.expectedInt16 = 0;
+    sn_coap_parser_stub.expectedHeader = NULL;
+    free(req);
+    sn_coap_protocol_destroy(handle);
+#endif
+}
+
 //TEST(libCoap_protocol, sn_coap_protocol_clear_retransmission_buffer)
 //{
 //    sn_coap_protocol_clear_retransmission_buffer();
@@ -168,6 +334,7 @@ TEST(libCoap_protocol, sn_coap_protocol_delete_retransmission)
     dst_addr_ptr.addr_ptr = temp_addr;
     dst_addr_ptr.addr_len = 4;
     dst_addr_ptr.type = SN_NSDL_ADDRESS_TYPE_IPV4;
+    src_coap_msg_ptr.msg_id = 0x63;
 
     struct coap_s * handle = sn_coap_protocol_init(myMalloc, myFree, null_tx_cb, NULL);
 
@@ -418,10 +585,11 @@ TEST(libCoap_protocol, sn_coap_protocol_build)
     retCounter = 1;
     handle = sn_coap_protocol_init(myMalloc, myFree, null_tx_cb, NULL);
 
+    // Request record is not stored when out of memory, message is still built
     retCounter = 6;
     sn_coap_builder_stub.expectedInt16 = 1;
     hdr.payload_len = 0;
-    CHECK( -2 == sn_coap_protocol_build(handle, &addr, dst_packet_data_ptr, &hdr, NULL));
+    CHECK( 1 == sn_coap_protocol_build(handle, &addr, dst_packet_data_ptr, &hdr, NULL));
 
     retCounter = 7;
     sn_coap_builder_stub.expectedInt16 = 1;
@@ -988,13 +1156,13 @@ TEST(libCoap_protocol, sn_coap_protocol_parse)
 
     retCounter = 21;
     sn_coap_builder_stub.expectedInt16 = 1;
-    tmp_hdr.payload_ptr = (uint8_t*)malloc(3);
+    tmp_hdr.payload_ptr = (uint8_t*)malloc(SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE + 1);
 //    tmp_hdr.options_list_ptr = (sn_coap_options_list_s*)malloc(sizeof(sn_coap_options_list_s));
 //    memset(tmp_hdr.options_list_ptr, 0, sizeof(sn_coap_options_list_s));
 //    tmp_hdr.options_list_ptr->block2 = 1;
     tmp_hdr.msg_id = 19;
-    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_GET;
-    tmp_hdr.payload_len = 1;
+    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_PUT;
+    tmp_hdr.payload_len = SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE + 1;
     sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL);
 
     free(tmp_hdr.options_list_ptr);
@@ -1034,13 +1202,13 @@ TEST(libCoap_protocol, sn_coap_protocol_parse)
 
     retCounter = 21;
     sn_coap_builder_stub.expectedInt16 = 1;
-    tmp_hdr.payload_ptr = (uint8_t*)malloc(3);
+    tmp_hdr.payload_ptr = (uint8_t*)malloc(SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE + 1);
 //    tmp_hdr.options_list_ptr = (sn_coap_options_list_s*)malloc(sizeof(sn_coap_options_list_s));
 //    memset(tmp_hdr.options_list_ptr, 0, sizeof(sn_coap_options_list_s));
 //    tmp_hdr.options_list_ptr->block2 = 1;
     tmp_hdr.msg_id = 20;
-    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_GET;
-    tmp_hdr.payload_len = 1;
+    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_PUT;
+    tmp_hdr.payload_len = SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE + 1;
     sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL);
 
     free(tmp_hdr.options_list_ptr);
@@ -1434,7 +1602,8 @@ TEST(libCoap_protocol, sn_coap_protocol_parse)
     memset(tmp_hdr.options_list_ptr, 0, sizeof(sn_coap_options_list_s));
     tmp_hdr.options_list_ptr->block2 = 1;
     tmp_hdr.msg_id = 41;
-    tmp_hdr.payload_len = buff_len;
+    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    tmp_hdr.payload_len = 0;
     sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL);
 
     free(tmp_hdr.options_list_ptr);
@@ -1482,7 +1651,8 @@ TEST(libCoap_protocol, sn_coap_protocol_parse)
     memset(tmp_hdr.options_list_ptr, 0, sizeof(sn_coap_options_list_s));
     tmp_hdr.options_list_ptr->block2 = 1;
     tmp_hdr.msg_id = 42;
-    tmp_hdr.payload_len = buff_len;
+    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    tmp_hdr.payload_len = 0;
     sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL);
 
     free(tmp_hdr.options_list_ptr);
@@ -1530,7 +1700,8 @@ TEST(libCoap_protocol, sn_coap_protocol_parse)
     memset(tmp_hdr.options_list_ptr, 0, sizeof(sn_coap_options_list_s));
     tmp_hdr.options_list_ptr->block2 = 1;
     tmp_hdr.msg_id = 43;
-    tmp_hdr.payload_len = buff_len;
+    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    tmp_hdr.payload_len = 0;
     sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL);
 
     free(tmp_hdr.options_list_ptr);
@@ -1577,7 +1748,8 @@ TEST(libCoap_protocol, sn_coap_protocol_parse)
     memset(tmp_hdr.options_list_ptr, 0, sizeof(sn_coap_options_list_s));
     tmp_hdr.options_list_ptr->block2 = 1;
     tmp_hdr.msg_id = 44;
-    tmp_hdr.payload_len = buff_len;
+    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    tmp_hdr.payload_len = 0;
     sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL);
 
     free(tmp_hdr.options_list_ptr);
@@ -1623,7 +1795,8 @@ TEST(libCoap_protocol, sn_coap_protocol_parse)
     memset(tmp_hdr.options_list_ptr, 0, sizeof(sn_coap_options_list_s));
     tmp_hdr.options_list_ptr->block2 = 1;
     tmp_hdr.msg_id = 45;
-    tmp_hdr.payload_len = buff_len;
+    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    tmp_hdr.payload_len = 0;
     sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL);
 
     free(tmp_hdr.options_list_ptr);
@@ -1670,7 +1843,8 @@ TEST(libCoap_protocol, sn_coap_protocol_parse)
     memset(tmp_hdr.options_list_ptr, 0, sizeof(sn_coap_options_list_s));
     tmp_hdr.options_list_ptr->block2 = 1;
     tmp_hdr.msg_id = 46;
-    tmp_hdr.payload_len = buff_len;
+    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    tmp_hdr.payload_len = 0;
     sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL);
 
     free(tmp_hdr.options_list_ptr);
@@ -1678,11 +1852,13 @@ TEST(libCoap_protocol, sn_coap_protocol_parse)
     free(tmp_addr.addr_ptr);
     free(dst_packet_data_ptr);
 
+    // Request of the next block reuses request record, nothing more is allocated for it
     sn_coap_builder_stub.expectedInt16 = 1;
     retCounter = 8;
     ret = sn_coap_protocol_parse(handle, addr, packet_data_len, packet_data_ptr, NULL);
-    CHECK( NULL == ret );
+    CHECK( NULL != ret );
     free(payload);
+    sn_coap_parser_release_allocated_coap_msg_mem(handle, ret);
 
     sn_coap_protocol_destroy(handle);
     retCounter = 1;
@@ -1721,7 +1897,8 @@ TEST(libCoap_protocol, sn_coap_protocol_parse)
     memset(tmp_hdr.options_list_ptr, 0, sizeof(sn_coap_options_list_s));
     tmp_hdr.options_list_ptr->block2 = 1;
     tmp_hdr.msg_id = 47;
-    tmp_hdr.payload_len = buff_len;
+    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    tmp_hdr.payload_len = 0;
     sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL);
 
     free(tmp_hdr.options_list_ptr);
@@ -1774,7 +1951,8 @@ TEST(libCoap_protocol, sn_coap_protocol_parse)
     memset(tmp_hdr.options_list_ptr, 0, sizeof(sn_coap_options_list_s));
     tmp_hdr.options_list_ptr->block2 = 1;
     tmp_hdr.msg_id = 47;
-    tmp_hdr.payload_len = buff_len;
+    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    tmp_hdr.payload_len = 0;
     sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL);
 
     free(tmp_hdr.options_list_ptr);
@@ -2204,6 +2382,149 @@ TEST(libCoap_protocol, sn_coap_protocol_exec2)
     sn_coap_protocol_destroy(handle);
 }
 
+static uint8_t send_failure_cb_count = 0;
+static sn_coap_send_failure_s send_failure_cb_last;
+
+void send_failure_cb(struct coap_s *handle, const sn_coap_send_failure_s *failures, uint8_t count)
+{
+    send_failure_cb_count += count;
+    send_failure_cb_last = failures[count - 1];
+}
+
+TEST(libCoap_protocol, sn_coap_protocol_set_send_failure_callback)
+{
+    CHECK(-1 == sn_coap_protocol_set_send_failure_callback(NULL, send_failure_cb));
+    CHECK(0 == sn_coap_protocol_set_send_failure_callback(coap_handle, send_failure_cb));
+    CHECK(0 == sn_coap_protocol_set_send_failure_callback(coap_handle, NULL));
+}
+
+TEST(libCoap_protocol, sn_coap_protocol_exec_send_failure_callback)
+{
+    retCounter = 1;
+    struct coap_s * handle = sn_coap_protocol_init(myMalloc, myFree, null_tx_cb, null_rx_cb);
+    CHECK(0 == sn_coap_protocol_set_send_failure_callback(handle, send_failure_cb));
+
+    sn_nsdl_addr_s tmp_addr;
+    memset(&tmp_addr, 0, sizeof(sn_nsdl_addr_s));
+    sn_coap_hdr_s tmp_hdr;
+    memset(&tmp_hdr, 0, sizeof(sn_coap_hdr_s));
+
+    uint8_t* dst_packet_data_ptr = (uint8_t*)malloc(5);
+    memset(dst_packet_data_ptr, '1', 5);
+
+    tmp_addr.addr_ptr = (uint8_t*)malloc(5);
+    memset(tmp_addr.addr_ptr, '1', 5);
+    tmp_addr.addr_len = 5;
+
+    uint8_t token[2] = {0xab, 0xcd};
+    uint8_t uri_path[3] = {'a', '/', 'b'};
+    tmp_hdr.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_POST;
+    tmp_hdr.msg_id = 18;
+    tmp_hdr.token_ptr = token;
+    tmp_hdr.token_len = 2;
+    tmp_hdr.uri_path_ptr = uri_path;
+    tmp_hdr.uri_path_len = 3;
+
+    retCounter = 20;
+    sn_coap_builder_stub.expectedInt16 = 5;
+    CHECK(5 == sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL));
+    CHECK(1 == handle->count_resent_msgs);
+
+    tmp_hdr.msg_id = 19;
+    CHECK(5 == sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL));
+    CHECK(2 == handle->count_resent_msgs);
+
+    send_failure_cb_count = 0;
+    sn_coap_protocol_set_retransmission_parameters(handle, 0, 5);
+    CHECK(0 == sn_coap_protocol_exec(handle, 600));
+
+    CHECK(2 == send_failure_cb_count);
+    CHECK(0 == handle->count_resent_msgs);
+    CHECK(19 == send_failure_cb_last.msg_id);
+    CHECK(COAP_MSG_CODE_REQUEST_POST == send_failure_cb_last.msg_code);
+    CHECK(2 == send_failure_cb_last.token_len);
+    CHECK(3 == send_failure_cb_last.uri_path_len);
+
+    free(tmp_addr.addr_ptr);
+    free(dst_packet_data_ptr);
+    sn_coap_builder_stub.expectedInt16 = 0;
+    retCounter = 0;
+    sn_coap_protocol_destroy(handle);
+}
+
+static uint8_t tx_batch_cb_calls = 0;
+static uint8_t tx_batch_cb_count = 0;
+static sn_coap_tx_entry_s tx_batch_cb_last;
+static uint8_t tx_batch_cb_last_addr[5];
+
+void tx_batch_cb(struct coap_s *handle, const sn_coap_tx_entry_s *entries, uint8_t count)
+{
+    tx_batch_cb_calls++;
+    tx_batch_cb_count += count;
+    tx_batch_cb_last = entries[count - 1];
+    memcpy(tx_batch_cb_last_addr, tx_batch_cb_last.dst_addr_ptr->addr_ptr, 5);
+}
+
+TEST(libCoap_protocol, sn_coap_protocol_exec_tx_batch_callback)
+{
+    retCounter = 1;
+    struct coap_s * handle = sn_coap_protocol_init(myMalloc, myFree, null_tx_cb, null_rx_cb);
+    CHECK(-1 == sn_coap_protocol_set_tx_batch_callback(NULL, tx_batch_cb));
+    CHECK(-2 == sn_coap_protocol_set_tx_batch_callback(handle, tx_batch_cb));
+    retCounter = 1;
+    CHECK(0 == sn_coap_protocol_set_tx_batch_callback(handle, tx_batch_cb));
+
+    sn_nsdl_addr_s tmp_addr;
+    memset(&tmp_addr, 0, sizeof(sn_nsdl_addr_s));
+    sn_coap_hdr_s tmp_hdr;
+    memset(&tmp_hdr, 0, sizeof(sn_coap_hdr_s));
+
+    uint8_t* dst_packet_data_ptr = (uint8_t*)malloc(5);
+    memset(dst_packet_data_ptr, '1', 5);
+
+    tmp_addr.addr_ptr = (uint8_t*)malloc(5);
+    memset(tmp_addr.addr_ptr, '2', 5);
+    tmp_addr.addr_len = 5;
+
+    tmp_hdr.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    tmp_hdr.msg_code = COAP_MSG_CODE_REQUEST_POST;
+
+    retCounter = 20;
+    sn_coap_builder_stub.expectedInt16 = 5;
+    for (uint16_t msg_id = 18; msg_id < 20; msg_id++) {
+        tmp_hdr.msg_id = msg_id;
+        CHECK(5 == sn_coap_protocol_build(handle, &tmp_addr, dst_packet_data_ptr, &tmp_hdr, NULL));
+    }
+    CHECK(2 == handle->count_resent_msgs);
+
+    // Re-sendings of one exec are given to batch callback with one call
+    tx_batch_cb_calls = 0;
+    tx_batch_cb_count = 0;
+    retCounter = 2;
+    CHECK(0 == sn_coap_protocol_exec(handle, 600));
+    CHECK(1 == tx_batch_cb_calls);
+    CHECK(2 == tx_batch_cb_count);
+    CHECK(5 == tx_batch_cb_last.packet_len);
+    CHECK(tx_batch_cb_last.dst_addr_ptr->addr_ptr != tmp_addr.addr_ptr);
+    CHECK(0 == memcmp(tx_batch_cb_last_addr, tmp_addr.addr_ptr, 5));
+    CHECK(2 == handle->count_resent_msgs);
+
+    // Packets which could not be copied are sent with TX callback
+    retCounter = 0;
+    CHECK(0 == sn_coap_protocol_exec(handle, 1200));
+    CHECK(1 == tx_batch_cb_calls);
+
+    CHECK(0 == sn_coap_protocol_set_tx_batch_callback(handle, NULL));
+    CHECK(NULL == handle->tx_batch);
+
+    free(tmp_addr.addr_ptr);
+    free(dst_packet_data_ptr);
+    sn_coap_builder_stub.expectedInt16 = 0;
+    retCounter = 0;
+    sn_coap_protocol_destroy(handle);
+}
+
 TEST(libCoap_protocol, sn_coap_protocol_block_remove)
 {
     sn_coap_protocol_block_remove(0,0,0,0);
@@ -2274,3 +2595,295 @@ TEST(libCoap_protocol, sn_coap_protocol_block_remove)
     sn_coap_protocol_destroy(handle);
 }
 
+
+static uint8_t block_sink_cb_count = 0;
+static sn_coap_block_s block_sink_cb_last;
+static int8_t block_sink_cb_result = 0;
+
+int8_t block_sink_cb(struct coap_s *handle, const sn_coap_block_s *block, void *param)
+{
+    block_sink_cb_count++;
+    block_sink_cb_last = *block;
+    return block_sink_cb_result;
+}
+
+static sn_coap_hdr_s *parse_block1(struct coap_s *handle, sn_nsdl_addr_s *addr, uint16_t msg_id, uint32_t block1, uint8_t *payload)
+{
+    sn_coap_hdr_s *hdr = (sn_coap_hdr_s *)malloc(sizeof(sn_coap_hdr_s));
+    memset(hdr, 0, sizeof(sn_coap_hdr_s));
+    hdr->msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    hdr->msg_code = COAP_MSG_CODE_REQUEST_PUT;
+    hdr->msg_id = msg_id;
+    hdr->payload_ptr = payload;
+    hdr->payload_len = 16;
+    hdr->options_list_ptr = (sn_coap_options_list_s *)malloc(sizeof(sn_coap_options_list_s));
+    memset(hdr->options_list_ptr, 0, sizeof(sn_coap_options_list_s));
+    hdr->options_list_ptr->block1 = block1;
+    hdr->options_list_ptr->block2 = COAP_OPTION_BLOCK_NONE;
+    hdr->options_list_ptr->use_size1 = true;
+    hdr->options_list_ptr->size1 = 0x100000;
+    sn_coap_parser_stub.expectedHeader = hdr;
+
+    return sn_coap_protocol_parse(handle, addr, 16, payload, NULL);
+}
+
+TEST(libCoap_protocol, sn_coap_protocol_set_block_sink_callback)
+{
+    CHECK(-1 == sn_coap_protocol_set_block_sink_callback(NULL, block_sink_cb));
+    CHECK(0 == sn_coap_protocol_set_block_sink_callback(coap_handle, block_sink_cb));
+    CHECK(0 == sn_coap_protocol_set_block_sink_callback(coap_handle, NULL));
+}
+
+TEST(libCoap_protocol, sn_coap_protocol_block1_to_block_sink)
+{
+    uint8_t payload[16];
+    uint8_t addr_bytes[5] = {'a', 'a', 'a', 'a', 'a'};
+    sn_nsdl_addr_s addr;
+    sn_coap_hdr_s *hdr;
+
+    memset(&addr, 0, sizeof(sn_nsdl_addr_s));
+    addr.addr_ptr = addr_bytes;
+    addr.addr_len = sizeof(addr_bytes);
+    memset(payload, 'p', sizeof(payload));
+
+    retCounter = 1;
+    struct coap_s *handle = sn_coap_protocol_init(myMalloc, myFree, null_tx_cb, NULL);
+    CHECK(0 == sn_coap_protocol_set_block_sink_callback(handle, block_sink_cb));
+    block_sink_cb_count = 0;
+    block_sink_cb_result = 0;
+    retCounter = 100;
+
+    // Blocks are delivered one by one, larger than SN_COAP_MAX_INCOMING_BLOCK_MESSAGE_SIZE transfer is not refused
+    hdr = parse_block1(handle, &addr, 1, 0x08, payload);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(handle, hdr);
+    CHECK(1 == block_sink_cb_count);
+    CHECK(0 == block_sink_cb_last.offset);
+    CHECK(0x100000 == block_sink_cb_last.total_size);
+    CHECK(16 == block_sink_cb_last.payload_len);
+    CHECK(0 == block_sink_cb_last.last);
+
+    // Only offset of the next block is stored
+    CHECK(1 == ns_list_count(&handle->linked_list_blockwise_received_payloads));
+    CHECK(NULL == ns_list_get_first(&handle->linked_list_blockwise_received_payloads)->payload_ptr);
+
+    hdr = parse_block1(handle, &addr, 2, 0x18, payload);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(handle, hdr);
+    CHECK(2 == block_sink_cb_count);
+    CHECK(16 == block_sink_cb_last.offset);
+
+    // Duplicate block is acknowledged again but not delivered
+    hdr = parse_block1(handle, &addr, 3, 0x18, payload);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(handle, hdr);
+    CHECK(2 == block_sink_cb_count);
+
+    // Block after a missing one is responded with error
+    CHECK(NULL == parse_block1(handle, &addr, 4, 0x38, payload));
+    CHECK(2 == block_sink_cb_count);
+
+    // Last block completes the transfer without whole payload
+    hdr = parse_block1(handle, &addr, 5, 0x20, payload);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED == hdr->coap_status);
+    CHECK(NULL == hdr->payload_ptr);
+    CHECK(0 == hdr->payload_len);
+    sn_coap_parser_release_allocated_coap_msg_mem(handle, hdr);
+    CHECK(3 == block_sink_cb_count);
+    CHECK(32 == block_sink_cb_last.offset);
+    CHECK(1 == block_sink_cb_last.last);
+    CHECK(ns_list_is_empty(&handle->linked_list_blockwise_received_payloads));
+
+    // Rejected block stops the transfer
+    block_sink_cb_result = -1;
+    CHECK(NULL == parse_block1(handle, &addr, 6, 0x08, payload));
+    CHECK(4 == block_sink_cb_count);
+    CHECK(ns_list_is_empty(&handle->linked_list_blockwise_received_payloads));
+    block_sink_cb_result = 0;
+    CHECK(NULL == parse_block1(handle, &addr, 7, 0x18, payload));
+    CHECK(4 == block_sink_cb_count);
+
+    retCounter = 0;
+    sn_coap_protocol_destroy(handle);
+}
+
+static uint8_t provided_payload[40];
+static uint8_t payload_provider_cb_count = 0;
+static const uint8_t *payload_provider_cb_ref = NULL;
+static uint32_t payload_provider_cb_offset = 0;
+static uint16_t payload_provider_cb_length = 0;
+static bool payload_provider_cb_fail = false;
+
+const uint8_t *payload_provider_cb(struct coap_s *handle, const uint8_t *payload_ptr, uint32_t offset, uint16_t length)
+{
+    payload_provider_cb_count++;
+    payload_provider_cb_ref = payload_ptr;
+    payload_provider_cb_offset = offset;
+    payload_provider_cb_length = length;
+    return payload_provider_cb_fail ? NULL : provided_payload + (offset % sizeof(provided_payload));
+}
+
+static sn_coap_hdr_s *parse_block1_ack(struct coap_s *handle, sn_nsdl_addr_s *addr, uint16_t msg_id, uint32_t block1)
+{
+    sn_coap_hdr_s *hdr = (sn_coap_hdr_s *)malloc(sizeof(sn_coap_hdr_s));
+    memset(hdr, 0, sizeof(sn_coap_hdr_s));
+    hdr->msg_type = COAP_MSG_TYPE_ACKNOWLEDGEMENT;
+    hdr->msg_code = COAP_MSG_CODE_RESPONSE_CONTINUE;
+    hdr->msg_id = msg_id;
+    hdr->options_list_ptr = (sn_coap_options_list_s *)malloc(sizeof(sn_coap_options_list_s));
+    memset(hdr->options_list_ptr, 0, sizeof(sn_coap_options_list_s));
+    hdr->options_list_ptr->block1 = block1;
+    hdr->options_list_ptr->block2 = COAP_OPTION_BLOCK_NONE;
+    sn_coap_parser_stub.expectedHeader = hdr;
+
+    return sn_coap_protocol_parse(handle, addr, sizeof(provided_payload), provided_payload, NULL);
+}
+
+TEST(libCoap_protocol, sn_coap_protocol_set_payload_provider)
+{
+    CHECK(-1 == sn_coap_protocol_set_payload_provider(NULL, payload_provider_cb));
+    CHECK(0 == sn_coap_protocol_set_payload_provider(coap_handle, payload_provider_cb));
+    CHECK(0 == sn_coap_protocol_set_payload_provider(coap_handle, NULL));
+}
+
+TEST(libCoap_protocol, sn_coap_protocol_build_from_payload_provider)
+{
+    uint8_t payload_ref = 0;
+    uint8_t addr_bytes[5] = {'a', 'a', 'a', 'a', 'a'};
+    uint8_t packet[5];
+    sn_nsdl_addr_s addr;
+    sn_coap_hdr_s hdr;
+    sn_coap_hdr_s *ack;
+
+    memset(&addr, 0, sizeof(sn_nsdl_addr_s));
+    addr.addr_ptr = addr_bytes;
+    addr.addr_len = sizeof(addr_bytes);
+    memset(&hdr, 0, sizeof(sn_coap_hdr_s));
+    hdr.msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    hdr.msg_code = COAP_MSG_CODE_REQUEST_PUT;
+    hdr.msg_id = 20;
+    hdr.payload_ptr = &payload_ref;
+    hdr.payload_len = sizeof(provided_payload);
+
+    retCounter = 1;
+    struct coap_s *handle = sn_coap_protocol_init(myMalloc, myFree, null_tx_cb, NULL);
+    CHECK(0 == sn_coap_protocol_set_payload_provider(handle, payload_provider_cb));
+    payload_provider_cb_count = 0;
+    payload_provider_cb_fail = false;
+
+    // Provider failing for the first block fails the build
+    payload_provider_cb_fail = true;
+    retCounter = 10;
+    CHECK(-2 == sn_coap_protocol_build(handle, &addr, packet, &hdr, NULL));
+    CHECK(&payload_ref == hdr.payload_ptr);
+    CHECK(sizeof(provided_payload) == hdr.payload_len);
+    payload_provider_cb_fail = false;
+
+    // Stored message only refers to the payload
+    retCounter = 2;
+    sn_coap_builder_stub.expectedInt16 = 5;
+    CHECK(5 == sn_coap_protocol_build(handle, &addr, packet, &hdr, NULL));
+    CHECK(0 == retCounter);
+    CHECK(2 == payload_provider_cb_count);
+    CHECK(&payload_ref == payload_provider_cb_ref);
+    CHECK(0 == payload_provider_cb_offset);
+    CHECK(16 == payload_provider_cb_length);
+    CHECK(&payload_ref == hdr.payload_ptr);
+
+    coap_blockwise_msg_s *stored = ns_list_get_first(&handle->linked_list_blockwise_sent_msgs);
+    CHECK(NULL == stored->coap_msg_ptr->payload_ptr);
+    CHECK(sizeof(provided_payload) == stored->payload_len);
+    CHECK(&payload_ref == stored->payload_ref);
+
+    // Next block is read from provider at its offset
+    retCounter = 10;
+    sn_coap_builder_stub.expectedUint16 = 5;
+    ack = parse_block1_ack(handle, &addr, 20, 0x08);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_ACK == ack->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(handle, ack);
+    CHECK(3 == payload_provider_cb_count);
+    CHECK(16 == payload_provider_cb_offset);
+    CHECK(16 == payload_provider_cb_length);
+    CHECK(NULL == stored->coap_msg_ptr->payload_ptr);
+
+    // Failing provider ends the transfer
+    payload_provider_cb_fail = true;
+    CHECK(NULL == parse_block1_ack(handle, &addr, stored->coap_msg_ptr->msg_id, 0x18));
+    CHECK(4 == payload_provider_cb_count);
+    CHECK(32 == payload_provider_cb_offset);
+    CHECK(8 == payload_provider_cb_length);
+    CHECK(ns_list_is_empty(&handle->linked_list_blockwise_sent_msgs));
+
+    sn_coap_builder_stub.expectedInt16 = 0;
+    sn_coap_builder_stub.expectedUint16 = 0;
+    retCounter = 0;
+    sn_coap_protocol_destroy(handle);
+}
+
+TEST(libCoap_protocol, sn_coap_protocol_build_large_payload_from_provider)
+{
+    const uint32_t total_len = 0x200000;
+    uint8_t payload_ref = 0;
+    uint8_t addr_bytes[5] = {'a', 'a', 'a', 'a', 'a'};
+    uint8_t packet[5];
+    sn_nsdl_addr_s addr;
+    sn_coap_hdr_s hdr;
+    sn_coap_hdr_s *ack;
+
+    memset(&addr, 0, sizeof(sn_nsdl_addr_s));
+    addr.addr_ptr = addr_bytes;
+    addr.addr_len = sizeof(addr_bytes);
+    memset(&hdr, 0, sizeof(sn_coap_hdr_s));
+    hdr.msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    hdr.msg_code = COAP_MSG_CODE_REQUEST_PUT;
+    hdr.msg_id = 30;
+    hdr.payload_ptr = &payload_ref;
+    hdr.payload_len = UINT16_MAX;
+    hdr.options_list_ptr = (sn_coap_options_list_s *)malloc(sizeof(sn_coap_options_list_s));
+    memset(hdr.options_list_ptr, 0, sizeof(sn_coap_options_list_s));
+    hdr.options_list_ptr->block1 = COAP_OPTION_BLOCK_NONE;
+    hdr.options_list_ptr->block2 = COAP_OPTION_BLOCK_NONE;
+
+    retCounter = 1;
+    struct coap_s *handle = sn_coap_protocol_init(myMalloc, myFree, null_tx_cb, NULL);
+    CHECK(0 == sn_coap_protocol_set_payload_provider(handle, payload_provider_cb));
+    payload_provider_cb_count = 0;
+    payload_provider_cb_fail = false;
+
+    // Size1 gives total length of payload longer than payload_len can tell
+    hdr.options_list_ptr->use_size1 = true;
+    hdr.options_list_ptr->size1 = total_len;
+    CHECK(0 == prepare_blockwise_message(handle, &hdr));
+    CHECK(total_len == hdr.options_list_ptr->size1);
+    CHECK(0x08 == hdr.options_list_ptr->block1);
+
+    retCounter = 10;
+    sn_coap_builder_stub.expectedInt16 = 5;
+    CHECK(5 == sn_coap_protocol_build(handle, &addr, packet, &hdr, NULL));
+
+    coap_blockwise_msg_s *stored = ns_list_get_first(&handle->linked_list_blockwise_sent_msgs);
+    CHECK(total_len == stored->payload_len);
+
+    // Blocks beyond 64 KB are read from provider
+    sn_coap_builder_stub.expectedUint16 = 5;
+    ack = parse_block1_ack(handle, &addr, stored->coap_msg_ptr->msg_id, (0x1FFFD << 4) | 0x08);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_ACK == ack->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(handle, ack);
+    CHECK(0x1FFFE0 == payload_provider_cb_offset);
+    CHECK(16 == payload_provider_cb_length);
+    CHECK(((0x1FFFE << 4) | 0x08) == stored->coap_msg_ptr->options_list_ptr->block1);
+
+    // Last block
+    ack = parse_block1_ack(handle, &addr, stored->coap_msg_ptr->msg_id, (0x1FFFE << 4) | 0x08);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_ACK == ack->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(handle, ack);
+    CHECK(0x1FFFF0 == payload_provider_cb_offset);
+    CHECK(16 == payload_provider_cb_length);
+    CHECK((0x1FFFF << 4) == stored->coap_msg_ptr->options_list_ptr->block1);
+
+    free(hdr.options_list_ptr);
+    sn_coap_builder_stub.expectedInt16 = 0;
+    sn_coap_builder_stub.expectedUint16 = 0;
+    retCounter = 0;
+    sn_coap_protocol_destroy(handle);
+}
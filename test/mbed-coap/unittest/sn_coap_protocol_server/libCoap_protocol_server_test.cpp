@@ -0,0 +1,1544 @@
+/*
+ * Copyright (c) 2015 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CppUTest/TestHarness.h"
+#include <string.h>
+#include <stdint.h>
+#include "sn_coap_protocol.h"
+#include "sn_coap_header_internal.h"
+#include "sn_coap_protocol_internal.h"
+
+#include "sn_coap_builder_stub.h"
+#include "sn_coap_parser_stub.h"
+#include "sn_coap_header_check_stub.h"
+
+int retCounter = 0;
+static coap_s *coap_handle = NULL;
+static sn_coap_hdr_s *parsed_hdr = NULL;
+static uint8_t packet[4];
+static uint8_t addr_bytes[16];
+static sn_nsdl_addr_s addr;
+static uint8_t tx_count;
+static uint8_t tx_packet[16];
+static uint16_t tx_len;
+
+void *myMalloc(uint16_t size)
+{
+    if (retCounter > 0) {
+        retCounter--;
+        return malloc(size);
+    } else {
+        return NULL;
+    }
+}
+
+void myFree(void *addr)
+{
+    if (addr) {
+        free(addr);
+    }
+}
+
+uint8_t null_tx_cb(uint8_t *a, uint16_t b, sn_nsdl_addr_s *c, void *d)
+{
+    tx_count++;
+    tx_len = b;
+    if (b <= sizeof(tx_packet)) {
+        memcpy(tx_packet, a, b);
+    }
+    return 0;
+}
+
+static const sn_coap_hdr_s *exchange_response;
+static uintptr_t exchange_ctx;
+static uint8_t exchange_count;
+
+static void exchange_cb(struct coap_s *handle, const sn_coap_hdr_s *response, void *ctx)
+{
+    exchange_response = response;
+    exchange_ctx = (uintptr_t)ctx;
+    exchange_count++;
+}
+
+static sn_coap_status_e parse_con(uint16_t msg_id)
+{
+    memset(parsed_hdr, 0, sizeof(sn_coap_hdr_s));
+    parsed_hdr->msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    parsed_hdr->msg_code = COAP_MSG_CODE_REQUEST_GET;
+    parsed_hdr->msg_id = msg_id;
+    sn_coap_parser_stub.expectedHeader = parsed_hdr;
+
+    sn_coap_hdr_s *hdr = sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL);
+    if (hdr != parsed_hdr) {
+        return COAP_STATUS_PARSER_ERROR_IN_HEADER;
+    }
+    return hdr->coap_status;
+}
+
+static void build_ack(uint16_t msg_id)
+{
+    uint8_t ack_packet[4] = {0x60, 0x45, 0x00, 0x00};
+    sn_coap_hdr_s ack;
+
+    memset(&ack, 0, sizeof(sn_coap_hdr_s));
+    ack.msg_type = COAP_MSG_TYPE_ACKNOWLEDGEMENT;
+    ack.msg_code = COAP_MSG_CODE_RESPONSE_CONTENT;
+    ack.msg_id = msg_id;
+    sn_coap_builder_stub.expectedInt16 = sizeof(ack_packet);
+    sn_coap_protocol_build(coap_handle, &addr, ack_packet, &ack, NULL);
+    sn_coap_builder_stub.expectedInt16 = 0;
+}
+
+static void set_token(sn_coap_hdr_s *hdr, uint8_t token)
+{
+    if (token) {
+        hdr->token_ptr = (uint8_t *)malloc(1);
+        hdr->token_ptr[0] = token;
+        hdr->token_len = 1;
+    }
+}
+
+static sn_coap_hdr_s *alloc_block1(uint8_t token, int16_t request_tag, uint16_t msg_id, uint32_t block_number, bool more, uint8_t *payload, uint16_t payload_len, uint32_t size1)
+{
+    sn_coap_hdr_s *hdr = (sn_coap_hdr_s *)malloc(sizeof(sn_coap_hdr_s));
+    memset(hdr, 0, sizeof(sn_coap_hdr_s));
+    hdr->msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    hdr->msg_code = COAP_MSG_CODE_REQUEST_PUT;
+    hdr->msg_id = msg_id;
+    set_token(hdr, token);
+    hdr->payload_ptr = payload;
+    hdr->payload_len = payload_len;
+    hdr->options_list_ptr = (sn_coap_options_list_s *)malloc(sizeof(sn_coap_options_list_s));
+    memset(hdr->options_list_ptr, 0, sizeof(sn_coap_options_list_s));
+    hdr->options_list_ptr->block1 = (block_number << 4) | (more ? 0x08 : 0);
+    hdr->options_list_ptr->block2 = COAP_OPTION_BLOCK_NONE;
+    hdr->options_list_ptr->use_size1 = size1 != 0;
+    hdr->options_list_ptr->size1 = size1;
+    if (request_tag >= 0) {
+        hdr->options_list_ptr->use_request_tag = true;
+        hdr->options_list_ptr->request_tag_len = 1;
+        hdr->options_list_ptr->request_tag[0] = request_tag;
+    }
+
+    return hdr;
+}
+
+static sn_coap_hdr_s *parse_block1_tagged(uint8_t token, int16_t request_tag, uint16_t msg_id, uint32_t block_number, bool more, uint8_t *payload, uint16_t payload_len, uint32_t size1)
+{
+    sn_coap_parser_stub.expectedHeader = alloc_block1(token, request_tag, msg_id, block_number, more, payload, payload_len, size1);
+
+    return sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL);
+}
+
+static sn_coap_hdr_s *parse_q_block1(uint32_t block_number, bool more, uint8_t *payload)
+{
+    sn_coap_hdr_s *hdr = alloc_block1(1, -1, 0x100 + block_number, block_number, more, payload, 16, 0);
+    hdr->options_list_ptr->use_q_block1 = true;
+    sn_coap_parser_stub.expectedHeader = hdr;
+
+    return sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL);
+}
+
+static sn_coap_hdr_s *parse_q_block1_response(uint16_t msg_id, sn_coap_msg_code_e msg_code, int32_t block1, uint8_t *payload, uint16_t payload_len)
+{
+    sn_coap_hdr_s *hdr = (sn_coap_hdr_s *)malloc(sizeof(sn_coap_hdr_s));
+    memset(hdr, 0, sizeof(sn_coap_hdr_s));
+    hdr->msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    hdr->msg_code = msg_code;
+    hdr->msg_id = msg_id;
+    hdr->content_format = payload ? COAP_CT_MISSING_BLOCKS : COAP_CT_NONE;
+    set_token(hdr, 1);
+    hdr->payload_ptr = payload;
+    hdr->payload_len = payload_len;
+    hdr->options_list_ptr = (sn_coap_options_list_s *)malloc(sizeof(sn_coap_options_list_s));
+    memset(hdr->options_list_ptr, 0, sizeof(sn_coap_options_list_s));
+    hdr->options_list_ptr->block1 = block1;
+    hdr->options_list_ptr->block2 = COAP_OPTION_BLOCK_NONE;
+    hdr->options_list_ptr->use_q_block1 = block1 != COAP_OPTION_BLOCK_NONE;
+    sn_coap_parser_stub.expectedHeader = hdr;
+
+    return sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL);
+}
+
+static sn_coap_hdr_s *parse_block1_response(uint16_t msg_id, uint8_t token, int32_t block1)
+{
+    sn_coap_hdr_s *hdr = (sn_coap_hdr_s *)malloc(sizeof(sn_coap_hdr_s));
+    memset(hdr, 0, sizeof(sn_coap_hdr_s));
+    hdr->msg_type = COAP_MSG_TYPE_ACKNOWLEDGEMENT;
+    hdr->msg_code = (block1 & 0x08) ? COAP_MSG_CODE_RESPONSE_CONTINUE : COAP_MSG_CODE_RESPONSE_CHANGED;
+    hdr->msg_id = msg_id;
+    set_token(hdr, token);
+    hdr->options_list_ptr = (sn_coap_options_list_s *)malloc(sizeof(sn_coap_options_list_s));
+    memset(hdr->options_list_ptr, 0, sizeof(sn_coap_options_list_s));
+    hdr->options_list_ptr->block1 = block1;
+    hdr->options_list_ptr->block2 = COAP_OPTION_BLOCK_NONE;
+    sn_coap_parser_stub.expectedHeader = hdr;
+
+    return sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL);
+}
+
+static sn_coap_hdr_s *parse_block1_token(uint8_t token, uint32_t block_number, bool more, uint8_t *payload, uint16_t payload_len, uint32_t size1)
+{
+    return parse_block1_tagged(token, -1, (token << 8) | block_number, block_number, more, payload, payload_len, size1);
+}
+
+static sn_coap_hdr_s *parse_block1(uint32_t block_number, bool more, uint8_t *payload, uint16_t payload_len, uint32_t size1)
+{
+    return parse_block1_token(0, block_number, more, payload, payload_len, size1);
+}
+
+static sn_coap_hdr_s *parse_block2_request(uint8_t token, uint16_t msg_id, uint32_t block_number)
+{
+    sn_coap_hdr_s *hdr = (sn_coap_hdr_s *)malloc(sizeof(sn_coap_hdr_s));
+    memset(hdr, 0, sizeof(sn_coap_hdr_s));
+    hdr->msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    hdr->msg_code = COAP_MSG_CODE_REQUEST_GET;
+    hdr->msg_id = msg_id;
+    set_token(hdr, token);
+    hdr->options_list_ptr = (sn_coap_options_list_s *)malloc(sizeof(sn_coap_options_list_s));
+    memset(hdr->options_list_ptr, 0, sizeof(sn_coap_options_list_s));
+    hdr->options_list_ptr->block1 = COAP_OPTION_BLOCK_NONE;
+    hdr->options_list_ptr->block2 = block_number << 4;
+    sn_coap_parser_stub.expectedHeader = hdr;
+
+    return sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL);
+}
+
+static sn_coap_hdr_s *parse_block2_response(uint16_t msg_id, uint8_t token, uint32_t block_number, bool more, uint8_t *payload)
+{
+    sn_coap_hdr_s *hdr = (sn_coap_hdr_s *)malloc(sizeof(sn_coap_hdr_s));
+    memset(hdr, 0, sizeof(sn_coap_hdr_s));
+    hdr->msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    hdr->msg_code = COAP_MSG_CODE_RESPONSE_CONTENT;
+    hdr->msg_id = msg_id;
+    set_token(hdr, token);
+    hdr->payload_ptr = payload;
+    hdr->payload_len = 16;
+    hdr->options_list_ptr = (sn_coap_options_list_s *)malloc(sizeof(sn_coap_options_list_s));
+    memset(hdr->options_list_ptr, 0, sizeof(sn_coap_options_list_s));
+    hdr->options_list_ptr->block1 = COAP_OPTION_BLOCK_NONE;
+    hdr->options_list_ptr->block2 = (block_number << 4) | (more ? 0x08 : 0);
+    sn_coap_parser_stub.expectedHeader = hdr;
+
+    return sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL);
+}
+
+static void build_block2_response(uint16_t msg_id, uint8_t token, uint8_t *payload, uint16_t payload_len)
+{
+    uint8_t response_packet[4];
+    sn_coap_hdr_s response;
+
+    memset(&response, 0, sizeof(sn_coap_hdr_s));
+    response.msg_type = COAP_MSG_TYPE_ACKNOWLEDGEMENT;
+    response.msg_code = COAP_MSG_CODE_RESPONSE_CONTENT;
+    response.msg_id = msg_id;
+    response.token_ptr = &token;
+    response.token_len = 1;
+    response.payload_ptr = payload;
+    response.payload_len = payload_len;
+    sn_coap_builder_stub.expectedInt16 = sizeof(response_packet);
+    sn_coap_protocol_build(coap_handle, &addr, response_packet, &response, NULL);
+    sn_coap_builder_stub.expectedInt16 = 0;
+}
+
+static void fill_block(uint8_t *block, uint32_t block_number)
+{
+    for (uint8_t i = 0; i < 16; i++) {
+        block[i] = block_number * 16 + i;
+    }
+}
+
+TEST_GROUP(libCoap_protocol_server)
+{
+    void setup() {
+        // Handle, and duplication ring and hash slots in one chunk each
+        retCounter = 5;
+        coap_handle = sn_coap_protocol_init(myMalloc, myFree, null_tx_cb, NULL);
+        // Peer table is allocated when first peer is stored
+        retCounter = 4;
+        parsed_hdr = (sn_coap_hdr_s *)malloc(sizeof(sn_coap_hdr_s));
+        memset(addr_bytes, 1, sizeof(addr_bytes));
+        memset(&addr, 0, sizeof(addr));
+        addr.addr_ptr = addr_bytes;
+        addr.addr_len = 16;
+        addr.port = 5683;
+        addr.type = SN_NSDL_ADDRESS_TYPE_IPV6;
+    }
+
+    void teardown() {
+        retCounter = 0;
+        sn_coap_protocol_destroy(coap_handle);
+        free(parsed_hdr);
+    }
+};
+
+TEST(libCoap_protocol_server, init_preallocates_duplication_cache)
+{
+    CHECK(coap_handle != NULL);
+    CHECK(coap_handle->duplication_ring != NULL);
+    CHECK(coap_handle->duplication_slots != NULL);
+    CHECK(SN_COAP_DUPLICATION_MAX_MSGS_COUNT == coap_handle->sn_coap_duplication_buffer_size);
+
+    retCounter = 4;
+    CHECK(NULL == sn_coap_protocol_init(myMalloc, myFree, null_tx_cb, NULL));
+}
+
+TEST(libCoap_protocol_server, duplicate_detected)
+{
+    CHECK(COAP_STATUS_OK == parse_con(100));
+    CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == parse_con(100));
+    CHECK(1 == coap_handle->count_duplication_msgs);
+
+    // Same Message ID from other port is not duplicate
+    addr.port++;
+    CHECK(COAP_STATUS_OK == parse_con(100));
+
+    // Same Message ID from other address is not duplicate
+    addr_bytes[15] = 2;
+    CHECK(COAP_STATUS_OK == parse_con(100));
+    CHECK(3 == coap_handle->count_duplication_msgs);
+}
+
+TEST(libCoap_protocol_server, oldest_entry_evicted_when_full)
+{
+    uint16_t i;
+    for (i = 1; i <= SN_COAP_DUPLICATION_MAX_MSGS_COUNT + 1; i++) {
+        CHECK(COAP_STATUS_OK == parse_con(i));
+    }
+    CHECK(SN_COAP_DUPLICATION_MAX_MSGS_COUNT == coap_handle->count_duplication_msgs);
+
+    for (i = 2; i <= SN_COAP_DUPLICATION_MAX_MSGS_COUNT + 1; i++) {
+        CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == parse_con(i));
+    }
+    CHECK(COAP_STATUS_OK == parse_con(1));
+}
+
+TEST(libCoap_protocol_server, old_entries_expire)
+{
+    sn_coap_protocol_exec(coap_handle, 10);
+    CHECK(COAP_STATUS_OK == parse_con(1));
+    sn_coap_protocol_exec(coap_handle, 40);
+    CHECK(COAP_STATUS_OK == parse_con(2));
+
+    sn_coap_protocol_exec(coap_handle, 10 + SN_COAP_DUPLICATION_MAX_TIME_MSGS_STORED + 1);
+    CHECK(1 == coap_handle->count_duplication_msgs);
+    CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == parse_con(2));
+    CHECK(COAP_STATUS_OK == parse_con(1));
+}
+
+TEST(libCoap_protocol_server, peer_shared_by_stored_messages)
+{
+    uint8_t con_packet[4] = {0x40, 0x01, 0x00, 0x07};
+    sn_coap_hdr_s con;
+
+    CHECK(COAP_STATUS_OK == parse_con(1));
+    CHECK(1 == coap_handle->peer_table.peer_count);
+    uint32_t peer_id = sn_coap_peer_table_find(&coap_handle->peer_table, &addr);
+    CHECK(0 != peer_id);
+
+    // Re-sent request references same peer, address is not copied
+    memset(&con, 0, sizeof(sn_coap_hdr_s));
+    con.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    con.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    con.msg_id = 7;
+    retCounter = 4;
+    sn_coap_builder_stub.expectedInt16 = sizeof(con_packet);
+    CHECK(sizeof(con_packet) == sn_coap_protocol_build(coap_handle, &addr, con_packet, &con, NULL));
+    sn_coap_builder_stub.expectedInt16 = 0;
+    CHECK(0 == retCounter);
+    CHECK(1 == coap_handle->count_resent_msgs);
+    CHECK(1 == coap_handle->peer_table.peer_count);
+    CHECK(sn_coap_peer_table_get_addr(&coap_handle->peer_table, peer_id) ==
+          ns_list_get_first(&coap_handle->linked_list_resent_msgs)->send_msg_ptr->dst_addr_ptr);
+
+    // Acknowledgement from the peer removes re-sent request
+    memset(parsed_hdr, 0, sizeof(sn_coap_hdr_s));
+    parsed_hdr->msg_type = COAP_MSG_TYPE_ACKNOWLEDGEMENT;
+    parsed_hdr->msg_code = COAP_MSG_CODE_RESPONSE_CONTENT;
+    parsed_hdr->msg_id = 7;
+    sn_coap_parser_stub.expectedHeader = parsed_hdr;
+    CHECK(parsed_hdr == sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL));
+    CHECK(0 == coap_handle->count_resent_msgs);
+
+    // Peer is removed when it has been idle long enough after its last message expired
+    sn_coap_protocol_exec(coap_handle, SN_COAP_DUPLICATION_MAX_TIME_MSGS_STORED + 1);
+    CHECK(0 == coap_handle->count_duplication_msgs);
+    CHECK(1 == coap_handle->peer_table.peer_count);
+    sn_coap_protocol_exec(coap_handle, SN_COAP_DUPLICATION_MAX_TIME_MSGS_STORED + SN_COAP_PEER_IDLE_TIMEOUT + 2);
+    CHECK(0 == coap_handle->peer_table.peer_count);
+}
+
+TEST(libCoap_protocol_server, peer_table_full)
+{
+    CHECK(-1 == sn_coap_protocol_set_peer_table_size(NULL, 1, 0));
+    CHECK(0 == sn_coap_protocol_set_peer_table_size(coap_handle, 1, 0));
+
+    CHECK(COAP_STATUS_OK == parse_con(1));
+
+    // Messages from peers not fitting to the table are not stored
+    addr.port++;
+    CHECK(COAP_STATUS_OK == parse_con(1));
+    CHECK(COAP_STATUS_OK == parse_con(1));
+    CHECK(1 == coap_handle->count_duplication_msgs);
+    addr.port--;
+    CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == parse_con(1));
+}
+
+TEST(libCoap_protocol_server, long_address_not_stored)
+{
+    uint8_t long_addr[SN_COAP_PEER_MAX_ADDR_LEN + 1];
+    memset(long_addr, 'a', sizeof(long_addr));
+    addr.addr_ptr = long_addr;
+    addr.addr_len = sizeof(long_addr);
+    addr.type = SN_NSDL_ADDRESS_TYPE_HOSTNAME;
+
+    CHECK(COAP_STATUS_OK == parse_con(1));
+    CHECK(COAP_STATUS_OK == parse_con(1));
+    CHECK(0 == coap_handle->count_duplication_msgs);
+}
+
+TEST(libCoap_protocol_server, resize_keeps_newest_entries)
+{
+    uint16_t i;
+    for (i = 1; i <= 4; i++) {
+        CHECK(COAP_STATUS_OK == parse_con(i));
+    }
+
+    retCounter = 4;
+    CHECK(0 == sn_coap_protocol_set_duplicate_buffer_size_2(coap_handle, 2));
+    CHECK(2 == coap_handle->count_duplication_msgs);
+    CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == parse_con(3));
+    CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == parse_con(4));
+
+    // Out of memory keeps old cache
+    retCounter = 3;
+    CHECK(-1 == sn_coap_protocol_set_duplicate_buffer_size_2(coap_handle, 8));
+    CHECK(2 == coap_handle->sn_coap_duplication_buffer_size);
+    CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == parse_con(4));
+
+    CHECK(-1 == sn_coap_protocol_set_duplicate_buffer_size_2(coap_handle, SN_COAP_MAX_ALLOWED_DUPLICATION_MESSAGE_COUNT + 1));
+
+    // Zero disables duplicate detection
+    CHECK(0 == sn_coap_protocol_set_duplicate_buffer_size_2(coap_handle, 0));
+    CHECK(COAP_STATUS_OK == parse_con(4));
+    CHECK(COAP_STATUS_OK == parse_con(4));
+}
+
+TEST(libCoap_protocol_server, thousands_of_entries)
+{
+    uint32_t i;
+    // More entries than fit to one allocation of 16-bit allocator, spanning several chunks
+    const uint32_t capacity = 20000;
+
+    // Ring in 5 chunks, 65536 hash slots in 16 chunks, and chunk pointers of both
+    retCounter += 23;
+    CHECK(0 == sn_coap_protocol_set_duplicate_buffer_size_2(coap_handle, capacity));
+
+    // Fill cache more than once around, so that evictions shift probe sequences
+    for (i = 0; i < capacity + capacity / 2; i++) {
+        CHECK(COAP_STATUS_OK == parse_con(i * 7));
+    }
+    CHECK(0 == retCounter);
+    CHECK(capacity == coap_handle->count_duplication_msgs);
+
+    for (i = capacity / 2; i < capacity + capacity / 2; i++) {
+        CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == parse_con(i * 7));
+    }
+    CHECK(COAP_STATUS_OK == parse_con(0));
+    CHECK(COAP_STATUS_OK == parse_con((capacity / 2 - 1) * 7));
+}
+
+TEST(libCoap_protocol_server, response_replay_budget)
+{
+    const uint32_t response_size = sizeof(coap_duplication_response_s) + 4;
+
+    retCounter += 2;
+    CHECK(0 == sn_coap_protocol_set_duplicate_response_cache_size(coap_handle, 2 * response_size));
+    CHECK(coap_handle->duplication_responses != NULL);
+
+    retCounter += 3;
+    for (uint16_t i = 1; i <= 3; i++) {
+        CHECK(COAP_STATUS_OK == parse_con(i));
+        build_ack(i);
+    }
+    CHECK(2 * response_size == coap_handle->count_duplication_response_bytes);
+
+    // Oldest Acknowledgement was dropped to keep within budget
+    tx_count = 0;
+    CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == parse_con(1));
+    CHECK(0 == tx_count);
+    CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == parse_con(2));
+    CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == parse_con(3));
+    CHECK(2 == tx_count);
+
+    // Acknowledgements are kept when cache is resized
+    retCounter = 6;
+    CHECK(0 == sn_coap_protocol_set_duplicate_buffer_size_2(coap_handle, 2));
+    tx_count = 0;
+    CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == parse_con(3));
+    CHECK(1 == tx_count);
+
+    // Acknowledgements are released with evicted entries
+    CHECK(COAP_STATUS_OK == parse_con(4));
+    CHECK(COAP_STATUS_OK == parse_con(5));
+    CHECK(0 == coap_handle->count_duplication_response_bytes);
+
+    CHECK(0 == sn_coap_protocol_set_duplicate_response_cache_size(coap_handle, 0));
+    CHECK(coap_handle->duplication_responses == NULL);
+}
+
+TEST(libCoap_protocol_server, block1_reassembled_to_size1_buffer)
+{
+    uint8_t block[16];
+    uint8_t *reassembly_buffer = NULL;
+    sn_coap_hdr_s *hdr;
+
+    retCounter = 100;
+    for (uint32_t i = 0; i < 3; i++) {
+        fill_block(block, i);
+        hdr = parse_block1(i, true, block, sizeof(block), 64);
+        CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING == hdr->coap_status);
+        sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+
+        // Buffer is allocated once with the size told by the sender
+        coap_blockwise_payload_s *stored = ns_list_get_first(&coap_handle->linked_list_blockwise_received_payloads);
+        CHECK(1 == ns_list_count(&coap_handle->linked_list_blockwise_received_payloads));
+        CHECK(64 == stored->payload_size);
+        CHECK((i + 1) * 16 == stored->payload_len);
+        if (i == 0) {
+            reassembly_buffer = stored->payload_ptr;
+        }
+        CHECK(reassembly_buffer == stored->payload_ptr);
+    }
+
+    // Last block hands the buffer over without copying
+    fill_block(block, 3);
+    hdr = parse_block1(3, false, block, sizeof(block), 64);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED == hdr->coap_status);
+    CHECK(reassembly_buffer == hdr->payload_ptr);
+    CHECK(64 == hdr->payload_len);
+    for (uint8_t i = 0; i < 64; i++) {
+        CHECK(i == hdr->payload_ptr[i]);
+    }
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_blockwise_received_payloads));
+    free(hdr->payload_ptr);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+}
+
+TEST(libCoap_protocol_server, block1_reassembly_buffer_grows_geometrically)
+{
+    const uint16_t expected_sizes[] = {16, 32, 64, 64, 128};
+    uint8_t block[16];
+    sn_coap_hdr_s *hdr;
+
+    retCounter = 100;
+    for (uint32_t i = 0; i < 5; i++) {
+        fill_block(block, i);
+        hdr = parse_block1(i, true, block, sizeof(block), 0);
+        sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+
+        coap_blockwise_payload_s *stored = ns_list_get_first(&coap_handle->linked_list_blockwise_received_payloads);
+        CHECK(expected_sizes[i] == stored->payload_size);
+        CHECK((i + 1) * 16 == stored->payload_len);
+    }
+
+    // Sender not telling the right size does not matter
+    fill_block(block, 5);
+    hdr = parse_block1(5, false, block, sizeof(block), 20);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED == hdr->coap_status);
+    CHECK(96 == hdr->payload_len);
+    for (uint8_t i = 0; i < 96; i++) {
+        CHECK(i == hdr->payload_ptr[i]);
+    }
+    free(hdr->payload_ptr);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+}
+
+TEST(libCoap_protocol_server, block_remove_truncates_reassembly_buffer)
+{
+    uint8_t block[16];
+    sn_coap_hdr_s *hdr;
+
+    retCounter = 100;
+    for (uint32_t i = 0; i < 2; i++) {
+        fill_block(block, i);
+        hdr = parse_block1(i, true, block, sizeof(block), 0);
+        sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    }
+
+    // Only the latest block can be removed
+    fill_block(block, 0);
+    sn_coap_protocol_block_remove(coap_handle, &addr, sizeof(block), block);
+    coap_blockwise_payload_s *stored = ns_list_get_first(&coap_handle->linked_list_blockwise_received_payloads);
+    CHECK(32 == stored->payload_len);
+
+    fill_block(block, 1);
+    sn_coap_protocol_block_remove(coap_handle, &addr, sizeof(block), block);
+    CHECK(16 == stored->payload_len);
+    fill_block(block, 0);
+    sn_coap_protocol_block_remove(coap_handle, &addr, sizeof(block), block);
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_blockwise_received_payloads));
+
+    // Buffer of the following blocks starts from the next block
+    fill_block(block, 2);
+    hdr = parse_block1(2, false, block, sizeof(block), 0);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED == hdr->coap_status);
+    CHECK(16 == hdr->payload_len);
+    CHECK(32 == hdr->payload_ptr[0]);
+    free(hdr->payload_ptr);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+}
+
+TEST(libCoap_protocol_server, block1_transfers_separated_by_token)
+{
+    uint8_t block[16];
+    sn_coap_hdr_s *hdr;
+
+    // Two transfers from the same peer are interleaved
+    retCounter = 100;
+    for (uint32_t i = 0; i < 3; i++) {
+        fill_block(block, i);
+        hdr = parse_block1_token(1, i, true, block, sizeof(block), 0);
+        CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING == hdr->coap_status);
+        sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+
+        fill_block(block, i + 10);
+        hdr = parse_block1_token(2, i, true, block, sizeof(block), 0);
+        sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    }
+    CHECK(2 == ns_list_count(&coap_handle->linked_list_blockwise_received_payloads));
+    CHECK(1 == coap_handle->peer_table.peer_count);
+
+    fill_block(block, 3);
+    hdr = parse_block1_token(1, 3, false, block, sizeof(block), 0);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED == hdr->coap_status);
+    CHECK(64 == hdr->payload_len);
+    for (uint8_t i = 0; i < 64; i++) {
+        CHECK(i == hdr->payload_ptr[i]);
+    }
+    free(hdr->payload_ptr);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(1 == ns_list_count(&coap_handle->linked_list_blockwise_received_payloads));
+
+    fill_block(block, 13);
+    hdr = parse_block1_token(2, 3, false, block, sizeof(block), 0);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED == hdr->coap_status);
+    CHECK(64 == hdr->payload_len);
+    for (uint8_t i = 0; i < 64; i++) {
+        CHECK(160 + i == hdr->payload_ptr[i]);
+    }
+    free(hdr->payload_ptr);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+
+    // Removed transfers are removed from index as well
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_blockwise_received_payloads));
+    for (uint32_t i = 0; i < SN_COAP_BLOCKWISE_HASH_SIZE; i++) {
+        CHECK(NULL == coap_handle->blockwise_received_hash[i]);
+    }
+}
+
+TEST(libCoap_protocol_server, block1_transfers_separated_by_request_tag)
+{
+    uint8_t block[16];
+    sn_coap_hdr_s *hdr;
+
+    // First transfer changes token on every block, second one uses the first token of the first transfer
+    retCounter = 100;
+    for (uint32_t i = 0; i < 3; i++) {
+        fill_block(block, i);
+        hdr = parse_block1_tagged(i + 1, 0xa, 0x100 + i, i, true, block, sizeof(block), 0);
+        CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING == hdr->coap_status);
+        sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+
+        fill_block(block, i + 10);
+        hdr = parse_block1_tagged(1, 0xb, 0x200 + i, i, true, block, sizeof(block), 0);
+        CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING == hdr->coap_status);
+        sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    }
+    CHECK(2 == ns_list_count(&coap_handle->linked_list_blockwise_received_payloads));
+
+    fill_block(block, 13);
+    hdr = parse_block1_tagged(1, 0xb, 0x203, 3, false, block, sizeof(block), 0);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED == hdr->coap_status);
+    CHECK(64 == hdr->payload_len);
+    for (uint8_t i = 0; i < 64; i++) {
+        CHECK(160 + i == hdr->payload_ptr[i]);
+    }
+    free(hdr->payload_ptr);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+
+    fill_block(block, 3);
+    hdr = parse_block1_tagged(4, 0xa, 0x103, 3, false, block, sizeof(block), 0);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED == hdr->coap_status);
+    CHECK(64 == hdr->payload_len);
+    for (uint8_t i = 0; i < 64; i++) {
+        CHECK(i == hdr->payload_ptr[i]);
+    }
+    free(hdr->payload_ptr);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_blockwise_received_payloads));
+}
+
+TEST(libCoap_protocol_server, block1_transfer_continued_with_new_token)
+{
+    uint8_t block[16];
+    sn_coap_hdr_s *hdr;
+
+    // Client changes token on every block of a transfer without Request-Tag
+    retCounter = 100;
+    for (uint32_t i = 0; i < 3; i++) {
+        fill_block(block, i);
+        hdr = parse_block1_token(i + 1, i, true, block, sizeof(block), 0);
+        CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING == hdr->coap_status);
+        sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+        CHECK(1 == ns_list_count(&coap_handle->linked_list_blockwise_received_payloads));
+    }
+
+    fill_block(block, 3);
+    hdr = parse_block1_token(4, 3, false, block, sizeof(block), 0);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED == hdr->coap_status);
+    CHECK(64 == hdr->payload_len);
+    for (uint8_t i = 0; i < 64; i++) {
+        CHECK(i == hdr->payload_ptr[i]);
+    }
+    free(hdr->payload_ptr);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_blockwise_received_payloads));
+    for (uint32_t i = 0; i < SN_COAP_BLOCKWISE_HASH_SIZE; i++) {
+        CHECK(NULL == coap_handle->blockwise_received_hash[i]);
+    }
+
+    // Block after a lost block is answered with 4.08 instead of delivering truncated payload
+    fill_block(block, 0);
+    hdr = parse_block1_token(5, 0, true, block, sizeof(block), 0);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    fill_block(block, 2);
+    sn_coap_builder_stub.builtMsgCode = COAP_MSG_CODE_EMPTY;
+    CHECK(NULL == parse_block1_token(6, 2, false, block, sizeof(block), 0));
+    CHECK(COAP_MSG_CODE_RESPONSE_REQUEST_ENTITY_INCOMPLETE == sn_coap_builder_stub.builtMsgCode);
+
+    // Same when token is kept
+    CHECK(NULL == parse_block1_token(5, 2, false, block, sizeof(block), 0));
+    CHECK(COAP_MSG_CODE_RESPONSE_REQUEST_ENTITY_INCOMPLETE == sn_coap_builder_stub.builtMsgCode);
+    coap_blockwise_payload_s *stored = ns_list_get_first(&coap_handle->linked_list_blockwise_received_payloads);
+    CHECK(16 == stored->payload_len);
+}
+
+TEST(libCoap_protocol_server, block2_served_by_token)
+{
+    uint8_t payload1[40];
+    uint8_t payload2[40];
+    sn_coap_hdr_s *hdr;
+
+    memset(payload1, 1, sizeof(payload1));
+    memset(payload2, 2, sizeof(payload2));
+
+    retCounter = 100;
+    build_block2_response(10, 1, payload1, sizeof(payload1));
+    build_block2_response(11, 2, payload2, sizeof(payload2));
+    CHECK(2 == ns_list_count(&coap_handle->linked_list_blockwise_sent_msgs));
+    CHECK(1 == coap_handle->peer_table.peer_count);
+
+    // Last block of the second response ends its transfer, first one stays
+    sn_coap_builder_stub.expectedUint16 = sizeof(packet);
+    tx_count = 0;
+    hdr = parse_block2_request(2, 20, 2);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_ACK == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(1 == tx_count);
+    CHECK(1 == ns_list_count(&coap_handle->linked_list_blockwise_sent_msgs));
+    coap_blockwise_msg_s *stored = ns_list_get_first(&coap_handle->linked_list_blockwise_sent_msgs);
+    CHECK(1 == stored->token_len);
+    CHECK(1 == stored->token[0]);
+
+    // Request of the next block with a new token is served from the remaining transfer of the peer
+    hdr = parse_block2_request(3, 21, 1);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_ACK == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(2 == tx_count);
+    CHECK(((1 << 4) | 0x08) == stored->coap_msg_ptr->options_list_ptr->block2);
+    sn_coap_builder_stub.expectedUint16 = 0;
+}
+
+TEST(libCoap_protocol_server, block2_requested_from_request_record)
+{
+    uint8_t request_packet[4] = {0x51, 0x01, 0x00, 0x1e};
+    uint8_t token = 5;
+    uint8_t block[16];
+    uint8_t uri_path[] = "3/0/1";
+    uint8_t uri_query[] = "a=1";
+    sn_coap_options_list_s options;
+    sn_coap_hdr_s request;
+    sn_coap_hdr_s *hdr;
+
+    memset(&request, 0, sizeof(sn_coap_hdr_s));
+    memset(&options, 0, sizeof(sn_coap_options_list_s));
+    request.msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    request.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    request.msg_id = 30;
+    request.token_ptr = &token;
+    request.token_len = 1;
+    request.uri_path_ptr = uri_path;
+    request.uri_path_len = 5;
+    options.block1 = COAP_OPTION_BLOCK_NONE;
+    options.block2 = COAP_OPTION_BLOCK_NONE;
+    options.uri_query_ptr = uri_query;
+    options.uri_query_len = 3;
+    request.options_list_ptr = &options;
+
+    // Only a record of the request is stored, header is not copied
+    retCounter = 100;
+    sn_coap_builder_stub.expectedInt16 = sizeof(request_packet);
+    sn_coap_protocol_build(coap_handle, &addr, request_packet, &request, NULL);
+    sn_coap_builder_stub.expectedInt16 = 0;
+    CHECK(1 == ns_list_count(&coap_handle->linked_list_blockwise_sent_msgs));
+    coap_blockwise_msg_s *stored = ns_list_get_first(&coap_handle->linked_list_blockwise_sent_msgs);
+    CHECK(NULL == stored->coap_msg_ptr);
+    CHECK(30 == stored->msg_id);
+    CHECK(COAP_MSG_CODE_REQUEST_GET == stored->msg_code);
+    CHECK(1 == stored->token_len);
+    CHECK(token == stored->token[0]);
+    CHECK(5 == stored->uri_path_len);
+    CHECK(3 == stored->uri_query_len);
+
+    // Next block is requested from the same record, and from the same resource
+    sn_coap_builder_stub.expectedUint16 = sizeof(packet);
+    sn_coap_builder_stub.builtUriPathLen = 0;
+    sn_coap_builder_stub.builtUriQueryLen = 0;
+    tx_count = 0;
+    fill_block(block, 0);
+    hdr = parse_block2_response(30, token, 0, true, block);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(1 == tx_count);
+    CHECK(5 == sn_coap_builder_stub.builtUriPathLen);
+    CHECK(0 == memcmp(uri_path, sn_coap_builder_stub.builtUriPath, 5));
+    CHECK(3 == sn_coap_builder_stub.builtUriQueryLen);
+    CHECK(0 == memcmp(uri_query, sn_coap_builder_stub.builtUriQuery, 3));
+    CHECK(1 == ns_list_count(&coap_handle->linked_list_blockwise_sent_msgs));
+    CHECK(stored == ns_list_get_first(&coap_handle->linked_list_blockwise_sent_msgs));
+    CHECK(30 != stored->msg_id);
+
+    // Last block ends the transfer and removes the record
+    fill_block(block, 1);
+    hdr = parse_block2_response(stored->msg_id, token, 1, false, block);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED == hdr->coap_status);
+    CHECK(32 == hdr->payload_len);
+    for (uint8_t i = 0; i < 32; i++) {
+        CHECK(i == hdr->payload_ptr[i]);
+    }
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_blockwise_sent_msgs));
+    free(hdr->payload_ptr);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    sn_coap_builder_stub.expectedUint16 = 0;
+}
+
+TEST(libCoap_protocol_server, block2_stateless_built_by_user)
+{
+    uint8_t response_packet[4];
+    uint8_t representation[40];
+    sn_coap_hdr_s response;
+    sn_coap_hdr_s *hdr;
+
+    for (uint8_t i = 0; i < sizeof(representation); i++) {
+        representation[i] = i;
+    }
+    memset(&response, 0, sizeof(sn_coap_hdr_s));
+    response.msg_type = COAP_MSG_TYPE_ACKNOWLEDGEMENT;
+    response.msg_code = COAP_MSG_CODE_RESPONSE_CONTENT;
+    response.msg_id = 10;
+    response.payload_ptr = representation;
+    response.payload_len = sizeof(representation);
+
+    retCounter = 100;
+    CHECK(0 == sn_coap_protocol_set_stateless_block2(coap_handle, true));
+    sn_coap_builder_stub.expectedInt16 = sizeof(response_packet);
+
+    // First block is sent, response is not stored
+    CHECK(0 == prepare_blockwise_message(coap_handle, &response));
+    CHECK(sizeof(response_packet) == sn_coap_protocol_build(coap_handle, &addr, response_packet, &response, NULL));
+    CHECK(0x08 == response.options_list_ptr->block2);
+    CHECK(sizeof(representation) == response.options_list_ptr->size2);
+    CHECK(16 == sn_coap_builder_stub.builtPayloadLen);
+    CHECK(0 == sn_coap_builder_stub.builtPayload[0]);
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_blockwise_sent_msgs));
+
+    // Request of a later block is returned to user
+    tx_count = 0;
+    hdr = parse_block2_request(1, 11, 2);
+    CHECK(COAP_STATUS_OK == hdr->coap_status);
+    CHECK(0 == tx_count);
+
+    // User builds the response again with Block2 option of the request, only the asked block is sent
+    response.msg_id = hdr->msg_id;
+    response.payload_len = sizeof(representation);
+    response.options_list_ptr->block2 = hdr->options_list_ptr->block2;
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(sizeof(response_packet) == sn_coap_protocol_build(coap_handle, &addr, response_packet, &response, NULL));
+    CHECK((2 << 4) == response.options_list_ptr->block2);
+    CHECK(8 == sn_coap_builder_stub.builtPayloadLen);
+    CHECK(32 == sn_coap_builder_stub.builtPayload[0]);
+    CHECK(representation == response.payload_ptr);
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_blockwise_sent_msgs));
+
+    // Larger asked block is sent in blocks of the configured size
+    response.payload_len = sizeof(representation);
+    response.options_list_ptr->block2 = (1 << 4) | 1;
+    CHECK(sizeof(response_packet) == sn_coap_protocol_build(coap_handle, &addr, response_packet, &response, NULL));
+    CHECK((2 << 4) == response.options_list_ptr->block2);
+    CHECK(32 == sn_coap_builder_stub.builtPayload[0]);
+
+    // Block past the end of representation is not built
+    response.payload_len = sizeof(representation);
+    response.options_list_ptr->block2 = 3 << 4;
+    CHECK(-2 == sn_coap_protocol_build(coap_handle, &addr, response_packet, &response, NULL));
+
+    free(response.options_list_ptr);
+    sn_coap_builder_stub.expectedInt16 = 0;
+}
+
+TEST(libCoap_protocol_server, q_block1_received_out_of_order)
+{
+    uint8_t block[16];
+    sn_coap_hdr_s *hdr;
+    const uint32_t order[] = {1, 0, 3, 2, 4, 5, 7};
+
+    retCounter = 100;
+    sn_coap_builder_stub.expectedUint16 = sizeof(packet);
+    tx_count = 0;
+
+    // Block 2 is missing when the first set ends, block 6 when the last block arrives
+    for (uint32_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        fill_block(block, order[i]);
+        hdr = parse_q_block1(order[i], order[i] != 7, block);
+        CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING == hdr->coap_status);
+        sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+
+        if (order[i] == 3) {
+            CHECK(1 == tx_count);
+            CHECK(COAP_MSG_CODE_RESPONSE_REQUEST_ENTITY_INCOMPLETE == sn_coap_builder_stub.builtMsgCode);
+            CHECK(1 == sn_coap_builder_stub.builtPayloadLen);
+            CHECK(2 == sn_coap_builder_stub.builtPayload[0]);
+        } else if (order[i] == 2) {
+            // Set is acknowledged when the missing block arrives
+            CHECK(2 == tx_count);
+            CHECK(COAP_MSG_CODE_RESPONSE_CONTINUE == sn_coap_builder_stub.builtMsgCode);
+            CHECK(((3 << 4) | 0x08) == sn_coap_builder_stub.builtBlock1);
+        }
+    }
+    CHECK(3 == tx_count);
+    CHECK(COAP_MSG_CODE_RESPONSE_REQUEST_ENTITY_INCOMPLETE == sn_coap_builder_stub.builtMsgCode);
+    CHECK(1 == sn_coap_builder_stub.builtPayloadLen);
+    CHECK(6 == sn_coap_builder_stub.builtPayload[0]);
+
+    fill_block(block, 6);
+    hdr = parse_q_block1(6, true, block);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVED == hdr->coap_status);
+    CHECK(128 == hdr->payload_len);
+    for (uint8_t i = 0; i < 128; i++) {
+        CHECK(i == hdr->payload_ptr[i]);
+    }
+    free(hdr->payload_ptr);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(3 == tx_count);
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_blockwise_received_payloads));
+    sn_coap_builder_stub.expectedUint16 = 0;
+}
+
+TEST(libCoap_protocol_server, q_block1_sent_in_sets)
+{
+    uint8_t request_packet[4];
+    uint8_t payload[100];
+    uint8_t token = 1;
+    uint8_t missing[] = {2, 5};
+    sn_coap_hdr_s request;
+    sn_coap_options_list_s *options = (sn_coap_options_list_s *)malloc(sizeof(sn_coap_options_list_s));
+    sn_coap_hdr_s *hdr;
+
+    memset(payload, 7, sizeof(payload));
+    memset(&request, 0, sizeof(sn_coap_hdr_s));
+    memset(options, 0, sizeof(sn_coap_options_list_s));
+    options->block1 = COAP_OPTION_BLOCK_NONE;
+    options->block2 = COAP_OPTION_BLOCK_NONE;
+    options->use_q_block1 = true;
+    request.msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    request.msg_code = COAP_MSG_CODE_REQUEST_PUT;
+    request.token_ptr = &token;
+    request.token_len = 1;
+    request.payload_ptr = payload;
+    request.payload_len = sizeof(payload);
+    request.options_list_ptr = options;
+
+    retCounter = 100;
+    sn_coap_builder_stub.expectedInt16 = sizeof(request_packet);
+    sn_coap_builder_stub.expectedUint16 = sizeof(packet);
+    tx_count = 0;
+
+    // Rest of the first set is sent right away
+    CHECK(0 == prepare_blockwise_message(coap_handle, &request));
+    CHECK(sizeof(request_packet) == sn_coap_protocol_build(coap_handle, &addr, request_packet, &request, NULL));
+    CHECK(3 == tx_count);
+    CHECK(((3 << 4) | 0x08) == sn_coap_builder_stub.builtBlock1);
+
+    // 2.31 acknowledges the first set, last block of the second set is short
+    hdr = parse_q_block1_response(0x200, COAP_MSG_CODE_RESPONSE_CONTINUE, (3 << 4) | 0x08, NULL, 0);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_ACK == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(6 == tx_count);
+    CHECK((6 << 4) == sn_coap_builder_stub.builtBlock1);
+    CHECK(4 == sn_coap_builder_stub.builtPayloadLen);
+
+    // Only blocks listed in 4.08 are sent again
+    hdr = parse_q_block1_response(0x201, COAP_MSG_CODE_RESPONSE_REQUEST_ENTITY_INCOMPLETE, COAP_OPTION_BLOCK_NONE, missing, sizeof(missing));
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_ACK == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(8 == tx_count);
+    CHECK(((5 << 4) | 0x08) == sn_coap_builder_stub.builtBlock1);
+
+    // Final response ends the transfer
+    hdr = parse_q_block1_response(0x202, COAP_MSG_CODE_RESPONSE_CHANGED, COAP_OPTION_BLOCK_NONE, NULL, 0);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(8 == tx_count);
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_blockwise_sent_msgs));
+
+    free(options);
+    sn_coap_builder_stub.expectedInt16 = 0;
+    sn_coap_builder_stub.expectedUint16 = 0;
+}
+
+TEST(libCoap_protocol_server, block_size_tuned_per_peer)
+{
+    uint8_t request_packet[4];
+    uint8_t payload[160];
+    uint8_t token = 1;
+    sn_coap_hdr_s request;
+    sn_coap_hdr_s *hdr;
+
+    memset(payload, 7, sizeof(payload));
+    memset(&request, 0, sizeof(sn_coap_hdr_s));
+    request.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    request.msg_code = COAP_MSG_CODE_REQUEST_PUT;
+    request.token_ptr = &token;
+    request.token_len = 1;
+    request.payload_ptr = payload;
+    request.payload_len = sizeof(payload);
+
+    retCounter = 100;
+    CHECK(0 == sn_coap_protocol_set_block_size(coap_handle, 256));
+    CHECK(0 == sn_coap_protocol_set_retransmission_parameters(coap_handle, 3, 1));
+    sn_coap_builder_stub.expectedInt16 = sizeof(request_packet);
+    sn_coap_builder_stub.expectedUint16 = sizeof(packet);
+    tx_count = 0;
+
+    // 64 byte blocks fit in path MTU with headers
+    CHECK(0 == sn_coap_protocol_set_path_mtu(coap_handle, 200));
+    CHECK(0 == prepare_blockwise_message(coap_handle, &request));
+    CHECK(sizeof(request_packet) == sn_coap_protocol_build(coap_handle, &addr, request_packet, &request, NULL));
+    CHECK((0x08 | 2) == sn_coap_builder_stub.builtBlock1);
+    CHECK(64 == sn_coap_builder_stub.builtPayloadLen);
+
+    // Three of four transmissions lost halves block size, transfer continues after the acknowledged 64 bytes
+    sn_coap_protocol_exec(coap_handle, 2);
+    sn_coap_protocol_exec(coap_handle, 4);
+    sn_coap_protocol_exec(coap_handle, 8);
+    CHECK(3 == tx_count);
+    hdr = parse_block1_response(request.msg_id, 1, 0x08 | 2);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_ACK == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(4 == tx_count);
+    CHECK(((2 << 4) | 0x08 | 1) == sn_coap_builder_stub.builtBlock1);
+    CHECK(32 == sn_coap_builder_stub.builtPayloadLen);
+
+    // Blocks acknowledged without retransmissions double block size of the next transfer
+    hdr = parse_block1_response(0x300, 1, (2 << 4) | 0x08 | 1);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    hdr = parse_block1_response(0x301, 1, (3 << 4) | 0x08 | 1);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(6 == tx_count);
+    CHECK(((4 << 4) | 1) == sn_coap_builder_stub.builtBlock1);
+    hdr = parse_block1_response(0x302, 1, (4 << 4) | 1);
+    CHECK(COAP_STATUS_OK == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+
+    token = 2;
+    request.msg_id = 0;
+    request.payload_len = sizeof(payload);
+    CHECK(0 == prepare_blockwise_message(coap_handle, &request));
+    CHECK(sizeof(request_packet) == sn_coap_protocol_build(coap_handle, &addr, request_packet, &request, NULL));
+    CHECK((0x08 | 2) == sn_coap_builder_stub.builtBlock1);
+
+    // Peer asking for smaller blocks limits block size of the peer
+    hdr = parse_block1_response(request.msg_id, 2, 0x08);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_ACK == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(((4 << 4) | 0x08) == sn_coap_builder_stub.builtBlock1);
+    CHECK(16 == sn_coap_builder_stub.builtPayloadLen);
+    sn_coap_peer_s *peer = sn_coap_peer_table_get_peer(&coap_handle->peer_table, sn_coap_peer_table_find(&coap_handle->peer_table, &addr));
+    CHECK(16 == peer->block_size);
+    CHECK(16 == peer->block_size_max);
+
+    free(request.options_list_ptr);
+    sn_coap_builder_stub.expectedInt16 = 0;
+    sn_coap_builder_stub.expectedUint16 = 0;
+}
+
+TEST(libCoap_protocol_server, block_size_restored_when_smaller_blocks_lost)
+{
+    uint8_t request_packet[4];
+    uint8_t payload[640];
+    uint8_t token = 1;
+    sn_coap_hdr_s request;
+    sn_coap_hdr_s *hdr;
+
+    memset(payload, 7, sizeof(payload));
+    memset(&request, 0, sizeof(sn_coap_hdr_s));
+    request.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    request.msg_code = COAP_MSG_CODE_REQUEST_PUT;
+    request.token_ptr = &token;
+    request.token_len = 1;
+    request.payload_ptr = payload;
+    request.payload_len = sizeof(payload);
+
+    retCounter = 100;
+    CHECK(0 == sn_coap_protocol_set_block_size(coap_handle, 256));
+    CHECK(0 == sn_coap_protocol_set_retransmission_parameters(coap_handle, 3, 1));
+    sn_coap_builder_stub.expectedInt16 = sizeof(request_packet);
+    sn_coap_builder_stub.expectedUint16 = sizeof(packet);
+    tx_count = 0;
+
+    CHECK(0 == sn_coap_protocol_set_path_mtu(coap_handle, 200));
+    CHECK(0 == prepare_blockwise_message(coap_handle, &request));
+    CHECK(sizeof(request_packet) == sn_coap_protocol_build(coap_handle, &addr, request_packet, &request, NULL));
+    CHECK((0x08 | 2) == sn_coap_builder_stub.builtBlock1);
+
+    // Two of four transmissions lost keeps block size
+    sn_coap_protocol_exec(coap_handle, 2);
+    sn_coap_protocol_exec(coap_handle, 4);
+    hdr = parse_block1_response(request.msg_id, 1, 0x08 | 2);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    hdr = parse_block1_response(request.msg_id + 1, 1, (1 << 4) | 0x08 | 2);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(4 == tx_count);
+    CHECK(((2 << 4) | 0x08 | 2) == sn_coap_builder_stub.builtBlock1);
+    sn_coap_peer_s *peer = sn_coap_peer_table_get_peer(&coap_handle->peer_table, sn_coap_peer_table_find(&coap_handle->peer_table, &addr));
+    CHECK(64 == peer->block_size);
+
+    // Three of four lost halves it
+    sn_coap_protocol_exec(coap_handle, 5);
+    sn_coap_protocol_exec(coap_handle, 7);
+    sn_coap_protocol_exec(coap_handle, 11);
+    CHECK(7 == tx_count);
+    hdr = parse_block1_response(request.msg_id + 2, 1, (2 << 4) | 0x08 | 2);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(8 == tx_count);
+    CHECK(((6 << 4) | 0x08 | 1) == sn_coap_builder_stub.builtBlock1);
+    CHECK(32 == peer->block_size);
+
+    // Smaller blocks are lost as often, larger size is restored
+    sn_coap_protocol_exec(coap_handle, 12);
+    sn_coap_protocol_exec(coap_handle, 14);
+    sn_coap_protocol_exec(coap_handle, 18);
+    CHECK(11 == tx_count);
+    hdr = parse_block1_response(request.msg_id + 3, 1, (6 << 4) | 0x08 | 1);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_ACK == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(12 == tx_count);
+    CHECK(64 == peer->block_size);
+
+    free(request.options_list_ptr);
+    sn_coap_builder_stub.expectedInt16 = 0;
+    sn_coap_builder_stub.expectedUint16 = 0;
+}
+
+TEST(libCoap_protocol_server, block1_blocks_resent_until_acknowledged)
+{
+    uint8_t request_packet[4];
+    uint8_t payload[256];
+    uint8_t token = 1;
+    sn_coap_hdr_s request;
+    sn_coap_hdr_s *hdr;
+
+    memset(payload, 7, sizeof(payload));
+    memset(&request, 0, sizeof(sn_coap_hdr_s));
+    request.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    request.msg_code = COAP_MSG_CODE_REQUEST_PUT;
+    request.token_ptr = &token;
+    request.token_len = 1;
+    request.payload_ptr = payload;
+    request.payload_len = sizeof(payload);
+
+    retCounter = 100;
+    CHECK(0 == sn_coap_protocol_set_block_size(coap_handle, 256));
+    CHECK(0 == sn_coap_protocol_set_retransmission_parameters(coap_handle, 3, 2));
+    sn_coap_builder_stub.expectedInt16 = sizeof(request_packet);
+    sn_coap_builder_stub.expectedUint16 = sizeof(packet);
+    tx_count = 0;
+
+    CHECK(0 == sn_coap_protocol_set_path_mtu(coap_handle, 200));
+    CHECK(0 == prepare_blockwise_message(coap_handle, &request));
+    CHECK(sizeof(request_packet) == sn_coap_protocol_build(coap_handle, &addr, request_packet, &request, NULL));
+    hdr = parse_block1_response(request.msg_id, 1, 0x08 | 2);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(1 == tx_count);
+    CHECK(((1 << 4) | 0x08 | 2) == sn_coap_builder_stub.builtBlock1);
+
+    // Second block is re-sent like the first one
+    sn_coap_protocol_exec(coap_handle, 2);
+    CHECK(2 == tx_count);
+    sn_coap_protocol_exec(coap_handle, 6);
+    CHECK(3 == tx_count);
+
+    hdr = parse_block1_response(request.msg_id + 1, 1, (1 << 4) | 0x08 | 2);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_ACK == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(4 == tx_count);
+    CHECK(sn_coap_builder_stub.builtBlock1 & 0x08);
+    int32_t block1 = sn_coap_builder_stub.builtBlock1;
+
+    // Transfer making progress is kept over the blockwise data lifetime
+    sn_coap_protocol_exec(coap_handle, 12);
+    CHECK(5 == tx_count);
+    CHECK(1 == ns_list_count(&coap_handle->linked_list_blockwise_sent_msgs));
+    hdr = parse_block1_response(request.msg_id + 2, 1, block1);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_ACK == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(6 == tx_count);
+    CHECK((sn_coap_builder_stub.builtBlock1 >> 4) > (block1 >> 4));
+
+    free(request.options_list_ptr);
+    sn_coap_builder_stub.expectedInt16 = 0;
+    sn_coap_builder_stub.expectedUint16 = 0;
+}
+
+TEST(libCoap_protocol_server, block1_acknowledgement_replayed)
+{
+    uint8_t block[16];
+    sn_coap_hdr_s *hdr;
+
+    retCounter = 100;
+    CHECK(0 == sn_coap_protocol_set_duplicate_response_cache_size(coap_handle, 256));
+    sn_coap_builder_stub.expectedInt16 = sizeof(packet);
+    sn_coap_builder_stub.expectedUint16 = sizeof(packet);
+    tx_count = 0;
+
+    fill_block(block, 0);
+    sn_coap_parser_stub.expectedHeader = alloc_block1(1, -1, 0x100, 0, true, block, sizeof(block), 0);
+    sn_coap_parser_stub.expectedHeader->msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    hdr = sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL);
+    CHECK(COAP_STATUS_PARSER_BLOCKWISE_MSG_RECEIVING == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(1 == tx_count);
+
+    // Block re-sent after its Acknowledgement was lost gets the same Acknowledgement
+    sn_coap_parser_stub.expectedHeader = alloc_block1(1, -1, 0x100, 0, true, block, sizeof(block), 0);
+    sn_coap_parser_stub.expectedHeader->msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    hdr = sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL);
+    CHECK(COAP_STATUS_PARSER_DUPLICATED_MSG == hdr->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr);
+    CHECK(2 == tx_count);
+
+    sn_coap_builder_stub.expectedInt16 = 0;
+    sn_coap_builder_stub.expectedUint16 = 0;
+}
+
+TEST(libCoap_protocol_server, observers_notified_from_one_encoding)
+{
+    uint8_t uri[] = "temp";
+    uint8_t token[2] = {0xa1, 0xa2};
+    uint8_t payload[] = "21";
+    sn_coap_options_list_s options;
+    sn_coap_hdr_s request;
+    sn_coap_hdr_s notification;
+
+    retCounter = 100;
+    memset(&options, 0, sizeof(options));
+    options.observe = COAP_OBSERVE_REGISTER;
+    memset(&request, 0, sizeof(request));
+    request.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    request.uri_path_ptr = uri;
+    request.uri_path_len = sizeof(uri) - 1;
+    request.token_ptr = &token[0];
+    request.token_len = 1;
+    request.options_list_ptr = &options;
+
+    CHECK(0 == sn_coap_protocol_observe_register(coap_handle, &addr, &request));
+    request.token_ptr = &token[1];
+    CHECK(0 == sn_coap_protocol_observe_register(coap_handle, &addr, &request));
+    // Registering again keeps the existing registration
+    CHECK(0 == sn_coap_protocol_observe_register(coap_handle, &addr, &request));
+    CHECK(2 == coap_handle->count_observers);
+    options.observe = COAP_OBSERVE_DEREGISTER;
+    CHECK(-1 == sn_coap_protocol_observe_register(coap_handle, &addr, &request));
+
+    memset(&notification, 0, sizeof(notification));
+    notification.msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+    notification.msg_code = COAP_MSG_CODE_RESPONSE_CONTENT;
+    notification.uri_path_ptr = uri;
+    notification.uri_path_len = sizeof(uri) - 1;
+    notification.payload_ptr = payload;
+    notification.payload_len = sizeof(payload) - 1;
+
+    // Notification is built once and sent with token and Message ID of each observer
+    sn_coap_builder_stub.expectedUint16 = 8;
+    sn_coap_builder_stub.expectedInt16 = 8;
+    tx_count = 0;
+    CHECK(2 == sn_coap_protocol_observe_notify(coap_handle, &notification, NULL));
+    CHECK(2 == tx_count);
+    CHECK(9 == tx_len);
+    CHECK(1 == (tx_packet[0] & 0x0f));
+    CHECK(token[1] == tx_packet[4]);
+    CHECK(0 == memcmp(sn_coap_builder_stub.builtPayload, payload, 2));
+    coap_observe_resource_s *resource = ns_list_get_first(&coap_handle->linked_list_observe_resources);
+    CHECK(1 == resource->observe_seq);
+    coap_observer_s *first = ns_list_get_first(&resource->observers);
+    coap_observer_s *second = ns_list_get_next(&resource->observers, first);
+    CHECK(first->msg_id != second->msg_id);
+    CHECK(second->msg_id == ((tx_packet[2] << 8) | tx_packet[3]));
+
+    // Other resources have no observers
+    notification.uri_path_len--;
+    CHECK(0 == sn_coap_protocol_observe_notify(coap_handle, &notification, NULL));
+    notification.uri_path_len++;
+
+    // Reset to the last notification cancels the observation
+    memset(parsed_hdr, 0, sizeof(sn_coap_hdr_s));
+    parsed_hdr->msg_type = COAP_MSG_TYPE_RESET;
+    parsed_hdr->msg_id = second->msg_id;
+    sn_coap_parser_stub.expectedHeader = parsed_hdr;
+    CHECK(parsed_hdr == sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL));
+    CHECK(1 == coap_handle->count_observers);
+
+    // Confirmable notifications are stored for resending
+    notification.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    CHECK(1 == sn_coap_protocol_observe_notify(coap_handle, &notification, NULL));
+    CHECK(2 == resource->observe_seq);
+    CHECK(1 == coap_handle->count_resent_msgs);
+    CHECK(token[0] == tx_packet[4]);
+
+    CHECK(-2 == sn_coap_protocol_observe_deregister(coap_handle, &addr, &token[1], 1));
+    CHECK(0 == sn_coap_protocol_observe_deregister(coap_handle, &addr, &token[0], 1));
+    CHECK(0 == coap_handle->count_observers);
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_observe_resources));
+
+    sn_coap_builder_stub.expectedInt16 = 0;
+    sn_coap_builder_stub.expectedUint16 = 0;
+}
+
+TEST(libCoap_protocol_server, notifications_rate_controlled)
+{
+    uint8_t uri[] = "temp";
+    uint8_t token = 0xa1;
+    uint8_t values[3] = {1, 2, 3};
+    sn_coap_options_list_s options;
+    sn_coap_hdr_s request;
+    sn_coap_hdr_s notification;
+
+    retCounter = 100;
+    memset(&options, 0, sizeof(options));
+    options.observe = COAP_OBSERVE_REGISTER;
+    memset(&request, 0, sizeof(request));
+    request.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    request.uri_path_ptr = uri;
+    request.uri_path_len = sizeof(uri) - 1;
+    request.token_ptr = &token;
+    request.token_len = 1;
+    request.options_list_ptr = &options;
+
+    CHECK(-2 == sn_coap_protocol_observe_set_rate(coap_handle, uri, sizeof(uri) - 1, 5, 20));
+    CHECK(0 == sn_coap_protocol_observe_register(coap_handle, &addr, &request));
+    CHECK(-1 == sn_coap_protocol_observe_set_rate(coap_handle, uri, sizeof(uri) - 1, 5, 4));
+    CHECK(0 == sn_coap_protocol_observe_set_rate(coap_handle, uri, sizeof(uri) - 1, 5, 20));
+
+    memset(&notification, 0, sizeof(notification));
+    notification.msg_code = COAP_MSG_CODE_RESPONSE_CONTENT;
+    notification.uri_path_ptr = uri;
+    notification.uri_path_len = sizeof(uri) - 1;
+    notification.payload_len = 1;
+
+    sn_coap_builder_stub.expectedUint16 = 6;
+    sn_coap_builder_stub.expectedInt16 = 6;
+    sn_coap_protocol_exec(coap_handle, 10);
+    tx_count = 0;
+
+    // First change is sent right away, later ones are coalesced until pmin has passed
+    for (uint8_t i = 0; i < sizeof(values); i++) {
+        notification.payload_ptr = &values[i];
+        CHECK(0 == sn_coap_protocol_observe_changed(coap_handle, &notification, NULL));
+    }
+    CHECK(1 == tx_count);
+    CHECK(values[0] == sn_coap_builder_stub.builtPayload[0]);
+    sn_coap_protocol_exec(coap_handle, 14);
+    CHECK(1 == tx_count);
+    sn_coap_protocol_exec(coap_handle, 15);
+    CHECK(2 == tx_count);
+    CHECK(values[2] == sn_coap_builder_stub.builtPayload[0]);
+    sn_coap_protocol_exec(coap_handle, 16);
+    CHECK(2 == tx_count);
+    CHECK(0 == coap_handle->count_resent_msgs);
+
+    // Latest value is sent again as Confirmable when pmax has passed
+    values[2] = 4;
+    sn_coap_protocol_exec(coap_handle, 35);
+    CHECK(3 == tx_count);
+    CHECK(values[2] != sn_coap_builder_stub.builtPayload[0]);
+    CHECK(1 == coap_handle->count_resent_msgs);
+    coap_observe_resource_s *resource = ns_list_get_first(&coap_handle->linked_list_observe_resources);
+    CHECK(3 == resource->observe_seq);
+
+    // Without observers changes are not stored
+    CHECK(0 == sn_coap_protocol_observe_deregister(coap_handle, &addr, &token, 1));
+    CHECK(0 == sn_coap_protocol_observe_changed(coap_handle, &notification, NULL));
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_observe_resources));
+
+    sn_coap_builder_stub.expectedInt16 = 0;
+    sn_coap_builder_stub.expectedUint16 = 0;
+}
+
+TEST(libCoap_protocol_server, responses_matched_to_requests_by_token)
+{
+    sn_coap_hdr_s request;
+    uint8_t token[4];
+    uint8_t other_addr_bytes[16];
+    sn_nsdl_addr_s other_addr = addr;
+
+    retCounter = 100;
+    tx_count = 0;
+    exchange_count = 0;
+    memset(&request, 0, sizeof(request));
+    request.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    request.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    sn_coap_builder_stub.expectedUint16 = 8;
+    sn_coap_builder_stub.expectedInt16 = 8;
+
+    CHECK(-1 == sn_coap_protocol_send_request(coap_handle, &addr, &request, NULL, NULL, NULL));
+    request.msg_code = COAP_MSG_CODE_RESPONSE_CONTENT;
+    CHECK(-1 == sn_coap_protocol_send_request(coap_handle, &addr, &request, exchange_cb, NULL, NULL));
+    request.msg_code = COAP_MSG_CODE_REQUEST_GET;
+
+    // Requests are pipelined to same peer, each with its own token
+    for (uintptr_t i = 1; i <= 4; i++) {
+        request.msg_id = 0;
+        CHECK(0 == sn_coap_protocol_send_request(coap_handle, &addr, &request, exchange_cb, (void *)i, NULL));
+    }
+    CHECK(4 == tx_count);
+    CHECK(NULL == request.token_ptr);
+    CHECK(-1 == sn_coap_protocol_send_request(coap_handle, &addr, &request, exchange_cb, NULL, NULL));
+    coap_exchange_s *first = ns_list_get_first(&coap_handle->linked_list_exchanges);
+    coap_exchange_s *second = ns_list_get_next(&coap_handle->linked_list_exchanges, first);
+    CHECK(first->token != second->token);
+    CHECK(first->msg_id != second->msg_id);
+
+    // Response to the second request
+    token[0] = second->token >> 24;
+    token[1] = second->token >> 16;
+    token[2] = second->token >> 8;
+    token[3] = second->token;
+    memset(parsed_hdr, 0, sizeof(sn_coap_hdr_s));
+    parsed_hdr->msg_type = COAP_MSG_TYPE_ACKNOWLEDGEMENT;
+    parsed_hdr->msg_code = COAP_MSG_CODE_RESPONSE_CONTENT;
+    parsed_hdr->msg_id = second->msg_id;
+    parsed_hdr->token_ptr = token;
+    parsed_hdr->token_len = sizeof(token);
+    sn_coap_parser_stub.expectedHeader = parsed_hdr;
+
+    // Response from another peer is not matched
+    memcpy(other_addr_bytes, addr_bytes, sizeof(other_addr_bytes));
+    other_addr_bytes[0]++;
+    other_addr.addr_ptr = other_addr_bytes;
+    CHECK(parsed_hdr == sn_coap_protocol_parse(coap_handle, &other_addr, sizeof(packet), packet, NULL));
+    CHECK(0 == exchange_count);
+
+    CHECK(parsed_hdr == sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL));
+    CHECK(1 == exchange_count);
+    CHECK(parsed_hdr == exchange_response);
+    CHECK(2 == exchange_ctx);
+    CHECK(3 == coap_handle->count_exchanges);
+
+    // Reset completes the request it was sent to
+    memset(parsed_hdr, 0, sizeof(sn_coap_hdr_s));
+    parsed_hdr->msg_type = COAP_MSG_TYPE_RESET;
+    parsed_hdr->msg_id = first->msg_id;
+    CHECK(parsed_hdr == sn_coap_protocol_parse(coap_handle, &addr, sizeof(packet), packet, NULL));
+    CHECK(2 == exchange_count);
+    CHECK(1 == exchange_ctx);
+
+    // Requests without response time out
+    sn_coap_protocol_exec(coap_handle, SN_COAP_CLIENT_EXCHANGE_TIMEOUT - 1);
+    CHECK(2 == exchange_count);
+    sn_coap_protocol_exec(coap_handle, SN_COAP_CLIENT_EXCHANGE_TIMEOUT);
+    CHECK(4 == exchange_count);
+    CHECK(NULL == exchange_response);
+    CHECK(4 == exchange_ctx);
+    CHECK(ns_list_is_empty(&coap_handle->linked_list_exchanges));
+
+    sn_coap_builder_stub.expectedInt16 = 0;
+    sn_coap_builder_stub.expectedUint16 = 0;
+}
+
+TEST(libCoap_protocol_server, messages_taken_from_ingress_queue)
+{
+    sn_nsdl_addr_s *src_addr;
+    void *param;
+    sn_coap_hdr_s *hdr[3];
+
+    retCounter = 100;
+    CHECK(-1 == sn_coap_protocol_ingress_submit(coap_handle, &addr, sizeof(packet), packet, NULL));
+    CHECK(-1 == sn_coap_protocol_set_ingress_queue_size(coap_handle, 3));
+    CHECK(-1 == sn_coap_protocol_set_ingress_queue_size(coap_handle, 8));
+    CHECK(0 == sn_coap_protocol_set_ingress_queue_size(coap_handle, 2));
+    CHECK(NULL == sn_coap_protocol_ingress_process(coap_handle, &src_addr, &param));
+
+    for (uint8_t i = 0; i < 3; i++) {
+        hdr[i] = (sn_coap_hdr_s *)malloc(sizeof(sn_coap_hdr_s));
+        memset(hdr[i], 0, sizeof(sn_coap_hdr_s));
+        hdr[i]->msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+        hdr[i]->msg_code = COAP_MSG_CODE_REQUEST_GET;
+        hdr[i]->msg_id = 0x100 + i;
+        sn_coap_parser_stub.expectedHeader = hdr[i];
+        addr.port = 1000 + i;
+        CHECK((i < 2 ? 0 : -1) == sn_coap_protocol_ingress_submit(coap_handle, &addr, sizeof(packet), packet, (void *)hdr[i]));
+    }
+
+    // Messages are handled in order, with the submitted source address
+    addr.port = 0;
+    CHECK(hdr[0] == sn_coap_protocol_ingress_process(coap_handle, &src_addr, &param));
+    CHECK(1000 == src_addr->port);
+    CHECK(0 == memcmp(src_addr->addr_ptr, addr_bytes, sizeof(addr_bytes)));
+    CHECK(hdr[0] == param);
+    CHECK(hdr[1] == sn_coap_protocol_ingress_process(coap_handle, &src_addr, &param));
+    CHECK(1001 == src_addr->port);
+    CHECK(NULL == sn_coap_protocol_ingress_process(coap_handle, &src_addr, &param));
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr[0]);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr[1]);
+
+    // Message left in queue is released with the queue
+    for (uint8_t i = 0; i < 2; i++) {
+        hdr[i] = (sn_coap_hdr_s *)malloc(sizeof(sn_coap_hdr_s));
+        memset(hdr[i], 0, sizeof(sn_coap_hdr_s));
+        hdr[i]->msg_type = COAP_MSG_TYPE_NON_CONFIRMABLE;
+        hdr[i]->msg_code = COAP_MSG_CODE_REQUEST_GET;
+        hdr[i]->msg_id = 0x200;
+        sn_coap_parser_stub.expectedHeader = hdr[i];
+        CHECK(0 == sn_coap_protocol_ingress_submit(coap_handle, &addr, sizeof(packet), packet, NULL));
+    }
+    CHECK(hdr[0] == sn_coap_protocol_ingress_process(coap_handle, &src_addr, &param));
+    CHECK(COAP_STATUS_OK == hdr[0]->coap_status);
+    sn_coap_parser_release_allocated_coap_msg_mem(coap_handle, hdr[0]);
+
+    CHECK(0 == sn_coap_protocol_set_ingress_queue_size(coap_handle, 0));
+    CHECK(-1 == sn_coap_protocol_ingress_submit(coap_handle, &addr, sizeof(packet), packet, NULL));
+    sn_coap_parser_stub.expectedHeader = NULL;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2015 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEST_CONFIG_H
+#define TEST_CONFIG_H
+
+/**
+ * \def SN_COAP_SERVER_PROFILE
+ * \brief Server profile is tested in this suite
+ */
+#define SN_COAP_SERVER_PROFILE  1
+
+/**
+ * \def SN_COAP_DUPLICATION_MAX_MSGS_COUNT
+ * \brief Duplication cache capacity at init
+ */
+#define SN_COAP_DUPLICATION_MAX_MSGS_COUNT  4
+
+/**
+ * \def SN_COAP_BLOCKWISE_REASSEMBLY
+ * \brief Received blocks are reassembled to one buffer
+ */
+#define SN_COAP_BLOCKWISE_REASSEMBLY  1
+
+/**
+ * \def SN_COAP_Q_BLOCK_MAX_PAYLOADS
+ * \brief Q-Block1 transfers are sent and received in sets of four blocks
+ */
+#define SN_COAP_Q_BLOCK_MAX_PAYLOADS  4
+
+/**
+ * \def SN_COAP_BLOCK_SIZE_TUNING
+ * \brief Block size of a peer is tuned from loss ratio over four transmissions
+ */
+#define SN_COAP_BLOCK_SIZE_TUNING  1
+#define SN_COAP_BLOCK_SIZE_TUNING_WINDOW  4
+
+/**
+ * \def SN_COAP_BLOCK_SIZE_INCREASE_INTERVAL
+ * \brief Block size of a peer is doubled after two blocks are acknowledged without retransmissions
+ */
+#define SN_COAP_BLOCK_SIZE_INCREASE_INTERVAL  2
+
+/**
+ * \def SN_COAP_OBSERVE_MAX_OBSERVERS
+ * \brief Up to four observers are registered
+ */
+#define SN_COAP_OBSERVE_MAX_OBSERVERS  4
+
+/**
+ * \def SN_COAP_CLIENT_MAX_EXCHANGES
+ * \brief Up to four requests are pending
+ */
+#define SN_COAP_CLIENT_MAX_EXCHANGES  4
+
+/**
+ * \def SN_COAP_INGRESS_QUEUE_MAX_SIZE
+ * \brief Ingress queue can hold up to four messages
+ */
+#define SN_COAP_INGRESS_QUEUE_MAX_SIZE  4
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CppUTest/TestHarness.h"
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sn_coap_shard.h"
+
+#include "sn_coap_builder_stub.h"
+
+static int retCounter = 0;
+static sn_coap_shards_s *shards = NULL;
+static uint8_t addr_bytes[16];
+static sn_nsdl_addr_s addr;
+
+static void *myMalloc(uint16_t size)
+{
+    if (retCounter > 0) {
+        retCounter--;
+        return malloc(size);
+    } else {
+        return NULL;
+    }
+}
+
+static void myFree(void *addr)
+{
+    if (addr) {
+        free(addr);
+    }
+}
+
+static uint8_t null_tx_cb(uint8_t *a, uint16_t b, sn_nsdl_addr_s *c, void *d)
+{
+    return 0;
+}
+
+static void set_addr(uint32_t n)
+{
+    addr_bytes[12] = n >> 24;
+    addr_bytes[13] = n >> 16;
+    addr_bytes[14] = n >> 8;
+    addr_bytes[15] = n;
+}
+
+TEST_GROUP(libCoap_shard)
+{
+    void setup() {
+        retCounter = 1000;
+        shards = sn_coap_shards_init(4, myMalloc, myFree, null_tx_cb, NULL);
+        memset(addr_bytes, 1, sizeof(addr_bytes));
+        memset(&addr, 0, sizeof(addr));
+        addr.addr_ptr = addr_bytes;
+        addr.addr_len = 16;
+        addr.port = 5683;
+        addr.type = SN_NSDL_ADDRESS_TYPE_IPV6;
+    }
+
+    void teardown() {
+        retCounter = 1000;
+        sn_coap_shards_destroy(shards);
+        shards = NULL;
+        retCounter = 0;
+    }
+};
+
+TEST(libCoap_shard, init_and_get)
+{
+    CHECK(NULL != shards);
+    CHECK(4 == sn_coap_shards_count(shards));
+    CHECK(0 == sn_coap_shards_count(NULL));
+    CHECK(NULL == sn_coap_shards_init(0, myMalloc, myFree, null_tx_cb, NULL));
+
+    // Failing handle init releases handles created before it
+    for (int i = 0; i < 3; i++) {
+        retCounter = i;
+        CHECK(NULL == sn_coap_shards_init(2, myMalloc, myFree, null_tx_cb, NULL));
+    }
+
+    for (uint16_t i = 0; i < 4; i++) {
+        CHECK(NULL != sn_coap_shards_get(shards, i));
+        CHECK(sn_coap_shards_get(shards, 0) != sn_coap_shards_get(shards, i) || i == 0);
+    }
+    CHECK(NULL == sn_coap_shards_get(shards, 4));
+    CHECK(NULL == sn_coap_shards_get(NULL, 0));
+}
+
+TEST(libCoap_shard, peers_routed_to_all_shards)
+{
+    uint16_t peers_of_shard[4] = {0};
+
+    for (uint32_t i = 0; i < 64; i++) {
+        set_addr(i);
+        uint16_t index = sn_coap_shards_index(shards, &addr);
+        CHECK(index < 4);
+        // Same peer always goes to same shard
+        CHECK(index == sn_coap_shards_index(shards, &addr));
+        CHECK(sn_coap_shards_get(shards, index) == sn_coap_shards_route(shards, &addr));
+        peers_of_shard[index]++;
+    }
+    for (uint16_t i = 0; i < 4; i++) {
+        CHECK(0 != peers_of_shard[i]);
+    }
+
+    CHECK(0 == sn_coap_shards_index(shards, NULL));
+    CHECK(0 == sn_coap_shards_index(NULL, &addr));
+}
+
+TEST(libCoap_shard, stats_summed_over_shards)
+{
+    sn_coap_stats_s stats;
+    sn_coap_hdr_s hdr;
+    uint8_t packet[8];
+
+    CHECK(-1 == sn_coap_shards_get_stats(NULL, &stats));
+    CHECK(-1 == sn_coap_shards_get_stats(shards, NULL));
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    hdr.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    sn_coap_builder_stub.expectedInt16 = sizeof(packet);
+    sn_coap_builder_stub.expectedUint16 = sizeof(packet);
+    CHECK(sizeof(packet) == sn_coap_protocol_build(sn_coap_shards_get(shards, 0), &addr, packet, &hdr, NULL));
+    CHECK(sizeof(packet) == sn_coap_protocol_build(sn_coap_shards_get(shards, 3), &addr, packet, &hdr, NULL));
+    sn_coap_builder_stub.expectedInt16 = 0;
+    sn_coap_builder_stub.expectedUint16 = 0;
+
+    CHECK(0 == sn_coap_shards_get_stats(shards, &stats));
+    CHECK(2 == stats.resent_msgs);
+    CHECK(2 * sizeof(packet) == stats.resent_bytes);
+    CHECK(0 == stats.duplication_msgs);
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CppUTest/TestHarness.h"
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sn_coap_udp.h"
+#include "sn_coap_shard.h"
+
+#define SHARD_COUNT 4
+#define PEER_COUNT 16
+
+static coap_s *server_handle = NULL;
+static coap_s *client_handle = NULL;
+static sn_coap_udp_s *server = NULL;
+static sn_coap_udp_s *client = NULL;
+static uint8_t loopback[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+static uint8_t loopback_v4[4] = {127, 0, 0, 1};
+static sn_coap_shards_s *shards = NULL;
+static sn_coap_udp_s *shard_udp[SHARD_COUNT];
+static coap_s *peer_handle[PEER_COUNT];
+static sn_coap_udp_s *peer_udp[PEER_COUNT];
+static int received_by[PEER_COUNT];
+static uint16_t msg_count;
+static uint8_t last_msg_code;
+static sn_coap_msg_type_e last_msg_type;
+
+static void *myMalloc(uint16_t size)
+{
+    return malloc(size);
+}
+
+static void myFree(void *addr)
+{
+    if (addr) {
+        free(addr);
+    }
+}
+
+static int8_t null_rx_cb(sn_coap_hdr_s *a, sn_nsdl_addr_s *b, void *c)
+{
+    return 0;
+}
+
+static void send_message(coap_s *handle, sn_coap_udp_s *udp, sn_nsdl_addr_s *dst, sn_coap_hdr_s *msg)
+{
+    uint16_t len = sn_coap_builder_calc_needed_packet_data_size(msg);
+    uint8_t *packet = (uint8_t *)malloc(len);
+    CHECK(len == sn_coap_protocol_build(handle, dst, packet, msg, udp));
+    CHECK(1 == sn_coap_udp_tx(packet, len, dst, udp));
+    free(packet);
+}
+
+static void msg_cb(sn_coap_udp_s *udp, sn_coap_hdr_s *msg, sn_nsdl_addr_s *src, void *ctx)
+{
+    coap_s *handle = (coap_s *)ctx;
+
+    msg_count++;
+    last_msg_code = msg->msg_code;
+    last_msg_type = msg->msg_type;
+
+    // Server answers requests with piggybacked response
+    if (msg->msg_code == COAP_MSG_CODE_REQUEST_GET) {
+        sn_coap_hdr_s *response = sn_coap_build_response(handle, msg, COAP_MSG_CODE_RESPONSE_CONTENT);
+        send_message(handle, udp, src, response);
+        sn_coap_parser_release_allocated_coap_msg_mem(handle, response);
+    }
+    sn_coap_parser_release_allocated_coap_msg_mem(handle, msg);
+}
+
+static void run_until(sn_coap_udp_s *udp, uint16_t count)
+{
+    for (int i = 0; i < 100 && msg_count < count; i++) {
+        CHECK(0 == sn_coap_udp_run(udp, 10));
+    }
+}
+
+// Records which shard received message of a peer
+static void shard_msg_cb(sn_coap_udp_s *udp, sn_coap_hdr_s *msg, sn_nsdl_addr_s *src, void *ctx)
+{
+    for (int i = 0; i < SHARD_COUNT; i++) {
+        for (int j = 0; j < PEER_COUNT; j++) {
+            if (udp == shard_udp[i] && src->port == sn_coap_udp_get_port(peer_udp[j])) {
+                received_by[j] = i;
+            }
+        }
+    }
+    msg_cb(udp, msg, src, ctx);
+}
+
+static void run_all_until(sn_coap_udp_s **udps, int udp_count, uint16_t count)
+{
+    for (int i = 0; i < 100 && msg_count < count; i++) {
+        for (int j = 0; j < udp_count; j++) {
+            CHECK(0 == sn_coap_udp_run(udps[j], 1));
+        }
+    }
+}
+
+// Address of peer as seen by the shards, every other peer uses IPv4
+static void peer_addr(int peer, sn_nsdl_addr_s *addr)
+{
+    memset(addr, 0, sizeof(sn_nsdl_addr_s));
+    if (peer % 2) {
+        addr->type = SN_NSDL_ADDRESS_TYPE_IPV4;
+        addr->addr_ptr = loopback_v4;
+        addr->addr_len = 4;
+    } else {
+        addr->type = SN_NSDL_ADDRESS_TYPE_IPV6;
+        addr->addr_ptr = loopback;
+        addr->addr_len = 16;
+    }
+    addr->port = sn_coap_udp_get_port(peer_udp[peer]);
+}
+
+TEST_GROUP(libCoap_udp)
+{
+    void setup() {
+        server_handle = sn_coap_protocol_init(myMalloc, myFree, sn_coap_udp_tx, null_rx_cb);
+        client_handle = sn_coap_protocol_init(myMalloc, myFree, sn_coap_udp_tx, null_rx_cb);
+        server = sn_coap_udp_init(server_handle, 0, true, msg_cb, server_handle);
+        client = sn_coap_udp_init(client_handle, 0, false, msg_cb, client_handle);
+        msg_count = 0;
+    }
+
+    void teardown() {
+        sn_coap_udp_destroy(server);
+        sn_coap_udp_destroy(client);
+        sn_coap_protocol_destroy(server_handle);
+        sn_coap_protocol_destroy(client_handle);
+    }
+};
+
+TEST(libCoap_udp, init)
+{
+    CHECK(NULL != server);
+    CHECK(0 != sn_coap_udp_get_port(server));
+    CHECK(0 <= sn_coap_udp_get_fd(server));
+    CHECK(server_handle == sn_coap_udp_get_context(server));
+    CHECK(NULL == sn_coap_udp_init(NULL, 0, false, msg_cb, NULL));
+    CHECK(NULL == sn_coap_udp_init(server_handle, 0, false, NULL, NULL));
+
+    // Nothing to receive
+    CHECK(0 == sn_coap_udp_run(server, 0));
+    CHECK(0 == msg_count);
+}
+
+TEST(libCoap_udp, request_and_response_over_loopback)
+{
+    sn_nsdl_addr_s dst;
+    sn_coap_hdr_s request;
+
+    memset(&dst, 0, sizeof(dst));
+    dst.type = SN_NSDL_ADDRESS_TYPE_IPV6;
+    dst.addr_ptr = loopback;
+    dst.addr_len = 16;
+    dst.port = sn_coap_udp_get_port(server);
+
+    memset(&request, 0, sizeof(request));
+    request.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    request.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    request.uri_path_ptr = (uint8_t *)"test";
+    request.uri_path_len = 4;
+
+    // Packets are sent in one batch when flushed
+    for (int i = 0; i < 3; i++) {
+        send_message(client_handle, client, &dst, &request);
+    }
+    CHECK(0 == sn_coap_udp_run(server, 0));
+    CHECK(0 == msg_count);
+    CHECK(0 == sn_coap_udp_flush(client));
+
+    run_until(server, 3);
+    CHECK(3 == msg_count);
+    CHECK(COAP_MSG_CODE_REQUEST_GET == last_msg_code);
+
+    run_until(client, 6);
+    CHECK(6 == msg_count);
+    CHECK(COAP_MSG_CODE_RESPONSE_CONTENT == last_msg_code);
+    CHECK(COAP_MSG_TYPE_ACKNOWLEDGEMENT == last_msg_type);
+
+    // Too long packets and unsupported addresses are not sent
+    uint8_t packet[8] = {0};
+    CHECK(0 == sn_coap_udp_tx(packet, 0xffff, &dst, client));
+    dst.type = SN_NSDL_ADDRESS_TYPE_HOSTNAME;
+    CHECK(0 == sn_coap_udp_tx(packet, sizeof(packet), &dst, client));
+    CHECK(0 == sn_coap_udp_tx(packet, sizeof(packet), &dst, NULL));
+}
+
+TEST_GROUP(libCoap_udp_shards)
+{
+    void setup() {
+        shards = sn_coap_shards_init(SHARD_COUNT, myMalloc, myFree, sn_coap_udp_tx, null_rx_cb);
+        for (int i = 0; i < SHARD_COUNT; i++) {
+            coap_s *handle = sn_coap_shards_get(shards, i);
+            sn_coap_protocol_set_retransmission_buffer(handle, 6, 512);
+            shard_udp[i] = sn_coap_udp_init(handle, i ? sn_coap_udp_get_port(shard_udp[0]) : 0, true, shard_msg_cb, handle);
+        }
+        for (int j = 0; j < PEER_COUNT; j++) {
+            peer_handle[j] = sn_coap_protocol_init(myMalloc, myFree, sn_coap_udp_tx, null_rx_cb);
+            peer_udp[j] = sn_coap_udp_init(peer_handle[j], 0, false, msg_cb, peer_handle[j]);
+            received_by[j] = -1;
+        }
+        msg_count = 0;
+    }
+
+    void teardown() {
+        for (int j = 0; j < PEER_COUNT; j++) {
+            sn_coap_udp_destroy(peer_udp[j]);
+            sn_coap_protocol_destroy(peer_handle[j]);
+        }
+        for (int i = 0; i < SHARD_COUNT; i++) {
+            sn_coap_udp_destroy(shard_udp[i]);
+        }
+        sn_coap_shards_destroy(shards);
+    }
+};
+
+TEST(libCoap_udp_shards, exchanges_stay_on_shard_of_peer)
+{
+    sn_nsdl_addr_s dst;
+    sn_nsdl_addr_s src;
+    sn_coap_hdr_s request;
+    sn_coap_stats_s stats;
+    bool shard_used[SHARD_COUNT] = {false};
+
+    for (int i = 0; i < SHARD_COUNT; i++) {
+        CHECK(NULL != shard_udp[i]);
+    }
+    CHECK(-1 == sn_coap_udp_steer_shards(NULL, SHARD_COUNT));
+    CHECK(-1 == sn_coap_udp_steer_shards(shard_udp[0], 0));
+    CHECK(0 == sn_coap_udp_steer_shards(shard_udp[0], SHARD_COUNT));
+
+    memset(&request, 0, sizeof(request));
+    request.msg_type = COAP_MSG_TYPE_CONFIRMABLE;
+    request.msg_code = COAP_MSG_CODE_REQUEST_GET;
+    request.uri_path_ptr = (uint8_t *)"test";
+    request.uri_path_len = 4;
+
+    // Requests of peers reach the shard selected by sn_coap_shards_index()
+    for (int j = 0; j < PEER_COUNT; j++) {
+        peer_addr(j, &dst);
+        dst.port = sn_coap_udp_get_port(shard_udp[0]);
+        send_message(peer_handle[j], peer_udp[j], &dst, &request);
+        CHECK(0 == sn_coap_udp_flush(peer_udp[j]));
+    }
+    run_all_until(shard_udp, SHARD_COUNT, PEER_COUNT);
+    CHECK(PEER_COUNT == msg_count);
+    for (int j = 0; j < PEER_COUNT; j++) {
+        peer_addr(j, &src);
+        CHECK(sn_coap_shards_index(shards, &src) == received_by[j]);
+        shard_used[received_by[j]] = true;
+        received_by[j] = -1;
+    }
+    CHECK(shard_used[0] + shard_used[1] + shard_used[2] + shard_used[3] > 1);
+    run_all_until(peer_udp, PEER_COUNT, 2 * PEER_COUNT);
+    CHECK(2 * PEER_COUNT == msg_count);
+
+    // Confirmable requests sent by the owning shard are acknowledged to the same shard
+    for (int j = 0; j < PEER_COUNT; j++) {
+        peer_addr(j, &dst);
+        uint16_t index = sn_coap_shards_index(shards, &dst);
+        CHECK(sn_coap_shards_get(shards, index) == sn_coap_shards_route(shards, &dst));
+        send_message(sn_coap_shards_get(shards, index), shard_udp[index], &dst, &request);
+        CHECK(0 == sn_coap_udp_flush(shard_udp[index]));
+    }
+    CHECK(0 == sn_coap_shards_get_stats(shards, &stats));
+    CHECK(0 < stats.resent_msgs);
+    run_all_until(peer_udp, PEER_COUNT, 3 * PEER_COUNT);
+    run_all_until(shard_udp, SHARD_COUNT, 4 * PEER_COUNT);
+    CHECK(4 * PEER_COUNT == msg_count);
+    for (int j = 0; j < PEER_COUNT; j++) {
+        peer_addr(j, &src);
+        CHECK(sn_coap_shards_index(shards, &src) == received_by[j]);
+    }
+    CHECK(0 == sn_coap_shards_get_stats(shards, &stats));
+    CHECK(0 == stats.resent_msgs);
+}
@@ -27,8 +27,10 @@
 /* * * * INCLUDE FILES * * * */
 /* * * * * * * * * * * * * * */
 
+#include <string.h>
 #include "ns_types.h"
 #include "sn_coap_header.h"
+#include "sn_coap_protocol_internal.h"
 #include "sn_coap_builder_stub.h"
 
 
@@ -41,6 +43,23 @@ sn_coap_hdr_s *sn_coap_build_response(struct coap_s *handle, sn_coap_hdr_s *coap
 
 int16_t sn_coap_builder_2(uint8_t *dst_packet_data_ptr, sn_coap_hdr_s *src_coap_msg_ptr, uint16_t blockwise_size)
 {
+    sn_coap_builder_stub.builtMsgCode = src_coap_msg_ptr->msg_code;
+    sn_coap_builder_stub.builtBlock1 = src_coap_msg_ptr->options_list_ptr ? src_coap_msg_ptr->options_list_ptr->block1 : COAP_OPTION_BLOCK_NONE;
+    sn_coap_builder_stub.builtPayloadLen = src_coap_msg_ptr->payload_len;
+    if (src_coap_msg_ptr->payload_ptr && src_coap_msg_ptr->payload_len <= sizeof(sn_coap_builder_stub.builtPayload)) {
+        memcpy(sn_coap_builder_stub.builtPayload, src_coap_msg_ptr->payload_ptr, src_coap_msg_ptr->payload_len);
+    }
+    sn_coap_builder_stub.builtUriPathLen = src_coap_msg_ptr->uri_path_ptr ? src_coap_msg_ptr->uri_path_len : 0;
+    if (src_coap_msg_ptr->uri_path_ptr && src_coap_msg_ptr->uri_path_len <= sizeof(sn_coap_builder_stub.builtUriPath)) {
+        memcpy(sn_coap_builder_stub.builtUriPath, src_coap_msg_ptr->uri_path_ptr, src_coap_msg_ptr->uri_path_len);
+    }
+    sn_coap_builder_stub.builtUriQueryLen = 0;
+    if (src_coap_msg_ptr->options_list_ptr && src_coap_msg_ptr->options_list_ptr->uri_query_ptr) {
+        sn_coap_builder_stub.builtUriQueryLen = src_coap_msg_ptr->options_list_ptr->uri_query_len;
+        if (src_coap_msg_ptr->options_list_ptr->uri_query_len <= sizeof(sn_coap_builder_stub.builtUriQuery)) {
+            memcpy(sn_coap_builder_stub.builtUriQuery, src_coap_msg_ptr->options_list_ptr->uri_query_ptr, src_coap_msg_ptr->options_list_ptr->uri_query_len);
+        }
+    }
     return sn_coap_builder_stub.expectedInt16;
 }
 
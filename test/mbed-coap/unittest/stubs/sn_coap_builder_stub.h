@@ -20,6 +20,16 @@ typedef struct {
     int16_t expectedInt16;
     uint16_t expectedUint16;
     sn_coap_hdr_s *expectedHeader;
+
+    /* Last message given to sn_coap_builder_2() */
+    uint8_t builtMsgCode;
+    int32_t builtBlock1;
+    uint8_t builtPayload[16];
+    uint16_t builtPayloadLen;
+    uint8_t builtUriPath[16];
+    uint16_t builtUriPathLen;
+    uint8_t builtUriQuery[16];
+    uint16_t builtUriQueryLen;
 } sn_coap_builder_stub_def;
 
 extern sn_coap_builder_stub_def sn_coap_builder_stub;
@@ -63,21 +63,76 @@ int8_t sn_coap_protocol_set_block_size(struct coap_s *handle, uint16_t block_siz
     return sn_coap_protocol_stub.expectedInt8;
 }
 
+int8_t sn_coap_protocol_set_path_mtu(struct coap_s *handle, uint16_t path_mtu)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
 int8_t sn_coap_protocol_set_duplicate_buffer_size(struct coap_s *handle, uint8_t message_count)
 {
     return sn_coap_protocol_stub.expectedInt8;
 }
 
+int8_t sn_coap_protocol_set_duplicate_buffer_size_2(struct coap_s *handle, uint32_t message_count)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_set_duplicate_response_cache_size(struct coap_s *handle, uint32_t size_bytes)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_set_peer_table_size(struct coap_s *handle, uint32_t max_peers, uint32_t idle_timeout)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
 int8_t sn_coap_protocol_set_retransmission_parameters(struct coap_s *handle, uint8_t resending_count, uint8_t resending_intervall)
 {
     return sn_coap_protocol_stub.expectedInt8;
 }
 
+int8_t sn_coap_protocol_set_retransmission_parameters_2(struct coap_s *handle, uint8_t resending_count, uint16_t resending_intervall)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
 int8_t sn_coap_protocol_set_retransmission_buffer(struct coap_s *handle, uint8_t buffer_size_messages, uint16_t buffer_size_bytes)
 {
     return sn_coap_protocol_stub.expectedInt8;
 }
 
+int8_t sn_coap_protocol_set_retransmission_buffer_2(struct coap_s *handle, uint32_t buffer_size_messages, uint32_t buffer_size_bytes)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_set_send_failure_callback(struct coap_s *handle, void (*send_failure_cb)(struct coap_s *, const sn_coap_send_failure_s *, uint8_t))
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_set_block_sink_callback(struct coap_s *handle, int8_t (*block_sink_cb)(struct coap_s *, const sn_coap_block_s *, void *))
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_set_payload_provider(struct coap_s *handle, const uint8_t *(*payload_provider_cb)(struct coap_s *, const uint8_t *, uint32_t, uint16_t))
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_set_stateless_block2(struct coap_s *handle, bool enable)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_get_retransmission_buffer_usage(struct coap_s *handle, uint32_t *msg_count, uint32_t *byte_count)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
 void sn_coap_protocol_clear_retransmission_buffer(struct coap_s *handle)
 {
 }
@@ -112,4 +167,61 @@ void sn_coap_protocol_block_remove(struct coap_s *handle, sn_nsdl_addr_s *source
 {
 }
 
+int32_t sn_coap_protocol_observe_register(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, const sn_coap_hdr_s *request_ptr)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_observe_deregister(struct coap_s *handle, sn_nsdl_addr_s *addr_ptr, const uint8_t *token_ptr, uint8_t token_len)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int32_t sn_coap_protocol_observe_notify(struct coap_s *handle, const sn_coap_hdr_s *notification_ptr, void *param)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+
+
+int8_t sn_coap_protocol_observe_set_rate(struct coap_s *handle, const uint8_t *uri_path_ptr, uint16_t uri_path_len, uint32_t pmin, uint32_t pmax)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_observe_changed(struct coap_s *handle, const sn_coap_hdr_s *notification_ptr, void *param)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_send_request(struct coap_s *handle, sn_nsdl_addr_s *dst_addr_ptr, sn_coap_hdr_s *request_ptr,
+        void (*response_cb)(struct coap_s *, const sn_coap_hdr_s *, void *), void *ctx, void *param)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_set_ingress_queue_size(struct coap_s *handle, uint16_t queue_size)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_ingress_submit(struct coap_s *handle, sn_nsdl_addr_s *src_addr_ptr, uint16_t packet_data_len, uint8_t *packet_data_ptr, void *param)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
 
+sn_coap_hdr_s *sn_coap_protocol_ingress_process(struct coap_s *handle, sn_nsdl_addr_s **src_addr_ptr, void **param)
+{
+    return sn_coap_protocol_stub.expectedHeader;
+}
+
+int8_t sn_coap_protocol_get_stats(struct coap_s *handle, sn_coap_stats_s *stats_ptr)
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}
+
+int8_t sn_coap_protocol_set_tx_batch_callback(struct coap_s *handle,
+        void (*tx_batch_cb)(struct coap_s *, const sn_coap_tx_entry_s *, uint8_t))
+{
+    return sn_coap_protocol_stub.expectedInt8;
+}